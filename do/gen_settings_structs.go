@@ -575,6 +575,9 @@ var (
 		mkField("CustomScreenDPI", Int, 0,
 			"actual resolution of the main screen in DPI (if this value "+
 				"isn't positive, the system's UI setting is used)").setExpert().setVersion("2.5"),
+		mkField("RenderThreads", Int, 0,
+			"number of threads used for rendering pages in the background. "+
+				"0 means one thread per processor core (up to 8)").setExpert().setVersion("3.3"),
 		mkEmptyLine(),
 
 		mkField("RememberStatePerDocument", Bool, true,
@@ -19,6 +19,12 @@
 /* #define FZ_PLOTTERS_CMYK 1 */
 /* #define FZ_PLOTTERS_N 1 */
 
+/**
+	Choose whether to use SSE2/AVX2 resp. NEON versions of the most
+	common painters where the CPU supports them (decided at runtime).
+*/
+/* #define FZ_ENABLE_SIMD 1 */
+
 /**
 	Choose which document agents to include.
 	By default all are enabled. To avoid building unwanted
@@ -118,6 +124,10 @@
 #define FZ_PLOTTERS_N 1
 #endif /* FZ_PLOTTERS_N */
 
+#ifndef FZ_ENABLE_SIMD
+#define FZ_ENABLE_SIMD 1
+#endif /* FZ_ENABLE_SIMD */
+
 /* We need at least 1 plotter defined */
 #if FZ_PLOTTERS_G == 0 && FZ_PLOTTERS_RGB == 0 && FZ_PLOTTERS_CMYK == 0
 #undef FZ_PLOTTERS_N
@@ -95,10 +95,21 @@ typedef struct
 	void (*unlock)(void *user, int lock);
 } fz_locks_context;
 
+/**
+	Number of independently locked shards the glyph cache is split
+	into, so that threads rendering in parallel rarely wait for each
+	other when looking up glyphs.
+*/
+#ifndef FZ_GLYPH_CACHE_SHARDS
+#define FZ_GLYPH_CACHE_SHARDS 8
+#endif
+
 enum {
 	FZ_LOCK_ALLOC = 0,
 	FZ_LOCK_FREETYPE,
+	/* one lock per glyph cache shard: FZ_LOCK_GLYPHCACHE + shard */
 	FZ_LOCK_GLYPHCACHE,
+	FZ_LOCK_GLYPHCACHE_LAST = FZ_LOCK_GLYPHCACHE + FZ_GLYPH_CACHE_SHARDS - 1,
 	FZ_LOCK_MAX
 };
 
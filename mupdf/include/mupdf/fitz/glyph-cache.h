@@ -46,6 +46,33 @@ void fz_render_t3_glyph_direct(fz_context *ctx, fz_device *dev, fz_font *font, i
 */
 void fz_prepare_t3_glyph(fz_context *ctx, fz_font *font, int gid);
 
+/**
+	Set the maximum number of bytes used by cached glyphs (shared
+	by all contexts cloned from the same base context). Least
+	recently used glyphs are evicted once it is exceeded.
+
+	max: The budget in bytes, or 0 for the default (1 MB).
+*/
+void fz_set_glyph_cache_size(fz_context *ctx, size_t max);
+
+/**
+	Glyph cache usage, summed over all shards.
+*/
+typedef struct
+{
+	size_t size;
+	size_t max_size;
+	int count;
+	int64_t hits;
+	int64_t misses;
+	int64_t evictions;
+} fz_glyph_cache_stats;
+
+/**
+	Retrieve the usage counters of the glyph cache.
+*/
+void fz_get_glyph_cache_stats(fz_context *ctx, fz_glyph_cache_stats *stats);
+
 /**
 	Dump debug statistics for the glyph cache.
 */
@@ -74,6 +74,14 @@ pdf_document *pdf_open_document(fz_context *ctx, const char *filename);
 */
 pdf_document *pdf_open_document_with_stream(fz_context *ctx, fz_stream *file);
 
+/*
+	Same as pdf_open_document_with_stream, but if the file needs to
+	be repaired, the xref table previously saved with
+	pdf_save_repaired_xref is used instead of rescanning the file
+	(as long as it still matches the file). repaired_xref may be NULL.
+*/
+pdf_document *pdf_open_document_with_repaired_xref(fz_context *ctx, fz_stream *file, fz_buffer *repaired_xref);
+
 /*
 	Closes and frees an opened PDF document.
 
@@ -313,6 +321,7 @@ struct pdf_document
 	pdf_rev_page_map *rev_page_map;
 
 	int repair_attempted;
+	int repaired_xref_restored;
 
 	/* State indicating which file parsing method we are using */
 	int file_reading_linearly;
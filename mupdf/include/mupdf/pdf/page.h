@@ -153,6 +153,10 @@ struct pdf_page
 	fz_link *links;
 	pdf_annot *annots, **annot_tailp;
 	pdf_widget *widgets, **widget_tailp;
+
+	/* incremented whenever an annotation is added, removed or modified
+	 * or gets a new appearance (which might change its Rect) */
+	int annot_generation;
 };
 
 #endif
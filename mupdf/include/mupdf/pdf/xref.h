@@ -138,6 +138,28 @@ void pdf_xref_remove_unsaved_signature(fz_context *ctx, pdf_document *doc, pdf_o
 int pdf_xref_obj_is_unsaved_signature(pdf_document *doc, pdf_obj *obj);
 
 void pdf_repair_xref(fz_context *ctx, pdf_document *doc);
+
+/*
+	Serialize the xref table, trailer and page tree mapping of a
+	document that had to be repaired, so that the file doesn't have
+	to be rescanned the next time it's opened (see
+	pdf_open_document_with_repaired_xref). Returns NULL if the
+	document wasn't repaired or is encrypted.
+*/
+fz_buffer *pdf_save_repaired_xref(fz_context *ctx, pdf_document *doc);
+
+/*
+	Restore an xref table saved with pdf_save_repaired_xref instead
+	of repairing the document. Returns 0 (after leaving the document
+	ready for pdf_repair_xref) if the saved data doesn't match the file.
+*/
+int pdf_load_repaired_xref(fz_context *ctx, pdf_document *doc, fz_buffer *saved);
+
+/*
+	Determine if the xref table was restored with
+	pdf_load_repaired_xref (instead of rescanning the file).
+*/
+int pdf_repaired_xref_was_restored(fz_context *ctx, pdf_document *doc);
 void pdf_repair_obj_stms(fz_context *ctx, pdf_document *doc);
 
 /*
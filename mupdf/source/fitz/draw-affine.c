@@ -3874,6 +3874,25 @@ fz_gridfit_matrix(int as_tiled, fz_matrix m)
 
 /* Draw an image with an affine transform on destination */
 
+/* The equivalent of the *_near_fb0 painters for fa == ONE, for all rows */
+static void
+paint_image_rows(byte * FZ_RESTRICT dp, int dstride, const byte * FZ_RESTRICT sp, int sw, int sh, int ss, int sn, int u, int v, int fc, int fd, int w, int h, fz_image_row_painter_t *rowfn)
+{
+	while (h--)
+	{
+		/* with fa == ONE, the source column is u >> PREC plus the destination column */
+		int ui = u >> PREC;
+		int vi = v >> PREC;
+		int x0 = ui < 0 ? -ui : 0;
+		int x1 = fz_mini(w, sw - ui);
+		if (vi >= 0 && vi < sh && x0 < x1)
+			rowfn(dp + x0 * 4, sp + vi * ss + (ui + x0) * sn, x1 - x0);
+		dp += dstride;
+		u += fc;
+		v += fd;
+	}
+}
+
 static void
 fz_paint_image_imp(fz_context *ctx,
 	fz_pixmap *dst,
@@ -4004,7 +4023,18 @@ fz_paint_image_imp(fz_context *ctx,
 		return;
 	}
 
-	/* TODO: if (fb == 0 && fa == 1) call fz_paint_span */
+	/* Unscaled and unrotated opaque images (such as scans that have
+	 * already been scaled to size) are simply copied row by row. */
+	if (fb == 0 && fa == ONE && !dolerp && alpha == 255 && !color && !hp && !gp && !sa &&
+		da && dn == 3 && (sn == 1 || sn == 3) && !fz_overprint_required(eop))
+	{
+		fz_image_row_painter_t *rowfn = fz_get_image_row_painter_simd(sn);
+		if (rowfn)
+		{
+			paint_image_rows(dp, dst->stride, sp, sw, sh, ss, sn, u, v, fc, fd, w, h, rowfn);
+			return;
+		}
+	}
 
 	/* Sometimes we can get an alpha only input to be
 	 * plotted. In this case treat it as a greyscale
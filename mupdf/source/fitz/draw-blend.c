@@ -1082,16 +1082,25 @@ fz_blend_pixmap(fz_context *ctx, fz_pixmap * FZ_RESTRICT dst, fz_pixmap * FZ_RES
 	{
 		unsigned char *sp2;
 		int nn;
+		fz_span_scaler_t *scalefn = fz_get_mul255_span_simd();
 		h = src->h;
 		sp2 = src->samples;
 		nn = src->w * src->n;
 		while (h--)
 		{
-			n = nn;
-			while (n--)
+			if (scalefn)
 			{
-				*sp2 = fz_mul255(*sp2, alpha);
-				sp2++;
+				scalefn(sp2, nn, alpha);
+				sp2 += nn;
+			}
+			else
+			{
+				n = nn;
+				while (n--)
+				{
+					*sp2 = fz_mul255(*sp2, alpha);
+					sp2++;
+				}
 			}
 			sp2 += src->stride - nn;
 		}
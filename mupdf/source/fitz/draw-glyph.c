@@ -7,9 +7,12 @@
 #include <math.h>
 
 #define MAX_GLYPH_SIZE 256
-#define MAX_CACHE_SIZE (1024*1024)
+#define DEFAULT_CACHE_SIZE (1024*1024)
 
-#define GLYPH_HASH_LEN 509
+/* Initial number of hash buckets per shard (must be a power of 2). Each
+ * shard doubles its table once it holds more than two entries per bucket
+ * so that large budgets don't degrade into long bucket chains. */
+#define INITIAL_HASH_LEN 64
 
 typedef struct
 {
@@ -32,19 +35,34 @@ typedef struct fz_glyph_cache_entry
 	fz_glyph *val;
 } fz_glyph_cache_entry;
 
-struct fz_glyph_cache
+/* The cache is split into FZ_GLYPH_CACHE_SHARDS shards (picked by key
+ * hash), each with its own lock, hash table, LRU list and an equal part
+ * of the budget, so that concurrent render threads sharing the cache
+ * mostly don't contend for the same lock. */
+typedef struct
 {
-	int refs;
+	fz_glyph_cache_entry **entry;
+	int hash_len;
+	int count;
 	size_t total;
-#ifndef NDEBUG
-	int num_evictions;
-	ptrdiff_t evicted;
-#endif
-	fz_glyph_cache_entry *entry[GLYPH_HASH_LEN];
+	size_t max;
+	int64_t hits;
+	int64_t misses;
+	int64_t evictions;
 	fz_glyph_cache_entry *lru_head;
 	fz_glyph_cache_entry *lru_tail;
+} fz_glyph_cache_shard;
+
+struct fz_glyph_cache
+{
+	/* protected by the lock of the first shard (FZ_LOCK_GLYPHCACHE) */
+	int refs;
+	size_t max;
+	fz_glyph_cache_shard shard[FZ_GLYPH_CACHE_SHARDS];
 };
 
+#define SHARD_LOCK(i) (FZ_LOCK_GLYPHCACHE + (i))
+
 static size_t
 fz_glyph_size(fz_context *ctx, fz_glyph *glyph)
 {
@@ -57,75 +75,182 @@ void
 fz_new_glyph_cache_context(fz_context *ctx)
 {
 	fz_glyph_cache *cache;
+	int i;
 
 	cache = fz_malloc_struct(ctx, fz_glyph_cache);
-	cache->total = 0;
 	cache->refs = 1;
-
+	cache->max = DEFAULT_CACHE_SIZE;
+	/* set before allocating the shards so that the cache is freed
+	 * together with the context if that fails */
 	ctx->glyph_cache = cache;
+
+	for (i = 0; i < FZ_GLYPH_CACHE_SHARDS; i++)
+	{
+		fz_glyph_cache_shard *shard = &cache->shard[i];
+		shard->entry = fz_malloc_array(ctx, INITIAL_HASH_LEN, fz_glyph_cache_entry *);
+		memset(shard->entry, 0, INITIAL_HASH_LEN * sizeof(fz_glyph_cache_entry *));
+		shard->hash_len = INITIAL_HASH_LEN;
+		shard->max = cache->max / FZ_GLYPH_CACHE_SHARDS;
+	}
 }
 
-static void
-drop_glyph_cache_entry(fz_context *ctx, fz_glyph_cache_entry *entry)
+static inline int
+bucket_index(fz_glyph_cache_shard *shard, unsigned hash)
 {
-	fz_glyph_cache *cache = ctx->glyph_cache;
+	return (hash / FZ_GLYPH_CACHE_SHARDS) & (shard->hash_len - 1);
+}
 
+static void
+drop_glyph_cache_entry(fz_context *ctx, fz_glyph_cache_shard *shard, fz_glyph_cache_entry *entry)
+{
 	if (entry->lru_next)
 		entry->lru_next->lru_prev = entry->lru_prev;
 	else
-		cache->lru_tail = entry->lru_prev;
+		shard->lru_tail = entry->lru_prev;
 	if (entry->lru_prev)
 		entry->lru_prev->lru_next = entry->lru_next;
 	else
-		cache->lru_head = entry->lru_next;
-	cache->total -= fz_glyph_size(ctx, entry->val);
+		shard->lru_head = entry->lru_next;
+	shard->total -= fz_glyph_size(ctx, entry->val);
+	shard->count--;
 	if (entry->bucket_next)
 		entry->bucket_next->bucket_prev = entry->bucket_prev;
 	if (entry->bucket_prev)
 		entry->bucket_prev->bucket_next = entry->bucket_next;
 	else
-		cache->entry[entry->hash] = entry->bucket_next;
+		shard->entry[bucket_index(shard, entry->hash)] = entry->bucket_next;
 	fz_drop_font(ctx, entry->key.font);
 	fz_drop_glyph(ctx, entry->val);
 	fz_free(ctx, entry);
 }
 
-/* The glyph cache lock is always held when this function is called. */
+/* The shard's lock is always held when this function is called. */
 static void
-do_purge(fz_context *ctx)
+evict_to_budget(fz_context *ctx, fz_glyph_cache_shard *shard, size_t max)
 {
-	fz_glyph_cache *cache = ctx->glyph_cache;
-	int i;
+	while (shard->total > max && shard->lru_tail)
+	{
+		shard->evictions++;
+		drop_glyph_cache_entry(ctx, shard, shard->lru_tail);
+	}
+}
+
+/* The shard's lock is always held when this function is called. */
+static void
+grow_hash_table(fz_context *ctx, fz_glyph_cache_shard *shard)
+{
+	fz_glyph_cache_entry **entry, *e;
+	int idx;
 
-	for (i = 0; i < GLYPH_HASH_LEN; i++)
+	/* A failure to grow only means longer bucket chains. */
+	entry = fz_malloc_no_throw(ctx, shard->hash_len * 2 * sizeof(fz_glyph_cache_entry *));
+	if (!entry)
+		return;
+	memset(entry, 0, shard->hash_len * 2 * sizeof(fz_glyph_cache_entry *));
+	fz_free(ctx, shard->entry);
+	shard->entry = entry;
+	shard->hash_len *= 2;
+
+	/* Every entry is on the LRU list, so rehash them from there. */
+	for (e = shard->lru_head; e; e = e->lru_next)
 	{
-		while (cache->entry[i])
-			drop_glyph_cache_entry(ctx, cache->entry[i]);
+		idx = bucket_index(shard, e->hash);
+		e->bucket_prev = NULL;
+		e->bucket_next = entry[idx];
+		if (e->bucket_next)
+			e->bucket_next->bucket_prev = e;
+		entry[idx] = e;
 	}
+}
+
+/* The shard's lock is always held when this function is called. */
+static void
+do_purge(fz_context *ctx, fz_glyph_cache_shard *shard)
+{
+	while (shard->lru_head)
+		drop_glyph_cache_entry(ctx, shard, shard->lru_head);
 
-	cache->total = 0;
+	shard->total = 0;
 }
 
 void
 fz_purge_glyph_cache(fz_context *ctx)
 {
-	fz_lock(ctx, FZ_LOCK_GLYPHCACHE);
-	do_purge(ctx);
-	fz_unlock(ctx, FZ_LOCK_GLYPHCACHE);
+	int i;
+
+	for (i = 0; i < FZ_GLYPH_CACHE_SHARDS; i++)
+	{
+		fz_lock(ctx, SHARD_LOCK(i));
+		do_purge(ctx, &ctx->glyph_cache->shard[i]);
+		fz_unlock(ctx, SHARD_LOCK(i));
+	}
+}
+
+void
+fz_set_glyph_cache_size(fz_context *ctx, size_t max)
+{
+	fz_glyph_cache *cache = ctx->glyph_cache;
+	int i;
+
+	if (max == 0)
+		max = DEFAULT_CACHE_SIZE;
+	for (i = 0; i < FZ_GLYPH_CACHE_SHARDS; i++)
+	{
+		fz_glyph_cache_shard *shard = &cache->shard[i];
+		fz_lock(ctx, SHARD_LOCK(i));
+		if (i == 0)
+			cache->max = max;
+		shard->max = max / FZ_GLYPH_CACHE_SHARDS;
+		evict_to_budget(ctx, shard, shard->max);
+		fz_unlock(ctx, SHARD_LOCK(i));
+	}
+}
+
+void
+fz_get_glyph_cache_stats(fz_context *ctx, fz_glyph_cache_stats *stats)
+{
+	fz_glyph_cache *cache = ctx->glyph_cache;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < FZ_GLYPH_CACHE_SHARDS; i++)
+	{
+		fz_glyph_cache_shard *shard = &cache->shard[i];
+		fz_lock(ctx, SHARD_LOCK(i));
+		if (i == 0)
+			stats->max_size = cache->max;
+		stats->size += shard->total;
+		stats->count += shard->count;
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		fz_unlock(ctx, SHARD_LOCK(i));
+	}
 }
 
 void
 fz_drop_glyph_cache_context(fz_context *ctx)
 {
+	fz_glyph_cache *cache;
+	int i;
+
 	if (!ctx || !ctx->glyph_cache)
 		return;
 
+	cache = ctx->glyph_cache;
 	fz_lock(ctx, FZ_LOCK_GLYPHCACHE);
-	ctx->glyph_cache->refs--;
-	if (ctx->glyph_cache->refs == 0)
+	cache->refs--;
+	if (cache->refs == 0)
 	{
-		do_purge(ctx);
-		fz_free(ctx, ctx->glyph_cache);
+		/* No other context can use the cache anymore, so the
+		 * remaining shards don't need to be locked. */
+		for (i = 0; i < FZ_GLYPH_CACHE_SHARDS; i++)
+		{
+			if (cache->shard[i].entry)
+				do_purge(ctx, &cache->shard[i]);
+			fz_free(ctx, cache->shard[i].entry);
+		}
+		fz_free(ctx, cache);
 		ctx->glyph_cache = NULL;
 	}
 	fz_unlock(ctx, FZ_LOCK_GLYPHCACHE);
@@ -215,7 +340,7 @@ static unsigned do_hash(unsigned char *s, int len)
 }
 
 static inline void
-move_to_front(fz_glyph_cache *cache, fz_glyph_cache_entry *entry)
+move_to_front(fz_glyph_cache_shard *cache, fz_glyph_cache_entry *entry)
 {
 	if (entry->lru_prev == NULL)
 		return; /* At front already */
@@ -237,13 +362,13 @@ move_to_front(fz_glyph_cache *cache, fz_glyph_cache_entry *entry)
 fz_glyph *
 fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colorspace *model, const fz_irect *scissor, int alpha, int aa)
 {
-	fz_glyph_cache *cache;
+	fz_glyph_cache_shard *cache;
 	fz_glyph_key key;
 	fz_matrix subpix_ctm;
 	fz_irect subpix_scissor;
 	float size;
 	fz_glyph *val;
-	int do_cache, locked, caching;
+	int do_cache, locked, caching, lock;
 	fz_glyph_cache_entry *entry;
 	unsigned hash;
 	int is_ft_font = !!fz_font_ft_face(ctx, font);
@@ -271,8 +396,6 @@ fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colo
 		do_cache = 0;
 	}
 
-	cache = ctx->glyph_cache;
-
 	key.font = font;
 	key.gid = gid;
 	key.a = subpix_ctm.a * 65536;
@@ -281,20 +404,24 @@ fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colo
 	key.d = subpix_ctm.d * 65536;
 	key.aa = aa;
 
-	hash = do_hash((unsigned char *)&key, sizeof(key)) % GLYPH_HASH_LEN;
-	fz_lock(ctx, FZ_LOCK_GLYPHCACHE);
-	entry = cache->entry[hash];
+	hash = do_hash((unsigned char *)&key, sizeof(key));
+	cache = &ctx->glyph_cache->shard[hash % FZ_GLYPH_CACHE_SHARDS];
+	lock = SHARD_LOCK(hash % FZ_GLYPH_CACHE_SHARDS);
+	fz_lock(ctx, lock);
+	entry = cache->entry[bucket_index(cache, hash)];
 	while (entry)
 	{
 		if (memcmp(&entry->key, &key, sizeof(key)) == 0)
 		{
 			move_to_front(cache, entry);
+			cache->hits++;
 			val = fz_keep_glyph(ctx, entry->val);
-			fz_unlock(ctx, FZ_LOCK_GLYPHCACHE);
+			fz_unlock(ctx, lock);
 			return val;
 		}
 		entry = entry->bucket_next;
 	}
+	cache->misses++;
 
 	locked = 1;
 	caching = 0;
@@ -317,10 +444,10 @@ fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colo
 			 * we insert ours to find one already there, we
 			 * abandon ours, and use the one there already.
 			 */
-			fz_unlock(ctx, FZ_LOCK_GLYPHCACHE);
+			fz_unlock(ctx, lock);
 			locked = 0;
 			val = fz_render_t3_glyph(ctx, font, gid, subpix_ctm, model, scissor, aa);
-			fz_lock(ctx, FZ_LOCK_GLYPHCACHE);
+			fz_lock(ctx, lock);
 			locked = 1;
 		}
 		else
@@ -338,7 +465,7 @@ fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colo
 				{
 					/* We had to unlock. Someone else might
 					 * have rendered in the meantime */
-					entry = cache->entry[hash];
+					entry = cache->entry[bucket_index(cache, hash)];
 					while (entry)
 					{
 						if (memcmp(&entry->key, &key, sizeof(key)) == 0)
@@ -355,10 +482,10 @@ fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colo
 				entry = fz_malloc_struct(ctx, fz_glyph_cache_entry);
 				entry->key = key;
 				entry->hash = hash;
-				entry->bucket_next = cache->entry[hash];
+				entry->bucket_next = cache->entry[bucket_index(cache, hash)];
 				if (entry->bucket_next)
 					entry->bucket_next->bucket_prev = entry;
-				cache->entry[hash] = entry;
+				cache->entry[bucket_index(cache, hash)] = entry;
 				entry->val = fz_keep_glyph(ctx, val);
 				fz_keep_font(ctx, key.font);
 
@@ -370,14 +497,10 @@ fz_render_glyph(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm, fz_colo
 				cache->lru_head = entry;
 
 				cache->total += fz_glyph_size(ctx, val);
-				while (cache->total > MAX_CACHE_SIZE)
-				{
-#ifndef NDEBUG
-					cache->num_evictions++;
-					cache->evicted += fz_glyph_size(ctx, cache->lru_tail->val);
-#endif
-					drop_glyph_cache_entry(ctx, cache->lru_tail);
-				}
+				cache->count++;
+				evict_to_budget(ctx, cache, cache->max);
+				if (cache->count > cache->hash_len * 2)
+					grow_hash_table(ctx, cache);
 			}
 		}
 unlock_and_return_val:
@@ -387,7 +510,7 @@ unlock_and_return_val:
 	fz_always(ctx)
 	{
 		if (locked)
-			fz_unlock(ctx, FZ_LOCK_GLYPHCACHE);
+			fz_unlock(ctx, lock);
 	}
 	fz_catch(ctx)
 	{
@@ -439,9 +562,13 @@ fz_render_glyph_pixmap(fz_context *ctx, fz_font *font, int gid, fz_matrix *ctm,
 void
 fz_dump_glyph_cache_stats(fz_context *ctx, fz_output *out)
 {
-	fz_glyph_cache *cache = ctx->glyph_cache;
-	fz_write_printf(ctx, out, "Glyph Cache Size: %zu\n", cache->total);
-#ifndef NDEBUG
-	fz_write_printf(ctx, out, "Glyph Cache Evictions: %d (%zu bytes)\n", cache->num_evictions, cache->evicted);
-#endif
+	fz_glyph_cache_stats stats;
+	int64_t lookups;
+
+	fz_get_glyph_cache_stats(ctx, &stats);
+	lookups = stats.hits + stats.misses;
+	fz_write_printf(ctx, out, "Glyph Cache Size: %zu of %zu (%d glyphs)\n", stats.size, stats.max_size, stats.count);
+	fz_write_printf(ctx, out, "Glyph Cache Hits: %ld of %ld lookups (%g%%)\n",
+		stats.hits, lookups, lookups ? 100.0 * stats.hits / lookups : 0.0);
+	fz_write_printf(ctx, out, "Glyph Cache Evictions: %ld\n", stats.evictions);
 }
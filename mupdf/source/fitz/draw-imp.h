@@ -435,6 +435,35 @@ fz_solid_color_painter_t *fz_get_solid_color_painter(int n, const unsigned char
 fz_span_painter_t *fz_get_span_painter(int da, int sa, int n, int alpha, const fz_overprint * FZ_RESTRICT eop);
 fz_span_color_painter_t *fz_get_span_color_painter(int n, int da, const unsigned char * FZ_RESTRICT color, const fz_overprint * FZ_RESTRICT eop);
 
+/*
+	Vectorized painters (see draw-simd.c). The getters return NULL if
+	there's no vectorized painter for the given pixel format (or the
+	CPU doesn't support it), in which case the portable painters
+	above have to be used. Both produce the exact same output.
+*/
+enum
+{
+	FZ_SIMD_NONE,
+	FZ_SIMD_SSE2,
+	FZ_SIMD_AVX2,
+	FZ_SIMD_NEON
+};
+
+int fz_simd_level(void);
+/* caps the instruction set used by the painters, e.g. FZ_SIMD_NONE for forcing the portable ones */
+void fz_set_simd_level(int level);
+
+/* copies opaque (sn == 1) gray resp. (sn == 3) RGB samples into an RGB pixmap with alpha */
+typedef void (fz_image_row_painter_t)(unsigned char * FZ_RESTRICT dp, const unsigned char * FZ_RESTRICT sp, int w);
+/* p[i] = fz_mul255(p[i], alpha) */
+typedef void (fz_span_scaler_t)(unsigned char * FZ_RESTRICT p, int len, int alpha);
+
+fz_solid_color_painter_t *fz_get_solid_color_painter_simd(int n, int da);
+fz_span_painter_t *fz_get_span_painter_simd(int da, int sa, int n, int alpha);
+fz_span_color_painter_t *fz_get_span_color_painter_simd(int n, int da);
+fz_image_row_painter_t *fz_get_image_row_painter_simd(int sn);
+fz_span_scaler_t *fz_get_mul255_span_simd(void);
+
 void fz_paint_image(fz_context *ctx, fz_pixmap * FZ_RESTRICT dst, const fz_irect * FZ_RESTRICT scissor, fz_pixmap * FZ_RESTRICT shape, fz_pixmap * FZ_RESTRICT group_alpha, fz_pixmap * FZ_RESTRICT img, fz_matrix ctm, int alpha, int lerp_allowed, int gridfit_as_tiled, const fz_overprint * FZ_RESTRICT eop);
 void fz_paint_image_with_color(fz_context *ctx, fz_pixmap * FZ_RESTRICT dst, const fz_irect * FZ_RESTRICT scissor, fz_pixmap * FZ_RESTRICT shape, fz_pixmap * FZ_RESTRICT group_alpha, fz_pixmap * FZ_RESTRICT img, fz_matrix ctm, const unsigned char * FZ_RESTRICT colorbv, int lerp_allowed, int gridfit_as_tiled, const fz_overprint * FZ_RESTRICT eop);
 
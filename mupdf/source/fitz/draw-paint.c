@@ -574,6 +574,10 @@ static void paint_solid_color_N_da_op(byte * FZ_RESTRICT dp, int n, int w, const
 fz_solid_color_painter_t *
 fz_get_solid_color_painter(int n, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
 {
+#if FZ_PLOTTERS_RGB
+	fz_solid_color_painter_t *simd;
+#endif /* FZ_PLOTTERS_RGB */
+
 #if FZ_ENABLE_SPOT_RENDERING
 	if (fz_overprint_required(eop))
 	{
@@ -601,7 +605,10 @@ fz_get_solid_color_painter(int n, const byte * FZ_RESTRICT color, int da, const
 #if FZ_PLOTTERS_RGB
 		case 3:
 			if (da)
-				return paint_solid_color_3_da;
+			{
+				simd = fz_get_solid_color_painter_simd(n, da);
+				return simd ? simd : paint_solid_color_3_da;
+			}
 			else if (color[3] == 255)
 				return paint_solid_color_3;
 			else
@@ -996,6 +1003,10 @@ paint_span_with_color_N_da_op(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp
 fz_span_color_painter_t *
 fz_get_span_color_painter(int n, int da, const byte * FZ_RESTRICT color, const fz_overprint * FZ_RESTRICT eop)
 {
+#if FZ_PLOTTERS_RGB
+	fz_span_color_painter_t *simd;
+#endif /* FZ_PLOTTERS_RGB */
+
 #if FZ_ENABLE_SPOT_RENDERING
 	if (fz_overprint_required(eop))
 	{
@@ -1007,7 +1018,11 @@ fz_get_span_color_painter(int n, int da, const byte * FZ_RESTRICT color, const f
 	case 0: return da ? paint_span_with_color_0_da : NULL;
 	case 1: return da ? paint_span_with_color_1_da : paint_span_with_color_1;
 #if FZ_PLOTTERS_RGB
-	case 3: return da ? paint_span_with_color_3_da : paint_span_with_color_3;
+	case 3:
+		if (!da)
+			return paint_span_with_color_3;
+		simd = fz_get_span_color_painter_simd(n, da);
+		return simd ? simd : paint_span_with_color_3_da;
 #endif/* FZ_PLOTTERS_RGB */
 #if FZ_PLOTTERS_CMYK
 	case 4: return da ? paint_span_with_color_4_da : paint_span_with_color_4;
@@ -1976,6 +1991,10 @@ paint_span_N_general_alpha_op(byte * FZ_RESTRICT dp, int da, const byte * FZ_RES
 fz_span_painter_t *
 fz_get_span_painter(int da, int sa, int n, int alpha, const fz_overprint * FZ_RESTRICT eop)
 {
+#if FZ_PLOTTERS_RGB
+	fz_span_painter_t *simd;
+#endif /* FZ_PLOTTERS_RGB */
+
 #if FZ_ENABLE_SPOT_RENDERING
 	if (fz_overprint_required(eop))
 	{
@@ -2036,6 +2055,9 @@ fz_get_span_painter(int da, int sa, int n, int alpha, const fz_overprint * FZ_RE
 		if (da)
 			if (sa)
 			{
+				simd = fz_get_span_painter_simd(da, sa, n, alpha);
+				if (simd)
+					return simd;
 				if (alpha == 255)
 					return paint_span_3_da_sa;
 				else if (alpha > 0)
@@ -0,0 +1,878 @@
+#include "mupdf/fitz.h"
+
+#include "draw-imp.h"
+
+#include <string.h>
+
+/*
+
+Vectorized versions of the painters that dominate rendering into
+(and compositing of) 8 bit RGB(A) pixmaps with alpha:
+
+	* solid color fills (fz_get_solid_color_painter)
+	* anti-aliased fills through a coverage mask (fz_get_span_color_painter)
+	* premultiplied "source over destination" (fz_get_span_painter)
+	* copying unscaled opaque gray and RGB images (fz_paint_image)
+	* scaling by a constant alpha (fz_blend_pixmap)
+
+Every painter here produces exactly the same bytes as the portable C
+painter it replaces, so the two can be mixed freely (e.g. the C painters
+are still used for the last few pixels of a span and for all the pixel
+formats that aren't vectorized). Most of the arithmetic is done on 16 bit
+lanes: blending c over d by an amount of ma (0...256) is computed as
+
+	(d * 256 + (c - d) * ma) >> 8
+
+which is exact even with wrapping 16 bit arithmetic, as the true value
+is a convex combination of c * 256 and d * 256 (and thus in 0...65280).
+
+Which instruction set is used is decided at runtime (SSE2 resp. AVX2 on
+x86/x64, NEON on ARM64). fz_set_simd_level allows capping it (e.g. for
+comparing the implementations in benchmarks).
+
+*/
+
+typedef unsigned char byte;
+
+#if FZ_ENABLE_SIMD && (defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__))
+#define SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#elif FZ_ENABLE_SIMD && (defined(__aarch64__) || defined(_M_ARM64))
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+static int simd_level_detected = -1;
+static int simd_level_max = FZ_SIMD_NEON;
+
+#ifdef SIMD_X86
+static void
+cpuid(int leaf, int regs[4])
+{
+#ifdef _MSC_VER
+	__cpuidex(regs, leaf, 0);
+#else
+	unsigned int r[4] = { 0 };
+	__cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]);
+	memcpy(regs, r, sizeof(r));
+#endif
+}
+
+static int
+os_saves_ymm_registers(void)
+{
+#ifdef _MSC_VER
+	return (_xgetbv(0) & 6) == 6;
+#else
+	unsigned int eax, edx;
+	__asm__ volatile ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+	return (eax & 6) == 6;
+#endif
+}
+#endif
+
+static int
+detect_simd_level(void)
+{
+#if defined(SIMD_X86)
+	int regs[4];
+	int level = FZ_SIMD_NONE;
+	cpuid(0, regs);
+	if (regs[0] < 1)
+		return FZ_SIMD_NONE;
+	cpuid(1, regs);
+	if (regs[3] & (1 << 26))
+		level = FZ_SIMD_SSE2;
+	/* AVX2 also requires the OS to preserve the upper halves of the ymm registers */
+	if (level && (regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && os_saves_ymm_registers())
+	{
+		cpuid(0, regs);
+		if (regs[0] >= 7)
+		{
+			cpuid(7, regs);
+			if (regs[1] & (1 << 5))
+				level = FZ_SIMD_AVX2;
+		}
+	}
+	return level;
+#elif defined(SIMD_NEON)
+	return FZ_SIMD_NEON;
+#else
+	return FZ_SIMD_NONE;
+#endif
+}
+
+int
+fz_simd_level(void)
+{
+	/* racing threads will all detect the same level */
+	if (simd_level_detected < 0)
+		simd_level_detected = detect_simd_level();
+	return fz_mini(simd_level_detected, simd_level_max);
+}
+
+void
+fz_set_simd_level(int level)
+{
+	simd_level_max = level;
+}
+
+#if defined(SIMD_X86) || defined(SIMD_NEON)
+
+/* The portable versions of the kernels, for the pixels left over at the end of a span */
+
+static inline void
+blend_pixel_4(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT color, int ma)
+{
+	dp[0] = FZ_BLEND(color[0], dp[0], ma);
+	dp[1] = FZ_BLEND(color[1], dp[1], ma);
+	dp[2] = FZ_BLEND(color[2], dp[2], ma);
+	dp[3] = FZ_BLEND(color[3], dp[3], ma);
+}
+
+static inline void
+solid_color_3_da_tail(byte * FZ_RESTRICT dp, int w, const byte * FZ_RESTRICT rgba, int sa)
+{
+	for (; w > 0; w--, dp += 4)
+	{
+		if (sa == 256)
+			memcpy(dp, rgba, 4);
+		else
+			blend_pixel_4(dp, rgba, sa);
+	}
+}
+
+static inline void
+span_with_color_3_da_tail(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int w, const byte * FZ_RESTRICT rgba, int sa)
+{
+	for (; w > 0; w--, dp += 4)
+	{
+		int ma = *mp++;
+		ma = FZ_EXPAND(ma);
+		if (sa != 256)
+			ma = FZ_COMBINE(ma, sa);
+		blend_pixel_4(dp, rgba, ma);
+	}
+}
+
+static inline void
+span_3_da_sa_tail(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	for (; w > 0; w--, dp += 4, sp += 4)
+	{
+		int t = FZ_EXPAND(sp[3]);
+		if (t == 0)
+			continue;
+		t = 256 - t;
+		dp[0] = sp[0] + FZ_COMBINE(dp[0], t);
+		dp[1] = sp[1] + FZ_COMBINE(dp[1], t);
+		dp[2] = sp[2] + FZ_COMBINE(dp[2], t);
+		dp[3] = sp[3] + FZ_COMBINE(dp[3], t);
+	}
+}
+
+static inline void
+span_3_da_sa_alpha_tail(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w, int alpha)
+{
+	for (; w > 0; w--, dp += 4, sp += 4)
+	{
+		int masa = FZ_COMBINE(sp[3], alpha);
+		int t = FZ_EXPAND(255 - masa);
+		dp[0] = FZ_COMBINE(sp[0], alpha) + FZ_COMBINE(dp[0], t);
+		dp[1] = FZ_COMBINE(sp[1], alpha) + FZ_COMBINE(dp[1], t);
+		dp[2] = FZ_COMBINE(sp[2], alpha) + FZ_COMBINE(dp[2], t);
+		dp[3] = masa + FZ_COMBINE(dp[3], t);
+	}
+}
+
+static inline void
+gray_to_rgba_tail(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	for (; w > 0; w--, dp += 4)
+	{
+		dp[0] = dp[1] = dp[2] = *sp++;
+		dp[3] = 255;
+	}
+}
+
+static inline void
+rgb_to_rgba_tail(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	for (; w > 0; w--, dp += 4, sp += 3)
+	{
+		dp[0] = sp[0];
+		dp[1] = sp[1];
+		dp[2] = sp[2];
+		dp[3] = 255;
+	}
+}
+
+static inline void
+mul255_tail(byte * FZ_RESTRICT p, int len, int alpha)
+{
+	for (; len > 0; len--, p++)
+		*p = fz_mul255(*p, alpha);
+}
+
+/* color with its alpha replaced by 255 (as blended by the non-premultiplied color painters) */
+static inline void
+opaque_rgba(byte rgba[4], const byte * FZ_RESTRICT color)
+{
+	rgba[0] = color[0];
+	rgba[1] = color[1];
+	rgba[2] = color[2];
+	rgba[3] = 255;
+}
+
+#endif /* SIMD_X86 || SIMD_NEON */
+
+#ifdef SIMD_X86
+
+static inline uint32_t
+load_u32(const byte *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+/* SSE2: 4 pixels at a time */
+
+TARGET_SSE2 static inline __m128i
+blend_epi16_sse2(__m128i c, __m128i d, __m128i ma)
+{
+	__m128i x = _mm_mullo_epi16(_mm_sub_epi16(c, d), ma);
+	return _mm_srli_epi16(_mm_add_epi16(_mm_slli_epi16(d, 8), x), 8);
+}
+
+TARGET_SSE2 static void
+paint_solid_color_3_da_sse2(byte * FZ_RESTRICT dp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int sa = FZ_EXPAND(color[3]);
+	byte rgba[4];
+	__m128i c;
+	if (sa == 0)
+		return;
+	opaque_rgba(rgba, color);
+	c = _mm_set1_epi32((int)load_u32(rgba));
+	if (sa == 256)
+	{
+		for (; w >= 4; w -= 4, dp += 16)
+			_mm_storeu_si128((__m128i *)dp, c);
+	}
+	else
+	{
+		__m128i zero = _mm_setzero_si128();
+		__m128i ma = _mm_set1_epi16((short)sa);
+		c = _mm_unpacklo_epi8(c, zero);
+		for (; w >= 4; w -= 4, dp += 16)
+		{
+			__m128i d = _mm_loadu_si128((const __m128i *)dp);
+			__m128i lo = blend_epi16_sse2(c, _mm_unpacklo_epi8(d, zero), ma);
+			__m128i hi = blend_epi16_sse2(c, _mm_unpackhi_epi8(d, zero), ma);
+			_mm_storeu_si128((__m128i *)dp, _mm_packus_epi16(lo, hi));
+		}
+	}
+	solid_color_3_da_tail(dp, w, rgba, sa);
+}
+
+TARGET_SSE2 static void
+paint_span_with_color_3_da_sse2(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int sa = FZ_EXPAND(color[3]);
+	byte rgba[4];
+	__m128i zero = _mm_setzero_si128();
+	__m128i c, c32, sa16;
+	if (sa == 0)
+		return;
+	opaque_rgba(rgba, color);
+	c32 = _mm_set1_epi32((int)load_u32(rgba));
+	c = _mm_unpacklo_epi8(c32, zero);
+	sa16 = _mm_set1_epi16((short)sa);
+	for (; w >= 4; w -= 4, dp += 16, mp += 4)
+	{
+		uint32_t m4 = load_u32(mp);
+		__m128i m, d, lo, hi;
+		/* fully transparent resp. opaque runs are common */
+		if (m4 == 0)
+			continue;
+		if (m4 == 0xFFFFFFFF && sa == 256)
+		{
+			_mm_storeu_si128((__m128i *)dp, c32);
+			continue;
+		}
+		m = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)m4), zero);
+		m = _mm_add_epi16(m, _mm_srli_epi16(m, 7));
+		if (sa != 256)
+			m = _mm_srli_epi16(_mm_mullo_epi16(m, sa16), 8);
+		/* replicate each pixel's coverage to its 4 components */
+		m = _mm_unpacklo_epi16(m, m);
+		d = _mm_loadu_si128((const __m128i *)dp);
+		lo = blend_epi16_sse2(c, _mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(m, m));
+		hi = blend_epi16_sse2(c, _mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(m, m));
+		_mm_storeu_si128((__m128i *)dp, _mm_packus_epi16(lo, hi));
+	}
+	span_with_color_3_da_tail(dp, mp, w, rgba, sa);
+}
+
+/* s + (d * t >> 8) with t = 256 - FZ_EXPAND(alpha of s), truncated to 8 bits */
+TARGET_SSE2 static inline __m128i
+over_epi16_sse2(__m128i s, __m128i d)
+{
+	__m128i t = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+	t = _mm_sub_epi16(_mm_set1_epi16(256), _mm_add_epi16(t, _mm_srli_epi16(t, 7)));
+	d = _mm_srli_epi16(_mm_mullo_epi16(d, t), 8);
+	return _mm_and_si128(_mm_add_epi16(s, d), _mm_set1_epi16(0xFF));
+}
+
+TARGET_SSE2 static void
+paint_span_3_da_sa_sse2(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	__m128i zero = _mm_setzero_si128();
+	for (; w >= 4; w -= 4, dp += 16, sp += 16)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)sp);
+		__m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(s, 24), zero);
+		__m128i d, lo, hi, r;
+		int mask = _mm_movemask_epi8(transparent);
+		if (mask == 0xFFFF)
+			continue;
+		d = _mm_loadu_si128((const __m128i *)dp);
+		lo = over_epi16_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+		hi = over_epi16_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+		r = _mm_packus_epi16(lo, hi);
+		/* fully transparent source pixels leave the destination untouched */
+		r = _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, r));
+		_mm_storeu_si128((__m128i *)dp, r);
+	}
+	span_3_da_sa_tail(dp, sp, w);
+}
+
+TARGET_SSE2 static inline __m128i
+over_alpha_epi16_sse2(__m128i s, __m128i d, __m128i alpha)
+{
+	__m128i t;
+	s = _mm_srli_epi16(_mm_mullo_epi16(s, alpha), 8);
+	t = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+	t = _mm_sub_epi16(_mm_set1_epi16(255), t);
+	t = _mm_add_epi16(t, _mm_srli_epi16(t, 7));
+	d = _mm_srli_epi16(_mm_mullo_epi16(d, t), 8);
+	return _mm_and_si128(_mm_add_epi16(s, d), _mm_set1_epi16(0xFF));
+}
+
+TARGET_SSE2 static void
+paint_span_3_da_sa_alpha_sse2(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha16;
+	alpha = FZ_EXPAND(alpha);
+	alpha16 = _mm_set1_epi16((short)alpha);
+	for (; w >= 4; w -= 4, dp += 16, sp += 16)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)sp);
+		__m128i d = _mm_loadu_si128((const __m128i *)dp);
+		__m128i lo = over_alpha_epi16_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), alpha16);
+		__m128i hi = over_alpha_epi16_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), alpha16);
+		_mm_storeu_si128((__m128i *)dp, _mm_packus_epi16(lo, hi));
+	}
+	span_3_da_sa_alpha_tail(dp, sp, w, alpha);
+}
+
+TARGET_SSE2 static void
+gray_to_rgba_sse2(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	__m128i opaque = _mm_set1_epi32((int)0xFF000000);
+	for (; w >= 16; w -= 16, dp += 64, sp += 16)
+	{
+		__m128i g = _mm_loadu_si128((const __m128i *)sp);
+		__m128i lo = _mm_unpacklo_epi8(g, g);
+		__m128i hi = _mm_unpackhi_epi8(g, g);
+		_mm_storeu_si128((__m128i *)dp, _mm_or_si128(_mm_unpacklo_epi16(lo, lo), opaque));
+		_mm_storeu_si128((__m128i *)(dp + 16), _mm_or_si128(_mm_unpackhi_epi16(lo, lo), opaque));
+		_mm_storeu_si128((__m128i *)(dp + 32), _mm_or_si128(_mm_unpacklo_epi16(hi, hi), opaque));
+		_mm_storeu_si128((__m128i *)(dp + 48), _mm_or_si128(_mm_unpackhi_epi16(hi, hi), opaque));
+	}
+	gray_to_rgba_tail(dp, sp, w);
+}
+
+TARGET_SSE2 static void
+mul255_sse2(byte * FZ_RESTRICT p, int len, int alpha)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha16 = _mm_set1_epi16((short)alpha);
+	__m128i round = _mm_set1_epi16(128);
+	for (; len >= 16; len -= 16, p += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)p);
+		__m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), alpha16), round);
+		__m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), alpha16), round);
+		lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+		hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+		_mm_storeu_si128((__m128i *)p, _mm_packus_epi16(lo, hi));
+	}
+	mul255_tail(p, len, alpha);
+}
+
+/* AVX2: 8 pixels at a time. Note that unpacking and packing work on
+ * the two 128 bit halves separately, so that the low resp. high
+ * halves of a pixel vector hold pixels 0, 1, 4, 5 resp. 2, 3, 6, 7. */
+
+TARGET_AVX2 static inline __m256i
+blend_epi16_avx2(__m256i c, __m256i d, __m256i ma)
+{
+	__m256i x = _mm256_mullo_epi16(_mm256_sub_epi16(c, d), ma);
+	return _mm256_srli_epi16(_mm256_add_epi16(_mm256_slli_epi16(d, 8), x), 8);
+}
+
+TARGET_AVX2 static void
+paint_solid_color_3_da_avx2(byte * FZ_RESTRICT dp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int sa = FZ_EXPAND(color[3]);
+	byte rgba[4];
+	__m256i c;
+	if (sa == 0)
+		return;
+	opaque_rgba(rgba, color);
+	c = _mm256_set1_epi32((int)load_u32(rgba));
+	if (sa == 256)
+	{
+		for (; w >= 8; w -= 8, dp += 32)
+			_mm256_storeu_si256((__m256i *)dp, c);
+	}
+	else
+	{
+		__m256i zero = _mm256_setzero_si256();
+		__m256i ma = _mm256_set1_epi16((short)sa);
+		c = _mm256_unpacklo_epi8(c, zero);
+		for (; w >= 8; w -= 8, dp += 32)
+		{
+			__m256i d = _mm256_loadu_si256((const __m256i *)dp);
+			__m256i lo = blend_epi16_avx2(c, _mm256_unpacklo_epi8(d, zero), ma);
+			__m256i hi = blend_epi16_avx2(c, _mm256_unpackhi_epi8(d, zero), ma);
+			_mm256_storeu_si256((__m256i *)dp, _mm256_packus_epi16(lo, hi));
+		}
+	}
+	solid_color_3_da_tail(dp, w, rgba, sa);
+}
+
+TARGET_AVX2 static void
+paint_span_with_color_3_da_avx2(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int sa = FZ_EXPAND(color[3]);
+	byte rgba[4];
+	__m256i zero = _mm256_setzero_si256();
+	__m256i c, c32, sa16;
+	if (sa == 0)
+		return;
+	opaque_rgba(rgba, color);
+	c32 = _mm256_set1_epi32((int)load_u32(rgba));
+	c = _mm256_unpacklo_epi8(c32, zero);
+	sa16 = _mm256_set1_epi16((short)sa);
+	for (; w >= 8; w -= 8, dp += 32, mp += 8)
+	{
+		uint64_t m8;
+		__m256i m, d, lo, hi;
+		memcpy(&m8, mp, 8);
+		if (m8 == 0)
+			continue;
+		if (m8 == ~(uint64_t)0 && sa == 256)
+		{
+			_mm256_storeu_si256((__m256i *)dp, c32);
+			continue;
+		}
+		/* one pixel's coverage per 32 bit lane */
+		m = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)mp));
+		m = _mm256_add_epi16(m, _mm256_srli_epi16(m, 7));
+		if (sa != 256)
+			m = _mm256_srli_epi16(_mm256_mullo_epi16(m, sa16), 8);
+		m = _mm256_or_si256(m, _mm256_slli_epi32(m, 16));
+		d = _mm256_loadu_si256((const __m256i *)dp);
+		lo = blend_epi16_avx2(c, _mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi32(m, m));
+		hi = blend_epi16_avx2(c, _mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi32(m, m));
+		_mm256_storeu_si256((__m256i *)dp, _mm256_packus_epi16(lo, hi));
+	}
+	span_with_color_3_da_tail(dp, mp, w, rgba, sa);
+}
+
+TARGET_AVX2 static inline __m256i
+over_epi16_avx2(__m256i s, __m256i d)
+{
+	__m256i t = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+	t = _mm256_sub_epi16(_mm256_set1_epi16(256), _mm256_add_epi16(t, _mm256_srli_epi16(t, 7)));
+	d = _mm256_srli_epi16(_mm256_mullo_epi16(d, t), 8);
+	return _mm256_and_si256(_mm256_add_epi16(s, d), _mm256_set1_epi16(0xFF));
+}
+
+TARGET_AVX2 static void
+paint_span_3_da_sa_avx2(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	__m256i zero = _mm256_setzero_si256();
+	for (; w >= 8; w -= 8, dp += 32, sp += 32)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)sp);
+		__m256i transparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(s, 24), zero);
+		__m256i d, lo, hi, r;
+		if (_mm256_movemask_epi8(transparent) == -1)
+			continue;
+		d = _mm256_loadu_si256((const __m256i *)dp);
+		lo = over_epi16_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+		hi = over_epi16_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+		r = _mm256_packus_epi16(lo, hi);
+		r = _mm256_blendv_epi8(r, d, transparent);
+		_mm256_storeu_si256((__m256i *)dp, r);
+	}
+	span_3_da_sa_tail(dp, sp, w);
+}
+
+TARGET_AVX2 static inline __m256i
+over_alpha_epi16_avx2(__m256i s, __m256i d, __m256i alpha)
+{
+	__m256i t;
+	s = _mm256_srli_epi16(_mm256_mullo_epi16(s, alpha), 8);
+	t = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+	t = _mm256_sub_epi16(_mm256_set1_epi16(255), t);
+	t = _mm256_add_epi16(t, _mm256_srli_epi16(t, 7));
+	d = _mm256_srli_epi16(_mm256_mullo_epi16(d, t), 8);
+	return _mm256_and_si256(_mm256_add_epi16(s, d), _mm256_set1_epi16(0xFF));
+}
+
+TARGET_AVX2 static void
+paint_span_3_da_sa_alpha_avx2(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i alpha16;
+	alpha = FZ_EXPAND(alpha);
+	alpha16 = _mm256_set1_epi16((short)alpha);
+	for (; w >= 8; w -= 8, dp += 32, sp += 32)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)sp);
+		__m256i d = _mm256_loadu_si256((const __m256i *)dp);
+		__m256i lo = over_alpha_epi16_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), alpha16);
+		__m256i hi = over_alpha_epi16_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), alpha16);
+		_mm256_storeu_si256((__m256i *)dp, _mm256_packus_epi16(lo, hi));
+	}
+	span_3_da_sa_alpha_tail(dp, sp, w, alpha);
+}
+
+TARGET_AVX2 static void
+gray_to_rgba_avx2(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	__m256i opaque = _mm256_set1_epi32((int)0xFF000000);
+	__m256i spread = _mm256_set1_epi32(0x010101);
+	for (; w >= 8; w -= 8, dp += 32, sp += 8)
+	{
+		__m256i g = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)sp));
+		_mm256_storeu_si256((__m256i *)dp, _mm256_or_si256(_mm256_mullo_epi32(g, spread), opaque));
+	}
+	gray_to_rgba_tail(dp, sp, w);
+}
+
+TARGET_AVX2 static void
+rgb_to_rgba_avx2(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	__m128i opaque = _mm_set1_epi32((int)0xFF000000);
+	__m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	/* each load reads 16 bytes of which only 12 (4 pixels) are used */
+	for (; w >= 10; w -= 8, dp += 32, sp += 24)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)sp);
+		__m128i b = _mm_loadu_si128((const __m128i *)(sp + 12));
+		a = _mm_or_si128(_mm_shuffle_epi8(a, shuffle), opaque);
+		b = _mm_or_si128(_mm_shuffle_epi8(b, shuffle), opaque);
+		_mm256_storeu_si256((__m256i *)dp, _mm256_inserti128_si256(_mm256_castsi128_si256(a), b, 1));
+	}
+	rgb_to_rgba_tail(dp, sp, w);
+}
+
+TARGET_AVX2 static void
+mul255_avx2(byte * FZ_RESTRICT p, int len, int alpha)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i alpha16 = _mm256_set1_epi16((short)alpha);
+	__m256i round = _mm256_set1_epi16(128);
+	for (; len >= 32; len -= 32, p += 32)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)p);
+		__m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(v, zero), alpha16), round);
+		__m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(v, zero), alpha16), round);
+		lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+		hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+		_mm256_storeu_si256((__m256i *)p, _mm256_packus_epi16(lo, hi));
+	}
+	mul255_tail(p, len, alpha);
+}
+
+#endif /* SIMD_X86 */
+
+#ifdef SIMD_NEON
+
+/* NEON: 8 pixels at a time, deinterleaved into one vector per component */
+
+static inline uint8x8_t
+blend_u8_neon(uint8x8_t c, uint8x8_t d, uint16x8_t ma)
+{
+	uint16x8_t d16 = vmovl_u8(d);
+	uint16x8_t x = vmulq_u16(vsubq_u16(vmovl_u8(c), d16), ma);
+	return vshrn_n_u16(vaddq_u16(vshlq_n_u16(d16, 8), x), 8);
+}
+
+static inline uint16x8_t
+expand_u16_neon(uint16x8_t a)
+{
+	return vsraq_n_u16(a, a, 7);
+}
+
+static void
+paint_solid_color_3_da_neon(byte * FZ_RESTRICT dp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int sa = FZ_EXPAND(color[3]);
+	byte rgba[4];
+	if (sa == 0)
+		return;
+	opaque_rgba(rgba, color);
+	if (sa == 256)
+	{
+		uint32_t c;
+		uint32x4_t c4;
+		memcpy(&c, rgba, 4);
+		c4 = vdupq_n_u32(c);
+		for (; w >= 8; w -= 8, dp += 32)
+		{
+			vst1q_u32((uint32_t *)(void *)dp, c4);
+			vst1q_u32((uint32_t *)(void *)(dp + 16), c4);
+		}
+	}
+	else
+	{
+		uint16x8_t ma = vdupq_n_u16((uint16_t)sa);
+		int k;
+		for (; w >= 8; w -= 8, dp += 32)
+		{
+			uint8x8x4_t d = vld4_u8(dp);
+			for (k = 0; k < 4; k++)
+				d.val[k] = blend_u8_neon(vdup_n_u8(rgba[k]), d.val[k], ma);
+			vst4_u8(dp, d);
+		}
+	}
+	solid_color_3_da_tail(dp, w, rgba, sa);
+}
+
+static void
+paint_span_with_color_3_da_neon(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT mp, int n, int w, const byte * FZ_RESTRICT color, int da, const fz_overprint * FZ_RESTRICT eop)
+{
+	int sa = FZ_EXPAND(color[3]);
+	byte rgba[4];
+	int k;
+	if (sa == 0)
+		return;
+	opaque_rgba(rgba, color);
+	for (; w >= 8; w -= 8, dp += 32, mp += 8)
+	{
+		uint64_t m8;
+		uint16x8_t ma;
+		uint8x8x4_t d;
+		memcpy(&m8, mp, 8);
+		if (m8 == 0)
+			continue;
+		ma = expand_u16_neon(vmovl_u8(vld1_u8(mp)));
+		if (sa != 256)
+			ma = vshrq_n_u16(vmulq_n_u16(ma, (uint16_t)sa), 8);
+		d = vld4_u8(dp);
+		for (k = 0; k < 4; k++)
+			d.val[k] = blend_u8_neon(vdup_n_u8(rgba[k]), d.val[k], ma);
+		vst4_u8(dp, d);
+	}
+	span_with_color_3_da_tail(dp, mp, w, rgba, sa);
+}
+
+static void
+paint_span_3_da_sa_neon(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	int k;
+	for (; w >= 8; w -= 8, dp += 32, sp += 32)
+	{
+		uint8x8x4_t s = vld4_u8(sp);
+		uint8x8x4_t d = vld4_u8(dp);
+		uint8x8_t transparent = vceq_u8(s.val[3], vdup_n_u8(0));
+		uint16x8_t t = vsubq_u16(vdupq_n_u16(256), expand_u16_neon(vmovl_u8(s.val[3])));
+		for (k = 0; k < 4; k++)
+		{
+			/* vmovn keeps the low 8 bits, just as storing into a byte does */
+			uint16x8_t r = vaddq_u16(vmovl_u8(s.val[k]), vshrq_n_u16(vmulq_u16(vmovl_u8(d.val[k]), t), 8));
+			d.val[k] = vbsl_u8(transparent, d.val[k], vmovn_u16(r));
+		}
+		vst4_u8(dp, d);
+	}
+	span_3_da_sa_tail(dp, sp, w);
+}
+
+static void
+paint_span_3_da_sa_alpha_neon(byte * FZ_RESTRICT dp, int da, const byte * FZ_RESTRICT sp, int sa, int n, int w, int alpha, const fz_overprint * FZ_RESTRICT eop)
+{
+	int k;
+	alpha = FZ_EXPAND(alpha);
+	for (; w >= 8; w -= 8, dp += 32, sp += 32)
+	{
+		uint8x8x4_t s = vld4_u8(sp);
+		uint8x8x4_t d = vld4_u8(dp);
+		uint16x8_t masa = vshrq_n_u16(vmulq_n_u16(vmovl_u8(s.val[3]), (uint16_t)alpha), 8);
+		uint16x8_t t = expand_u16_neon(vsubq_u16(vdupq_n_u16(255), masa));
+		for (k = 0; k < 4; k++)
+		{
+			uint16x8_t sk = vshrq_n_u16(vmulq_n_u16(vmovl_u8(s.val[k]), (uint16_t)alpha), 8);
+			uint16x8_t r = vaddq_u16(sk, vshrq_n_u16(vmulq_u16(vmovl_u8(d.val[k]), t), 8));
+			d.val[k] = vmovn_u16(r);
+		}
+		vst4_u8(dp, d);
+	}
+	span_3_da_sa_alpha_tail(dp, sp, w, alpha);
+}
+
+static void
+gray_to_rgba_neon(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	for (; w >= 8; w -= 8, dp += 32, sp += 8)
+	{
+		uint8x8x4_t d;
+		d.val[0] = d.val[1] = d.val[2] = vld1_u8(sp);
+		d.val[3] = vdup_n_u8(255);
+		vst4_u8(dp, d);
+	}
+	gray_to_rgba_tail(dp, sp, w);
+}
+
+static void
+rgb_to_rgba_neon(byte * FZ_RESTRICT dp, const byte * FZ_RESTRICT sp, int w)
+{
+	for (; w >= 8; w -= 8, dp += 32, sp += 24)
+	{
+		uint8x8x3_t s = vld3_u8(sp);
+		uint8x8x4_t d;
+		d.val[0] = s.val[0];
+		d.val[1] = s.val[1];
+		d.val[2] = s.val[2];
+		d.val[3] = vdup_n_u8(255);
+		vst4_u8(dp, d);
+	}
+	rgb_to_rgba_tail(dp, sp, w);
+}
+
+static void
+mul255_neon(byte * FZ_RESTRICT p, int len, int alpha)
+{
+	uint8x8_t alpha8 = vdup_n_u8((uint8_t)alpha);
+	for (; len >= 8; len -= 8, p += 8)
+	{
+		uint16x8_t x = vaddq_u16(vmull_u8(vld1_u8(p), alpha8), vdupq_n_u16(128));
+		x = vsraq_n_u16(x, x, 8);
+		vst1_u8(p, vshrn_n_u16(x, 8));
+	}
+	mul255_tail(p, len, alpha);
+}
+
+#endif /* SIMD_NEON */
+
+fz_solid_color_painter_t *
+fz_get_solid_color_painter_simd(int n, int da)
+{
+	int level = fz_simd_level();
+	if (n != 4 || !da)
+		return NULL;
+#if defined(SIMD_X86)
+	if (level >= FZ_SIMD_AVX2)
+		return paint_solid_color_3_da_avx2;
+	if (level >= FZ_SIMD_SSE2)
+		return paint_solid_color_3_da_sse2;
+#elif defined(SIMD_NEON)
+	if (level == FZ_SIMD_NEON)
+		return paint_solid_color_3_da_neon;
+#endif
+	(void)level;
+	return NULL;
+}
+
+fz_span_color_painter_t *
+fz_get_span_color_painter_simd(int n, int da)
+{
+	int level = fz_simd_level();
+	if (n != 4 || !da)
+		return NULL;
+#if defined(SIMD_X86)
+	if (level >= FZ_SIMD_AVX2)
+		return paint_span_with_color_3_da_avx2;
+	if (level >= FZ_SIMD_SSE2)
+		return paint_span_with_color_3_da_sse2;
+#elif defined(SIMD_NEON)
+	if (level == FZ_SIMD_NEON)
+		return paint_span_with_color_3_da_neon;
+#endif
+	(void)level;
+	return NULL;
+}
+
+fz_span_painter_t *
+fz_get_span_painter_simd(int da, int sa, int n, int alpha)
+{
+	int level = fz_simd_level();
+	if (n != 3 || !da || !sa || alpha <= 0 || alpha > 255)
+		return NULL;
+#if defined(SIMD_X86)
+	if (level >= FZ_SIMD_AVX2)
+		return alpha == 255 ? paint_span_3_da_sa_avx2 : paint_span_3_da_sa_alpha_avx2;
+	if (level >= FZ_SIMD_SSE2)
+		return alpha == 255 ? paint_span_3_da_sa_sse2 : paint_span_3_da_sa_alpha_sse2;
+#elif defined(SIMD_NEON)
+	if (level == FZ_SIMD_NEON)
+		return alpha == 255 ? paint_span_3_da_sa_neon : paint_span_3_da_sa_alpha_neon;
+#endif
+	(void)level;
+	return NULL;
+}
+
+fz_image_row_painter_t *
+fz_get_image_row_painter_simd(int sn)
+{
+	int level = fz_simd_level();
+#if defined(SIMD_X86)
+	if (level >= FZ_SIMD_AVX2)
+		return sn == 1 ? gray_to_rgba_avx2 : sn == 3 ? rgb_to_rgba_avx2 : NULL;
+	if (level >= FZ_SIMD_SSE2)
+		return sn == 1 ? gray_to_rgba_sse2 : NULL;
+#elif defined(SIMD_NEON)
+	if (level == FZ_SIMD_NEON)
+		return sn == 1 ? gray_to_rgba_neon : sn == 3 ? rgb_to_rgba_neon : NULL;
+#endif
+	(void)level;
+	(void)sn;
+	return NULL;
+}
+
+fz_span_scaler_t *
+fz_get_mul255_span_simd(void)
+{
+	int level = fz_simd_level();
+#if defined(SIMD_X86)
+	if (level >= FZ_SIMD_AVX2)
+		return mul255_avx2;
+	if (level >= FZ_SIMD_SSE2)
+		return mul255_sse2;
+#elif defined(SIMD_NEON)
+	if (level == FZ_SIMD_NEON)
+		return mul255_neon;
+#endif
+	(void)level;
+	return NULL;
+}
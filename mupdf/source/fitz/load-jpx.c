@@ -1,5 +1,6 @@
 #include "mupdf/fitz.h"
 
+#include "image-imp.h"
 #include "pixmap-imp.h"
 
 #include <assert.h>
@@ -302,6 +303,13 @@ safe_mla32(fz_context *ctx, int32_t a, int32_t b, int32_t c)
 	return res32;
 }
 
+/* ceil(a / 2^b), used for component geometry at a reduced resolution */
+static int32_t
+jpx_ceildivpow2(OPJ_UINT32 a, OPJ_UINT32 b)
+{
+	return (int32_t)(((int64_t)a + ((int64_t)1 << b) - 1) >> b);
+}
+
 static inline void
 template_copy_comp(unsigned char *dst0, int w, int h, int stride, const OPJ_INT32 *src, int32_t ox, int32_t oy, OPJ_UINT32 cdx, OPJ_UINT32 cdy, OPJ_UINT32 cw, OPJ_UINT32 ch, OPJ_UINT32 sgnd, OPJ_UINT32 prec, int comps)
 {
@@ -398,8 +406,9 @@ copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx)
 		OPJ_UINT32 cdy = comp->dy;
 		OPJ_UINT32 cw = comp->w;
 		OPJ_UINT32 ch = comp->h;
-		int32_t oy = safe_mul32(ctx, comp->y0, cdy) - jpx->y0;
-		int32_t ox = safe_mul32(ctx, comp->x0, cdx) - jpx->x0;
+		/* comp->w and comp->h are already reduced, the origins aren't */
+		int32_t oy = safe_mul32(ctx, jpx_ceildivpow2(comp->y0, comp->factor), cdy) - jpx_ceildivpow2(jpx->y0, comp->factor);
+		int32_t ox = safe_mul32(ctx, jpx_ceildivpow2(comp->x0, comp->factor), cdx) - jpx_ceildivpow2(jpx->x0, comp->factor);
 		unsigned char *dst0 = dst + oy * stride;
 
 		if (comp->data == NULL)
@@ -417,21 +426,43 @@ copy_jpx_to_pixmap(fz_context *ctx, fz_pixmap *img, opj_image_t *jpx)
 	}
 }
 
-static fz_pixmap *
-jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_t size, fz_colorspace *defcs, int onlymeta)
+/* The lowest resolution level all components can be decoded at. */
+static OPJ_UINT32
+jpx_max_reduce(opj_codec_t *codec)
+{
+	opj_codestream_info_v2_t *info = opj_get_cstr_info(codec);
+	OPJ_UINT32 i, max_reduce = 0;
+
+	if (!info)
+		return 0;
+	if (info->m_default_tile_info.tccp_info && info->nbcomps > 0)
+	{
+		max_reduce = 32;
+		for (i = 0; i < info->nbcomps; i++)
+		{
+			OPJ_UINT32 numres = info->m_default_tile_info.tccp_info[i].numresolutions;
+			if (numres == 0)
+				max_reduce = 0;
+			else if (numres - 1 < max_reduce)
+				max_reduce = numres - 1;
+		}
+	}
+	opj_destroy_cstr_info(&info);
+	return max_reduce;
+}
+
+/* Decodes the codestream skipping up to *reduce resolution levels (i.e.
+ * at 1/2^*reduce of the full size). On return, *reduce is the number
+ * of levels which have actually been skipped. */
+static opj_image_t *
+jpx_decode(fz_context *ctx, const unsigned char *data, size_t size, int indexed, OPJ_UINT32 *reduce)
 {
-	fz_pixmap *img = NULL;
 	opj_dparameters_t params;
 	opj_codec_t *codec;
 	opj_image_t *jpx;
 	opj_stream_t *stream;
 	OPJ_CODEC_FORMAT format;
-	int a, n, k;
-	int w, h;
 	stream_block sb;
-	OPJ_UINT32 i;
-
-	fz_var(img);
 
 	if (size < 2)
 		fz_throw(ctx, FZ_ERROR_GENERIC, "not enough data to determine image format");
@@ -443,7 +474,7 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 		format = OPJ_CODEC_JP2;
 
 	opj_set_default_decoder_parameters(&params);
-	if (fz_colorspace_is_indexed(ctx, defcs))
+	if (indexed)
 		params.flags |= OPJ_DPARAMETERS_IGNORE_PCLR_CMAP_CDEF_FLAG;
 
 	codec = opj_create_decompress(format);
@@ -475,18 +506,64 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to read JPX header");
 	}
 
+	if (*reduce > 0)
+	{
+		OPJ_UINT32 max_reduce = jpx_max_reduce(codec);
+		if (*reduce > max_reduce)
+			*reduce = max_reduce;
+		if (*reduce > 0 && !opj_set_decoded_resolution_factor(codec, *reduce))
+		{
+			opj_set_decoded_resolution_factor(codec, 0);
+			*reduce = 0;
+		}
+	}
+
 	if (!opj_decode(codec, stream, jpx))
 	{
 		opj_stream_destroy(stream);
 		opj_destroy_codec(codec);
 		opj_image_destroy(jpx);
+		/* single tiles might have fewer resolution levels than announced
+		 * in the main header, so retry at full resolution */
+		if (*reduce > 0)
+		{
+			fz_warn(ctx, "retrying to decode JPX image at full resolution");
+			*reduce = 0;
+			return jpx_decode(ctx, data, size, indexed, reduce);
+		}
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to decode JPX image");
 	}
 
 	opj_stream_destroy(stream);
 	opj_destroy_codec(codec);
 
-	/* jpx should never be NULL here, but check anyway */
+	return jpx;
+}
+
+/* l2factor is the log2 of the subsampling wanted. It's updated to the
+ * subsampling which remains to be done by the caller. */
+static fz_pixmap *
+jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_t size, fz_colorspace *defcs, int onlymeta, int *l2factor)
+{
+	fz_pixmap *img = NULL;
+	opj_image_t *jpx;
+	OPJ_UINT32 reduce;
+	int a, n, k;
+	int w, h;
+	OPJ_UINT32 i;
+
+	fz_var(img);
+
+	/* the image only has to be decoded for determining the colorspace,
+	 * so do that at the lowest resolution available */
+	if (onlymeta)
+		reduce = 32;
+	else
+		reduce = l2factor && *l2factor > 0 ? *l2factor : 0;
+	jpx = jpx_decode(ctx, data, size, fz_colorspace_is_indexed(ctx, defcs), &reduce);
+	if (l2factor && !onlymeta)
+		*l2factor -= reduce;
+
 	if (!jpx)
 		fz_throw(ctx, FZ_ERROR_GENERIC, "opj_decode failed");
 
@@ -511,6 +588,11 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 
 	w = state->width = jpx->x1 - jpx->x0;
 	h = state->height = jpx->y1 - jpx->y0;
+	if (reduce > 0)
+	{
+		w = jpx_ceildivpow2(jpx->x1, reduce) - jpx_ceildivpow2(jpx->x0, reduce);
+		h = jpx_ceildivpow2(jpx->y1, reduce) - jpx_ceildivpow2(jpx->y0, reduce);
+	}
 	state->xres = 72; /* openjpeg does not read the JPEG 2000 resc box */
 	state->yres = 72; /* openjpeg does not read the JPEG 2000 resc box */
 
@@ -601,6 +683,12 @@ jpx_read_image(fz_context *ctx, fz_jpxd *state, const unsigned char *data, size_
 
 fz_pixmap *
 fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs)
+{
+	return fz_load_jpx_subsampled(ctx, data, size, defcs, NULL);
+}
+
+fz_pixmap *
+fz_load_jpx_subsampled(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs, int *l2factor)
 {
 	fz_jpxd state = { 0 };
 	fz_pixmap *pix = NULL;
@@ -608,7 +696,7 @@ fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspa
 	fz_try(ctx)
 	{
 		opj_lock(ctx);
-		pix = jpx_read_image(ctx, &state, data, size, defcs, 0);
+		pix = jpx_read_image(ctx, &state, data, size, defcs, 0, l2factor);
 	}
 	fz_always(ctx)
 		opj_unlock(ctx);
@@ -626,7 +714,7 @@ fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *w
 	fz_try(ctx)
 	{
 		opj_lock(ctx);
-		jpx_read_image(ctx, &state, data, size, NULL, 1);
+		jpx_read_image(ctx, &state, data, size, NULL, 1, NULL);
 	}
 	fz_always(ctx)
 		opj_unlock(ctx);
@@ -648,6 +736,12 @@ fz_load_jpx(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspa
 	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
 }
 
+fz_pixmap *
+fz_load_jpx_subsampled(fz_context *ctx, const unsigned char *data, size_t size, fz_colorspace *defcs, int *l2factor)
+{
+	fz_throw(ctx, FZ_ERROR_GENERIC, "JPX support disabled");
+}
+
 void
 fz_load_jpx_info(fz_context *ctx, const unsigned char *data, size_t size, int *wp, int *hp, int *xresp, int *yresp, fz_colorspace **cspacep)
 {
@@ -154,6 +154,8 @@ void
 pdf_dirty_annot(fz_context *ctx, pdf_annot *annot)
 {
 	annot->needs_new_ap = 1;
+	if (annot->page)
+		annot->page->annot_generation++;
 	if (annot->page && annot->page->doc)
 		annot->page->doc->dirty = 1;
 }
@@ -306,6 +308,7 @@ pdf_create_annot_raw(fz_context *ctx, pdf_page *page, enum pdf_annot_type type)
 		*page->annot_tailp = annot;
 		page->annot_tailp = &annot->next;
 		}
+		page->annot_generation++;
 
 		doc->dirty = 1;
 	}
@@ -653,6 +656,7 @@ pdf_delete_annot(fz_context *ctx, pdf_page *page, pdf_annot *annot)
 		else
 		page->annot_tailp = annotptr;
 	}
+	page->annot_generation++;
 
 	/* Remove the annot from the "Annots" array. */
 	annot_arr = pdf_dict_get(ctx, page->obj, PDF_NAME(Annots));
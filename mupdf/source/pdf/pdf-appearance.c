@@ -2317,6 +2317,7 @@ void pdf_update_appearance(fz_context *ctx, pdf_annot *annot)
 		if (pdf_is_stream(ctx, ap_n))
 			annot->ap = pdf_keep_obj(ctx, ap_n);
 		annot->has_new_ap = 1;
+		annot->page->annot_generation++;
 	}
 
 	ft = pdf_dict_get(ctx, annot->obj, PDF_NAME(FT));
@@ -2374,6 +2375,7 @@ void pdf_update_appearance(fz_context *ctx, pdf_annot *annot)
 			annot->ap = NULL;
 			annot->ap = pdf_keep_obj(ctx, new_ap_n);
 			annot->has_new_ap = 1;
+			annot->page->annot_generation++;
 		}
 		fz_always(ctx)
 		{
@@ -217,6 +217,47 @@ pdf_is_jpx_image(fz_context *ctx, pdf_obj *dict)
 	return 0;
 }
 
+/* Keep the JPX stream compressed, so that it can be decoded at the
+ * resolution needed (and cached per resolution in the store). */
+static fz_image *
+pdf_load_jpx_compressed(fz_context *ctx, fz_buffer *buf, fz_colorspace *colorspace, fz_image *mask, int smask_in_data)
+{
+	fz_compressed_buffer *bc = NULL;
+	fz_colorspace *cs = NULL;
+	fz_image *img = NULL;
+	unsigned char *data;
+	size_t len;
+	int w, h, xres, yres;
+
+	fz_var(cs);
+
+	len = fz_buffer_storage(ctx, buf, &data);
+	fz_load_jpx_info(ctx, data, len, &w, &h, &xres, &yres, &cs);
+
+	fz_try(ctx)
+	{
+		if (colorspace && fz_colorspace_n(ctx, colorspace) == fz_colorspace_n(ctx, cs))
+		{
+			fz_drop_colorspace(ctx, cs);
+			cs = fz_keep_colorspace(ctx, colorspace);
+		}
+		else if (colorspace)
+			fz_warn(ctx, "jpx file and dict colorspace do not match");
+
+		bc = fz_malloc_struct(ctx, fz_compressed_buffer);
+		bc->buffer = fz_keep_buffer(ctx, buf);
+		bc->params.type = FZ_IMAGE_JPX;
+		bc->params.u.jpx.smask_in_data = smask_in_data;
+		img = fz_new_image_from_compressed_buffer(ctx, w, h, 8, cs, 96, 96, 0, 0, NULL, NULL, bc, mask);
+	}
+	fz_always(ctx)
+		fz_drop_colorspace(ctx, cs);
+	fz_catch(ctx)
+		fz_rethrow(ctx);
+
+	return img;
+}
+
 static fz_image *
 pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 {
@@ -231,6 +272,7 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 	fz_var(buf);
 	fz_var(colorspace);
 	fz_var(mask);
+	fz_var(img);
 
 	buf = pdf_load_stream(ctx, dict);
 
@@ -244,9 +286,6 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 		if (obj)
 			colorspace = pdf_load_colorspace(ctx, obj);
 
-		len = fz_buffer_storage(ctx, buf, &data);
-		pix = fz_load_jpx(ctx, data, len, colorspace);
-
 		obj = pdf_dict_geta(ctx, dict, PDF_NAME(SMask), PDF_NAME(Mask));
 		if (pdf_is_dict(ctx, obj))
 		{
@@ -256,6 +295,16 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 				mask = pdf_load_image_imp(ctx, doc, NULL, obj, NULL, 1);
 		}
 
+		/* soft masks need the decoded pixmap and decode arrays are applied to it */
+		if (!forcemask && !fz_colorspace_is_indexed(ctx, colorspace) && !pdf_dict_geta(ctx, dict, PDF_NAME(Decode), PDF_NAME(D)))
+		{
+			img = pdf_load_jpx_compressed(ctx, buf, colorspace, mask, pdf_dict_get_int(ctx, dict, PDF_NAME(SMaskInData)));
+			break;
+		}
+
+		len = fz_buffer_storage(ctx, buf, &data);
+		pix = fz_load_jpx(ctx, data, len, colorspace);
+
 		obj = pdf_dict_geta(ctx, dict, PDF_NAME(Decode), PDF_NAME(D));
 		if (obj && !fz_colorspace_is_indexed(ctx, colorspace))
 		{
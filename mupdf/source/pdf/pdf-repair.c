@@ -718,3 +718,238 @@ pdf_repair_obj_stms(fz_context *ctx, pdf_document *doc)
 			fz_throw(ctx, FZ_ERROR_GENERIC, "invalid reference to non-object-stream: %d (%d 0 R)", (int)entry->ofs, i);
 	}
 }
+
+/* Save and restore repaired xref tables, so that broken files don't have to be rescanned */
+
+#define REPAIRED_XREF_MAGIC "%MuPDF-repaired-xref-1\n"
+/* type, gen, num, ofs, stm_ofs, stm_len */
+#define REPAIRED_XREF_ENTRY_SIZE (1 + 2 + 4 + 8 + 8 + 4)
+/* number of objects whose offsets are checked before a saved xref is used */
+#define REPAIRED_XREF_CHECKS 32
+
+static void
+append_int64_le(fz_context *ctx, fz_buffer *buf, int64_t x)
+{
+	fz_append_int32_le(ctx, buf, (int)(x & 0xFFFFFFFF));
+	fz_append_int32_le(ctx, buf, (int)(x >> 32));
+}
+
+fz_buffer *
+pdf_save_repaired_xref(fz_context *ctx, pdf_document *doc)
+{
+	fz_buffer *buf = NULL;
+	fz_output *out = NULL;
+	int i, xref_len;
+	int64_t file_len;
+
+	/* encrypted documents aren't saved since their object streams can only
+	 * be repaired once they've been authenticated */
+	if (!doc->repair_attempted || doc->crypt || doc->num_xref_sections != 1 || doc->num_incremental_sections != 0)
+		return NULL;
+
+	fz_var(buf);
+	fz_var(out);
+
+	fz_try(ctx)
+	{
+		xref_len = pdf_xref_len(ctx, doc);
+		fz_seek(ctx, doc->file, 0, SEEK_END);
+		file_len = fz_tell(ctx, doc->file);
+
+		buf = fz_new_buffer(ctx, 1024 + (size_t)xref_len * REPAIRED_XREF_ENTRY_SIZE);
+		fz_append_string(ctx, buf, REPAIRED_XREF_MAGIC);
+		append_int64_le(ctx, buf, file_len);
+		fz_append_int32_le(ctx, buf, xref_len);
+		for (i = 0; i < xref_len; i++)
+		{
+			pdf_xref_entry *entry = pdf_get_xref_entry(ctx, doc, i);
+			int stm_len = -1;
+			/* stream lengths corrected by pdf_repair_xref only live in the cached objects */
+			if (entry->type == 'n' && entry->stm_ofs && pdf_is_dict(ctx, entry->obj))
+			{
+				pdf_obj *length = pdf_dict_get(ctx, entry->obj, PDF_NAME(Length));
+				if (pdf_is_int(ctx, length) && !pdf_is_indirect(ctx, length))
+					stm_len = pdf_to_int(ctx, length);
+			}
+			fz_append_byte(ctx, buf, entry->type ? entry->type : 'f');
+			fz_append_int16_le(ctx, buf, entry->gen);
+			fz_append_int32_le(ctx, buf, entry->num);
+			append_int64_le(ctx, buf, entry->ofs);
+			append_int64_le(ctx, buf, entry->stm_ofs);
+			fz_append_int32_le(ctx, buf, stm_len);
+		}
+
+		fz_append_int32_le(ctx, buf, doc->rev_page_map ? doc->rev_page_count : 0);
+		for (i = 0; doc->rev_page_map && i < doc->rev_page_count; i++)
+		{
+			fz_append_int32_le(ctx, buf, doc->rev_page_map[i].page);
+			fz_append_int32_le(ctx, buf, doc->rev_page_map[i].object);
+		}
+
+		out = fz_new_output_with_buffer(ctx, buf);
+		pdf_print_obj(ctx, out, pdf_trailer(ctx, doc), 1, 1);
+		fz_close_output(ctx, out);
+	}
+	fz_always(ctx)
+		fz_drop_output(ctx, out);
+	fz_catch(ctx)
+	{
+		fz_drop_buffer(ctx, buf);
+		fz_rethrow(ctx);
+	}
+
+	return buf;
+}
+
+static void
+check_repaired_xref_entry(fz_context *ctx, pdf_document *doc, int num, int64_t ofs)
+{
+	pdf_lexbuf *buf = &doc->lexbuf.base;
+
+	fz_seek(ctx, doc->file, ofs, SEEK_SET);
+	if (pdf_lex(ctx, doc->file, buf) != PDF_TOK_INT || buf->i != num ||
+		pdf_lex(ctx, doc->file, buf) != PDF_TOK_INT ||
+		pdf_lex(ctx, doc->file, buf) != PDF_TOK_OBJ)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "object moved (%d 0 R)", num);
+}
+
+int
+pdf_load_repaired_xref(fz_context *ctx, pdf_document *doc, fz_buffer *saved)
+{
+	fz_stream *stm = NULL;
+	pdf_obj *trailer = NULL;
+	pdf_obj *dict = NULL;
+	pdf_rev_page_map *rev_page_map = NULL;
+	int *stm_lens = NULL;
+	int i, step, xref_len, rev_page_count;
+	int64_t file_len;
+	size_t magic_len = strlen(REPAIRED_XREF_MAGIC);
+
+	if (!saved || saved->len < magic_len || memcmp(saved->data, REPAIRED_XREF_MAGIC, magic_len) != 0)
+		return 0;
+	if (doc->repair_attempted)
+		return 0;
+
+	fz_var(stm);
+	fz_var(trailer);
+	fz_var(dict);
+	fz_var(rev_page_map);
+	fz_var(stm_lens);
+
+	/* objects that fail to load while validating must not trigger a repair */
+	doc->repair_attempted = 1;
+
+	fz_try(ctx)
+	{
+		stm = fz_open_buffer(ctx, saved);
+		fz_skip(ctx, stm, magic_len);
+
+		fz_seek(ctx, doc->file, 0, SEEK_END);
+		file_len = fz_tell(ctx, doc->file);
+		if (fz_read_int64_le(ctx, stm) != file_len)
+			fz_throw(ctx, FZ_ERROR_GENERIC, "file size changed");
+
+		xref_len = fz_read_int32_le(ctx, stm);
+		if (xref_len <= 0 || xref_len > PDF_MAX_OBJECT_NUMBER + 1 || (size_t)xref_len * REPAIRED_XREF_ENTRY_SIZE > saved->len)
+			fz_throw(ctx, FZ_ERROR_GENERIC, "invalid xref length");
+
+		pdf_forget_xref(ctx, doc);
+		pdf_ensure_solid_xref(ctx, doc, xref_len);
+		stm_lens = fz_malloc_array(ctx, xref_len, int);
+		for (i = 0; i < xref_len; i++)
+		{
+			pdf_xref_entry *entry = pdf_get_populating_xref_entry(ctx, doc, i);
+			int bad;
+			entry->type = fz_read_byte(ctx, stm);
+			entry->gen = fz_read_uint16_le(ctx, stm);
+			entry->num = fz_read_int32_le(ctx, stm);
+			entry->ofs = fz_read_int64_le(ctx, stm);
+			entry->stm_ofs = fz_read_int64_le(ctx, stm);
+			stm_lens[i] = fz_read_int32_le(ctx, stm);
+			if (entry->type == 'n')
+				bad = entry->ofs <= 0 || entry->ofs >= file_len || entry->stm_ofs < 0 || entry->stm_ofs >= file_len;
+			else if (entry->type == 'o')
+				bad = entry->ofs <= 0 || entry->ofs >= xref_len;
+			else
+				bad = entry->type != 'f';
+			if (bad)
+				fz_throw(ctx, FZ_ERROR_GENERIC, "invalid xref entry (%d 0 R)", i);
+		}
+
+		rev_page_count = fz_read_int32_le(ctx, stm);
+		if (rev_page_count < 0 || rev_page_count > xref_len)
+			fz_throw(ctx, FZ_ERROR_GENERIC, "invalid page count");
+		if (rev_page_count > 0)
+			rev_page_map = fz_malloc_array(ctx, rev_page_count, pdf_rev_page_map);
+		for (i = 0; i < rev_page_count; i++)
+		{
+			rev_page_map[i].page = fz_read_int32_le(ctx, stm);
+			rev_page_map[i].object = fz_read_int32_le(ctx, stm);
+			if (rev_page_map[i].page < 0 || rev_page_map[i].page >= rev_page_count ||
+				rev_page_map[i].object <= 0 || rev_page_map[i].object >= xref_len)
+				fz_throw(ctx, FZ_ERROR_GENERIC, "invalid page tree entry");
+		}
+
+		trailer = pdf_parse_stm_obj(ctx, doc, stm, &doc->lexbuf.base);
+		if (!pdf_is_dict(ctx, trailer))
+			fz_throw(ctx, FZ_ERROR_GENERIC, "invalid trailer");
+		pdf_set_populating_xref_trailer(ctx, doc, trailer);
+
+		/* spot check that the objects are still where they were found */
+		step = fz_maxi(1, xref_len / REPAIRED_XREF_CHECKS);
+		for (i = 1; i < xref_len; i += step)
+		{
+			pdf_xref_entry *entry = pdf_get_populating_xref_entry(ctx, doc, i);
+			if (entry->type == 'n')
+				check_repaired_xref_entry(ctx, doc, i, entry->ofs);
+		}
+		if (!pdf_is_dict(ctx, pdf_dict_get(ctx, trailer, PDF_NAME(Root))))
+			fz_throw(ctx, FZ_ERROR_GENERIC, "missing Root object");
+
+		/* correct the stream lengths the same way as pdf_repair_xref */
+		for (i = 0; i < xref_len; i++)
+		{
+			pdf_obj *old_obj = NULL;
+			if (stm_lens[i] < 0)
+				continue;
+			dict = pdf_load_object(ctx, doc, i);
+			pdf_dict_get_put_drop(ctx, dict, PDF_NAME(Length), pdf_new_int(ctx, stm_lens[i]), &old_obj);
+			if (old_obj)
+				orphan_object(ctx, doc, old_obj);
+			pdf_drop_obj(ctx, dict);
+			dict = NULL;
+		}
+
+		if (rev_page_map && rev_page_count == pdf_count_pages(ctx, doc))
+		{
+			pdf_drop_page_tree(ctx, doc);
+			doc->rev_page_map = rev_page_map;
+			doc->rev_page_count = rev_page_count;
+			rev_page_map = NULL;
+		}
+	}
+	fz_always(ctx)
+	{
+		fz_drop_stream(ctx, stm);
+		pdf_drop_obj(ctx, trailer);
+		pdf_drop_obj(ctx, dict);
+		fz_free(ctx, rev_page_map);
+		fz_free(ctx, stm_lens);
+	}
+	fz_catch(ctx)
+	{
+		fz_warn(ctx, "ignoring saved xref: %s", fz_caught_message(ctx));
+		doc->repair_attempted = 0;
+		return 0;
+	}
+
+	doc->dirty = 1;
+	doc->repaired_xref_restored = 1;
+	return 1;
+}
+
+int
+pdf_repaired_xref_was_restored(fz_context *ctx, pdf_document *doc)
+{
+	return doc->repaired_xref_restored;
+}
@@ -1425,13 +1425,13 @@ pdf_load_linear(fz_context *ctx, pdf_document *doc)
  */
 
 static void
-pdf_init_document(fz_context *ctx, pdf_document *doc)
+pdf_init_document(fz_context *ctx, pdf_document *doc, fz_buffer *repaired_xref)
 {
 	pdf_obj *encrypt, *id;
 	pdf_obj *dict = NULL;
 	pdf_obj *obj;
 	pdf_obj *nobj = NULL;
-	int i, repaired = 0;
+	int i, repaired = 0, restored = 0;
 
 	fz_var(dict);
 	fz_var(nobj);
@@ -1484,7 +1484,14 @@ pdf_init_document(fz_context *ctx, pdf_document *doc)
 			/* pdf_repair_xref may access xref_index, so reset it properly */
 			if (doc->xref_index)
 				memset(doc->xref_index, 0, sizeof(int) * doc->max_xref_len);
-			pdf_repair_xref(ctx, doc);
+			if (repaired_xref)
+				restored = pdf_load_repaired_xref(ctx, doc, repaired_xref);
+			if (!restored)
+			{
+				if (doc->xref_index)
+					memset(doc->xref_index, 0, sizeof(int) * doc->max_xref_len);
+				pdf_repair_xref(ctx, doc);
+			}
 			pdf_prime_xref_index(ctx, doc);
 		}
 
@@ -1499,7 +1506,9 @@ pdf_init_document(fz_context *ctx, pdf_document *doc)
 		if (repaired)
 		{
 			int xref_len = pdf_xref_len(ctx, doc);
-			pdf_repair_obj_stms(ctx, doc);
+			/* a restored xref already includes the objects in object streams */
+			if (!restored)
+				pdf_repair_obj_stms(ctx, doc);
 
 			hasroot = (pdf_dict_get(ctx, pdf_trailer(ctx, doc), PDF_NAME(Root)) != NULL);
 			hasinfo = (pdf_dict_get(ctx, pdf_trailer(ctx, doc), PDF_NAME(Info)) != NULL);
@@ -2405,11 +2414,17 @@ pdf_new_document(fz_context *ctx, fz_stream *file)
 
 pdf_document *
 pdf_open_document_with_stream(fz_context *ctx, fz_stream *file)
+{
+	return pdf_open_document_with_repaired_xref(ctx, file, NULL);
+}
+
+pdf_document *
+pdf_open_document_with_repaired_xref(fz_context *ctx, fz_stream *file, fz_buffer *repaired_xref)
 {
 	pdf_document *doc = pdf_new_document(ctx, file);
 	fz_try(ctx)
 	{
-		pdf_init_document(ctx, doc);
+		pdf_init_document(ctx, doc, repaired_xref);
 	}
 	fz_catch(ctx)
 	{
@@ -2436,7 +2451,7 @@ pdf_open_document(fz_context *ctx, const char *filename)
 	{
 		file = fz_open_file(ctx, filename);
 		doc = pdf_new_document(ctx, file);
-		pdf_init_document(ctx, doc);
+		pdf_init_document(ctx, doc, NULL);
 	}
 	fz_always(ctx)
 	{
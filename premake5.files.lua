@@ -641,6 +641,7 @@ function mupdf_files()
     "draw-path.c",
     "draw-rasterize.c",
     "draw-scale-simple.c",
+    "draw-simd.c",
     "draw-unpack.c",
     "encode-basic.c",
     "encode-fax.c",
@@ -928,7 +929,9 @@ end
 function engine_dump_files()
   files_in_dir("src", {
     "EngineDump.cpp",
+    "PdfSync.*",
     "SumatraConfig.*",
+    "TextSelection.*",
     "mui/MiniMui.*",
     "mui/TextRender.*"
   })
@@ -592,6 +592,10 @@ workspace "SumatraPDF"
     includedirs { "src", "src/wingui", "mupdf/include" }
     disablewarnings { "4100", "4267", "4457" }
     engine_dump_files()
+    -- for -bench-synctex
+    synctex_files()
+    disablewarnings { "4244", "4702", "4706" }
+    includedirs { "ext/zlib", "ext/synctex" }
     links { "engines", "utils", "unrar", "mupdf", "unarrlib", "libwebp", "libdjvu" }
     links {
       "comctl32", "gdiplus", "msimg32", "shlwapi",
@@ -292,6 +292,7 @@ project "mupdf-opt"
       "draw-path.c",
       "draw-rasterize.c",
       "draw-scale-simple.c",
+      "draw-simd.c",
       "draw-unpack.c",
       "encode-basic.c",
       "encode-fax.c",
@@ -51,6 +51,7 @@ ACCEL gAccelerators[] = {
     {FSHIFT | FVIRTKEY, VK_F3, CmdFindPrev},
     {FCONTROL | FVIRTKEY, VK_F3, CmdFindNextSel},
     {FSHIFT | FCONTROL | FVIRTKEY, VK_F3, CmdFindPrevSel},
+    {FALT | FVIRTKEY, VK_F3, CmdFindAll},
     {FCONTROL | FVIRTKEY, VK_F4, CmdClose},
     {FVIRTKEY, VK_F5, CmdViewPresentationMode},
     {FVIRTKEY, VK_F6, CmdMoveFrameFocus},
@@ -728,7 +728,7 @@ static void DebugShowLinks(DisplayModel* dm, HDC hdc) {
     HPEN pen = CreatePen(PS_SOLID, 1, RGB(0x00, 0xff, 0xff));
     HGDIOBJ oldPen = SelectObject(hdc, pen);
 
-    for (int pageNo = dm->PageCount(); pageNo >= 1; --pageNo) {
+    for (int pageNo = dm->visibleLast; pageNo >= dm->visibleFirst && pageNo >= 1; --pageNo) {
         PageInfo* pageInfo = dm->GetPageInfo(pageNo);
         if (!pageInfo || !pageInfo->shown || 0.0 == pageInfo->visibleRatio) {
             continue;
@@ -760,7 +760,7 @@ static void DebugShowLinks(DisplayModel* dm, HDC hdc) {
         pen = CreatePen(PS_SOLID, 1, RGB(0xff, 0x00, 0xff));
         oldPen = SelectObject(hdc, pen);
 
-        for (int pageNo = dm->PageCount(); pageNo >= 1; --pageNo) {
+        for (int pageNo = dm->visibleLast; pageNo >= dm->visibleFirst && pageNo >= 1; --pageNo) {
             PageInfo* pageInfo = dm->GetPageInfo(pageNo);
             if (!pageInfo->shown || 0.0 == pageInfo->visibleRatio) {
                 continue;
@@ -869,7 +869,7 @@ static void DrawDocument(WindowInfo* win, HDC hdc, RECT* rcArea) {
     bool rendering = false;
     Rect screen(Point(), dm->GetViewPort().Size());
 
-    for (int pageNo = 1; pageNo <= dm->PageCount(); ++pageNo) {
+    for (int pageNo = dm->visibleFirst; pageNo > 0 && pageNo <= dm->visibleLast; ++pageNo) {
         PageInfo* pageInfo = dm->GetPageInfo(pageNo);
         if (!pageInfo || 0.0f == pageInfo->visibleRatio) {
             continue;
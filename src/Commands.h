@@ -53,6 +53,7 @@ Cmd* enum (e.g. CmdOpen) and a human-readable name (not used yet).
     V(CmdFindMatch, "Find: Match Case")                                   \
     V(CmdFindNextSel, "Find: Next Selection")                             \
     V(CmdFindPrevSel, "Find: Previous Selection")                         \
+    V(CmdFindAll, "Find: All")                                            \
     V(CmdSaveAnnotations, "Save Annotations")                             \
     V(CmdEditAnnotations, "Edit Annotations")                             \
     V(CmdZoomFitPage, "Zoom: Fit Page")                                   \
@@ -24,6 +24,9 @@ struct ControllerCallback {
     virtual void RequestRendering(int pageNo) = 0;
     virtual void CleanUp(DisplayModel* dm) = 0;
     virtual void RenderThumbnail(DisplayModel* dm, Size size, const onBitmapRenderedCb&) = 0;
+    // tell the UI that all data of a progressively loaded document has been read
+    // (called on a background thread, see EngineBase::IsLoadingProgressively)
+    virtual void DocumentDataLoaded(DisplayModel* dm) = 0;
     // ChmModel //
     // tell the UI to move focus back to the main window
     // (if always == false, then focus is only moved if it's inside
@@ -46,6 +46,7 @@
 #include "utils/BaseUtil.h"
 #include "utils/WinUtil.h"
 #include "utils/ScopedWin.h"
+#include "utils/ThreadUtil.h"
 #include "utils/Log.h"
 
 #include "wingui/TreeModel.h"
@@ -63,6 +64,8 @@
 #include "ProgressUpdateUI.h"
 #include "TextSelection.h"
 #include "TextSearch.h"
+#include "SumatraPDF.h"
+#include "FileThumbnails.h"
 
 // if true, we pre-render the pages right before and after the visible pages
 static bool gPredictiveRender = true;
@@ -249,15 +252,19 @@ SizeF DisplayModel::PageSizeAfterRotation(int pageNo, bool fitToContent) const {
     if (!pageInfo) {
         return {};
     }
-    if (fitToContent && pageInfo->contentBox.IsEmpty()) {
+    if (!fitToContent) {
+        if (pageInfo->rotatedSize.IsEmpty()) {
+            pageInfo->rotatedSize = engine->Transform(pageInfo->page, pageNo, 1.0, rotation).Size();
+        }
+        return pageInfo->rotatedSize;
+    }
+    if (pageInfo->contentBox.IsEmpty()) {
         pageInfo->contentBox = engine->PageContentBox(pageNo);
         if (pageInfo->contentBox.IsEmpty()) {
             return PageSizeAfterRotation(pageNo);
         }
     }
-
-    RectF box = fitToContent ? pageInfo->contentBox : pageInfo->page;
-    return engine->Transform(box, pageNo, 1.0, rotation).Size();
+    return engine->Transform(pageInfo->contentBox, pageNo, 1.0, rotation).Size();
 }
 
 /* given 'columns' and an absolute 'pageNo', return the number of the first
@@ -291,6 +298,11 @@ static int LastPageInARowNo(int pageNo, int columns, bool showCover, int pageCou
 // must call SetInitialViewSettings() after creation
 DisplayModel::DisplayModel(EngineBase* engine, ControllerCallback* cb) : Controller(cb) {
     this->engine = engine;
+    // (before the page count is first needed, so that an ebook engine
+    // doesn't have to lay out all pages right away)
+    if (engine->IsLoadingProgressively()) {
+        engine->SetProgressiveLoadingCallback([this] { this->cb->DocumentDataLoaded(this); });
+    }
     CrashIf(!engine || engine->PageCount() <= 0);
     engineType = engine->kind;
 
@@ -313,22 +325,56 @@ DisplayModel::DisplayModel(EngineBase* engine, ControllerCallback* cb) : Control
     textCache = new DocumentTextCache(engine);
     textSelection = new TextSelection(engine, textCache);
     textSearch = new TextSearch(engine, textCache);
+    if (ShouldCacheText()) {
+        LoadTextIndex(textCache, engine->FileName());
+    }
+}
+
+// the text of password protected documents (and of documents which
+// don't allow copying their text) is never written to disk
+bool DisplayModel::ShouldCacheText() const {
+    if (!engine->FileName() || engine->IsPasswordProtected() || !engine->AllowsCopyingText()) {
+        return false;
+    }
+    if (!HasPermission(Perm_SavePreferences | Perm_DiskAccess)) {
+        return false;
+    }
+    return gGlobalPrefs->rememberOpenedFiles;
 }
 
 DisplayModel::~DisplayModel() {
     dontRenderFlag = true;
+    if (engine->IsLoadingProgressively()) {
+        engine->SetProgressiveLoadingCallback(nullptr);
+    }
     cb->CleanUp(this);
 
     delete pdfSync;
     delete textSearch;
     delete textSelection;
-    delete textCache;
+    if (ShouldCacheText() && textCache->isDirty) {
+        // writing the index (up to 64 MB) mustn't hold up closing the document,
+        // so the text cache is saved and deleted in the background
+        DocumentTextCache* cache = textCache;
+        cache->engine = nullptr;
+        WCHAR* filePath = str::Dup(engine->FileName());
+        RunAsync([cache, filePath] {
+            SaveTextIndex(cache, filePath);
+            delete cache;
+            free(filePath);
+        });
+    } else {
+        delete textCache;
+    }
     delete engine;
     free(pagesInfo);
+    for (PageInfo* prev : prevPagesInfo) {
+        free(prev);
+    }
 }
 
 PageInfo* DisplayModel::GetPageInfo(int pageNo) const {
-    if (!ValidPageNo(pageNo)) {
+    if (!ValidPageNo(pageNo) || pageNo > pagesInfoCount) {
         return nullptr;
     }
     CrashIf(!pagesInfo);
@@ -375,10 +421,21 @@ void DisplayModel::SetInitialViewSettings(DisplayMode newDisplayMode, int newSta
     BuildPagesInfo();
 }
 
-void DisplayModel::BuildPagesInfo() {
-    CrashIf(pagesInfo);
+// (re)allocates pagesInfo for all pages, keeping the info of the first prevPageCount pages
+void DisplayModel::BuildPagesInfo(int prevPageCount) {
+    CrashIf((pagesInfo != nullptr) != (prevPageCount > 0));
     int pageCount = PageCount();
-    pagesInfo = AllocArray<PageInfo>(pageCount);
+    if (pageCount > pagesInfoCapacity) {
+        // grow geometrically for documents which keep getting more pages
+        int capacity = prevPageCount > 0 ? std::max(pageCount, 2 * pagesInfoCapacity) : pageCount;
+        PageInfo* newPagesInfo = AllocArray<PageInfo>(capacity);
+        if (pagesInfo) {
+            memcpy(newPagesInfo, pagesInfo, prevPageCount * sizeof(PageInfo));
+            prevPagesInfo.Append(pagesInfo);
+        }
+        pagesInfo = newPagesInfo;
+        pagesInfoCapacity = capacity;
+    }
 
     RectF defaultRect;
     float fileDPI = engine->GetFileDPI();
@@ -394,8 +451,8 @@ void DisplayModel::BuildPagesInfo() {
         newStartPage--;
     }
 
-    for (int pageNo = 1; pageNo <= pageCount; pageNo++) {
-        PageInfo* pageInfo = GetPageInfo(pageNo);
+    for (int pageNo = prevPageCount + 1; pageNo <= pageCount; pageNo++) {
+        PageInfo* pageInfo = &pagesInfo[pageNo - 1];
         pageInfo->page = engine->PageMediabox(pageNo);
         // layout pages with an empty mediabox as A4 size (resp. letter size)
         if (pageInfo->page.IsEmpty()) {
@@ -409,6 +466,15 @@ void DisplayModel::BuildPagesInfo() {
             pageInfo->shown = true;
         }
     }
+    // (only now may other threads access the new pages' info)
+    pagesInfoCount = pageCount;
+}
+
+void DisplayModel::FreeSupersededPagesInfo() {
+    for (PageInfo* prev : prevPagesInfo) {
+        free(prev);
+    }
+    prevPagesInfo.Reset();
 }
 
 // TODO: a better name e.g. ShouldShow() to better distinguish between
@@ -540,7 +606,7 @@ int DisplayModel::FirstVisiblePageNo() const {
         return INVALID_PAGE_NO;
     }
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
+    for (int pageNo = visibleFirst; pageNo > 0 && pageNo <= visibleLast; ++pageNo) {
         PageInfo* pageInfo = GetPageInfo(pageNo);
         if (pageInfo->visibleRatio > 0.0) {
             return pageNo;
@@ -566,7 +632,7 @@ int DisplayModel::CurrentPageNo() const {
     int mostVisiblePage = INVALID_PAGE_NO;
     float ratio = 0;
 
-    for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
+    for (int pageNo = visibleFirst; pageNo > 0 && pageNo <= visibleLast; pageNo++) {
         PageInfo* pageInfo = GetPageInfo(pageNo);
         if (pageInfo->visibleRatio > ratio) {
             mostVisiblePage = pageNo;
@@ -661,13 +727,21 @@ void DisplayModel::Relayout(float newZoomVirtual, int newRotation) {
         return;
     }
 
-    rotation = NormalizeRotation(newRotation);
+    newRotation = NormalizeRotation(newRotation);
+    if (newRotation != rotation) {
+        for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
+            GetPageInfo(pageNo)->rotatedSize = SizeF();
+        }
+    }
+    rotation = newRotation;
 
     bool needHScroll = false;
     bool needVScroll = false;
     viewPort = Rect(viewPort.TL(), totalViewPortSize);
 
 RestartLayout:
+    pageRows.Reset();
+    PageRow row;
     int currPosY = windowMargin.top;
     float currZoomReal = zoomReal;
     CalcZoomReal(newZoomVirtual);
@@ -732,6 +806,13 @@ RestartLayout:
 
         pageInfo->pos = pos;
 
+        if (0 == row.firstPageNo) {
+            row.firstPageNo = pageNo;
+            row.top = pos.y;
+        }
+        row.lastPageNo = pageNo;
+        row.bottom = pos.y + rowMaxPageDy;
+
         pageInARow++;
         CrashIf(pageInARow > columns);
         if (pageInARow == columns) {
@@ -739,12 +820,15 @@ RestartLayout:
             currPosY += rowMaxPageDy + pageSpacing.dy;
             rowMaxPageDy = 0;
             pageInARow = 0;
+            pageRows.Append(row);
+            row = PageRow();
         }
     }
 
     if (pageInARow != 0) {
         /* this is a partial row */
         currPosY += rowMaxPageDy + pageSpacing.dy;
+        pageRows.Append(row);
     }
     // restart the layout if we detect we need to show scrollbars
     // (there are some edge cases we can't catch in the above loop)
@@ -845,6 +929,19 @@ RestartLayout:
             }
             pageInfo->pos.y += offY;
         }
+        for (PageRow& r : pageRows) {
+            r.top += offY;
+            r.bottom += offY;
+        }
+    }
+
+    for (size_t i = 0; i < pageRows.size(); i++) {
+        PageRow& r = pageRows.at(i);
+        r.maxBottom = i > 0 ? std::max(pageRows.at(i - 1).maxBottom, r.bottom) : r.bottom;
+    }
+    for (size_t i = pageRows.size(); i > 0; i--) {
+        PageRow& r = pageRows.at(i - 1);
+        r.minTop = i < pageRows.size() ? std::min(pageRows.at(i).minTop, r.top) : r.top;
     }
 
     canvasSize = Size(std::max(canvasDx, viewPort.dx), std::max(canvasDy, viewPort.dy));
@@ -859,6 +956,7 @@ void DisplayModel::ChangeStartPage(int newStartPage) {
     if (IsBookView(GetDisplayMode()) && newStartPage == 1 && columns > 1) {
         newStartPage--;
     }
+    ClearVisibleParts();
     for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
         PageInfo* pageInfo = GetPageInfo(pageNo);
         if (IsContinuous(GetDisplayMode())) {
@@ -869,11 +967,26 @@ void DisplayModel::ChangeStartPage(int newStartPage) {
         } else {
             pageInfo->shown = false;
         }
-        pageInfo->visibleRatio = 0.0;
     }
     Relayout(zoomVirtual, rotation);
 }
 
+// returns the first row which ends below y (or pageRows.size() if there's none)
+static size_t FirstRowEndingAfter(const Vec<PageRow>& rows, int y) {
+    const PageRow* first = rows.begin();
+    const PageRow* it = std::partition_point(first, rows.end(), [y](const PageRow& row) { return row.maxBottom <= y; });
+    return it - first;
+}
+
+// only pages between visibleFirst and visibleLast can have a visibleRatio != 0
+void DisplayModel::ClearVisibleParts() {
+    for (int pageNo = visibleFirst; pageNo > 0 && pageNo <= visibleLast; ++pageNo) {
+        GetPageInfo(pageNo)->visibleRatio = 0.0;
+    }
+    visibleFirst = 0;
+    visibleLast = 0;
+}
+
 /* Given positions of each page in a large sheet that is continuous view and
    coordinates of a current view into that large sheet, calculate which
    parts of each page is visible on the screen.
@@ -884,24 +997,36 @@ void DisplayModel::RecalcVisibleParts() {
         return;
     }
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
-        PageInfo* pageInfo = GetPageInfo(pageNo);
-        if (!pageInfo->shown) {
-            CrashIf(0.0 != pageInfo->visibleRatio);
-            continue;
+    ClearVisibleParts();
+    // only look at the rows overlapping the view port (see PageRow)
+    for (size_t i = FirstRowEndingAfter(pageRows, viewPort.y); i < pageRows.size(); i++) {
+        PageRow& row = pageRows.at(i);
+        if (row.minTop >= viewPort.y + viewPort.dy) {
+            break;
         }
+        for (int pageNo = row.firstPageNo; pageNo <= row.lastPageNo; ++pageNo) {
+            PageInfo* pageInfo = GetPageInfo(pageNo);
+            if (!pageInfo->shown) {
+                CrashIf(0.0 != pageInfo->visibleRatio);
+                continue;
+            }
 
-        Rect pageRect = pageInfo->pos;
-        Rect visiblePart = pageRect.Intersect(viewPort);
+            Rect pageRect = pageInfo->pos;
+            Rect visiblePart = pageRect.Intersect(viewPort);
 
-        pageInfo->visibleRatio = 0.0;
-        if (!visiblePart.IsEmpty()) {
-            CrashIf(pageRect.dx <= 0 || pageRect.dy <= 0);
-            // calculate with floating point precision to prevent an integer overflow
-            pageInfo->visibleRatio = 1.0f * visiblePart.dx * visiblePart.dy / ((float)pageRect.dx * pageRect.dy);
+            pageInfo->visibleRatio = 0.0;
+            if (!visiblePart.IsEmpty()) {
+                CrashIf(pageRect.dx <= 0 || pageRect.dy <= 0);
+                // calculate with floating point precision to prevent an integer overflow
+                pageInfo->visibleRatio = 1.0f * visiblePart.dx * visiblePart.dy / ((float)pageRect.dx * pageRect.dy);
+            }
+            pageInfo->pageOnScreen = pageRect;
+            pageInfo->pageOnScreen.Offset(-viewPort.x, -viewPort.y);
+        }
+        if (0 == visibleFirst) {
+            visibleFirst = row.firstPageNo;
         }
-        pageInfo->pageOnScreen = pageRect;
-        pageInfo->pageOnScreen.Offset(-viewPort.x, -viewPort.y);
+        visibleLast = row.lastPageNo;
     }
 }
 
@@ -911,15 +1036,22 @@ int DisplayModel::GetPageNoByPoint(Point pt) {
         return -1;
     }
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
-        PageInfo* pageInfo = GetPageInfo(pageNo);
-        CrashIf(!(0.0 == pageInfo->visibleRatio || pageInfo->shown));
-        if (!pageInfo->shown) {
-            continue;
+    int y = pt.y + viewPort.y;
+    for (size_t i = FirstRowEndingAfter(pageRows, y - 1); i < pageRows.size(); i++) {
+        PageRow& row = pageRows.at(i);
+        if (row.minTop > y) {
+            break;
         }
+        for (int pageNo = row.firstPageNo; pageNo <= row.lastPageNo; ++pageNo) {
+            PageInfo* pageInfo = GetPageInfo(pageNo);
+            CrashIf(!(0.0 == pageInfo->visibleRatio || pageInfo->shown));
+            if (!pageInfo->shown) {
+                continue;
+            }
 
-        if (pageInfo->pageOnScreen.Contains(pt)) {
-            return pageNo;
+            if (PageOnScreen(pageNo).Contains(pt)) {
+                return pageNo;
+            }
         }
     }
 
@@ -931,31 +1063,62 @@ int DisplayModel::GetPageNextToPoint(Point pt) {
         return startPage;
     }
 
-    unsigned int maxDist = UINT_MAX;
-    int closest = startPage;
+    int pageNo = GetPageNoByPoint(pt);
+    if (pageNo > 0) {
+        return pageNo;
+    }
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
-        PageInfo* pageInfo = GetPageInfo(pageNo);
-        CrashIf(0.0 != pageInfo->visibleRatio && !pageInfo->shown);
-        if (!pageInfo->shown) {
-            continue;
+    // search outwards from the point's row and stop as soon as no closer
+    // page center can be found in the remaining rows (see PageRow)
+    i64 maxDist = INT64_MAX;
+    int closest = startPage;
+    auto checkRow = [&](PageRow& row) {
+        for (int no = row.firstPageNo; no <= row.lastPageNo; ++no) {
+            PageInfo* pageInfo = GetPageInfo(no);
+            CrashIf(0.0 != pageInfo->visibleRatio && !pageInfo->shown);
+            if (!pageInfo->shown) {
+                continue;
+            }
+            Rect r = PageOnScreen(no);
+            i64 dx = pt.x - r.x - r.dx / 2;
+            i64 dy = pt.y - r.y - r.dy / 2;
+            i64 dist = dx * dx + dy * dy;
+            if (dist < maxDist || (dist == maxDist && no < closest)) {
+                closest = no;
+                maxDist = dist;
+            }
         }
+    };
 
-        if (pageInfo->pageOnScreen.Contains(pt)) {
-            return pageNo;
+    int y = pt.y + viewPort.y;
+    PageRow* first = pageRows.begin();
+    PageRow* it = std::partition_point(first, pageRows.end(), [y](const PageRow& row) { return row.minTop <= y; });
+    size_t split = it - first;
+    for (size_t i = split; i < pageRows.size(); i++) {
+        i64 minDy = (i64)pageRows.at(i).minTop - y;
+        if (minDy * minDy > maxDist) {
+            break;
         }
-
-        Rect r = pageInfo->pageOnScreen;
-        unsigned int dist = distSq(pt.x - r.x - r.dx / 2, pt.y - r.y - r.dy / 2);
-        if (dist < maxDist) {
-            closest = pageNo;
-            maxDist = dist;
+        checkRow(pageRows.at(i));
+    }
+    for (size_t i = split; i > 0; i--) {
+        i64 minDy = std::max((i64)y - pageRows.at(i - 1).maxBottom, (i64)0);
+        if (minDy * minDy > maxDist) {
+            break;
         }
+        checkRow(pageRows.at(i - 1));
     }
 
     return closest;
 }
 
+// pageInfo->pageOnScreen is only up-to-date for pages around the view port
+Rect DisplayModel::PageOnScreen(int pageNo) const {
+    Rect r = GetPageInfo(pageNo)->pos;
+    r.Offset(-viewPort.x, -viewPort.y);
+    return r;
+}
+
 Point DisplayModel::CvtToScreen(int pageNo, PointF pt) {
     PageInfo* pageInfo = GetPageInfo(pageNo);
     SubmitCrashIf(!pageInfo);
@@ -970,7 +1133,7 @@ Point DisplayModel::CvtToScreen(int pageNo, PointF pt) {
     }
     PointF p = engine->Transform(pt, pageNo, zoom, rotation);
     // don't add the full 0.5 for rounding to account for precision errors
-    Rect r = pageInfo->pageOnScreen;
+    Rect r = PageOnScreen(pageNo);
     p.x += 0.499 + r.x;
     p.y += 0.499 + r.y;
 
@@ -995,7 +1158,7 @@ PointF DisplayModel::CvtFromScreen(Point pt, int pageNo) {
     }
 
     // don't add the full 0.5 for rounding to account for precision errors
-    Rect r = pageInfo->pageOnScreen;
+    Rect r = PageOnScreen(pageNo);
     PointF p = PointF(pt.x - 0.499 - r.x, pt.y - 0.499 - r.y);
     float zoom = pageInfo->zoomReal;
     // TODO: must be a better way
@@ -1067,7 +1230,7 @@ void DisplayModel::RenderVisibleParts() {
     int firstVisiblePage = 0;
     int lastVisiblePage = 0;
 
-    for (int pageNo = 1; pageNo <= PageCount(); ++pageNo) {
+    for (int pageNo = visibleFirst; pageNo > 0 && pageNo <= visibleLast; ++pageNo) {
         PageInfo* pageInfo = GetPageInfo(pageNo);
         if (pageInfo->visibleRatio > 0.0) {
             CrashIf(!pageInfo->shown);
@@ -1195,9 +1358,9 @@ void DisplayModel::GoToPage(int pageNo, int scrollY, bool addNavPt, int scrollX)
     } else if (ZOOM_FIT_CONTENT == zoomVirtual) {
         // make sure that CalcZoomReal uses the correct page to calculate
         // the zoom level for (visibility will be recalculated below anyway)
-        for (int i = PageCount(); i > 0; i--) {
-            GetPageInfo(i)->visibleRatio = (i == pageNo ? 1.0f : 0);
-        }
+        ClearVisibleParts();
+        GetPageInfo(pageNo)->visibleRatio = 1.0f;
+        visibleFirst = visibleLast = pageNo;
         Relayout(zoomVirtual, rotation);
     }
     // lf("DisplayModel::GoToPage(pageNo=%d, scrollY=%d)", pageNo, scrollY);
@@ -1279,10 +1442,10 @@ void DisplayModel::SetDisplayMode(DisplayMode newDisplayMode, bool keepContinuou
         /* mark all pages as shown but not yet visible. The equivalent code
            for non-continuous mode is in DisplayModel::changeStartPage() called
            from DisplayModel::GoToPage() */
+        ClearVisibleParts();
         for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
             PageInfo* pageInfo = &(pagesInfo[pageNo - 1]);
             pageInfo->shown = true;
-            pageInfo->visibleRatio = 0.0;
         }
         Relayout(zoomVirtual, rotation);
     }
@@ -1350,10 +1513,10 @@ bool DisplayModel::GoToPrevPage(int scrollY) {
         top = GetContentStart(currPageNo);
     }
 
-    PageInfo* pageInfo = GetPageInfo(currPageNo);
-    if (zoomVirtual == ZOOM_FIT_CONTENT && -pageInfo->pageOnScreen.y <= top.y) {
+    Rect pageOnScreen = PageOnScreen(currPageNo);
+    if (zoomVirtual == ZOOM_FIT_CONTENT && -pageOnScreen.y <= top.y) {
         scrollY = 0; // continue, even though the current page isn't fully visible
-    } else if (std::max(-pageInfo->pageOnScreen.y, 0) > scrollY && IsContinuous(GetDisplayMode())) {
+    } else if (std::max(-pageOnScreen.y, 0) > scrollY && IsContinuous(GetDisplayMode())) {
         /* the current page isn't fully visible, so show it first */
         GoToPage(currPageNo, scrollY);
         return true;
@@ -1366,7 +1529,7 @@ bool DisplayModel::GoToPrevPage(int scrollY) {
 
     // scroll to the bottom of the page
     if (-1 == scrollY) {
-        scrollY = GetPageInfo(firstPageInNewRow)->pageOnScreen.dy;
+        scrollY = PageOnScreen(firstPageInNewRow).dy;
     }
 
     GoToPage(firstPageInNewRow, scrollY);
@@ -1621,6 +1784,35 @@ float DisplayModel::GetNextZoomStep(float towardsLevel) const {
     return newZoom;
 }
 
+// called once all data of a progressively loaded document has been read (resp. whenever
+// more pages of an ebook have been laid out), returns true if page sizes have changed
+// from what they had been estimated
+bool DisplayModel::FinishProgressiveLoading() {
+    int prevPageCount = PageCount();
+    bool sizesChanged = engine->FinishProgressiveLoading();
+    if (!sizesChanged && PageCount() == prevPageCount) {
+        return false;
+    }
+
+    ScrollState ss = GetScrollState();
+    if (PageCount() > prevPageCount) {
+        BuildPagesInfo(prevPageCount);
+        textCache->UpdatePageCount();
+    }
+    for (int pageNo = 1; sizesChanged && pageNo <= PageCount(); pageNo++) {
+        PageInfo* pageInfo = GetPageInfo(pageNo);
+        RectF mediabox = engine->PageMediabox(pageNo);
+        if (!mediabox.IsEmpty()) {
+            pageInfo->page = mediabox;
+        }
+        pageInfo->rotatedSize = SizeF();
+        pageInfo->contentBox = RectF();
+    }
+    Relayout(zoomVirtual, rotation);
+    SetScrollState(ss);
+    return sizesChanged;
+}
+
 void DisplayModel::RotateBy(int newRotation) {
     newRotation = NormalizeRotation(newRotation);
     CrashIf(0 == newRotation);
@@ -1643,18 +1835,36 @@ WCHAR* DisplayModel::GetTextInRegion(int pageNo, RectF region) {
         return nullptr;
     }
 
-    str::WStr result;
+    const GlyphIndex* index = textCache->GetGlyphIndex(pageNo);
+    if (!index) {
+        return nullptr;
+    }
+
+    // only look at the glyphs overlapping the region (in text order)
     Rect regionI = region.Round();
-    for (const WCHAR* src = pageText; *src; src++) {
-        if (*src != '\n') {
-            Rect rect = coords[src - pageText];
-            Rect isect = regionI.Intersect(rect);
-            if (!isect.IsEmpty() && 1.0 * isect.dx * isect.dy / (rect.dx * rect.dy) >= 0.3) {
-                result.Append(*src);
-            }
-        } else if (result.size() > 0 && result.Last() != '\n') {
+    Vec<int> candidates;
+    index->FindInRect(regionI, candidates);
+
+    str::WStr result;
+    int prev = -1;
+    for (int glyph : candidates) {
+        if (pageText[glyph] == '\n') {
+            continue;
+        }
+        Rect rect = coords[glyph];
+        Rect isect = regionI.Intersect(rect);
+        if (isect.IsEmpty() || 1.0 * isect.dx * isect.dy / (rect.dx * rect.dy) < 0.3) {
+            continue;
+        }
+        // line breaks between the selected glyphs
+        if (prev != -1 && wmemchr(pageText + prev + 1, '\n', glyph - prev - 1)) {
             result.Append(L"\r\n", 2);
         }
+        result.Append(pageText[glyph]);
+        prev = glyph;
+    }
+    if (prev != -1 && str::FindChar(pageText + prev + 1, '\n')) {
+        result.Append(L"\r\n", 2);
     }
 
     return result.StealData();
@@ -1677,7 +1887,6 @@ bool DisplayModel::ShowResultRectToScreen(TextSel* res) {
         return false;
     }
 
-    PageInfo* pageInfo = GetPageInfo(res->pages[0]);
     int sx = 0, sy = 0;
 
     // vertically, we try to position the search result between 40%
@@ -1694,11 +1903,11 @@ bool DisplayModel::ShowResultRectToScreen(TextSel* res) {
     // horizontally, we try to position the search result at the
     // center of the screen, but don't scroll further than page
     // boundaries, so that as much context as possible remains visible
+    Rect pageOnScreen = PageOnScreen(res->pages[0]);
     if (extremes.x < 0) {
-        sx = std::max(extremes.x + extremes.dx / 2 - viewPort.dx / 2, pageInfo->pageOnScreen.x);
+        sx = std::max(extremes.x + extremes.dx / 2 - viewPort.dx / 2, pageOnScreen.x);
     } else if (extremes.x + extremes.dx >= viewPort.dx) {
-        sx = std::min(extremes.x + extremes.dx / 2 - viewPort.dx / 2,
-                      pageInfo->pageOnScreen.x + pageInfo->pageOnScreen.dx - viewPort.dx);
+        sx = std::min(extremes.x + extremes.dx / 2 - viewPort.dx / 2, pageOnScreen.x + pageOnScreen.dx - viewPort.dx);
     }
 
     if (sx != 0) {
@@ -1717,23 +1926,26 @@ ScrollState DisplayModel::GetScrollState() {
         state.page = CurrentPageNo();
     }
 
-    PageInfo* pageInfo = GetPageInfo(state.page);
     // Shortcut: don't calculate precise positions, if the
     // page wasn't scrolled right/down at all
-    if (!pageInfo || pageInfo->pageOnScreen.x > 0 && pageInfo->pageOnScreen.y > 0) {
+    if (!GetPageInfo(state.page)) {
+        return state;
+    }
+    Rect pageOnScreen = PageOnScreen(state.page);
+    if (pageOnScreen.x > 0 && pageOnScreen.y > 0) {
         return state;
     }
 
     Rect screen(Point(), viewPort.Size());
-    Rect pageVis = pageInfo->pageOnScreen.Intersect(screen);
+    Rect pageVis = pageOnScreen.Intersect(screen);
     state.page = GetPageNextToPoint(pageVis.TL());
     PointF ptD = CvtFromScreen(pageVis.TL(), state.page);
 
     // Remember to show the margin, if it's currently visible
-    if (pageInfo->pageOnScreen.x <= 0) {
+    if (pageOnScreen.x <= 0) {
         state.x = ptD.x;
     }
-    if (pageInfo->pageOnScreen.y <= 0) {
+    if (pageOnScreen.y <= 0) {
         state.y = ptD.y;
     }
 
@@ -1826,6 +2038,36 @@ void DisplayModel::CopyNavHistory(DisplayModel& orig) {
     }
 }
 
+// after a reload, takes over the content boxes and the extracted text of all pages
+// which haven't changed (cf. MatchUnchangedPages), so that only changed pages have
+// to be processed again; returns the number of unchanged pages
+int DisplayModel::CopyUnchangedPages(DisplayModel& orig, Vec<int>& origPageNos) {
+    int nUnchanged = MatchUnchangedPages(orig.engine, engine, origPageNos);
+    if (nUnchanged == 0) {
+        return 0;
+    }
+    for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
+        int origPageNo = origPageNos.at(pageNo - 1);
+        if (origPageNo == 0) {
+            continue;
+        }
+        GetPageInfo(pageNo)->contentBox = orig.GetPageInfo(origPageNo)->contentBox;
+        if (!orig.textCache->HasTextForPage(origPageNo) || textCache->HasTextForPage(pageNo)) {
+            continue;
+        }
+        PageText text;
+        Rect* coords = nullptr;
+        const WCHAR* s = orig.textCache->GetTextForPage(origPageNo, &text.len, &coords);
+        text.text = str::DupN(s, text.len);
+        if (coords) {
+            text.coords = (Rect*)memdup(coords, text.len * sizeof(Rect));
+        }
+        textCache->AddTextForPage(pageNo, text);
+    }
+    logf("DisplayModel::CopyUnchangedPages: %d of %d pages unchanged\n", nUnchanged, PageCount());
+    return nUnchanged;
+}
+
 bool DisplayModel::ShouldCacheRendering(int pageNo) {
     // recommend caching for all documents which are non-trivial to render
     if (!engine->IsImageCollection()) {
@@ -1836,7 +2078,8 @@ bool DisplayModel::ShouldCacheRendering(int pageNo) {
     // them for every UI update (WM_PAINT) can cause notable lags, and also
     // for smaller images which are scaled up
     PageInfo* info = GetPageInfo(pageNo);
-    return info->page.dx * info->page.dy > 1024 * 1024 || info->pageOnScreen.dx * info->pageOnScreen.dy > 1024 * 1024;
+    Rect pageOnScreen = PageOnScreen(pageNo);
+    return info->page.dx * info->page.dy > 1024 * 1024 || pageOnScreen.dx * pageOnScreen.dy > 1024 * 1024;
 }
 
 void DisplayModel::ScrollToLink(PageDestination* dest) {
@@ -1860,8 +2103,7 @@ void DisplayModel::ScrollToLink(PageDestination* dest) {
             scroll.x = -1;
         }
         if (DEST_USE_DEFAULT == rect.y) {
-            PageInfo* pageInfo = GetPageInfo(CurrentPageNo());
-            scroll.y = -(pageInfo->pageOnScreen.y - windowMargin.top);
+            scroll.y = -(PageOnScreen(CurrentPageNo()).y - windowMargin.top);
         }
     } else if (rect.dx != DEST_USE_DEFAULT && rect.dy != DEST_USE_DEFAULT) {
         // PDF: /FitR left bottom right top
@@ -11,6 +11,9 @@ struct PageInfo {
 
     /* data that is calculated when needed. actual content size within a page (View target) */
     RectF contentBox{};
+    /* data that is calculated when needed (and reset when rotation changes).
+       page size after applying rotation, needed for every page in DisplayModel::Relayout() */
+    SizeF rotatedSize{};
 
     /* data that needs to be set before DisplayModel::Relayout().
        Determines whether a given page should be shown on the screen. */
@@ -24,7 +27,9 @@ struct PageInfo {
 
     /* data that changes due to scrolling. Calculated in DisplayModel::RecalcVisibleParts() */
     float visibleRatio; /* (0.0 = invisible, 1.0 = fully visible) */
-    /* position of page relative to visible view port: pos.Offset(-viewPort.x, -viewPort.y) */
+    /* position of page relative to visible view port: pos.Offset(-viewPort.x, -viewPort.y)
+       only kept up to date for the pages around the view port, use DisplayModel::PageOnScreen()
+       for pages that might not be visible */
     Rect pageOnScreen{};
 
     // when zoomVirtual in DisplayMode is ZOOM_FIT_PAGE, ZOOM_FIT_WIDTH
@@ -44,6 +49,20 @@ struct ScrollState {
     double y = 0;
 };
 
+/* A row of shown pages in the layout (one page per row in single page modes) */
+struct PageRow {
+    int firstPageNo = 0;
+    int lastPageNo = 0;
+    /* vertical extent of the row's pages on the canvas */
+    int top = 0;
+    int bottom = 0;
+    /* largest bottom of this and all previous rows resp. smallest top of this
+       and all following rows, so that the rows overlapping a given range can
+       be binary searched (even if pages overlap due to negative page spacing) */
+    int maxBottom = 0;
+    int minTop = 0;
+};
+
 struct DocumentTextCache;
 struct TextSelection;
 class TextSearch;
@@ -124,6 +143,8 @@ struct DisplayModel : public Controller {
     TextSelection* textSelection{nullptr};
     // access only from Search thread
     TextSearch* textSearch{nullptr};
+    // whether extracted text is persisted next to the thumbnails
+    bool ShouldCacheText() const;
 
     PageInfo* GetPageInfo(int pageNo) const;
 
@@ -154,6 +175,9 @@ struct DisplayModel : public Controller {
        (i.e. 100.0 is original size) or one of virtual values ZOOM_FIT_PAGE,
        ZOOM_FIT_WIDTH or ZOOM_FIT_CONTENT, whose real value depends on draw area size */
     void RotateBy(int rotation);
+    bool FinishProgressiveLoading();
+    // to be called once no rendering thread can still use this (see BuildPagesInfo)
+    void FreeSupersededPagesInfo();
 
     WCHAR* GetTextInRegion(int pageNo, RectF region);
     bool IsOverText(Point pt);
@@ -161,6 +185,7 @@ struct DisplayModel : public Controller {
     Annotation* GetAnnotationAtPos(Point pt, AnnotationType* allowedAnnots);
 
     int GetPageNoByPoint(Point pt);
+    Rect PageOnScreen(int pageNo) const;
     Point CvtToScreen(int pageNo, PointF pt);
     Rect CvtToScreen(int pageNo, RectF r);
     PointF CvtFromScreen(Point pt, int pageNo = INVALID_PAGE_NO);
@@ -172,6 +197,7 @@ struct DisplayModel : public Controller {
     void SetScrollState(ScrollState state);
 
     void CopyNavHistory(DisplayModel& orig);
+    int CopyUnchangedPages(DisplayModel& orig, Vec<int>& origPageNos);
 
     void SetInitialViewSettings(DisplayMode displayMode, int newStartPage, Size viewPort, int screenDPI);
     void SetDisplayR2L(bool r2l);
@@ -186,12 +212,13 @@ struct DisplayModel : public Controller {
 
     bool GetPresentationMode() const;
 
-    void BuildPagesInfo();
+    void BuildPagesInfo(int prevPageCount = 0);
     float ZoomRealFromVirtualForPage(float zoomVirtual, int pageNo) const;
     SizeF PageSizeAfterRotation(int pageNo, bool fitToContent = false) const;
     void ChangeStartPage(int startPage);
     Point GetContentStart(int pageNo);
     void RecalcVisibleParts();
+    void ClearVisibleParts();
     void RenderVisibleParts();
     void AddNavPoint();
     RectF GetContentBox(int pageNo);
@@ -204,6 +231,21 @@ struct DisplayModel : public Controller {
 
     /* an array of PageInfo, len of array is pageCount */
     PageInfo* pagesInfo{nullptr};
+    /* number of initialized entries of pagesInfo (lags behind PageCount() while
+       more pages are being added) and number of allocated entries */
+    int pagesInfoCount{0};
+    int pagesInfoCapacity{0};
+    /* arrays replaced by BuildPagesInfo for documents which keep getting more pages
+       (e.g. ebooks laid out in the background), as other threads might still use them.
+       as the capacity doubles, these take up less memory than pagesInfo */
+    Vec<PageInfo*> prevPagesInfo;
+    /* rows of shown pages from top to bottom, as laid out by Relayout(). Used for
+       finding the pages at a given position without looking at all of them */
+    Vec<PageRow> pageRows;
+    /* all pages with a non-zero visibleRatio are between visibleFirst and
+       visibleLast (both are 0 if no page is visible) */
+    int visibleFirst{0};
+    int visibleLast{0};
 
     DisplayMode displayMode{DisplayMode::Automatic};
     /* In non-continuous mode is the first page from a file that we're
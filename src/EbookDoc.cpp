@@ -3,6 +3,7 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/Archive.h"
+#include "utils/Dict.h"
 #include "utils/FileUtil.h"
 #include "utils/GuessFileType.h"
 #include "utils/GdiPlusUtil.h"
@@ -264,6 +265,63 @@ WCHAR* PropertyMap::Get(DocumentProperty prop) const {
     return nullptr;
 }
 
+EbookImages::EbookImages() {
+    // long-lived (one per document), so start small
+    urlToIdx = new dict::MapStrToInt(64);
+}
+
+EbookImages::~EbookImages() {
+    for (ImageData2* img : images) {
+        free(img->base.data);
+        free(img->fileName);
+        delete img;
+    }
+    delete urlToIdx;
+}
+
+ImageData2* EbookImages::Add(char* url, std::span<u8> data, size_t fileId) {
+    if (data.empty()) {
+        free(data.data());
+        data = {};
+    }
+    int idx = (int)images.size();
+    int existingIdx = -1;
+    if (!urlToIdx->Insert(url, idx, &existingIdx)) {
+        ImageData2* img = images.at(existingIdx);
+        free(url);
+        if (!img->base.data && !data.empty()) {
+            img->base.data = (char*)data.data();
+            img->base.len = data.size();
+        } else {
+            free(data.data());
+        }
+        return img;
+    }
+    ImageData2* img = new ImageData2();
+    img->base.data = (char*)data.data();
+    img->base.len = data.size();
+    img->fileName = url;
+    img->fileId = fileId;
+    images.Append(img);
+    return img;
+}
+
+ImageData2* EbookImages::Find(const char* url) {
+    int idx = -1;
+    if (!url || !urlToIdx->Get(url, &idx)) {
+        return nullptr;
+    }
+    return images.at(idx);
+}
+
+size_t EbookImages::size() const {
+    return images.size();
+}
+
+ImageData2* EbookImages::at(size_t idx) const {
+    return images.at(idx);
+}
+
 /* ********** EPUB ********** */
 
 const char* EPUB_CONTAINER_NS = "urn:oasis:names:tc:opendocument:xmlns:container";
@@ -285,9 +343,13 @@ EpubDoc::EpubDoc(IStream* stream) {
 EpubDoc::~EpubDoc() {
     EnterCriticalSection(&zipAccess);
 
-    for (size_t i = 0; i < images.size(); i++) {
-        free(images.at(i).base.data);
-        free(images.at(i).fileName);
+    for (EpubChapter& chapter : chapters) {
+        free(chapter.path);
+    }
+    if (isHtmlDataReserved) {
+        VirtualFree(htmlData, 0, MEM_RELEASE);
+    } else {
+        free(htmlData);
     }
 
     LeaveCriticalSection(&zipAccess);
@@ -397,11 +459,8 @@ bool EpubDoc::Load() {
                 continue;
             }
             // load the image lazily
-            ImageData2 data = {0};
-            auto tmp = strconv::WstrToUtf8(imgPath);
-            data.fileName = (char*)tmp.data();
-            data.fileId = zip->GetFileId(data.fileName);
-            images.Append(data);
+            char* url = (char*)strconv::WstrToUtf8(imgPath).data();
+            images.Add(url, {}, zip->GetFileId(url));
         } else if (isHtmlMediaType(mediatype)) {
             AutoFreeWstr htmlPath(node->GetAttribute("href"));
             if (!htmlPath) {
@@ -453,25 +512,113 @@ bool EpubDoc::Load() {
 
         const WCHAR* fileName = pathList.at(idList.Find(idref));
         AutoFreeWstr fullPath = str::Join(contentPath, fileName);
-        AutoFree html = zip->GetFileDataByName(fullPath);
-        if (!html.data) {
+        EpubChapter chapter;
+        chapter.path = (char*)strconv::WstrToUtf8(fullPath).data();
+        chapter.fileId = zip->GetFileId(chapter.path);
+        if (chapter.fileId == (size_t)-1) {
+            free(chapter.path);
             continue;
         }
-        char* decoded = DecodeTextToUtf8(html.data, true);
-        html.TakeOwnershipOf(decoded);
-        if (!html.data) {
-            continue;
+        // converting to UTF-8 at most triples the size (plus the page marker, see LoadChapterHtml)
+        size_t size = zip->GetFileInfos().at(chapter.fileId)->fileSizeUncompressed;
+        chapter.maxSize = 3 * size + str::Len(chapter.path) + 64;
+        chapters.Append(chapter);
+    }
+
+    // the first chapters are needed for the first page anyway
+    if (!ReserveHtmlData()) {
+        // load all chapters at once instead
+        str::Str html;
+        for (int i = 0; i < chapters.isize(); i++) {
+            html.AppendAndFree(LoadChapterHtml(i));
         }
-        // insert explicit page-breaks between sections including
-        // an anchor with the file name at the top (for internal links)
-        AutoFree utf8_path = strconv::WstrToUtf8(fullPath);
-        DebugCrashIf(str::FindChar(utf8_path.Get(), '"'));
-        str::TransChars(utf8_path.Get(), "\"", "'");
-        htmlData.AppendFmt("<pagebreak page_path=\"%s\" page_marker />", utf8_path.Get());
-        htmlData.Append(html.data);
+        htmlDataSize = html.size();
+        htmlData = html.StealData();
+        chaptersLoaded = chapters.isize();
+        return htmlDataSize > 0;
     }
+    return LoadChapters(0).size() > 0;
+}
 
-    return htmlData.size() > 0;
+// returns the html of a chapter converted to UTF-8 (or nullptr on failure)
+char* EpubDoc::LoadChapterHtml(int chapterNo) {
+    EpubChapter& chapter = chapters.at(chapterNo);
+    AutoFree html = zip->GetFileDataById(chapter.fileId);
+    if (!html.data) {
+        return nullptr;
+    }
+    AutoFree decoded = DecodeTextToUtf8(html.data, true);
+    if (!decoded.data) {
+        return nullptr;
+    }
+    // insert explicit page-breaks between sections including
+    // an anchor with the file name at the top (for internal links)
+    AutoFree utf8_path = str::Dup(chapter.path);
+    DebugCrashIf(str::FindChar(utf8_path.Get(), '"'));
+    str::TransChars(utf8_path.Get(), "\"", "'");
+    return str::Format("<pagebreak page_path=\"%s\" page_marker />%s", utf8_path.Get(), decoded.Get());
+}
+
+// reserves (but doesn't commit) enough memory for the html of all chapters
+bool EpubDoc::ReserveHtmlData() {
+    size_t size = 1;
+    for (EpubChapter& chapter : chapters) {
+        if (addOverflows<size_t>(size, chapter.maxSize)) {
+            return false;
+        }
+        size += chapter.maxSize;
+    }
+    htmlData = (char*)VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_READWRITE);
+    if (!htmlData) {
+        return false;
+    }
+    htmlDataReserved = size;
+    isHtmlDataReserved = true;
+    return true;
+}
+
+bool EpubDoc::AppendHtmlData(const char* html, size_t len) {
+    CrashIf(!isHtmlDataReserved);
+    // + 1 for the terminating zero
+    size_t needed = htmlDataSize + len + 1;
+    if (needed > htmlDataReserved) {
+        return false;
+    }
+    if (needed > htmlDataCommitted) {
+        // commit in steps of 1 MB
+        size_t toCommit = std::min(RoundUp(needed, 1024 * 1024), htmlDataReserved);
+        if (!VirtualAlloc(htmlData, toCommit, MEM_COMMIT, PAGE_READWRITE)) {
+            return false;
+        }
+        htmlDataCommitted = toCommit;
+    }
+    memcpy(htmlData + htmlDataSize, html, len);
+    htmlDataSize += len;
+    htmlData[htmlDataSize] = '\0';
+    return true;
+}
+
+std::span<u8> EpubDoc::LoadChapters(size_t htmlOffset, size_t* nextLoadAt) {
+    ScopedCritSec scope(&zipAccess);
+
+    // also load the next chapter, so that a tag at the end of a chapter
+    // is parsed the same way as when all chapters are loaded
+    while (chaptersLoaded < chapters.isize() && (0 == htmlDataSize || lastChapterStart <= htmlOffset)) {
+        size_t chapterStart = htmlDataSize;
+        AutoFree html = LoadChapterHtml(chaptersLoaded);
+        chaptersLoaded++;
+        if (html.data && AppendHtmlData(html.data, str::Len(html.data))) {
+            lastChapterStart = chapterStart;
+        }
+    }
+    if (nextLoadAt) {
+        *nextLoadAt = chaptersLoaded < chapters.isize() ? lastChapterStart : (size_t)-1;
+    }
+    return {(u8*)htmlData, htmlDataSize};
+}
+
+int EpubDoc::GetChapterCount() const {
+    return chapters.isize();
 }
 
 void EpubDoc::ParseMetadata(const char* content) {
@@ -515,8 +662,19 @@ void EpubDoc::ParseMetadata(const char* content) {
     }
 }
 
-std::span<u8> EpubDoc::GetHtmlData() const {
-    return htmlData.AsSpan();
+std::span<u8> EpubDoc::GetHtmlData() {
+    LoadChapters((size_t)-1);
+    return {(u8*)htmlData, htmlDataSize};
+}
+
+// images registered in the manifest are only inflated when they're first drawn
+static bool LoadEpubImage(MultiFormatArchive* zip, ImageData2* img) {
+    if (!img->base.data) {
+        auto res = zip->GetFileDataById(img->fileId);
+        img->base.len = res.size();
+        img->base.data = (char*)res.data();
+    }
+    return img->base.data != nullptr;
 }
 
 ImageData* EpubDoc::GetImageData(const char* fileName, const char* pagePath) {
@@ -532,16 +690,9 @@ ImageData* EpubDoc::GetImageData(const char* fileName, const char* pagePath) {
         // format specific state such as hiddenDepth and titleCount) and store it
         // in every HtmlPage, but this should work well enough for now
         for (size_t i = 0; i < images.size(); i++) {
-            ImageData2* img = &images.at(i);
-            if (str::EndsWithI(img->fileName, fileName)) {
-                if (!img->base.data) {
-                    auto res = zip->GetFileDataById(img->fileId);
-                    img->base.len = res.size();
-                    img->base.data = (char*)res.data();
-                }
-                if (img->base.data) {
-                    return &img->base;
-                }
+            ImageData2* img = images.at(i);
+            if (str::EndsWithI(img->fileName, fileName) && LoadEpubImage(zip, img)) {
+                return &img->base;
             }
         }
         return nullptr;
@@ -552,31 +703,17 @@ ImageData* EpubDoc::GetImageData(const char* fileName, const char* pagePath) {
     if (str::FindChar(url, '\\')) {
         str::TransChars(url, "\\", "/");
     }
-    for (size_t i = 0; i < images.size(); i++) {
-        ImageData2* img = &images.at(i);
-        if (str::Eq(img->fileName, url)) {
-            if (!img->base.data) {
-                auto res = zip->GetFileDataById(img->fileId);
-                img->base.len = res.size();
-                img->base.data = (char*)res.data();
-            }
-            if (img->base.data) {
-                return &img->base;
-            }
-        }
+    ImageData2* img = images.Find(url);
+    if (img) {
+        return LoadEpubImage(zip, img) ? &img->base : nullptr;
     }
 
     // try to also load images which aren't registered in the manifest
-    ImageData2 data = {0};
-    data.fileId = zip->GetFileId(url);
-    if (data.fileId != (size_t)-1) {
-        auto res = zip->GetFileDataById(data.fileId);
-        data.base.len = res.size();
-        data.base.data = (char*)res.data();
-        if (data.base.data) {
-            data.fileName = str::Dup(url);
-            images.Append(data);
-            return &images.Last().base;
+    size_t fileId = zip->GetFileId(url);
+    if (fileId != (size_t)-1) {
+        auto res = zip->GetFileDataById(fileId);
+        if (res.data()) {
+            return &images.Add(url.Release(), res, fileId)->base;
         }
     }
 
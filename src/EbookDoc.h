@@ -3,6 +3,9 @@
 
 class HtmlPullParser;
 struct HtmlToken;
+namespace dict {
+class MapStrToInt;
+}
 
 char* NormalizeURL(const char* url, const char* base);
 
@@ -16,16 +19,62 @@ class PropertyMap {
     WCHAR* Get(DocumentProperty prop) const;
 };
 
+// the images of an ebook, looked up by their (normalized) url. the image data
+// is only freed together with EbookImages, as DrawInstrs point into it
+// (decoded bitmaps are cached separately by DrawHtmlPage)
+class EbookImages {
+    dict::MapStrToInt* urlToIdx = nullptr;
+    // allocated individually so that returned ImageData2 don't move
+    Vec<ImageData2*> images;
+
+  public:
+    EbookImages();
+    EbookImages(EbookImages const&) = delete;
+    EbookImages& operator=(EbookImages const&) = delete;
+    ~EbookImages();
+
+    // takes ownership of url and data (data may be empty for images that are
+    // loaded lazily or couldn't be loaded). if url is already known, the
+    // existing image is returned and url and data are freed
+    ImageData2* Add(char* url, std::span<u8> data, size_t fileId = 0);
+    ImageData2* Find(const char* url);
+
+    size_t size() const;
+    ImageData2* at(size_t idx) const;
+};
+
 /* ********** EPUB ********** */
 
+// a file listed in an EPUB's spine
+struct EpubChapter {
+    char* path = nullptr; // full path within the archive (UTF-8)
+    size_t fileId = 0;
+    // upper bound for the size of the chapter's html (after conversion to UTF-8)
+    size_t maxSize = 0;
+};
+
 class EpubDoc {
     MultiFormatArchive* zip = nullptr;
-    // zip and images are the only mutable members of EpubDoc after initialization;
-    // access to them must be serialized for multi-threaded users (such as EbookController)
+    // zip, images and the loaded chapters are the only mutable members of EpubDoc after
+    // initialization; access to them must be serialized for multi-threaded users
+    // (such as EbookController)
     CRITICAL_SECTION zipAccess;
 
-    str::Str htmlData;
-    Vec<ImageData2> images;
+    // the html of all chapters (in spine order) is concatenated into htmlData. chapters
+    // are only inflated when they're needed, so the address space for all of them is
+    // reserved upfront: the html mustn't move, as DrawInstrs point into it
+    char* htmlData = nullptr;
+    size_t htmlDataSize = 0;
+    size_t htmlDataReserved = 0;
+    size_t htmlDataCommitted = 0;
+    // false if htmlData had to be allocated at once (then all chapters are loaded)
+    bool isHtmlDataReserved = false;
+    Vec<EpubChapter> chapters;
+    int chaptersLoaded = 0;
+    // offset of the last loaded chapter's html in htmlData
+    size_t lastChapterStart = 0;
+
+    EbookImages images;
     AutoFreeWstr tocPath;
     AutoFreeWstr fileName;
     PropertyMap props;
@@ -33,6 +82,9 @@ class EpubDoc {
     bool isRtlDoc = false;
 
     bool Load();
+    char* LoadChapterHtml(int chapterNo);
+    bool ReserveHtmlData();
+    bool AppendHtmlData(const char* html, size_t len);
     void ParseMetadata(const char* content);
     bool ParseNavToc(const char* data, size_t dataLen, const char* pagePath, EbookTocVisitor* visitor);
     bool ParseNcxToc(const char* data, size_t dataLen, const char* pagePath, EbookTocVisitor* visitor);
@@ -42,7 +94,14 @@ class EpubDoc {
     explicit EpubDoc(IStream* stream);
     ~EpubDoc();
 
-    std::span<u8> GetHtmlData() const;
+    // loads all chapters which haven't been loaded yet
+    std::span<u8> GetHtmlData();
+    // makes sure that the chapter containing htmlOffset and the one after it
+    // are loaded and returns the html loaded so far (so that layout can start
+    // before all chapters have been inflated). nextLoadAt receives the offset
+    // from which on more chapters have to be loaded
+    std::span<u8> LoadChapters(size_t htmlOffset, size_t* nextLoadAt = nullptr);
+    int GetChapterCount() const;
 
     ImageData* GetImageData(const char* fileName, const char* pagePath);
     std::span<u8> GetFileData(const char* relPath, const char* pagePath);
@@ -234,6 +234,17 @@ void EpubFormatter::HandleHtmlTag(HtmlToken* t) {
     }
 }
 
+// chapters are only loaded when layout reaches them
+void EpubFormatter::EnsureHtmlLoaded() {
+    if ((size_t)currReparseIdx < loadChaptersAt) {
+        return;
+    }
+    auto html = epubDoc->LoadChapters((size_t)currReparseIdx, &loadChaptersAt);
+    if (html.size() > htmlParser->Len()) {
+        htmlParser->Extend(html.size());
+    }
+}
+
 bool EpubFormatter::IgnoreText() {
     return hiddenDepth > 0 || HtmlFormatter::IgnoreText();
 }
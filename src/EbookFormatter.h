@@ -30,10 +30,13 @@ class EpubFormatter : public HtmlFormatter {
     bool IgnoreText() override;
 
     void HandleTagSvgImage(HtmlToken* t);
+    void EnsureHtmlLoaded() override;
 
     EpubDoc* epubDoc;
     AutoFree pagePath;
     size_t hiddenDepth;
+    // html offset at which the next chapter has to be loaded
+    size_t loadChaptersAt = 0;
 
   public:
     EpubFormatter(HtmlFormatterArgs* args, EpubDoc* doc) : HtmlFormatter(args), epubDoc(doc), hiddenDepth(0) {
@@ -471,6 +471,30 @@ RectF EngineBase::PageContentBox(int pageNo, [[maybe_unused]] RenderTarget targe
     return PageMediabox(pageNo);
 }
 
+bool EngineBase::IsLoadingProgressively() {
+    return false;
+}
+
+void EngineBase::SetProgressiveLoadingCallback([[maybe_unused]] const std::function<void()>& onDataLoaded) {
+}
+
+bool EngineBase::FinishProgressiveLoading() {
+    return false;
+}
+
+u64 EngineBase::PageContentHash([[maybe_unused]] int pageNo) {
+    return 0;
+}
+
+void EngineBase::ComputePageContentHashes(const std::function<void()>& onHashed) {
+    if (onHashed) {
+        onHashed();
+    }
+}
+
+void EngineBase::StopComputingPageContentHashes() {
+}
+
 bool EngineBase::SaveFileAsPDF([[maybe_unused]] const char* pdfFileName, [[maybe_unused]] bool includeUserAnnots) {
     return false;
 }
@@ -537,6 +561,55 @@ void EngineBase::SetFileName(const WCHAR* s) {
     fileNameBase.SetCopy(s);
 }
 
+struct PageHash {
+    u64 hash;
+    int pageNo;
+
+    bool operator<(const PageHash& other) const {
+        return hash < other.hash || hash == other.hash && pageNo < other.pageNo;
+    }
+};
+
+int MatchUnchangedPages(EngineBase* orig, EngineBase* engine, Vec<int>& origPageNos) {
+    int nOrigPages = orig->PageCount();
+    int nPages = engine->PageCount();
+    origPageNos.Reset();
+    origPageNos.AppendBlanks(nPages);
+
+    Vec<PageHash> origHashes;
+    for (int pageNo = 1; pageNo <= nOrigPages; pageNo++) {
+        u64 hash = orig->PageContentHash(pageNo);
+        if (hash != 0) {
+            origHashes.Append({hash, pageNo});
+        }
+    }
+    if (origHashes.size() == 0) {
+        return 0;
+    }
+    std::sort(origHashes.begin(), origHashes.end());
+
+    int nMatched = 0;
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        u64 hash = engine->PageContentHash(pageNo);
+        if (hash == 0) {
+            continue;
+        }
+        if (pageNo <= nOrigPages && orig->PageContentHash(pageNo) == hash) {
+            origPageNos[pageNo - 1] = pageNo;
+            nMatched++;
+            continue;
+        }
+        // pages might have been inserted or removed before this one
+        PageHash key = {hash, 0};
+        auto it = std::lower_bound(origHashes.begin(), origHashes.end(), key);
+        if (it != origHashes.end() && it->hash == hash) {
+            origPageNos[pageNo - 1] = it->pageNo;
+            nMatched++;
+        }
+    }
+    return nMatched;
+}
+
 PointF EngineBase::Transform(PointF pt, int pageNo, float zoom, int rotation, bool inverse) {
     RectF rc = RectF(pt, SizeF());
     RectF rect = Transform(rc, pageNo, zoom, rotation, inverse);
@@ -307,6 +307,9 @@ class EngineBase {
     char* decryptionKey = nullptr;
     bool hasPageLabels = false;
     int pageCount = -1;
+    // if true, RenderPage() may be called from several threads at once
+    // (else RenderCache only ever renders a single page of this document at a time)
+    bool supportsConcurrentRendering = false;
 
     // TODO: migrate other engines to use this
     AutoFreeWstr fileNameBase;
@@ -316,7 +319,8 @@ class EngineBase {
     virtual EngineBase* Clone() = 0;
 
     // number of pages the loaded document contains
-    int PageCount() const;
+    // (virtual so that engines laying out pages lazily can finish doing so first)
+    virtual int PageCount() const;
 
     // the box containing the visible page content (usually RectF(0, 0, pageWidth, pageHeight))
     virtual RectF PageMediabox(int pageNo) = 0;
@@ -324,6 +328,34 @@ class EngineBase {
     // (used for auto-cropping in Fit Content mode, can be PageMediabox)
     virtual RectF PageContentBox(int pageNo, RenderTarget target = RenderTarget::View);
 
+    // true for documents which are still being loaded progressively (e.g. linearized
+    // PDF documents on a network share): until FinishProgressiveLoading() has been
+    // called, the size of all but the first page is estimated and the ToC, page
+    // labels and document properties might be missing
+    // (for ebooks, PageCount() only includes the pages laid out so far once
+    // SetProgressiveLoadingCallback() has been called and grows with every call
+    // to FinishProgressiveLoading())
+    virtual bool IsLoadingProgressively();
+    // onDataLoaded is called (on a background thread) once all of the document's
+    // data is available (resp. right away, if it already is)
+    virtual void SetProgressiveLoadingCallback(const std::function<void()>& onDataLoaded);
+    // to be called on the UI thread after onDataLoaded has been called
+    // returns true if the size of any page has changed
+    virtual bool FinishProgressiveLoading();
+
+    // a hash of everything that determines what a page looks like (content, resources,
+    // annotations, page boxes) independent of how the document is laid out on disk,
+    // so that unchanged pages can be recognized after a reload (0 if unknown or if
+    // it hasn't been computed yet)
+    virtual u64 PageContentHash(int pageNo);
+    // computes the hashes for PageContentHash on a background thread and then calls
+    // onHashed on that thread (resp. right away, if they already have been computed
+    // or can't be). of several pending calls, only the latest onHashed is called
+    virtual void ComputePageContentHashes(const std::function<void()>& onHashed);
+    // to be called once the file has changed: objects which haven't been parsed yet
+    // would be read from the new data, so hashes which haven't been computed by now never are
+    virtual void StopComputingPageContentHashes();
+
     // renders a page into a cacheable RenderedBitmap
     // (*cookie_out must be deleted after the call returns)
     virtual RenderedBitmap* RenderPage(RenderPageArgs& args) = 0;
@@ -421,6 +453,11 @@ class EngineBase {
     void SetFileName(const WCHAR* s);
 };
 
+// for all pages of engine, sets origPageNos to the number of an identical page in orig
+// (preferring the same page number) or to 0 if there's none; returns the number of identical pages
+// (pages only match once ComputePageContentHashes has finished for both engines)
+int MatchUnchangedPages(EngineBase* orig, EngineBase* engine, Vec<int>& origPageNos);
+
 class PasswordUI {
   public:
     virtual WCHAR* GetPassword(const WCHAR* fileName, u8* fileDigest, u8 decryptionKeyOut[32], bool* saveKey) = 0;
@@ -127,6 +127,24 @@ static TocItem* newDjVuTocItem(TocItem* parent, const char* title, const char* l
     return res;
 }
 
+static void SpinDjVuMessageLoop(ddjvu_context_t* ctx, bool wait = true) {
+    const ddjvu_message_t* msg = nullptr;
+    if (wait) {
+        ddjvu_message_wait(ctx);
+    }
+    while ((msg = ddjvu_message_peek(ctx)) != nullptr) {
+        auto tag = msg->m_any.tag;
+        if (DDJVU_NEWSTREAM == tag) {
+            auto streamId = msg->m_newstream.streamid;
+            if (streamId != 0) {
+                BOOL stop = FALSE;
+                ddjvu_stream_close(msg->m_any.document, streamId, stop);
+            }
+        }
+        ddjvu_message_pop(ctx);
+    }
+}
+
 struct DjVuContext {
     ddjvu_context_t* ctx = nullptr;
     int refCount = 1;
@@ -166,21 +184,7 @@ struct DjVuContext {
     }
 
     void SpinMessageLoop(bool wait = true) {
-        const ddjvu_message_t* msg = nullptr;
-        if (wait) {
-            ddjvu_message_wait(ctx);
-        }
-        while ((msg = ddjvu_message_peek(ctx)) != nullptr) {
-            auto tag = msg->m_any.tag;
-            if (DDJVU_NEWSTREAM == tag) {
-                auto streamId = msg->m_newstream.streamid;
-                if (streamId != 0) {
-                    BOOL stop = FALSE;
-                    ddjvu_stream_close(msg->m_any.document, streamId, stop);
-                }
-            }
-            ddjvu_message_pop(ctx);
-        }
+        SpinDjVuMessageLoop(ctx, wait);
     }
 
     ddjvu_document_t* OpenFile(const WCHAR* fileName) {
@@ -232,6 +236,42 @@ void CleanupDjVuEngine() {
     minilisp_finish();
 }
 
+// maximum number of threads decoding pages of the same document in parallel
+#define MAX_DJVU_DECODERS 4
+// maximum amount of memory used by the decoded pages of a single document
+#define MAX_DJVU_PAGE_CACHE_SIZE (128 * 1024 * 1024)
+// number of pages decoded ahead (in reading order) after a page has been rendered
+#define DJVU_PREFETCH_PAGES 2
+
+// libdjvu is built with WINTHREADS, so pages of the same document can be
+// decoded in parallel as long as every thread uses its own context and document
+struct DjVuDecoder {
+    ddjvu_context_t* ctx = nullptr;
+    ddjvu_document_t* doc = nullptr;
+    // gDjVuContext->lock for the engine's main document, &ownLock otherwise
+    CRITICAL_SECTION* lock = nullptr;
+    CRITICAL_SECTION ownLock;
+};
+
+enum class DjVuPageState {
+    Decoding,
+    Decoded,
+    Failed,
+};
+
+// a decoded page can be rendered at any zoom level without decoding it again
+struct DjVuCachedPage {
+    int pageNo = 0;
+    // page may only be used while holding decoder->lock
+    DjVuDecoder* decoder = nullptr;
+    ddjvu_page_t* page = nullptr;
+    DjVuPageState state = DjVuPageState::Decoding;
+    // estimated memory used by the decoded page (in bytes)
+    size_t size = 0;
+    // pages are only evicted from the cache once they're no longer in use
+    int refs = 1;
+};
+
 class EngineDjVu : public EngineBase {
   public:
     EngineDjVu();
@@ -280,6 +320,21 @@ class EngineDjVu : public EngineBase {
 
     Vec<ddjvu_fileinfo_t> fileInfos;
 
+    // decoders[0] decodes from doc, the others are only created for files
+    DjVuDecoder decoders[MAX_DJVU_DECODERS];
+    int nDecoders = 0;
+    // most recently used page last
+    Vec<DjVuCachedPage*> cachedPages;
+    size_t cachedPagesSize = 0;
+    // protects cachedPages and the prefetching state; make sure to never
+    // wait for a decoder's lock while holding pagesAccess
+    CRITICAL_SECTION pagesAccess;
+    HANDLE prefetchThread = nullptr;
+    HANDLE prefetchEvent = nullptr;
+    // first page to be decoded ahead (0 if there's nothing to do)
+    int prefetchPageNo = 0;
+    bool stopPrefetching = false;
+
     RenderedBitmap* CreateRenderedBitmap(const char* bmpData, Size size, bool grayscale) const;
     bool ExtractPageText(miniexp_t item, str::WStr& extracted, Vec<Rect>& coords);
     char* ResolveNamedDest(const char* name);
@@ -288,6 +343,14 @@ class EngineDjVu : public EngineBase {
     bool Load(IStream* stream);
     bool FinishLoading();
     bool LoadMediaboxes();
+    void CreateDecoders();
+    DjVuDecoder* TryLockIdleDecoder();
+    DjVuCachedPage* AcquirePage(int pageNo, bool onlyIfIdle = false);
+    void ReleasePage(DjVuCachedPage* cp, bool isLocked = true);
+    void EvictPages(size_t maxSize);
+    void RequestPrefetch(int pageNo);
+    void PrefetchPages();
+    static DWORD WINAPI PrefetchThread(LPVOID data);
 };
 
 EngineDjVu::EngineDjVu() {
@@ -295,10 +358,30 @@ EngineDjVu::EngineDjVu() {
     defaultFileExt = L".djvu";
     // DPI isn't constant for all pages and thus premultiplied
     fileDPI = 300.0f;
+    supportsConcurrentRendering = true;
+    InitializeCriticalSection(&pagesAccess);
     GetDjVuContext();
 }
 
 EngineDjVu::~EngineDjVu() {
+    // the prefetching thread might be waiting for gDjVuContext->lock
+    if (prefetchThread) {
+        EnterCriticalSection(&pagesAccess);
+        stopPrefetching = true;
+        LeaveCriticalSection(&pagesAccess);
+        SetEvent(prefetchEvent);
+        WaitForSingleObject(prefetchThread, INFINITE);
+        CloseHandle(prefetchThread);
+        CloseHandle(prefetchEvent);
+    }
+    EvictPages(0);
+    CrashIf(cachedPages.size() > 0);
+    for (int i = 1; i < nDecoders; i++) {
+        ddjvu_document_release(decoders[i].doc);
+        ddjvu_context_release(decoders[i].ctx);
+        DeleteCriticalSection(&decoders[i].ownLock);
+    }
+
     ScopedCritSec scope(&gDjVuContext->lock);
 
     delete tocTree;
@@ -322,6 +405,7 @@ EngineDjVu::~EngineDjVu() {
         stream->Release();
     }
     ReleaseDjVuContext();
+    DeleteCriticalSection(&pagesAccess);
 }
 
 EngineBase* EngineDjVu::Clone() {
@@ -509,9 +593,257 @@ bool EngineDjVu::FinishLoading() {
         }
     }
 
+    CreateDecoders();
+
     return true;
 }
 
+void EngineDjVu::CreateDecoders() {
+    decoders[0].ctx = gDjVuContext->ctx;
+    decoders[0].doc = doc;
+    decoders[0].lock = &gDjVuContext->lock;
+    nDecoders = 1;
+
+    // documents loaded from a stream are only decoded by a single thread
+    const WCHAR* fileName = FileName();
+    if (!fileName) {
+        return;
+    }
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int n = std::min((int)si.dwNumberOfProcessors, MAX_DJVU_DECODERS);
+    AutoFree fileNameUtf8(strconv::WstrToUtf8(fileName));
+    for (; nDecoders < n; nDecoders++) {
+        DjVuDecoder& decoder = decoders[nDecoders];
+        decoder.ctx = ddjvu_context_create("DjVuEngine");
+        // reset the locale to "C" as most other code expects
+        setlocale(LC_ALL, "C");
+        if (!decoder.ctx) {
+            return;
+        }
+        decoder.doc = ddjvu_document_create_by_filename_utf8(decoder.ctx, fileNameUtf8.Get(), /* cache */ FALSE);
+        if (decoder.doc) {
+            while (!ddjvu_document_decoding_done(decoder.doc)) {
+                SpinDjVuMessageLoop(decoder.ctx);
+            }
+        }
+        // the file might have been modified since doc was loaded
+        if (!decoder.doc || ddjvu_document_decoding_error(decoder.doc) ||
+            ddjvu_document_get_pagenum(decoder.doc) != pageCount) {
+            logf("EngineDjVu: failed to open '%s' for decoder %d\n", fileNameUtf8.Get(), nDecoders);
+            if (decoder.doc) {
+                ddjvu_document_release(decoder.doc);
+            }
+            ddjvu_context_release(decoder.ctx);
+            decoder.doc = nullptr;
+            decoder.ctx = nullptr;
+            return;
+        }
+        InitializeCriticalSection(&decoder.ownLock);
+        decoder.lock = &decoder.ownLock;
+    }
+}
+
+// returns an idle decoder (with its lock held) or nullptr if all are busy
+DjVuDecoder* EngineDjVu::TryLockIdleDecoder() {
+    // prefer the decoders which aren't shared with other engines
+    for (int i = 1; i <= nDecoders; i++) {
+        DjVuDecoder* decoder = &decoders[i % nDecoders];
+        if (TryEnterCriticalSection(decoder->lock)) {
+            return decoder;
+        }
+    }
+    return nullptr;
+}
+
+// returns a decoded page with its decoder's lock held (give it back
+// with ReleasePage) or nullptr if the page couldn't be decoded.
+// if onlyIfIdle is set, pages are neither waited for nor returned from the cache
+DjVuCachedPage* EngineDjVu::AcquirePage(int pageNo, bool onlyIfIdle) {
+    EnterCriticalSection(&pagesAccess);
+    DjVuCachedPage* cp = nullptr;
+    for (size_t i = cachedPages.size(); i > 0; i--) {
+        if (cachedPages.at(i - 1)->pageNo == pageNo) {
+            cp = cachedPages.at(i - 1);
+            cachedPages.RemoveAt(i - 1);
+            cachedPages.Append(cp);
+            break;
+        }
+    }
+
+    if (cp) {
+        if (onlyIfIdle) {
+            LeaveCriticalSection(&pagesAccess);
+            return nullptr;
+        }
+        cp->refs++;
+        LeaveCriticalSection(&pagesAccess);
+        for (;;) {
+            EnterCriticalSection(cp->decoder->lock);
+            EnterCriticalSection(&pagesAccess);
+            DjVuPageState state = cp->state;
+            LeaveCriticalSection(&pagesAccess);
+            if (DjVuPageState::Decoded == state) {
+                return cp;
+            }
+            if (DjVuPageState::Failed == state) {
+                ReleasePage(cp);
+                return nullptr;
+            }
+            // the thread decoding the page hasn't acquired the decoder's lock yet
+            LeaveCriticalSection(cp->decoder->lock);
+            Sleep(1);
+        }
+    }
+
+    DjVuDecoder* decoder = TryLockIdleDecoder();
+    if (!decoder && onlyIfIdle) {
+        LeaveCriticalSection(&pagesAccess);
+        return nullptr;
+    }
+    cp = new DjVuCachedPage();
+    cp->pageNo = pageNo;
+    cp->decoder = decoder ? decoder : &decoders[pageNo % nDecoders];
+    cachedPages.Append(cp);
+    LeaveCriticalSection(&pagesAccess);
+    if (!decoder) {
+        decoder = cp->decoder;
+        EnterCriticalSection(decoder->lock);
+    }
+
+    ddjvu_page_t* page = ddjvu_page_create_by_pageno(decoder->doc, pageNo - 1);
+    if (page) {
+        while (!ddjvu_page_decoding_done(page)) {
+            SpinDjVuMessageLoop(decoder->ctx);
+        }
+        if (ddjvu_page_decoding_error(page)) {
+            ddjvu_page_release(page);
+            page = nullptr;
+        }
+    }
+    size_t size = 0;
+    if (page) {
+        // rough estimate: JB2 masks need about a bit per pixel,
+        // IW44 layers considerably more (even though they're subsampled)
+        size = (size_t)ddjvu_page_get_width(page) * (size_t)ddjvu_page_get_height(page);
+        if (DDJVU_PAGETYPE_BITONAL == ddjvu_page_get_type(page)) {
+            size /= 8;
+        }
+    }
+
+    EnterCriticalSection(&pagesAccess);
+    cp->page = page;
+    cp->size = size;
+    cp->state = page ? DjVuPageState::Decoded : DjVuPageState::Failed;
+    cachedPagesSize += size;
+    LeaveCriticalSection(&pagesAccess);
+
+    if (!page) {
+        ReleasePage(cp);
+        return nullptr;
+    }
+    return cp;
+}
+
+void EngineDjVu::ReleasePage(DjVuCachedPage* cp, bool isLocked) {
+    if (isLocked) {
+        LeaveCriticalSection(cp->decoder->lock);
+    }
+
+    bool drop = false;
+    EnterCriticalSection(&pagesAccess);
+    CrashIf(cp->refs <= 0);
+    cp->refs--;
+    // don't cache failures so that decoding is retried next time
+    if (0 == cp->refs && DjVuPageState::Failed == cp->state) {
+        cachedPages.Remove(cp);
+        drop = true;
+    }
+    LeaveCriticalSection(&pagesAccess);
+    if (drop) {
+        delete cp;
+    }
+
+    EvictPages(MAX_DJVU_PAGE_CACHE_SIZE);
+}
+
+// releases the least recently used pages until the cache fits into maxSize
+void EngineDjVu::EvictPages(size_t maxSize) {
+    Vec<DjVuCachedPage*> evicted;
+    EnterCriticalSection(&pagesAccess);
+    for (size_t i = 0; i < cachedPages.size() && cachedPagesSize > maxSize;) {
+        DjVuCachedPage* cp = cachedPages.at(i);
+        if (cp->refs > 0) {
+            i++;
+            continue;
+        }
+        CrashIf(cp->state != DjVuPageState::Decoded);
+        cachedPages.RemoveAt(i);
+        cachedPagesSize -= cp->size;
+        evicted.Append(cp);
+    }
+    LeaveCriticalSection(&pagesAccess);
+
+    // the pages are released outside of pagesAccess (see above)
+    for (DjVuCachedPage* cp : evicted) {
+        EnterCriticalSection(cp->decoder->lock);
+        ddjvu_page_release(cp->page);
+        LeaveCriticalSection(cp->decoder->lock);
+        delete cp;
+    }
+}
+
+// decodes the pages following pageNo in the background
+// so that they're ready by the time they're needed
+void EngineDjVu::RequestPrefetch(int pageNo) {
+    ScopedCritSec scope(&pagesAccess);
+    if (stopPrefetching || pageNo >= pageCount) {
+        return;
+    }
+    prefetchPageNo = pageNo + 1;
+    if (!prefetchThread) {
+        prefetchEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+        prefetchThread = CreateThread(nullptr, 0, PrefetchThread, this, 0, nullptr);
+    }
+    SetEvent(prefetchEvent);
+}
+
+DWORD WINAPI EngineDjVu::PrefetchThread(LPVOID data) {
+    EngineDjVu* engine = (EngineDjVu*)data;
+    engine->PrefetchPages();
+    return 0;
+}
+
+void EngineDjVu::PrefetchPages() {
+    for (;;) {
+        WaitForSingleObject(prefetchEvent, INFINITE);
+        EnterCriticalSection(&pagesAccess);
+        int first = prefetchPageNo;
+        prefetchPageNo = 0;
+        bool stop = stopPrefetching;
+        LeaveCriticalSection(&pagesAccess);
+        if (stop) {
+            return;
+        }
+
+        int last = std::min(first + DJVU_PREFETCH_PAGES - 1, pageCount);
+        for (int pageNo = first; pageNo > 0 && pageNo <= last; pageNo++) {
+            // don't hold up rendering by waiting for a busy decoder
+            DjVuCachedPage* cp = AcquirePage(pageNo, true);
+            if (cp) {
+                ReleasePage(cp);
+            }
+            EnterCriticalSection(&pagesAccess);
+            // give up on this range if a more recent one has been requested
+            stop = stopPrefetching || prefetchPageNo != 0;
+            LeaveCriticalSection(&pagesAccess);
+            if (stop) {
+                break;
+            }
+        }
+    }
+}
+
 RenderedBitmap* EngineDjVu::CreateRenderedBitmap(const char* bmpData, Size size, bool grayscale) const {
     int stride = ((size.dx * (grayscale ? 1 : 3) + 3) / 4) * 4;
 
@@ -549,7 +881,6 @@ RenderedBitmap* EngineDjVu::CreateRenderedBitmap(const char* bmpData, Size size,
 }
 
 RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
-    ScopedCritSec scope(&gDjVuContext->lock);
     auto pageRect = args.pageRect;
     auto zoom = args.zoom;
     auto pageNo = args.pageNo;
@@ -559,27 +890,22 @@ RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
     Rect full = Transform(PageMediabox(pageNo), pageNo, zoom, rotation).Round();
     screen = full.Intersect(screen);
 
-    ddjvu_page_t* page = ddjvu_page_create_by_pageno(doc, pageNo - 1);
-    if (!page) {
+    // pages are only decoded once, rendering again (e.g. at a different zoom) only rescales them
+    DjVuCachedPage* cp = AcquirePage(pageNo);
+    if (!cp) {
         return nullptr;
     }
+    ddjvu_page_t* page = cp->page;
     int rotation4 = (((-rotation / 90) % 4) + 4) % 4;
     ddjvu_page_set_rotation(page, (ddjvu_page_rotation_t)rotation4);
 
-    while (!ddjvu_page_decoding_done(page)) {
-        gDjVuContext->SpinMessageLoop();
-    }
-    if (ddjvu_page_decoding_error(page)) {
-        return nullptr;
-    }
-
     bool isBitonal = DDJVU_PAGETYPE_BITONAL == ddjvu_page_get_type(page);
     ddjvu_format_style_t style = isBitonal ? DDJVU_FORMAT_GREY8 : DDJVU_FORMAT_BGR24;
     ddjvu_format_t* fmt = ddjvu_format_create(style, 0, nullptr);
 
     defer {
         ddjvu_format_release(fmt);
-        ddjvu_page_release(page);
+        ReleasePage(cp);
     };
 
     int topToBottom = TRUE;
@@ -606,33 +932,26 @@ RenderedBitmap* EngineDjVu::RenderPage(RenderPageArgs& args) {
         isBitonal = true;
     }
     bmp = CreateRenderedBitmap(bmpData, screen.Size(), isBitonal);
+    RequestPrefetch(pageNo);
 
     return bmp;
 }
 
 RectF EngineDjVu::PageContentBox(int pageNo, [[maybe_unused]] RenderTarget target) {
-    ScopedCritSec scope(&gDjVuContext->lock);
-
     RectF pageRc = PageMediabox(pageNo);
-    ddjvu_page_t* page = ddjvu_page_create_by_pageno(doc, pageNo - 1);
-    if (!page) {
+    DjVuCachedPage* cp = AcquirePage(pageNo);
+    if (!cp) {
         return pageRc;
     }
+    ddjvu_page_t* page = cp->page;
     ddjvu_page_set_rotation(page, DDJVU_ROTATE_0);
 
-    while (!ddjvu_page_decoding_done(page)) {
-        gDjVuContext->SpinMessageLoop();
-    }
-    if (ddjvu_page_decoding_error(page)) {
-        return pageRc;
-    }
-
     // render the page in 8-bit grayscale up to 250x250 px in size
     ddjvu_format_t* fmt = ddjvu_format_create(DDJVU_FORMAT_GREY8, 0, nullptr);
 
     defer {
         ddjvu_format_release(fmt);
-        ddjvu_page_release(page);
+        ReleasePage(cp);
     };
 
     ddjvu_format_set_row_order(fmt, /* top_to_bottom */ TRUE);
@@ -1,13 +1,19 @@
 /* Copyright 2020 the SumatraPDF project authors (see AUTHORS file).
    License: GPLv3 */
 
+#include <psapi.h>
+
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
+#include "utils/Archive.h"
 #include "utils/CmdLineParser.h"
+#include "utils/DirIter.h"
 #include "utils/FileUtil.h"
 #include "utils/GdiPlusUtil.h"
+#include "utils/PalmDbReader.h"
 #include "mui/MiniMui.h"
 #include "utils/TgaReader.h"
+#include "utils/Timer.h"
 #include "utils/WinUtil.h"
 
 #include "wingui/TreeModel.h"
@@ -15,8 +21,20 @@
 #include "Annotation.h"
 #include "EngineBase.h"
 #include "EngineDjVu.h"
+#include "EnginePdf.h"
 #include "EngineCreate.h"
+#include "EbookBase.h"
+#include "EbookDoc.h"
+#include "MobiDoc.h"
 #include "PdfCreator.h"
+#include "PdfSync.h"
+#include "TextSelection.h"
+
+extern "C" {
+#include <mupdf/fitz.h>
+#include <mupdf/pdf.h>
+#include "../mupdf/source/fitz/draw-imp.h"
+}
 
 #define Out(msg, ...) printf(msg, __VA_ARGS__)
 
@@ -458,6 +476,780 @@ bool RenderDocument(EngineBase* engine, const WCHAR* renderPath, float zoom = 1.
     return success;
 }
 
+struct BenchTilesData {
+    EngineBase* engine = nullptr;
+    int pageNo = 1;
+    float zoom = 1.f;
+    Vec<RectF> tiles;
+    LONG nextTile = -1;
+};
+
+static DWORD WINAPI BenchTilesThread(LPVOID data) {
+    BenchTilesData* d = (BenchTilesData*)data;
+    for (;;) {
+        LONG idx = InterlockedIncrement(&d->nextTile);
+        if (idx >= d->tiles.isize()) {
+            return 0;
+        }
+        RenderPageArgs args(d->pageNo, d->zoom, 0, &d->tiles.at(idx));
+        delete d->engine->RenderPage(args);
+    }
+}
+
+// defined in EngineFzUtil.cpp
+fz_context* fz_clone_shared_context();
+void fz_set_shared_glyph_cache_size(size_t maxSize);
+fz_glyph_cache_stats fz_get_shared_glyph_cache_stats();
+fz_stream* fz_open_file2(fz_context* ctx, const WCHAR* filePath);
+RenderedBitmap* new_rendered_fz_pixmap(fz_context* ctx, fz_pixmap* pixmap);
+RenderedBitmap* FzRenderDisplayList(fz_context* ctx, CRITICAL_SECTION* ctxAccess, fz_display_list* list, fz_matrix ctm,
+                                    fz_rect pageRect, fz_cookie* cookie);
+
+// measures how long it takes until all tiles covering a full-screen viewport
+// of the first page have been rendered by 1, 2, 4 resp. 8 threads (the way
+// RenderCache's render threads split the work between them)
+static void BenchRenderThreads(EngineBase* engine, float zoom) {
+    constexpr int kViewportDx = 1920;
+    constexpr int kViewportDy = 1080;
+    constexpr int kTileSize = 512;
+
+    if (!engine->supportsConcurrentRendering) {
+        ErrOut("Error: %s doesn't support concurrent rendering", engine->FileName());
+        return;
+    }
+
+    BenchTilesData data;
+    data.engine = engine;
+    data.zoom = zoom;
+    RectF pageBox = engine->Transform(engine->PageMediabox(data.pageNo), data.pageNo, zoom, 0);
+    int dx = std::min((int)pageBox.dx, kViewportDx);
+    int dy = std::min((int)pageBox.dy, kViewportDy);
+    for (int y = 0; y < dy; y += kTileSize) {
+        for (int x = 0; x < dx; x += kTileSize) {
+            RectF tile(x, y, std::min(kTileSize, dx - x), std::min(kTileSize, dy - y));
+            data.tiles.Append(engine->Transform(tile, data.pageNo, zoom, 0, true));
+        }
+    }
+
+    // render once so that loading the page isn't measured
+    RenderPageArgs args(data.pageNo, zoom, 0, &data.tiles.at(0));
+    delete engine->RenderPage(args);
+
+    Out("<BenchRenderThreads Viewport=\"%dx%d\" Tiles=\"%d\" Zoom=\"%.2f\">\n", dx, dy, data.tiles.isize(), zoom);
+    for (int nThreads = 1; nThreads <= 8; nThreads *= 2) {
+        data.nextTile = -1;
+        HANDLE threads[8]{};
+        fz_glyph_cache_stats glyphsBefore = fz_get_shared_glyph_cache_stats();
+        auto timeStart = TimeGet();
+        for (int i = 0; i < nThreads; i++) {
+            threads[i] = CreateThread(nullptr, 0, BenchTilesThread, &data, 0, nullptr);
+        }
+        WaitForMultipleObjects(nThreads, threads, TRUE, INFINITE);
+        auto dur = TimeSinceInMs(timeStart);
+        for (int i = 0; i < nThreads; i++) {
+            CloseHandle(threads[i]);
+        }
+        fz_glyph_cache_stats glyphs = fz_get_shared_glyph_cache_stats();
+        i64 glyphHits = glyphs.hits - glyphsBefore.hits;
+        i64 glyphLookups = glyphHits + glyphs.misses - glyphsBefore.misses;
+        float glyphHitRate = glyphLookups > 0 ? 100.f * glyphHits / glyphLookups : 0.f;
+        Out("\t<Run Threads=\"%d\" TimeToFullViewportMs=\"%.2f\" GlyphCacheHitRate=\"%.1f%%\" />\n", nThreads, dur,
+            glyphHitRate);
+    }
+    fz_glyph_cache_stats glyphs = fz_get_shared_glyph_cache_stats();
+    Out("\t<GlyphCache Glyphs=\"%d\" SizeKB=\"%d\" MaxSizeKB=\"%d\" Evictions=\"%d\" />\n", glyphs.count,
+        (int)(glyphs.size / 1024), (int)(glyphs.max_size / 1024), (int)glyphs.evictions);
+    Out1("</BenchRenderThreads>\n");
+}
+
+// renders a recorded page the way FzRenderDisplayList used to: into an
+// RGB pixmap which is then converted and copied into a bitmap
+static RenderedBitmap* RenderDisplayListCopying(fz_context* ctx, fz_display_list* list, fz_matrix ctm) {
+    fz_irect bbox = fz_round_rect(fz_transform_rect(fz_bound_display_list(ctx, list), ctm));
+    fz_pixmap* pix = nullptr;
+    fz_device* dev = nullptr;
+    RenderedBitmap* bmp = nullptr;
+    fz_var(pix);
+    fz_var(dev);
+    fz_try(ctx) {
+        pix = fz_new_pixmap_with_bbox(ctx, fz_device_rgb(ctx), bbox, nullptr, 1);
+        fz_clear_pixmap_with_value(ctx, pix, 0xff);
+        dev = fz_new_draw_device(ctx, fz_identity, pix);
+        fz_run_display_list(ctx, list, dev, ctm, fz_rect_from_irect(bbox), nullptr);
+        fz_close_device(ctx, dev);
+        bmp = new_rendered_fz_pixmap(ctx, pix);
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+        fz_drop_pixmap(ctx, pix);
+    }
+    fz_catch(ctx) {
+        bmp = nullptr;
+    }
+    return bmp;
+}
+
+// number of bytes written after rendering a page into bmp's pixels (if !copying)
+// resp. into an RGB pixmap (if copying)
+static i64 GetBytesCopied(RenderedBitmap* bmp, bool copying) {
+    BITMAP info{};
+    if (!GetObject(bmp->GetBitmap(), sizeof(info), &info)) {
+        return 0;
+    }
+    i64 size = (i64)info.bmWidthBytes * info.bmHeight;
+    if (info.bmBitsPixel == 8) {
+        // reducing the colors to a palette and copying into the DIB section
+        return 2 * size;
+    }
+    // converting to BGRA and copying into the DIB section
+    return copying ? 2 * size : 0;
+}
+
+// compares rendering pages straight into bitmaps with rendering them into
+// an intermediate RGB pixmap which is then converted and copied into a bitmap.
+// both render the same display lists, so that only rasterizing is measured
+static void BenchBitmapConversion(EngineBase* engine, float zoom) {
+    constexpr int kMaxPages = 8;
+    constexpr int kRounds = 3;
+
+    if (engine->kind != kindEnginePdf) {
+        ErrOut("Error: -bench-bitmap is only supported for PDF documents");
+        return;
+    }
+
+    fz_context* ctx = fz_clone_shared_context();
+    if (!ctx) {
+        return;
+    }
+    fz_stream* stm = fz_open_file2(ctx, engine->FileName());
+    if (!stm) {
+        ErrOut("Error: couldn't open %s", path::GetBaseNameNoFree(engine->FileName()));
+        fz_drop_context(ctx);
+        return;
+    }
+    fz_document* doc = nullptr;
+    Vec<fz_display_list*> lists;
+    fz_var(doc);
+    fz_try(ctx) {
+        doc = (fz_document*)pdf_open_document_with_stream(ctx, stm);
+        int nPages = std::min(fz_count_pages(ctx, doc), kMaxPages);
+        for (int i = 0; i < nPages; i++) {
+            lists.Append(fz_new_display_list_from_page_number(ctx, doc, i));
+        }
+    }
+    fz_always(ctx) {
+        fz_drop_stream(ctx, stm);
+    }
+    fz_catch(ctx) {
+        ErrOut("Error: couldn't load the pages of %s", path::GetBaseNameNoFree(engine->FileName()));
+    }
+
+    CRITICAL_SECTION ctxAccess;
+    InitializeCriticalSection(&ctxAccess);
+    fz_matrix ctm = fz_scale(zoom, zoom);
+    // render once so that filling the glyph cache isn't measured
+    for (fz_display_list* list : lists) {
+        delete FzRenderDisplayList(ctx, &ctxAccess, list, ctm, fz_bound_display_list(ctx, list), nullptr);
+    }
+    Out("<BenchBitmap Pages=\"%d\" Zoom=\"%.2f\">\n", lists.isize(), zoom);
+    for (int direct = 0; direct < 2; direct++) {
+        i64 bytesCopied = 0;
+        double megaPixels = 0;
+        auto timeStart = TimeGet();
+        for (int i = 0; i < kRounds; i++) {
+            for (fz_display_list* list : lists) {
+                RenderedBitmap* bmp = nullptr;
+                if (direct) {
+                    bmp = FzRenderDisplayList(ctx, &ctxAccess, list, ctm, fz_bound_display_list(ctx, list), nullptr);
+                } else {
+                    bmp = RenderDisplayListCopying(ctx, list, ctm);
+                }
+                if (bmp) {
+                    Size size = bmp->Size();
+                    megaPixels += (double)size.dx * (double)size.dy / 1e6;
+                    bytesCopied += GetBytesCopied(bmp, !direct);
+                }
+                delete bmp;
+            }
+        }
+        auto dur = TimeSinceInMs(timeStart);
+        Out("\t<Run Mode=\"%s\" Megapixels=\"%.2f\" BytesCopied=\"%lld\" MsPerMegapixel=\"%.2f\" />\n",
+            direct ? "direct" : "copy", megaPixels, (long long)bytesCopied, megaPixels > 0 ? dur / megaPixels : 0.0);
+    }
+    Out1("</BenchBitmap>\n");
+    DeleteCriticalSection(&ctxAccess);
+
+    for (fz_display_list* list : lists) {
+        fz_drop_display_list(ctx, list);
+    }
+    fz_drop_document(ctx, doc);
+    fz_drop_context(ctx);
+}
+
+static size_t GetWorkingSetSize() {
+    PROCESS_MEMORY_COUNTERS pmc{};
+    pmc.cb = sizeof(pmc);
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return 0;
+    }
+    return pmc.WorkingSetSize;
+}
+
+// opens a file the way fz_open_file2 used to: files below 32 MB (MAX_MEMORY_FILE_SIZE)
+// are read into a temporary buffer which is then copied into a buffer owned by
+// mupdf, larger ones are read through a FILE*
+static fz_stream* OpenFileCopying(fz_context* ctx, const WCHAR* filePath) {
+    AutoFreeStr path = strconv::WstrToUtf8(filePath);
+    i64 fileSize = file::GetSize(path.AsView());
+    fz_stream* stm = nullptr;
+    if (fileSize <= 0 || fileSize >= 32 * 1024 * 1024) {
+        fz_try(ctx) {
+            stm = fz_open_file_w(ctx, filePath);
+        }
+        fz_catch(ctx) {
+            stm = nullptr;
+        }
+        return stm;
+    }
+    auto data = file::ReadFileWithAllocator(filePath, nullptr);
+    if (data.empty()) {
+        return nullptr;
+    }
+    fz_buffer* buf = nullptr;
+    fz_var(buf);
+    fz_try(ctx) {
+        buf = fz_new_buffer_from_copied_data(ctx, data.data(), data.size());
+        stm = fz_open_buffer(ctx, buf);
+    }
+    fz_always(ctx) {
+        fz_drop_buffer(ctx, buf);
+    }
+    fz_catch(ctx) {
+        stm = nullptr;
+    }
+    str::Free(data.data());
+    return stm;
+}
+
+// loads all PDF documents in a directory and renders their first page, once
+// opening them the way it used to be done (see OpenFileCopying) and once with
+// fz_open_file2 (which reads only the parts needed for that before the rest).
+// reports time and the growth of the working set until the first page is rendered
+static void BenchLoadDir(const WCHAR* dir) {
+    WStrVec files;
+    DirIter di(dir, true);
+    for (const WCHAR* path = di.First(); path; path = di.Next()) {
+        if (str::EndsWithI(path, L".pdf")) {
+            files.Append(str::Dup(path));
+        }
+    }
+    if (files.size() == 0) {
+        ErrOut("Error: no PDF documents in %s", dir);
+        return;
+    }
+    fz_context* ctx = fz_clone_shared_context();
+    if (!ctx) {
+        return;
+    }
+
+    Out("<BenchLoad Files=\"%d\">\n", (int)files.size());
+    // the first run is only for getting the files into the OS's file cache
+    for (int run = 0; run < 3; run++) {
+        bool copying = (run == 1);
+        double totalMs = 0;
+        double maxWorkingSetMB = 0;
+        for (const WCHAR* path : files) {
+            size_t wsBefore = GetWorkingSetSize();
+            auto timeStart = TimeGet();
+            fz_stream* stm = copying ? OpenFileCopying(ctx, path) : fz_open_file2(ctx, path);
+            fz_document* doc = nullptr;
+            fz_page* page = nullptr;
+            fz_pixmap* pix = nullptr;
+            fz_var(doc);
+            fz_var(page);
+            fz_var(pix);
+            fz_try(ctx) {
+                doc = (fz_document*)pdf_open_document_with_stream(ctx, stm);
+                page = fz_load_page(ctx, doc, 0);
+                pix = fz_new_pixmap_from_page(ctx, page, fz_scale(0.1f, 0.1f), fz_device_rgb(ctx), 0);
+            }
+            fz_catch(ctx) {
+                ErrOut("Error: couldn't render the first page of %s", path::GetBaseNameNoFree(path));
+            }
+            totalMs += TimeSinceInMs(timeStart);
+            size_t wsAfter = GetWorkingSetSize();
+            if (wsAfter > wsBefore) {
+                maxWorkingSetMB = std::max(maxWorkingSetMB, (double)(wsAfter - wsBefore) / (1024 * 1024));
+            }
+            fz_drop_pixmap(ctx, pix);
+            fz_drop_page(ctx, page);
+            fz_drop_document(ctx, doc);
+            fz_drop_stream(ctx, stm);
+        }
+        if (run > 0) {
+            Out("\t<Run Mode=\"%s\" LoadTimeMs=\"%.2f\" MaxWorkingSetGrowthMB=\"%.2f\" />\n",
+                copying ? "copied" : "lazy", totalMs, maxWorkingSetMB);
+        }
+    }
+    Out1("</BenchLoad>\n");
+    fz_drop_context(ctx);
+}
+
+// loads a (linearized) PDF document from a drive simulated to deliver
+// kbPerSec kB/s, once at once and once progressively (see fz_open_file_progressive),
+// and reports how long it takes until the first page has been rendered
+static void BenchProgressive(const WCHAR* filePath, PasswordUI* pwdUI, int kbPerSec) {
+    AutoFree filePathA = strconv::WstrToUtf8(filePath);
+    i64 fileSize = file::GetSize(filePathA.AsView());
+    if (fileSize <= 0) {
+        ErrOut("Error: couldn't open %s", filePath);
+        return;
+    }
+
+    Out("<BenchProgressive FileSizeKB=\"%d\" KBPerSec=\"%d\" ReadTimeMs=\"%.2f\">\n", (int)(fileSize / 1024),
+        kbPerSec, (double)fileSize * 1000 / (kbPerSec * 1024.0));
+    for (int progressive = 0; progressive < 2; progressive++) {
+        SetPdfProgressiveLoading(true, kbPerSec * 1024);
+        auto timeStart = TimeGet();
+        EngineBase* engine = CreateEngine(filePath, pwdUI);
+        if (!engine || engine->PageCount() == 0) {
+            ErrOut("Error: couldn't load %s", filePath);
+            delete engine;
+            break;
+        }
+        bool isProgressive = engine->IsLoadingProgressively();
+        HANDLE dataLoaded = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        engine->SetProgressiveLoadingCallback([dataLoaded] { SetEvent(dataLoaded); });
+        if (!progressive && isProgressive) {
+            // read all of the file before showing the first page
+            WaitForSingleObject(dataLoaded, INFINITE);
+            engine->FinishProgressiveLoading();
+        }
+        RenderPageArgs args(1, 1.0f, 0);
+        RenderedBitmap* bmp = engine->RenderPage(args);
+        auto firstPageMs = TimeSinceInMs(timeStart);
+        // whether the first page was shown before all of the file had been read
+        bool beforeAllData = isProgressive && WaitForSingleObject(dataLoaded, 0) != WAIT_OBJECT_0;
+        bool rendered = bmp != nullptr;
+        delete bmp;
+
+        bool sizesChanged = false;
+        if (progressive && isProgressive) {
+            WaitForSingleObject(dataLoaded, INFINITE);
+            sizesChanged = engine->FinishProgressiveLoading();
+        }
+        auto totalMs = TimeSinceInMs(timeStart);
+        Out("\t<Run Mode=\"%s\" Progressive=\"%s\" FirstPageMs=\"%.2f\" TotalMs=\"%.2f\" "
+            "FirstPageBeforeAllData=\"%s\" FirstPageRendered=\"%s\" PageSizesChanged=\"%s\" />\n",
+            progressive ? "progressive" : "complete", isProgressive ? "yes" : "no", firstPageMs, totalMs,
+            beforeAllData ? "yes" : "no", rendered ? "yes" : "no", sizesChanged ? "yes" : "no");
+        delete engine;
+        CloseHandle(dataLoaded);
+    }
+    SetPdfProgressiveLoading(false);
+    Out1("</BenchProgressive>\n");
+}
+
+// height of the viewport for which -bench-reload re-renders the visible pages
+// (about that of a maximized window on a 1080p screen)
+#define BENCH_RELOAD_VIEWPORT_DY 1000
+
+// waits for ComputePageContentHashes to finish
+static void WaitForPageContentHashes(EngineBase* engine) {
+    HANDLE hashed = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    engine->ComputePageContentHashes([hashed] { SetEvent(hashed); });
+    WaitForSingleObject(hashed, INFINITE);
+    CloseHandle(hashed);
+}
+
+// simulates reloading a document after it has been regenerated (e.g. by pdfTeX)
+// and compares the time until the visible pages are up-to-date when re-rendering
+// all of them with hashing the reloaded document and re-rendering only the visible
+// pages which have changed (see MatchUnchangedPages)
+static void BenchReload(const WCHAR* origPath, const WCHAR* filePath, PasswordUI* pwdUI, float zoom) {
+    Out("<BenchReload Zoom=\"%.0f%%\" ViewportDy=\"%d\">\n", zoom * 100, BENCH_RELOAD_VIEWPORT_DY);
+    for (int incremental = 0; incremental < 2; incremental++) {
+        // (hashes are computed once per engine, so load the displayed document afresh)
+        EngineBase* orig = CreateEngine(origPath, pwdUI);
+        if (!orig || orig->PageCount() == 0) {
+            ErrOut("Error: couldn't load %s", origPath);
+            delete orig;
+            break;
+        }
+        // the displayed document is hashed in the background after it's been loaded
+        WaitForPageContentHashes(orig);
+        auto timeStart = TimeGet();
+        EngineBase* engine = CreateEngine(filePath, pwdUI);
+        if (!engine || engine->PageCount() == 0) {
+            ErrOut("Error: couldn't load %s", filePath);
+            delete engine;
+            delete orig;
+            break;
+        }
+        auto loadMs = TimeSinceInMs(timeStart);
+        Vec<int> origPageNos;
+        int nUnchanged = 0;
+        if (incremental) {
+            WaitForPageContentHashes(engine);
+            nUnchanged = MatchUnchangedPages(orig, engine, origPageNos);
+        }
+        auto matchMs = TimeSinceInMs(timeStart) - loadMs;
+        int nVisible = 0;
+        int nRendered = 0;
+        float visibleDy = 0;
+        for (int pageNo = 1; pageNo <= engine->PageCount() && visibleDy < BENCH_RELOAD_VIEWPORT_DY; pageNo++) {
+            visibleDy += engine->Transform(engine->PageMediabox(pageNo), pageNo, zoom, 0).dy;
+            nVisible++;
+            if (incremental && origPageNos.at(pageNo - 1) != 0) {
+                continue;
+            }
+            RenderPageArgs args(pageNo, zoom, 0);
+            delete engine->RenderPage(args);
+            nRendered++;
+        }
+        auto totalMs = TimeSinceInMs(timeStart);
+        Out("\t<Run Mode=\"%s\" Pages=\"%d\" Unchanged=\"%d\" Visible=\"%d\" Rendered=\"%d\" "
+            "LoadMs=\"%.2f\" HashAndMatchMs=\"%.2f\" TotalMs=\"%.2f\" />\n",
+            incremental ? "incremental" : "full", engine->PageCount(), nUnchanged, nVisible, nRendered, loadMs,
+            matchMs, totalMs);
+        delete engine;
+        delete orig;
+    }
+    Out1("</BenchReload>\n");
+}
+
+static WCHAR* BenchSyncTexIndexPath(const WCHAR* pdfPath) {
+    return str::Join(pdfPath, L".bench.syncidx");
+}
+
+// measures how long it takes until the first inverse-search can be answered
+// (with the index being built from the .synctex file resp. mapped from the cache)
+// and how long inverse- and forward-searches for a grid of points take
+static void BenchSyncTex(const WCHAR* filePath, PasswordUI* pwdUI) {
+    EngineBase* engine = CreateEngine(filePath, pwdUI);
+    if (!engine || engine->PageCount() == 0) {
+        ErrOut("Error: couldn't load %s", filePath);
+        delete engine;
+        return;
+    }
+    AutoFreeWstr indexPath(BenchSyncTexIndexPath(filePath));
+    file::Delete(indexPath);
+    SetSyncTexIndexPathFunc(BenchSyncTexIndexPath);
+
+    constexpr int kGridSize = 10;
+    Out("<BenchSyncTex Pages=\"%d\">\n", engine->PageCount());
+    for (int cached = 0; cached < 2; cached++) {
+        auto timeStart = TimeGet();
+        Synchronizer* sync = nullptr;
+        int res = Synchronizer::Create(filePath, engine, &sync);
+        if (res != PDFSYNCERR_SUCCESS) {
+            ErrOut("Error: no .synctex file found for %s", filePath);
+            break;
+        }
+        AutoFreeWstr srcPath;
+        UINT line, col;
+        // the first lookup waits for the index
+        sync->DocToSource(1, Point(), srcPath, &line, &col);
+        auto indexMs = TimeSinceInMs(timeStart);
+
+        int nInverse = 0, nForward = 0, nFound = 0;
+        auto lookupStart = TimeGet();
+        for (int pageNo = 1; pageNo <= engine->PageCount(); pageNo++) {
+            RectF mediabox = engine->PageMediabox(pageNo);
+            for (int i = 0; i < kGridSize * kGridSize; i++) {
+                Point pt((int)(mediabox.dx * (i % kGridSize + 0.5f) / kGridSize),
+                         (int)(mediabox.dy * (i / kGridSize + 0.5f) / kGridSize));
+                nInverse++;
+                if (sync->DocToSource(pageNo, pt, srcPath, &line, &col) != PDFSYNCERR_SUCCESS) {
+                    continue;
+                }
+                UINT page;
+                Vec<Rect> rects;
+                nForward++;
+                if (sync->SourceToDoc(srcPath, line, col, &page, rects) == PDFSYNCERR_SUCCESS) {
+                    nFound++;
+                }
+            }
+        }
+        auto lookupMs = TimeSinceInMs(lookupStart);
+        Out("\t<Run Index=\"%s\" IndexMs=\"%.2f\" InverseSearches=\"%d\" ForwardSearches=\"%d\" Found=\"%d\" "
+            "LookupMs=\"%.2f\" />\n",
+            cached ? "cached" : "built", indexMs, nInverse, nForward, nFound, lookupMs);
+        delete sync;
+    }
+    Out1("</BenchSyncTex>\n");
+
+    SetSyncTexIndexPathFunc(nullptr);
+    file::Delete(indexPath);
+    delete engine;
+}
+
+// compares the time and memory needed until the first chapters of an EPUB document
+// can be laid out with what's needed for all chapters (see EpubDoc::LoadChapters)
+static void BenchEpub(const WCHAR* filePath) {
+    size_t wsBefore = GetWorkingSetSize();
+    auto timeStart = TimeGet();
+    EpubDoc* doc = EpubDoc::CreateFromFile(filePath);
+    if (!doc) {
+        ErrOut("Error: couldn't load %s", filePath);
+        return;
+    }
+    Out("<BenchEpub Chapters=\"%d\">\n", doc->GetChapterCount());
+    for (int loadAll = 0; loadAll < 2; loadAll++) {
+        size_t htmlSize = loadAll ? doc->GetHtmlData().size() : doc->LoadChapters(0).size();
+        auto dur = TimeSinceInMs(timeStart);
+        size_t ws = GetWorkingSetSize();
+        double wsGrowthMB = ws > wsBefore ? (double)(ws - wsBefore) / (1024 * 1024) : 0;
+        Out("\t<Run Chapters=\"%s\" HtmlKB=\"%d\" LoadMs=\"%.2f\" WorkingSetGrowthMB=\"%.2f\" />\n",
+            loadAll ? "all" : "first", (int)(htmlSize / 1024), dur, wsGrowthMB);
+    }
+    Out1("</BenchEpub>\n");
+    delete doc;
+}
+
+// defined in MobiDoc.cpp
+extern int gMobiDecompressThreads;
+
+// measures how long it takes to decompress all text records of a MOBI document
+// (which happens before it can be laid out) with 1 resp. up to 8 threads
+static void BenchMobi(const WCHAR* filePath) {
+    Out1("<BenchMobi>\n");
+    int defaultThreads = gMobiDecompressThreads;
+    for (int nThreads = 1; nThreads <= 8; nThreads *= 8) {
+        gMobiDecompressThreads = nThreads;
+        auto timeStart = TimeGet();
+        MobiDoc* doc = MobiDoc::CreateFromFile(filePath);
+        auto dur = TimeSinceInMs(timeStart);
+        if (!doc) {
+            ErrOut("Error: couldn't load %s", filePath);
+            break;
+        }
+        Out("\t<Run Threads=\"%d\" TextSizeKB=\"%d\" LoadMs=\"%.2f\" />\n", nThreads,
+            (int)(doc->GetHtmlDataSize() / 1024), dur);
+        delete doc;
+    }
+    gMobiDecompressThreads = defaultThreads;
+    Out1("</BenchMobi>\n");
+}
+
+// defined in TextSelection.cpp
+extern bool gTextSelectionUseIndex;
+
+// replays a mouse drag selecting text diagonally across the page with the
+// most text (among the first few) and compares hit-testing all glyphs with
+// hit-testing through a GlyphIndex
+static void BenchTextSelection(EngineBase* engine) {
+    constexpr int kMaxPages = 50;
+    constexpr int kMoves = 1000;
+
+    DocumentTextCache textCache(engine);
+    int pageNo = 0;
+    int maxLen = 0;
+    for (int i = 1; i <= std::min(engine->PageCount(), kMaxPages); i++) {
+        int len = 0;
+        textCache.GetTextForPage(i, &len);
+        if (len > maxLen) {
+            maxLen = len;
+            pageNo = i;
+        }
+    }
+    if (!pageNo) {
+        ErrOut("Error: %s doesn't contain any text", engine->FileName());
+        return;
+    }
+
+    // from the top left to the bottom right corner with the pointer
+    // wobbling up and down like it does when moved by hand
+    RectF mediabox = engine->PageMediabox(pageNo);
+    Vec<PointF> drag;
+    for (int i = 0; i < kMoves; i++) {
+        float t = (float)i / (kMoves - 1);
+        float wobble = sinf(i * 0.3f) * 6.f;
+        drag.Append(PointF(mediabox.x + t * mediabox.dx, mediabox.y + t * mediabox.dy + wobble));
+    }
+
+    Out("<BenchSelect Page=\"%d\" Glyphs=\"%d\" Moves=\"%d\">\n", pageNo, maxLen, kMoves);
+    Vec<int> results[2];
+    for (int useIndex = 0; useIndex < 2; useIndex++) {
+        gTextSelectionUseIndex = (useIndex != 0);
+        TextSelection sel(engine, &textCache);
+        auto timeStart = TimeGet();
+        sel.StartAt(pageNo, drag.at(0).x, drag.at(0).y);
+        for (PointF& pt : drag) {
+            sel.SelectUpTo(pageNo, pt.x, pt.y);
+            bool isOver = sel.IsOverGlyph(pageNo, pt.x, pt.y);
+            results[useIndex].Append(sel.endGlyph * 2 + (isOver ? 1 : 0));
+        }
+        auto dur = TimeSinceInMs(timeStart);
+        Out("\t<Run Index=\"%s\" TotalMs=\"%.2f\" MsPerMove=\"%.4f\" />\n", useIndex ? "grid" : "none", dur,
+            dur / kMoves);
+    }
+    gTextSelectionUseIndex = true;
+    bool same = memcmp(results[0].LendData(), results[1].LendData(), kMoves * sizeof(int)) == 0;
+    Out("\t<Check Exact=\"%s\" />\n", same ? "yes" : "NO");
+    Out1("</BenchSelect>\n");
+}
+
+static u32 gBenchRandState = 1;
+
+static u8 BenchRandByte() {
+    gBenchRandState = gBenchRandState * 1103515245 + 12345;
+    return (u8)(gBenchRandState >> 16);
+}
+
+// mostly fully covered resp. uncovered pixels, as for anti-aliased fills
+static u8 BenchRandCoverage() {
+    u8 v = BenchRandByte();
+    return v < 96 ? 0 : v < 192 ? 255 : BenchRandByte();
+}
+
+enum class BenchPainter { Solid, SolidAlpha, SpanColor, SpanOver, SpanOverAlpha, ImageGray, ImageRgb };
+
+struct BenchPaintData {
+    BenchPainter painter = BenchPainter::Solid;
+    fz_context* ctx = nullptr;
+    int n = 4; // components of the destination (including alpha)
+    int w = 0;
+    u8* dst = nullptr;
+    u8* src = nullptr;
+    u8* mask = nullptr;
+    u8 color[FZ_MAX_COLORS + 1]{};
+    fz_pixmap* dstPix = nullptr;
+    fz_pixmap* srcPix = nullptr;
+};
+
+// paints a single span (resp. an unscaled image) with the painter that
+// mupdf picks for the current fz_simd_level
+static void BenchPaintOnce(BenchPaintData& d) {
+    switch (d.painter) {
+        case BenchPainter::Solid:
+        case BenchPainter::SolidAlpha:
+            fz_get_solid_color_painter(d.n, d.color, 1, nullptr)(d.dst, d.n, d.w, d.color, 1, nullptr);
+            break;
+        case BenchPainter::SpanColor:
+            fz_get_span_color_painter(d.n, 1, d.color, nullptr)(d.dst, d.mask, d.n, d.w, d.color, 1, nullptr);
+            break;
+        case BenchPainter::SpanOver:
+            fz_get_span_painter(1, 1, d.n - 1, 255, nullptr)(d.dst, 1, d.src, 1, d.n - 1, d.w, 255, nullptr);
+            break;
+        case BenchPainter::SpanOverAlpha:
+            fz_get_span_painter(1, 1, d.n - 1, 128, nullptr)(d.dst, 1, d.src, 1, d.n - 1, d.w, 128, nullptr);
+            break;
+        case BenchPainter::ImageGray:
+        case BenchPainter::ImageRgb: {
+            fz_irect scissor = fz_pixmap_bbox(d.ctx, d.dstPix);
+            fz_matrix ctm = fz_scale((float)d.srcPix->w, (float)d.srcPix->h);
+            fz_paint_image(d.ctx, d.dstPix, &scissor, nullptr, nullptr, d.srcPix, ctm, 255, 1, 0, nullptr);
+            break;
+        }
+    }
+}
+
+// compares the vectorized painters (see mupdf/source/fitz/draw-simd.c) with the
+// portable ones for spans of different widths and pixel sizes and verifies that
+// both produce the exact same output
+static void BenchPaint() {
+    static const char* painterNames[] = {"solid", "solid-alpha", "span-color", "span-over", "span-over-alpha",
+                                         "image-gray", "image-rgb"};
+    static const char* simdNames[] = {"none", "sse2", "avx2", "neon"};
+    constexpr int kWidths[] = {16, 64, 256, 1024, 4096};
+    constexpr int kComponents[] = {2, 4, 5};
+    // images are painted in full, spans are repeatedly painted onto the same row
+    constexpr int kImageHeight = 64;
+    constexpr int kPixelsPerRun = 32 * 1000 * 1000;
+
+    fz_context* ctx = fz_new_context(nullptr, nullptr, FZ_STORE_UNLIMITED);
+    if (!ctx) {
+        ErrOut("Error: couldn't create a fitz context");
+        return;
+    }
+    int simdLevel = fz_simd_level();
+    Out("<BenchPaint Simd=\"%s\">\n", simdNames[simdLevel]);
+    for (int painter = 0; painter < (int)dimof(painterNames); painter++) {
+        bool isImage = painter >= (int)BenchPainter::ImageGray;
+        for (int n : kComponents) {
+            // images are only ever painted unscaled into RGB pixmaps with alpha
+            if (isImage && n != 4) {
+                continue;
+            }
+            for (int w : kWidths) {
+                BenchPaintData d;
+                d.painter = (BenchPainter)painter;
+                d.ctx = ctx;
+                d.n = n;
+                d.w = w;
+                int rows = isImage ? kImageHeight : 1;
+                size_t dstSize = (size_t)w * n * rows;
+                ScopedMem<u8> dstOrig(AllocArray<u8>(dstSize));
+                ScopedMem<u8> dstScalar(AllocArray<u8>(dstSize));
+                ScopedMem<u8> dstSimd(AllocArray<u8>(dstSize));
+                ScopedMem<u8> dstTimed(AllocArray<u8>(dstSize));
+                ScopedMem<u8> src(AllocArray<u8>((size_t)w * n));
+                ScopedMem<u8> mask(AllocArray<u8>(w));
+                for (size_t i = 0; i < dstSize; i++) {
+                    dstOrig.Get()[i] = BenchRandByte();
+                }
+                for (int i = 0; i < w; i++) {
+                    // premultiplied source pixels
+                    u8 a = BenchRandCoverage();
+                    for (int k = 0; k < n - 1; k++) {
+                        src.Get()[i * n + k] = (u8)(BenchRandByte() * a / 255);
+                    }
+                    src.Get()[i * n + n - 1] = a;
+                    mask.Get()[i] = BenchRandCoverage();
+                }
+                for (int k = 0; k < n - 1; k++) {
+                    d.color[k] = BenchRandByte();
+                }
+                d.color[n - 1] = d.painter == BenchPainter::SolidAlpha ? 128 : 255;
+                d.src = src.Get();
+                d.mask = mask.Get();
+
+                fz_pixmap* srcPix = nullptr;
+                if (isImage) {
+                    fz_colorspace* cs = d.painter == BenchPainter::ImageGray ? fz_device_gray(ctx) : fz_device_rgb(ctx);
+                    srcPix = fz_new_pixmap(ctx, cs, w, rows, nullptr, 0);
+                    for (size_t i = 0; i < (size_t)w * rows * srcPix->n; i++) {
+                        srcPix->samples[i] = BenchRandByte();
+                    }
+                }
+
+                d.srcPix = srcPix;
+                auto paintInto = [&](u8* dst, int reps) {
+                    memcpy(dst, dstOrig.Get(), dstSize);
+                    d.dst = dst;
+                    if (isImage) {
+                        d.dstPix = fz_new_pixmap_with_data(ctx, fz_device_rgb(ctx), w, rows, nullptr, 1, w * n, dst);
+                    }
+                    for (int i = 0; i < reps; i++) {
+                        BenchPaintOnce(d);
+                    }
+                    fz_drop_pixmap(ctx, d.dstPix);
+                    d.dstPix = nullptr;
+                };
+
+                double msPerMegapixel[2]{};
+                int reps = std::max(kPixelsPerRun / (w * rows), 1);
+                for (int simd = 0; simd < 2; simd++) {
+                    fz_set_simd_level(simd ? simdLevel : FZ_SIMD_NONE);
+                    paintInto(simd ? dstSimd.Get() : dstScalar.Get(), 1);
+                    auto timeStart = TimeGet();
+                    paintInto(dstTimed.Get(), reps);
+                    msPerMegapixel[simd] = TimeSinceInMs(timeStart) * 1e6 / ((double)reps * w * rows);
+                }
+                bool exact = memcmp(dstScalar.Get(), dstSimd.Get(), dstSize) == 0;
+                fz_drop_pixmap(ctx, srcPix);
+                double speedup = msPerMegapixel[1] > 0 ? msPerMegapixel[0] / msPerMegapixel[1] : 0.0;
+                Out("\t<Run Painter=\"%s\" N=\"%d\" Width=\"%d\" ScalarMsPerMegapixel=\"%.3f\" "
+                    "SimdMsPerMegapixel=\"%.3f\" Speedup=\"%.2f\" Exact=\"%s\" />\n",
+                    painterNames[painter], n, w, msPerMegapixel[0], msPerMegapixel[1], speedup, exact ? "yes" : "no");
+            }
+        }
+    }
+    Out1("</BenchPaint>\n");
+    fz_drop_context(ctx);
+}
+
 class PasswordHolder : public PasswordUI {
     const WCHAR* password;
 
@@ -478,8 +1270,20 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
     ParseCmdLine(GetCommandLine(), argList);
     if (argList.size() < 2) {
     Usage:
-        ErrOut("%s [-pwd <password>][-quick][-render <path-%%d.tga>] <filename>",
-               path::GetBaseNameNoFree(argList.at(0)));
+        ErrOut(
+            "%s [-pwd <password>][-quick][-render <path-%%d.tga>][-bench-threads [zoom%%]][-bench-bitmap [zoom%%]] "
+            "[-glyph-cache <kB>][-bench-select] <filename>\n"
+            "%s -bench-load <directory>\n"
+            "%s -bench-progressive [kB/s] <filename.pdf>\n"
+            "%s [-bench-zoom zoom%%] -bench-reload <previous.pdf> <filename.pdf>\n"
+            "%s -bench-synctex <filename.pdf>\n"
+            "%s -bench-mobi <filename.mobi>\n"
+            "%s -bench-epub <filename.epub>\n"
+            "%s -bench-paint",
+            path::GetBaseNameNoFree(argList.at(0)), path::GetBaseNameNoFree(argList.at(0)),
+            path::GetBaseNameNoFree(argList.at(0)), path::GetBaseNameNoFree(argList.at(0)),
+            path::GetBaseNameNoFree(argList.at(0)), path::GetBaseNameNoFree(argList.at(0)),
+            path::GetBaseNameNoFree(argList.at(0)), path::GetBaseNameNoFree(argList.at(0)));
         return 2;
     }
 
@@ -488,7 +1292,12 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
     bool fullDump = true;
     WCHAR* renderPath = nullptr;
     float renderZoom = 1.f;
-    bool loadOnly = false, silent = false;
+    float benchZoom = 1.f;
+    bool loadOnly = false, silent = false, benchThreads = false, benchBitmap = false, benchLoad = false;
+    bool benchPaint = false, benchSelect = false, benchSyncTex = false, benchMobi = false;
+    bool benchEpub = false;
+    int benchProgressiveKBPerSec = 0;
+    WCHAR* benchReloadPath = nullptr;
     int breakAlloc = 0;
 
     for (size_t i = 1; i < argList.size(); i++) {
@@ -509,6 +1318,51 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
             loadOnly = true;
         } else if (str::Eq(argList.at(i), L"-silent")) {
             silent = true;
+        } else if (str::Eq(argList.at(i), L"-bench-threads") || str::Eq(argList.at(i), L"-bench-bitmap")) {
+            if (str::Eq(argList.at(i), L"-bench-threads")) {
+                benchThreads = true;
+            } else {
+                benchBitmap = true;
+            }
+            // optional zoom argument (e.g. -bench-threads 400% file.pdf)
+            float zoom;
+            if (i + 2 < argList.size() && str::Parse(argList.at(i + 1), L"%f%%%$", &zoom) && zoom > 0.f) {
+                benchZoom = zoom / 100.f;
+                i++;
+            }
+        } else if (str::Eq(argList.at(i), L"-glyph-cache") && i + 1 < argList.size()) {
+            // glyph cache budget for comparing hit rates (e.g. -glyph-cache 1024 for MuPDF's default)
+            fz_set_shared_glyph_cache_size((size_t)_wtoi(argList.at(++i)) * 1024);
+        } else if (str::Eq(argList.at(i), L"-bench-select")) {
+            benchSelect = true;
+        } else if (str::Eq(argList.at(i), L"-bench-load")) {
+            benchLoad = true;
+        } else if (str::Eq(argList.at(i), L"-bench-progressive")) {
+            // optional transfer rate argument (e.g. -bench-progressive 100 file.pdf)
+            benchProgressiveKBPerSec = 256;
+            int kbPerSec;
+            if (i + 2 < argList.size() && str::Parse(argList.at(i + 1), L"%d%$", &kbPerSec) && kbPerSec > 0) {
+                benchProgressiveKBPerSec = kbPerSec;
+                i++;
+            }
+        } else if (str::Eq(argList.at(i), L"-bench-reload") && i + 1 < argList.size()) {
+            // the previous version of the document (before it was regenerated)
+            benchReloadPath = argList.at(++i);
+        } else if (str::Eq(argList.at(i), L"-bench-synctex")) {
+            benchSyncTex = true;
+        } else if (str::Eq(argList.at(i), L"-bench-mobi")) {
+            benchMobi = true;
+        } else if (str::Eq(argList.at(i), L"-bench-epub")) {
+            benchEpub = true;
+        } else if (str::Eq(argList.at(i), L"-bench-zoom") && i + 1 < argList.size()) {
+            float zoom;
+            if (str::Parse(argList.at(i + 1), L"%f%%%$", &zoom) && zoom > 0.f) {
+                benchZoom = zoom / 100.f;
+            }
+            i++;
+        } else if (str::Eq(argList.at(i), L"-bench-paint")) {
+            // doesn't need a document
+            benchPaint = true;
         } else if (str::Eq(argList.at(i), L"-full")) {
             // -full is for backward compatibility
             fullDump = true;
@@ -520,6 +1374,10 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
             goto Usage;
         }
     }
+    if (benchPaint) {
+        BenchPaint();
+        return 0;
+    }
     if (!filePath) {
         goto Usage;
     }
@@ -541,6 +1399,32 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
     ScopedGdiPlus gdiPlus;
     ScopedMiniMui miniMui;
 
+    PasswordHolder pwdUI(password);
+    if (benchLoad) {
+        BenchLoadDir(filePath);
+        return 0;
+    }
+    if (benchProgressiveKBPerSec > 0) {
+        BenchProgressive(filePath, &pwdUI, benchProgressiveKBPerSec);
+        return 0;
+    }
+    if (benchReloadPath) {
+        BenchReload(benchReloadPath, filePath, &pwdUI, benchZoom);
+        return 0;
+    }
+    if (benchSyncTex) {
+        BenchSyncTex(filePath, &pwdUI);
+        return 0;
+    }
+    if (benchMobi) {
+        BenchMobi(filePath);
+        return 0;
+    }
+    if (benchEpub) {
+        BenchEpub(filePath);
+        return 0;
+    }
+
     WIN32_FIND_DATA fdata;
     HANDLE hfind = FindFirstFile(filePath, &fdata);
     // embedded documents are referred to by an invalid path
@@ -551,7 +1435,6 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
         FindClose(hfind);
     }
 
-    PasswordHolder pwdUI(password);
     EngineBase* engine = CreateEngine(filePath, &pwdUI);
 #if 0
     bool isEngineDjVu = IsOfKind(engine, kindEngineDjVu);
@@ -573,6 +1456,15 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char** argv) {
     if (renderPath) {
         RenderDocument(engine, renderPath, renderZoom, silent);
     }
+    if (benchThreads) {
+        BenchRenderThreads(engine, benchZoom);
+    }
+    if (benchBitmap) {
+        BenchBitmapConversion(engine, benchZoom);
+    }
+    if (benchSelect) {
+        BenchTextSelection(engine);
+    }
     delete engine;
 
     return 0;
@@ -15,6 +15,7 @@
 #include "mui/Mui.h"
 #include "utils/PalmDbReader.h"
 #include "utils/TrivialHtmlParser.h"
+#include "utils/Timer.h"
 #include "utils/WinUtil.h"
 #include "utils/ZipUtil.h"
 
@@ -59,6 +60,15 @@ void SetDefaultEbookFont(const WCHAR* name, float size) {
 
 /* common classes for EPUB, FictionBook2, Mobi, PalmDOC, CHM, HTML and TXT engines */
 
+// number of pages laid out while loading (enough for a two-page book view),
+// the rest is laid out on demand or in the background
+constexpr int EBOOK_PAGES_FORMATTED_ON_LOAD = 2;
+// number of pages the background thread lays out at a time
+// before allowing other threads access to the pages
+constexpr int EBOOK_PAGES_FORMATTED_PER_CHUNK = 16;
+// how often a DisplayModel is told about the pages laid out in the background
+constexpr double EBOOK_PAGE_COUNT_UPDATE_INTERVAL_MS = 500;
+
 struct PageAnchor {
     DrawInstr* instr;
     int pageNo;
@@ -82,6 +92,12 @@ class EngineEbook : public EngineBase {
     EngineEbook();
     virtual ~EngineEbook();
 
+    int PageCount() const override;
+
+    bool IsLoadingProgressively() override;
+    void SetProgressiveLoadingCallback(const std::function<void()>& onDataLoaded) override;
+    bool FinishProgressiveLoading() override;
+
     RectF PageMediabox(int pageNo) override;
     RectF PageContentBox(int pageNo, RenderTarget target = RenderTarget::View) override;
 
@@ -112,14 +128,33 @@ class EngineEbook : public EngineBase {
     Vec<DrawInstr*> baseAnchors;
     // needed so that memory allocated by ResolveHtmlEntities isn't leaked
     PoolAllocator allocator;
-    // TODO: still needed?
+    // protects pages, anchors and baseAnchors while they're still being laid out
     CRITICAL_SECTION pagesAccess;
     // page dimensions can vary between filetypes
     RectF pageRect;
     float pageBorder;
 
+    // pages are laid out incrementally: a few while loading, the rest on demand
+    // (see GetHtmlPage) or by formattingThread until formatter runs out of pages
+    HtmlFormatter* formatter = nullptr;
+    bool skipEmptyPages = false;
+    bool finishedFormatting = false;
+    HANDLE formattingThread = nullptr;
+    LONG abortFormatting = 0;
+    // set once a DisplayModel is told about newly laid out pages (see SetProgressiveLoadingCallback):
+    // pageCount then only includes the pages laid out when FinishProgressiveLoading was last called
+    // (else all pages are laid out as soon as the page count is needed)
+    bool provisionalPageCount = false;
+    std::function<void()> onPagesFormatted;
+
     void GetTransform(Matrix& m, float zoom, int rotation);
-    bool ExtractPageAnchors();
+    bool StartFormatting(HtmlFormatter* formatter, bool skipEmptyPages);
+    void FormatPagesUpTo(int pageNo);
+    void FinishFormatting();
+    void StopFormatting();
+    bool LayoutComplete();
+    static DWORD WINAPI FormattingThread(LPVOID data);
+    void ExtractPageAnchors(int pageNo);
     WCHAR* ExtractFontList();
 
     virtual PageElement* CreatePageLink(DrawInstr* link, Rect rect, int pageNo);
@@ -179,6 +214,8 @@ EngineEbook::EngineEbook() {
 }
 
 EngineEbook::~EngineEbook() {
+    StopFormatting();
+
     EnterCriticalSection(&pagesAccess);
 
     if (pages) {
@@ -190,6 +227,48 @@ EngineEbook::~EngineEbook() {
     DeleteCriticalSection(&pagesAccess);
 }
 
+int EngineEbook::PageCount() const {
+    if (!provisionalPageCount) {
+        // the exact number of pages is only known once all pages have been laid out
+        ((EngineEbook*)this)->FinishFormatting();
+    }
+    return EngineBase::PageCount();
+}
+
+// pages are still being laid out resp. haven't all been included in pageCount yet
+bool EngineEbook::IsLoadingProgressively() {
+    ScopedCritSec scope(&pagesAccess);
+    return !finishedFormatting || pageCount < (int)pages->size();
+}
+
+// onDataLoaded is called (on a background thread) whenever more pages have been laid out
+void EngineEbook::SetProgressiveLoadingCallback(const std::function<void()>& onDataLoaded) {
+    ScopedCritSec scope(&pagesAccess);
+    provisionalPageCount = true;
+    onPagesFormatted = onDataLoaded;
+    if (onPagesFormatted && pageCount < (int)pages->size()) {
+        onPagesFormatted();
+    }
+}
+
+// includes all pages laid out so far in pageCount (page sizes never change)
+bool EngineEbook::FinishProgressiveLoading() {
+    ScopedCritSec scope(&pagesAccess);
+    pageCount = (int)pages->size();
+    return false;
+}
+
+// destinations on pages which haven't been laid out yet can't be resolved, so
+// returns false while pages are still being laid out for a DisplayModel
+// (without one, the remaining pages are laid out right away)
+bool EngineEbook::LayoutComplete() {
+    ScopedCritSec scope(&pagesAccess);
+    if (!provisionalPageCount) {
+        FinishFormatting();
+    }
+    return finishedFormatting && pageCount == (int)pages->size();
+}
+
 RectF EngineEbook::PageMediabox([[maybe_unused]] int pageNo) {
     return pageRect;
 }
@@ -231,39 +310,120 @@ void EngineEbook::GetTransform(Matrix& m, float zoom, int rotation) {
     GetBaseTransform(m, ToGdipRectF(pageRect), zoom, rotation);
 }
 
+// lays out the first pages and has the remaining ones laid out in the background
+// (takes ownership of formatter)
+bool EngineEbook::StartFormatting(HtmlFormatter* formatter, bool skipEmptyPages) {
+    CrashIf(pages || this->formatter);
+    pages = new Vec<HtmlPage*>();
+    this->formatter = formatter;
+    this->skipEmptyPages = skipEmptyPages;
+
+    FormatPagesUpTo(EBOOK_PAGES_FORMATTED_ON_LOAD);
+    if (pages->size() == 0) {
+        return false;
+    }
+    pageCount = (int)pages->size();
+    if (!finishedFormatting) {
+        formattingThread = CreateThread(nullptr, 0, FormattingThread, this, 0, nullptr);
+        if (!formattingThread) {
+            FinishFormatting();
+        }
+    }
+    return true;
+}
+
+DWORD WINAPI EngineEbook::FormattingThread(LPVOID data) {
+    EngineEbook* engine = (EngineEbook*)data;
+    auto lastUpdate = TimeGet();
+    while (!InterlockedAdd(&engine->abortFormatting, 0)) {
+        // release pagesAccess after every few pages so that
+        // pages which have already been laid out can be rendered
+        ScopedCritSec scope(&engine->pagesAccess);
+        if (engine->finishedFormatting) {
+            break;
+        }
+        engine->FormatPagesUpTo((int)engine->pages->size() + EBOOK_PAGES_FORMATTED_PER_CHUNK);
+        if (engine->onPagesFormatted && !engine->finishedFormatting &&
+            TimeSinceInMs(lastUpdate) >= EBOOK_PAGE_COUNT_UPDATE_INTERVAL_MS) {
+            engine->onPagesFormatted();
+            lastUpdate = TimeGet();
+        }
+    }
+    return 0;
+}
+
+// lays out pages until there are at least pageNo of them (or there are no more)
+void EngineEbook::FormatPagesUpTo(int pageNo) {
+    ScopedCritSec scope(&pagesAccess);
+
+    while (formatter && !finishedFormatting && (int)pages->size() < pageNo) {
+        HtmlPage* page = formatter->Next(skipEmptyPages);
+        if (!page) {
+            delete formatter;
+            formatter = nullptr;
+            finishedFormatting = true;
+            if (!provisionalPageCount) {
+                pageCount = (int)pages->size();
+            } else if (onPagesFormatted) {
+                onPagesFormatted();
+            }
+            break;
+        }
+        pages->Append(page);
+        ExtractPageAnchors((int)pages->size());
+    }
+}
+
+// lays out all remaining pages (e.g. for when the page count is needed)
+void EngineEbook::FinishFormatting() {
+    FormatPagesUpTo(INT_MAX);
+}
+
+// stops the background layout and destroys the formatter (to be called by
+// subclasses before they destroy the data the formatter depends on)
+void EngineEbook::StopFormatting() {
+    if (formattingThread) {
+        InterlockedIncrement(&abortFormatting);
+        WaitForSingleObject(formattingThread, INFINITE);
+        CloseHandle(formattingThread);
+        formattingThread = nullptr;
+    }
+    delete formatter;
+    formatter = nullptr;
+}
+
 Vec<DrawInstr>* EngineEbook::GetHtmlPage(int pageNo) {
-    CrashIf(pageNo < 1 || PageCount() < pageNo);
-    if (pageNo < 1 || PageCount() < pageNo) {
+    ScopedCritSec scope(&pagesAccess);
+
+    FormatPagesUpTo(pageNo);
+    CrashIf(pageNo < 1 || (int)pages->size() < pageNo);
+    if (pageNo < 1 || (int)pages->size() < pageNo) {
         return nullptr;
     }
+    // HtmlPages are never moved, so the instructions remain valid
+    // even after pagesAccess has been released
     return &pages->at(pageNo - 1)->instructions;
 }
 
-bool EngineEbook::ExtractPageAnchors() {
-    ScopedCritSec scope(&pagesAccess);
+// collects the anchors of a newly laid out page (must be called in pagesAccess)
+void EngineEbook::ExtractPageAnchors(int pageNo) {
+    CrashIf(baseAnchors.size() != (size_t)pageNo - 1);
+    DrawInstr* baseAnchor = baseAnchors.size() > 0 ? baseAnchors.Last() : nullptr;
+    Vec<DrawInstr>* pageInstrs = &pages->at(pageNo - 1)->instructions;
 
-    DrawInstr* baseAnchor = nullptr;
-    for (int pageNo = 1; pageNo <= pageCount; pageNo++) {
-        Vec<DrawInstr>* pageInstrs = GetHtmlPage(pageNo);
-        if (!pageInstrs) {
-            return false;
+    for (size_t k = 0; k < pageInstrs->size(); k++) {
+        DrawInstr* i = &pageInstrs->at(k);
+        if (DrawInstrType::Anchor != i->type) {
+            continue;
         }
-
-        for (size_t k = 0; k < pageInstrs->size(); k++) {
-            DrawInstr* i = &pageInstrs->at(k);
-            if (DrawInstrType::Anchor != i->type) {
-                continue;
-            }
-            anchors.Append(PageAnchor(i, pageNo));
-            if (k < 2 && str::StartsWith(i->str.s + i->str.len, "\" page_marker />")) {
-                baseAnchor = i;
-            }
+        anchors.Append(PageAnchor(i, pageNo));
+        if (k < 2 && str::StartsWith(i->str.s + i->str.len, "\" page_marker />")) {
+            baseAnchor = i;
         }
-        baseAnchors.Append(baseAnchor);
     }
+    baseAnchors.Append(baseAnchor);
 
     CrashIf(baseAnchors.size() != pages->size());
-    return true;
 }
 
 RectF EngineEbook::Transform(const RectF& rect, [[maybe_unused]] int pageNo, float zoom, int rotation, bool inverse) {
@@ -447,6 +607,8 @@ PageElement* EngineEbook::CreatePageLink(DrawInstr* link, Rect rect, int pageNo)
 Vec<IPageElement*>* EngineEbook::GetElements(int pageNo) {
     auto els = new Vec<IPageElement*>();
 
+    // links are resolved through anchors and baseAnchors
+    ScopedCritSec scope(&pagesAccess);
     Vec<DrawInstr>* pageInstrs = GetHtmlPage(pageNo);
     size_t n = pageInstrs->size();
     for (size_t idx = 0; idx < n; idx++) {
@@ -511,6 +673,11 @@ IPageElement* EngineEbook::GetElementAtPos(int pageNo, PointF pt) {
 }
 
 PageDestination* EngineEbook::GetNamedDest(const WCHAR* name) {
+    ScopedCritSec scope(&pagesAccess);
+    // while pages are laid out for a DisplayModel, only
+    // the anchors of the pages laid out so far are known
+    LayoutComplete();
+
     AutoFree name_utf8(strconv::WstrToUtf8(name));
     const char* id = name_utf8.Get();
     if (str::FindChar(id, '#')) {
@@ -564,11 +731,12 @@ PageDestination* EngineEbook::GetNamedDest(const WCHAR* name) {
 
 WCHAR* EngineEbook::ExtractFontList() {
     ScopedCritSec scope(&pagesAccess);
+    FinishFormatting();
 
     Vec<mui::CachedFont*> seenFonts;
     WStrVec fonts;
 
-    for (int pageNo = 1; pageNo <= PageCount(); pageNo++) {
+    for (int pageNo = 1; pageNo <= (int)pages->size(); pageNo++) {
         Vec<DrawInstr>* pageInstrs = GetHtmlPage(pageNo);
         if (!pageInstrs) {
             continue;
@@ -709,6 +877,7 @@ EngineEpub::EngineEpub() : EngineEbook() {
 }
 
 EngineEpub::~EngineEpub() {
+    StopFormatting();
     delete doc;
     delete tocTree;
     if (stream) {
@@ -753,7 +922,8 @@ bool EngineEpub::FinishLoading() {
     }
 
     HtmlFormatterArgs args{};
-    args.htmlStr = doc->GetHtmlData();
+    // the formatter loads the remaining chapters as it reaches them
+    args.htmlStr = doc->LoadChapters(0);
     args.pageDx = (float)pageRect.dx - 2 * pageBorder;
     args.pageDy = (float)pageRect.dy - 2 * pageBorder;
     args.SetFontName(GetDefaultFontName());
@@ -761,11 +931,7 @@ bool EngineEpub::FinishLoading() {
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = EpubFormatter(&args, doc).FormatAllPages(false);
-
-    // must set pageCount before ExtractPageAnchors
-    pageCount = (int)pages->size();
-    if (!ExtractPageAnchors()) {
+    if (!StartFormatting(new EpubFormatter(&args, doc), false)) {
         return false;
     }
 
@@ -775,7 +941,7 @@ bool EngineEpub::FinishLoading() {
         preferredLayout = Layout_Book;
     }
 
-    return pageCount > 0;
+    return true;
 }
 
 std::span<u8> EngineEpub::GetFileData() {
@@ -804,6 +970,9 @@ TocTree* EngineEpub::GetToc() {
     if (tocTree) {
         return tocTree;
     }
+    if (!LayoutComplete()) {
+        return nullptr;
+    }
     EbookTocBuilder builder(this);
     doc->ParseToc(&builder);
     TocItem* root = builder.GetRoot();
@@ -849,6 +1018,7 @@ class EngineFb2 : public EngineEbook {
         defaultFileExt = L".fb2";
     }
     virtual ~EngineFb2() {
+        StopFormatting();
         delete tocTree;
         delete doc;
     }
@@ -907,19 +1077,16 @@ bool EngineFb2::FinishLoading() {
         defaultFileExt = L".fb2z";
     }
 
-    pages = Fb2Formatter(&args, doc).FormatAllPages(false);
-    // must set pageCount before ExtractPageAnchors
-    pageCount = (int)pages->size();
-    if (!ExtractPageAnchors()) {
-        return false;
-    }
-    return pageCount > 0;
+    return StartFormatting(new Fb2Formatter(&args, doc), false);
 }
 
 TocTree* EngineFb2::GetToc() {
     if (tocTree) {
         return tocTree;
     }
+    if (!LayoutComplete()) {
+        return nullptr;
+    }
     EbookTocBuilder builder(this);
     doc->ParseToc(&builder);
     TocItem* root = builder.GetRoot();
@@ -967,6 +1134,7 @@ class EngineMobi : public EngineEbook {
         defaultFileExt = L".mobi";
     }
     ~EngineMobi() override {
+        StopFormatting();
         delete tocTree;
         delete doc;
     }
@@ -1022,13 +1190,7 @@ bool EngineMobi::FinishLoading() {
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = MobiFormatter(&args, doc).FormatAllPages();
-    // must set pageCount before ExtractPageAnchors
-    pageCount = (int)pages->size();
-    if (!ExtractPageAnchors()) {
-        return false;
-    }
-    return pageCount > 0;
+    return StartFormatting(new MobiFormatter(&args, doc), true);
 }
 
 PageDestination* EngineMobi::GetNamedDest(const WCHAR* name) {
@@ -1036,13 +1198,20 @@ PageDestination* EngineMobi::GetNamedDest(const WCHAR* name) {
     if (filePos < 0 || 0 == filePos && *name != '0') {
         return nullptr;
     }
+    ScopedCritSec scope(&pagesAccess);
+    bool layoutComplete = LayoutComplete();
+    int nPages = (int)pages->size();
     int pageNo;
-    for (pageNo = 1; pageNo < PageCount(); pageNo++) {
+    for (pageNo = 1; pageNo < nPages; pageNo++) {
         if (pages->at(pageNo)->reparseIdx > filePos) {
             break;
         }
     }
-    CrashIf(pageNo < 1 || pageNo > PageCount());
+    if (pageNo == nPages && !layoutComplete) {
+        // filePos might be on a page which hasn't been laid out yet
+        return nullptr;
+    }
+    CrashIf(pageNo < 1 || pageNo > nPages);
 
     const std::span<u8> htmlData = doc->GetHtmlData();
     size_t htmlLen = htmlData.size();
@@ -1051,7 +1220,6 @@ PageDestination* EngineMobi::GetNamedDest(const WCHAR* name) {
         return nullptr;
     }
 
-    ScopedCritSec scope(&pagesAccess);
     Vec<DrawInstr>* pageInstrs = GetHtmlPage(pageNo);
     // link to the bottom of the page, if filePos points
     // beyond the last visible DrawInstr of a page
@@ -1072,6 +1240,9 @@ TocTree* EngineMobi::GetToc() {
     if (tocTree) {
         return tocTree;
     }
+    if (!LayoutComplete()) {
+        return nullptr;
+    }
     EbookTocBuilder builder(this);
     doc->ParseToc(&builder);
     TocItem* root = builder.GetRoot();
@@ -1117,6 +1288,7 @@ class EnginePdb : public EngineEbook {
         defaultFileExt = L".pdb";
     }
     virtual ~EnginePdb() {
+        StopFormatting();
         delete tocTree;
         delete doc;
     }
@@ -1160,20 +1332,16 @@ bool EnginePdb::Load(const WCHAR* fileName) {
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = HtmlFormatter(&args).FormatAllPages();
-    // must set pageCount before ExtractPageAnchors
-    pageCount = (int)pages->size();
-    if (!ExtractPageAnchors()) {
-        return false;
-    }
-
-    return pageCount > 0;
+    return StartFormatting(new HtmlFormatter(&args), true);
 }
 
 TocTree* EnginePdb::GetToc() {
     if (tocTree) {
         return tocTree;
     }
+    if (!LayoutComplete()) {
+        return nullptr;
+    }
     EbookTocBuilder builder(this);
     doc->ParseToc(&builder);
     auto* root = builder.GetRoot();
@@ -1201,43 +1369,25 @@ EngineBase* CreatePdbEngineFromFile(const WCHAR* fileName) {
 class ChmDataCache {
     ChmDoc* doc = nullptr; // owned by creator
     AutoFree html;
-    Vec<ImageData2> images;
+    EbookImages images;
 
   public:
     ChmDataCache(ChmDoc* doc, char* html) : doc(doc), html(html) {
     }
 
-    ~ChmDataCache() {
-        for (size_t i = 0; i < images.size(); i++) {
-            free(images.at(i).base.data);
-            free(images.at(i).fileName);
-        }
-    }
-
     std::span<u8> GetHtmlData() {
         return html.AsSpan();
     }
 
     ImageData* GetImageData(const char* id, const char* pagePath) {
         AutoFree url(NormalizeURL(id, pagePath));
-        for (size_t i = 0; i < images.size(); i++) {
-            if (str::Eq(images.at(i).fileName, url)) {
-                return &images.at(i).base;
-            }
-        }
-
-        auto tmp = doc->GetData(url);
-        if (tmp.empty()) {
-            return nullptr;
+        ImageData2* img = images.Find(url);
+        if (!img) {
+            // also remember missing images so that they aren't looked up again
+            auto data = doc->GetData(url);
+            img = images.Add(url.Release(), data);
         }
-
-        ImageData2 data = {0};
-        data.base.data = (char*)tmp.data();
-        data.base.len = tmp.size();
-
-        data.fileName = url.Release();
-        images.Append(data);
-        return &images.Last().base;
+        return img->base.data ? &img->base : nullptr;
     }
 
     std::span<u8> GetFileData(const char* relPath, const char* pagePath) {
@@ -1329,6 +1479,7 @@ class EngineChm : public EngineEbook {
         defaultFileExt = L".chm";
     }
     virtual ~EngineChm() {
+        StopFormatting();
         delete dataCache;
         delete doc;
         delete tocTree;
@@ -1482,14 +1633,7 @@ bool EngineChm::Load(const WCHAR* fileName) {
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplusQuick;
 
-    pages = ChmFormatter(&args, dataCache).FormatAllPages(false);
-    // must set pageCount before ExtractPageAnchors
-    pageCount = (int)pages->size();
-    if (!ExtractPageAnchors()) {
-        return false;
-    }
-
-    return pageCount > 0;
+    return StartFormatting(new ChmFormatter(&args, dataCache), false);
 }
 
 PageDestination* EngineChm::GetNamedDest(const WCHAR* name) {
@@ -1512,6 +1656,9 @@ TocTree* EngineChm::GetToc() {
     if (tocTree) {
         return tocTree;
     }
+    if (!LayoutComplete()) {
+        return nullptr;
+    }
     EbookTocBuilder builder(this);
     doc->ParseToc(&builder);
     if (doc->HasIndex()) {
@@ -1579,6 +1726,7 @@ class EngineHtml : public EngineEbook {
         defaultFileExt = L".html";
     }
     virtual ~EngineHtml() {
+        StopFormatting();
         delete doc;
     }
     EngineBase* Clone() override {
@@ -1620,14 +1768,7 @@ bool EngineHtml::Load(const WCHAR* fileName) {
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplus;
 
-    pages = HtmlFileFormatter(&args, doc).FormatAllPages(false);
-    // must set pageCount before ExtractPageAnchors
-    pageCount = (int)pages->size();
-    if (!ExtractPageAnchors()) {
-        return false;
-    }
-
-    return pageCount > 0;
+    return StartFormatting(new HtmlFileFormatter(&args, doc), false);
 }
 
 static PageDestination* newRemoteHtmlDest(const WCHAR* relativeURL) {
@@ -1681,6 +1822,7 @@ class EngineTxt : public EngineEbook {
         defaultFileExt = L".txt";
     }
     virtual ~EngineTxt() {
+        StopFormatting();
         delete tocTree;
         delete doc;
     }
@@ -1735,20 +1877,16 @@ bool EngineTxt::Load(const WCHAR* fileName) {
     args.textAllocator = &allocator;
     args.textRenderMethod = mui::TextRenderMethodGdiplus;
 
-    pages = TxtFormatter(&args).FormatAllPages(false);
-    // must set pageCount before ExtractPageAnchors
-    pageCount = (int)pages->size();
-    if (!ExtractPageAnchors()) {
-        return false;
-    }
-
-    return pageCount > 0;
+    return StartFormatting(new TxtFormatter(&args), false);
 }
 
 TocTree* EngineTxt::GetToc() {
     if (tocTree) {
         return tocTree;
     }
+    if (!LayoutComplete()) {
+        return nullptr;
+    }
     EbookTocBuilder builder(this);
     doc->ParseToc(&builder);
     auto* root = builder.GetRoot();
@@ -13,6 +13,7 @@ extern "C" {
 #include "utils/FileUtil.h"
 #include "utils/HtmlParserLookup.h"
 #include "utils/HtmlPullParser.h"
+#include "utils/Timer.h"
 #include "utils/TrivialHtmlParser.h"
 #include "utils/WinUtil.h"
 #include "utils/ZipUtil.h"
@@ -27,11 +28,79 @@ extern "C" {
 
 // extensions to Fitz that are usable for both PDF and XPS
 
+extern "C" void pdf_install_load_system_font_funcs(fz_context* ctx);
+
 // maximum size of a file that's entirely loaded into memory before parsed
-// and displayed; larger files will be kept open while they're displayed
-// so that their content can be loaded on demand in order to preserve memory
+// and displayed; larger files will be kept open (memory mapped if possible)
+// while they're displayed so that their content can be loaded on demand
+// in order to preserve memory
 #define MAX_MEMORY_FILE_SIZE (32 * 1024 * 1024)
 
+// files from this size on are read lazily instead of at once (see fz_open_file2)
+#define MIN_LAZY_FILE_SIZE (1 * 1024 * 1024)
+
+static CRITICAL_SECTION gFzMutexes[FZ_LOCK_MAX];
+
+static void fz_lock_shared_context([[maybe_unused]] void* user, int lock) {
+    EnterCriticalSection(&gFzMutexes[lock]);
+}
+
+static void fz_unlock_shared_context([[maybe_unused]] void* user, int lock) {
+    LeaveCriticalSection(&gFzMutexes[lock]);
+}
+
+static fz_context* new_shared_context() {
+    for (size_t i = 0; i < dimof(gFzMutexes); i++) {
+        InitializeCriticalSection(&gFzMutexes[i]);
+    }
+    fz_locks_context locks{};
+    locks.lock = fz_lock_shared_context;
+    locks.unlock = fz_unlock_shared_context;
+    fz_context* ctx = fz_new_context(nullptr, &locks, MAX_CONTEXT_MEMORY);
+    if (ctx) {
+        // the font context is shared with all clones
+        pdf_install_load_system_font_funcs(ctx);
+        fz_set_glyph_cache_size(ctx, MAX_GLYPH_CACHE_SIZE);
+    }
+    return ctx;
+}
+
+static fz_context* get_shared_context() {
+    static fz_context* sharedCtx = new_shared_context();
+    return sharedCtx;
+}
+
+// All documents share a single process-wide store (and font, glyph and
+// colorspace caches) so that fonts and images are cached only once and
+// are evicted in LRU order across documents within MAX_CONTEXT_MEMORY.
+// Each engine gets its own clone, which like any fz_context must only be
+// used by one thread at a time (i.e. under the engine's ctxAccess).
+// The shared context is only used directly for the thread-safe glyph cache
+// functions below and lives until the process exits
+fz_context* fz_clone_shared_context() {
+    fz_context* sharedCtx = get_shared_context();
+    if (!sharedCtx) {
+        return nullptr;
+    }
+    return fz_clone_context(sharedCtx);
+}
+
+void fz_set_shared_glyph_cache_size(size_t maxSize) {
+    fz_context* sharedCtx = get_shared_context();
+    if (sharedCtx) {
+        fz_set_glyph_cache_size(sharedCtx, maxSize);
+    }
+}
+
+fz_glyph_cache_stats fz_get_shared_glyph_cache_stats() {
+    fz_glyph_cache_stats stats{};
+    fz_context* sharedCtx = get_shared_context();
+    if (sharedCtx) {
+        fz_get_glyph_cache_stats(sharedCtx, &stats);
+    }
+    return stats;
+}
+
 RectF ToRectFl(fz_rect rect) {
     return RectF::FromXY(rect.x0, rect.y0, rect.x1, rect.y1);
 }
@@ -169,54 +238,462 @@ void* fz_memdup(fz_context* ctx, void* p, size_t size) {
     return res;
 }
 
+// size of the blocks in which lazily read files are read
+#define LAZY_FILE_BLOCK_SIZE (64 * 1024)
+
+// a private copy of a file whose blocks are read from disk when they're first
+// accessed, so that parsing can start before the whole file has been read
+// (address space for the whole file is reserved upfront and committed block
+// by block). the remaining blocks are read on a low priority background thread,
+// after which the file is closed, so that it can be overwritten even by programs
+// that don't open files with FILE_SHARE_READ. until then, the file is open with
+// full sharing and if it's modified in the meantime, reading blocks that haven't
+// been read yet fails (instead of mixing old and new content)
+struct lazy_file {
+    CRITICAL_SECTION access;
+    HANDLE hFile;
+    HANDLE thread;
+    LONG abort;
+    // size and last modification time when the file was opened
+    i64 size;
+    FILETIME lastWrite;
+    bool changed;
+    u8* data;
+    // one flag per block which has been read
+    u8* blocksRead;
+    i64 blocksCount;
+};
+
+static bool lazy_file_changed(lazy_file* state) {
+    BY_HANDLE_FILE_INFORMATION info{};
+    if (!GetFileInformationByHandle(state->hFile, &info)) {
+        return true;
+    }
+    i64 size = ((i64)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    return size != state->size || CompareFileTime(&info.ftLastWriteTime, &state->lastWrite) != 0;
+}
+
+// returns false if the block couldn't be read or the file has been modified
+// caller must hold state->access
+static bool lazy_file_read_block(lazy_file* state, i64 block) {
+    if (state->blocksRead[block]) {
+        return true;
+    }
+    if (state->changed || !state->hFile) {
+        return false;
+    }
+    i64 offset = block * LAZY_FILE_BLOCK_SIZE;
+    DWORD len = (DWORD)std::min(state->size - offset, (i64)LAZY_FILE_BLOCK_SIZE);
+    u8* dst = state->data + offset;
+    if (!VirtualAlloc(dst, len, MEM_COMMIT, PAGE_READWRITE)) {
+        return false;
+    }
+    OVERLAPPED ov{};
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    DWORD nRead = 0;
+    BOOL ok = ReadFile(state->hFile, dst, len, &nRead, &ov);
+    // checking after reading also catches modifications while reading
+    if (lazy_file_changed(state)) {
+        state->changed = true;
+        return false;
+    }
+    if (!ok || nRead != len) {
+        return false;
+    }
+    state->blocksRead[block] = 1;
+    return true;
+}
+
+static void lazy_file_close(lazy_file* state) {
+    if (state->hFile) {
+        CloseHandle(state->hFile);
+        state->hFile = nullptr;
+    }
+}
+
+static DWORD WINAPI ReadLazyFileThread(LPVOID data) {
+    lazy_file* state = (lazy_file*)data;
+    // also lowers the I/O priority so that blocks needed for display are read first
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+    i64 block = 0;
+    for (; block < state->blocksCount && !InterlockedAdd(&state->abort, 0); block++) {
+        ScopedCritSec scope(&state->access);
+        if (!lazy_file_read_block(state, block)) {
+            break;
+        }
+    }
+    // once all blocks have been read (or the file has changed anyway), it's no longer needed
+    ScopedCritSec scope(&state->access);
+    if (block == state->blocksCount || state->changed) {
+        lazy_file_close(state);
+    }
+    return 0;
+}
+
+extern "C" int next_lazy_file(fz_context* ctx, fz_stream* stm, [[maybe_unused]] size_t max) {
+    lazy_file* state = (lazy_file*)stm->state;
+    i64 pos = stm->pos;
+    if (pos >= state->size) {
+        return EOF;
+    }
+    i64 block = pos / LAZY_FILE_BLOCK_SIZE;
+    i64 end = block;
+    {
+        ScopedCritSec scope(&state->access);
+        if (!lazy_file_read_block(state, block)) {
+            fz_throw(ctx, FZ_ERROR_GENERIC, "failed to read the file at offset %lld", (long long)pos);
+        }
+        // also hand out the following blocks which have already been read
+        while (end + 1 < state->blocksCount && state->blocksRead[end + 1]) {
+            end++;
+        }
+    }
+    stm->rp = state->data + pos;
+    stm->pos = std::min((end + 1) * LAZY_FILE_BLOCK_SIZE, state->size);
+    stm->wp = state->data + stm->pos;
+    return *stm->rp++;
+}
+
+extern "C" void seek_lazy_file([[maybe_unused]] fz_context* ctx, fz_stream* stm, i64 offset, int whence) {
+    lazy_file* state = (lazy_file*)stm->state;
+    // fz_seek has already turned relative seeks into absolute ones
+    if (whence == 2) {
+        offset += state->size;
+    }
+    // the next read will make sure that the data at offset has been read
+    stm->pos = std::clamp(offset, (i64)0, state->size);
+    stm->rp = stm->wp = state->data;
+}
+
+extern "C" void drop_lazy_file(fz_context* ctx, void* state_) {
+    lazy_file* state = (lazy_file*)state_;
+    if (state->thread) {
+        InterlockedExchange(&state->abort, 1);
+        WaitForSingleObject(state->thread, INFINITE);
+        CloseHandle(state->thread);
+    }
+    lazy_file_close(state);
+    DeleteCriticalSection(&state->access);
+    VirtualFree(state->data, 0, MEM_RELEASE);
+    fz_free(ctx, state->blocksRead);
+    fz_free(ctx, state);
+}
+
+// reads the parts of the file mupdf parses first on demand and the rest
+// in the background (see lazy_file)
+static fz_stream* fz_open_lazy_file(fz_context* ctx, const WCHAR* filePath) {
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    HANDLE h = CreateFileW(filePath, GENERIC_READ, share, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    BY_HANDLE_FILE_INFORMATION info{};
+    i64 fileSize = 0;
+    if (GetFileInformationByHandle(h, &info)) {
+        fileSize = ((i64)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    }
+    // e.g. not enough contiguous address space in 32-bit builds
+    u8* data = nullptr;
+    if (fileSize > 0 && (u64)fileSize <= SIZE_MAX) {
+        data = (u8*)VirtualAlloc(nullptr, (size_t)fileSize, MEM_RESERVE, PAGE_NOACCESS);
+    }
+    if (!data) {
+        CloseHandle(h);
+        return nullptr;
+    }
+
+    lazy_file* state = nullptr;
+    fz_var(state);
+    fz_try(ctx) {
+        state = fz_malloc_struct(ctx, lazy_file);
+        state->blocksCount = (fileSize + LAZY_FILE_BLOCK_SIZE - 1) / LAZY_FILE_BLOCK_SIZE;
+        state->blocksRead = (u8*)fz_calloc(ctx, (size_t)state->blocksCount, 1);
+    }
+    fz_catch(ctx) {
+        if (state) {
+            fz_free(ctx, state);
+        }
+        VirtualFree(data, 0, MEM_RELEASE);
+        CloseHandle(h);
+        return nullptr;
+    }
+    InitializeCriticalSection(&state->access);
+    state->hFile = h;
+    state->size = fileSize;
+    state->lastWrite = info.ftLastWriteTime;
+    state->data = data;
+    // if the thread can't be started, the file is only read on demand (and kept open)
+    state->thread = CreateThread(nullptr, 0, ReadLazyFileThread, state, 0, nullptr);
+
+    fz_stream* stm = nullptr;
+    fz_try(ctx) {
+        stm = fz_new_stream(ctx, state, next_lazy_file, drop_lazy_file);
+    }
+    fz_catch(ctx) {
+        // fz_new_stream drops state on failure
+        return nullptr;
+    }
+    stm->seek = seek_lazy_file;
+    return stm;
+}
+
+// reads the whole file into a buffer owned by mupdf (so that it works
+// across dll boundaries) without first reading it into a temporary buffer
+static fz_stream* fz_open_file_in_memory(fz_context* ctx, const WCHAR* filePath, i64 fileSize) {
+    fz_buffer* buf = nullptr;
+    fz_stream* stm = nullptr;
+    fz_var(buf);
+    fz_try(ctx) {
+        buf = fz_new_buffer(ctx, (size_t)fileSize);
+        int nRead = file::ReadN(filePath, (char*)buf->data, (size_t)fileSize);
+        if (nRead != fileSize) {
+            fz_throw(ctx, FZ_ERROR_GENERIC, "failed to read the file");
+        }
+        buf->len = (size_t)fileSize;
+        stm = fz_open_buffer(ctx, buf);
+    }
+    fz_always(ctx) {
+        fz_drop_buffer(ctx, buf);
+    }
+    fz_catch(ctx) {
+        stm = nullptr;
+    }
+    return stm;
+}
+
 fz_stream* fz_open_file2(fz_context* ctx, const WCHAR* filePath) {
     fz_stream* stm = nullptr;
     AutoFreeStr path = strconv::WstrToUtf8(filePath);
     i64 fileSize = file::GetSize(path.AsView());
     // load small files entirely into memory so that they can be
     // overwritten even by programs that don't open files with FILE_SHARE_READ
+    // (which is why they aren't memory mapped, as a mapped file can't be truncated)
     if (fileSize > 0 && fileSize < MAX_MEMORY_FILE_SIZE) {
-        auto dataTmp = file::ReadFileWithAllocator(filePath, nullptr);
-        if (dataTmp.empty()) {
-            // failed to read
-            return nullptr;
+        // larger ones on local drives are only read as far as needed before parsing
+        // starts (reading on demand could fail for network or removable drives)
+        if (fileSize >= MIN_LAZY_FILE_SIZE && path::IsOnFixedDrive(filePath)) {
+            stm = fz_open_lazy_file(ctx, filePath);
+            if (stm) {
+                return stm;
+            }
         }
+        return fz_open_file_in_memory(ctx, filePath, fileSize);
+    }
 
-        // TODO: we copy so that the memory ends up in chunk allocated
-        // by libmupdf so that it works across dll boundaries.
-        // We can either use  fz_new_buffer_from_shared_data
-        // and free the data on the side or create Allocator that
-        // uses fz_malloc_no_throw and pass it to ReadFileWithAllocator
-        size_t size = dataTmp.size();
-        void* data = fz_memdup(ctx, (void*)dataTmp.data(), size);
-        if (!data) {
-            return nullptr;
-        }
-        str::Free(dataTmp.data());
+    fz_try(ctx) {
+        stm = fz_open_file_w(ctx, filePath);
+    }
+    fz_catch(ctx) {
+        stm = nullptr;
+    }
+    return stm;
+}
+
+// size of the chunks in which progressively loaded files are read
+#define PROGRESSIVE_READ_CHUNK_SIZE (64 * 1024)
+// larger files are loaded normally (the whole file is kept in memory)
+#define MAX_PROGRESSIVE_FILE_SIZE (256 * 1024 * 1024)
+
+// a file that is read sequentially into memory on a background thread
+// (the thread doesn't touch the fz_stream or any fz_context)
+struct progressive_file {
+    HANDLE hFile;
+    HANDLE thread;
+    // signaled once reading has finished (successfully or not)
+    HANDLE doneEvent;
+    u8* data;
+    i64 size;
+    // number of bytes at the start of data which have been read so far
+    LONG64 available;
+    LONG failed;
+    LONG abort;
+    // if > 0, data doesn't become available faster than this
+    int bytesPerSec;
+    // if set, reading data that hasn't arrived yet throws FZ_ERROR_TRYLATER
+    // (only accessed by the thread currently using the stream)
+    bool tryLater;
+};
 
-        fz_buffer* buf = fz_new_buffer_from_data(ctx, (u8*)data, size);
-        fz_var(buf);
-        fz_try(ctx) {
-            stm = fz_open_buffer(ctx, buf);
+static DWORD WINAPI ReadProgressiveFileThread(LPVOID data) {
+    progressive_file* state = (progressive_file*)data;
+    DWORD chunkSize = PROGRESSIVE_READ_CHUNK_SIZE;
+    if (state->bytesPerSec > 0) {
+        // deliver throttled data in steps of about 1/10 s
+        chunkSize = std::clamp((DWORD)state->bytesPerSec / 10, (DWORD)512, chunkSize);
+    }
+    auto timeStart = TimeGet();
+    i64 nRead = 0;
+    while (nRead < state->size && !InterlockedAdd(&state->abort, 0)) {
+        DWORD toRead = (DWORD)std::min(state->size - nRead, (i64)chunkSize);
+        DWORD n = 0;
+        BOOL ok = ReadFile(state->hFile, state->data + nRead, toRead, &n, nullptr);
+        if (!ok || n == 0) {
+            InterlockedExchange(&state->failed, 1);
+            break;
         }
-        fz_always(ctx) {
-            fz_drop_buffer(ctx, buf);
+        nRead += n;
+        if (state->bytesPerSec > 0) {
+            double dueMs = (double)nRead * 1000 / state->bytesPerSec;
+            while (TimeSinceInMs(timeStart) < dueMs && !InterlockedAdd(&state->abort, 0)) {
+                Sleep(10);
+            }
         }
-        fz_catch(ctx) {
-            stm = nullptr;
+        InterlockedExchange64(&state->available, nRead);
+    }
+    SetEvent(state->doneEvent);
+    return 0;
+}
+
+// blocks until the data at pos has been read (or reading has failed)
+// and returns the number of bytes available
+static i64 WaitForProgressiveData(progressive_file* state, i64 pos) {
+    i64 available = InterlockedAdd64(&state->available, 0);
+    while (available <= pos) {
+        if (WaitForSingleObject(state->doneEvent, 5) == WAIT_OBJECT_0) {
+            return InterlockedAdd64(&state->available, 0);
         }
-        return stm;
+        available = InterlockedAdd64(&state->available, 0);
+    }
+    return available;
+}
+
+extern "C" int next_progressive_file(fz_context* ctx, fz_stream* stm, [[maybe_unused]] size_t max) {
+    progressive_file* state = (progressive_file*)stm->state;
+    i64 pos = stm->pos;
+    if (pos >= state->size) {
+        return EOF;
+    }
+    i64 available = InterlockedAdd64(&state->available, 0);
+    if (available <= pos && state->tryLater) {
+        // mupdf doesn't consider the stream broken and tries again later
+        fz_throw(ctx, FZ_ERROR_TRYLATER, "data at offset %lld hasn't been read yet", (long long)pos);
+    }
+    available = WaitForProgressiveData(state, pos);
+    if (available <= pos) {
+        fz_throw(ctx, FZ_ERROR_GENERIC, "failed to read the file at offset %lld", (long long)pos);
+    }
+    stm->rp = state->data + pos;
+    stm->wp = state->data + available;
+    stm->pos = available;
+    return *stm->rp++;
+}
+
+extern "C" void seek_progressive_file([[maybe_unused]] fz_context* ctx, fz_stream* stm, i64 offset, int whence) {
+    progressive_file* state = (progressive_file*)stm->state;
+    // fz_seek has already turned relative seeks into absolute ones
+    if (whence == 2) {
+        offset += state->size;
     }
+    // the next read will wait for the data at offset
+    stm->pos = std::clamp(offset, (i64)0, state->size);
+    stm->rp = stm->wp = state->data;
+}
 
+extern "C" void drop_progressive_file(fz_context* ctx, void* state_) {
+    progressive_file* state = (progressive_file*)state_;
+    InterlockedExchange(&state->abort, 1);
+    WaitForSingleObject(state->thread, INFINITE);
+    CloseHandle(state->thread);
+    CloseHandle(state->doneEvent);
+    CloseHandle(state->hFile);
+    free(state->data);
+    fz_free(ctx, state);
+}
+
+// for slow (e.g. network) drives: reads the file sequentially into memory on
+// a background thread while mupdf can already parse the data read so far.
+// the stream is marked as progressive so that mupdf loads linearized documents
+// from the start of the file (instead of from the xref table at its end).
+// reading data that hasn't arrived yet blocks until it has, unless FZ_ERROR_TRYLATER
+// has been requested with fz_set_stream_try_later
+// bytesPerSec > 0 throttles reading (for simulating a slow network share)
+fz_stream* fz_open_file_progressive(fz_context* ctx, const WCHAR* filePath, int bytesPerSec) {
+    AutoFreeStr path = strconv::WstrToUtf8(filePath);
+    i64 fileSize = file::GetSize(path.AsView());
+    if (fileSize <= 0 || fileSize > MAX_PROGRESSIVE_FILE_SIZE) {
+        return nullptr;
+    }
+    DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+    HANDLE h = CreateFileW(filePath, GENERIC_READ, share, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    u8* data = (u8*)malloc((size_t)fileSize);
+    if (!data) {
+        CloseHandle(h);
+        return nullptr;
+    }
+
+    progressive_file* state = nullptr;
+    fz_stream* stm = nullptr;
+    fz_var(state);
     fz_try(ctx) {
-        stm = fz_open_file_w(ctx, filePath);
+        state = fz_malloc_struct(ctx, progressive_file);
     }
     fz_catch(ctx) {
-        stm = nullptr;
+        free(data);
+        CloseHandle(h);
+        return nullptr;
+    }
+    state->hFile = h;
+    state->data = data;
+    state->size = fileSize;
+    state->bytesPerSec = bytesPerSec;
+    state->doneEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+    state->thread = CreateThread(nullptr, 0, ReadProgressiveFileThread, state, 0, nullptr);
+    if (!state->thread) {
+        CloseHandle(state->doneEvent);
+        fz_free(ctx, state);
+        free(data);
+        CloseHandle(h);
+        return nullptr;
+    }
+
+    fz_try(ctx) {
+        stm = fz_new_stream(ctx, state, next_progressive_file, drop_progressive_file);
     }
+    fz_catch(ctx) {
+        // fz_new_stream drops state on failure
+        return nullptr;
+    }
+    stm->seek = seek_progressive_file;
+    stm->progressive = 1;
     return stm;
 }
 
+// returns true once all the data of a stream opened with fz_open_file_progressive
+// has been read (or reading has failed), waiting for at most timeoutMs.
+// returns true for all other streams
+bool fz_wait_for_stream_data(fz_stream* stm, DWORD timeoutMs) {
+    if (!stm || stm->next != next_progressive_file) {
+        return true;
+    }
+    progressive_file* state = (progressive_file*)stm->state;
+    return WaitForSingleObject(state->doneEvent, timeoutMs) == WAIT_OBJECT_0;
+}
+
+// blocks until the data of a stream opened with fz_open_file_progressive has been
+// read up to (excluding) offset, or reading has failed
+void fz_wait_for_stream_data_until(fz_stream* stm, i64 offset) {
+    if (!stm || stm->next != next_progressive_file || offset <= 0) {
+        return;
+    }
+    progressive_file* state = (progressive_file*)stm->state;
+    WaitForProgressiveData(state, std::min(offset, state->size) - 1);
+}
+
+// for streams opened with fz_open_file_progressive: if tryLater is set, reading
+// data that hasn't arrived yet throws FZ_ERROR_TRYLATER instead of blocking
+// (which makes mupdf parse a linearized document only as far as it has been read)
+void fz_set_stream_try_later(fz_stream* stm, bool tryLater) {
+    if (!stm || stm->next != next_progressive_file) {
+        return;
+    }
+    progressive_file* state = (progressive_file*)stm->state;
+    state->tryLater = tryLater;
+}
+
 std::span<u8> fz_extract_stream_data(fz_context* ctx, fz_stream* stream) {
     fz_seek(ctx, stream, 0, 2);
     i64 fileLen = fz_tell(ctx, stream);
@@ -265,9 +742,8 @@ void fz_stream_fingerprint(fz_context* ctx, fz_stream* stm, u8 digest[16]) {
 }
 
 // try to produce an 8-bit palette for saving some memory
-static RenderedBitmap* try_render_as_palette_image(fz_pixmap* pixmap) {
-    int w = pixmap->w;
-    int h = pixmap->h;
+// samples are 4 bytes per pixel (RGBA or BGRA if isBgr)
+static RenderedBitmap* try_render_as_palette_image(const u8* samples, int w, int h, int stride, bool isBgr) {
     int rows8 = ((w + 3) / 4) * 4;
     u8* bmpData = (u8*)calloc(rows8, h);
     if (!bmpData) {
@@ -277,17 +753,23 @@ static RenderedBitmap* try_render_as_palette_image(fz_pixmap* pixmap) {
     ScopedMem<BITMAPINFO> bmi((BITMAPINFO*)calloc(1, sizeof(BITMAPINFO) + 255 * sizeof(RGBQUAD)));
 
     u8* dest = bmpData;
-    u8* source = pixmap->samples;
     u32* palette = (u32*)bmi.Get()->bmiColors;
     u8 grayIdxs[256] = {0};
 
     int paletteSize = 0;
     RGBQUAD c;
     for (int j = 0; j < h; j++) {
+        const u8* source = samples + (size_t)j * stride;
         for (int i = 0; i < w; i++) {
-            c.rgbRed = *source++;
-            c.rgbGreen = *source++;
-            c.rgbBlue = *source++;
+            if (isBgr) {
+                c.rgbBlue = *source++;
+                c.rgbGreen = *source++;
+                c.rgbRed = *source++;
+            } else {
+                c.rgbRed = *source++;
+                c.rgbGreen = *source++;
+                c.rgbBlue = *source++;
+            }
             c.rgbReserved = 0;
             source++;
 
@@ -340,6 +822,31 @@ static RenderedBitmap* try_render_as_palette_image(fz_pixmap* pixmap) {
     return new RenderedBitmap(hbmp, Size(w, h), hMap);
 }
 
+// creates a top-down 32-bit DIB section whose memory layout matches
+// a BGRA fz_pixmap, so that mupdf can draw straight into it
+static RenderedBitmap* new_rendered_bgra_bitmap(int w, int h, u8** samplesOut) {
+    BITMAPINFO bmi{};
+    BITMAPINFOHEADER* bmih = &bmi.bmiHeader;
+    bmih->biSize = sizeof(*bmih);
+    bmih->biWidth = w;
+    bmih->biHeight = -h;
+    bmih->biPlanes = 1;
+    bmih->biCompression = BI_RGB;
+    bmih->biBitCount = 32;
+    bmih->biSizeImage = w * h * 4;
+
+    void* data = nullptr;
+    HANDLE hMap = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, bmih->biSizeImage, nullptr);
+    HBITMAP hbmp = CreateDIBSection(nullptr, &bmi, DIB_RGB_COLORS, &data, hMap, 0);
+    if (!hbmp || !data) {
+        DeleteObject(hbmp);
+        SafeCloseHandle(&hMap);
+        return nullptr;
+    }
+    *samplesOut = (u8*)data;
+    return new RenderedBitmap(hbmp, Size(w, h), hMap);
+}
+
 // had to create a copy of fz_convert_pixmap to ensure we always get the alpha
 fz_pixmap* fz_convert_pixmap2(fz_context* ctx, fz_pixmap* pix, fz_colorspace* ds, fz_colorspace* prf,
                               fz_default_colorspaces* default_cs, fz_color_params color_params, int keep_alpha) {
@@ -374,7 +881,7 @@ fz_pixmap* fz_convert_pixmap2(fz_context* ctx, fz_pixmap* pix, fz_colorspace* ds
 
 RenderedBitmap* new_rendered_fz_pixmap(fz_context* ctx, fz_pixmap* pixmap) {
     if (pixmap->n == 4 && fz_colorspace_is_rgb(ctx, pixmap->colorspace)) {
-        RenderedBitmap* res = try_render_as_palette_image(pixmap);
+        RenderedBitmap* res = try_render_as_palette_image(pixmap->samples, pixmap->w, pixmap->h, pixmap->stride, false);
         if (res) {
             return res;
         }
@@ -435,6 +942,292 @@ RenderedBitmap* new_rendered_fz_pixmap(fz_context* ctx, fz_pixmap* pixmap) {
     return new RenderedBitmap(hbmp, Size(w, h), hMap);
 }
 
+// rasterizes a recorded page on a clone of ctx so that other pages can be
+// interpreted or rendered in parallel. ctxAccess is only held while cloning.
+// the caller must hold a reference to list
+// the page is drawn directly into the memory of the returned DIB section,
+// then it's converted to an 8-bit palette bitmap if it has few enough colors
+RenderedBitmap* FzRenderDisplayList(fz_context* ctx, CRITICAL_SECTION* ctxAccess, fz_display_list* list, fz_matrix ctm,
+                                    fz_rect pageRect, fz_cookie* cookie) {
+    fz_irect bbox = fz_round_rect(fz_transform_rect(pageRect, ctm));
+    fz_rect cliprect = fz_rect_from_irect(bbox);
+    int w = bbox.x1 - bbox.x0;
+    int h = bbox.y1 - bbox.y0;
+
+    u8* samples = nullptr;
+    RenderedBitmap* bitmap = new_rendered_bgra_bitmap(w, h, &samples);
+    if (!bitmap) {
+        return nullptr;
+    }
+
+    fz_context* ctx2 = nullptr;
+    {
+        ScopedCritSec scope(ctxAccess);
+        ctx2 = fz_clone_context(ctx);
+    }
+    if (!ctx2) {
+        delete bitmap;
+        return nullptr;
+    }
+
+    fz_pixmap* pix = nullptr;
+    fz_device* dev = nullptr;
+
+    fz_var(dev);
+    fz_var(pix);
+    fz_var(bitmap);
+
+    fz_try(ctx2) {
+        // the pixmap doesn't take ownership of samples
+        pix = fz_new_pixmap_with_bbox_and_data(ctx2, fz_device_bgr(ctx2), bbox, nullptr, 1, samples);
+        // initialize with white background
+        fz_clear_pixmap_with_value(ctx2, pix, 0xff);
+        dev = fz_new_draw_device(ctx2, fz_identity, pix);
+        fz_run_display_list(ctx2, list, dev, ctm, cliprect, cookie);
+        fz_close_device(ctx2, dev);
+    }
+    fz_always(ctx2) {
+        fz_drop_device(ctx2, dev);
+        fz_drop_pixmap(ctx2, pix);
+    }
+    fz_catch(ctx2) {
+        delete bitmap;
+        bitmap = nullptr;
+    }
+    fz_drop_context(ctx2);
+
+    if (bitmap) {
+        RenderedBitmap* bmp8 = try_render_as_palette_image(samples, w, h, w * 4, true);
+        if (bmp8) {
+            delete bitmap;
+            bitmap = bmp8;
+        }
+    }
+    return bitmap;
+}
+
+// caller must hold ctxAccess. pageInfo takes ownership of list and becomes
+// the most recently used entry of runCache. Display lists of pages beyond
+// MAX_PAGE_RUN_CACHE are dropped (renderers still using them hold a reference)
+void FzPageRunCacheAdd(fz_context* ctx, Vec<FzPageInfo*>& runCache, FzPageInfo* pageInfo, fz_display_list* list) {
+    if (pageInfo->list != list) {
+        fz_drop_display_list(ctx, pageInfo->list);
+        pageInfo->list = list;
+    }
+    runCache.Remove(pageInfo);
+    runCache.InsertAt(0, pageInfo);
+    while (runCache.size() > MAX_PAGE_RUN_CACHE) {
+        FzPageInfo* pi = runCache.Pop();
+        fz_drop_display_list(ctx, pi->list);
+        pi->list = nullptr;
+    }
+}
+
+// caller must hold ctxAccess
+void FzPageRunCacheRemove(fz_context* ctx, Vec<FzPageInfo*>& runCache, FzPageInfo* pageInfo) {
+    runCache.Remove(pageInfo);
+    fz_drop_display_list(ctx, pageInfo->list);
+    pageInfo->list = nullptr;
+}
+
+static void FzPageTextCacheAdd(Vec<FzPageInfo*>& textCache, FzPageInfo* pageInfo, PageText text) {
+    FreePageText(&pageInfo->text);
+    pageInfo->text = text;
+    textCache.Remove(pageInfo);
+    textCache.InsertAt(0, pageInfo);
+    while (textCache.size() > MAX_PAGE_TEXT_CACHE) {
+        FzPageInfo* pi = textCache.Pop();
+        FreePageText(&pi->text);
+    }
+}
+
+// hands out (and forgets) the text extracted by FzAnalyzePage
+// returns an empty PageText if it's been handed out or evicted already
+// caller must hold ctxAccess
+PageText FzPageTextCacheTake(Vec<FzPageInfo*>& textCache, FzPageInfo* pageInfo) {
+    PageText res = pageInfo->text;
+    pageInfo->text = {};
+    textCache.Remove(pageInfo);
+    return res;
+}
+
+// caller must hold ctxAccess
+void FzPageTextCacheRemove(Vec<FzPageInfo*>& textCache, FzPageInfo* pageInfo) {
+    textCache.Remove(pageInfo);
+    FreePageText(&pageInfo->text);
+}
+
+// rects are put into the cells they overlap after growing them by this much,
+// so that hit-tests on slightly different representations (RectF vs. fz_rect)
+// can't end up in a neighboring cell
+#define RECT_INDEX_SLOP 0.5f
+#define RECTS_PER_CELL 2
+#define RECT_INDEX_MAX_COLS 128
+
+// rects with NaN or huge coordinates (e.g. fz_infinite_rect) would break the grid
+static bool IsIndexableRect(fz_rect r) {
+    const float maxCoord = 1e6f;
+    return fabsf(r.x0) < maxCoord && fabsf(r.y0) < maxCoord && fabsf(r.x1) < maxCoord && fabsf(r.y1) < maxCoord;
+}
+
+static fz_rect GrownRect(fz_rect r) {
+    fz_rect res;
+    res.x0 = std::min(r.x0, r.x1) - RECT_INDEX_SLOP;
+    res.y0 = std::min(r.y0, r.y1) - RECT_INDEX_SLOP;
+    res.x1 = std::max(r.x0, r.x1) + RECT_INDEX_SLOP;
+    res.y1 = std::max(r.y0, r.y1) + RECT_INDEX_SLOP;
+    return res;
+}
+
+FzRectIndex::FzRectIndex(const fz_rect* rs, int n) {
+    rects.Append(rs, n);
+    int nInside = 0;
+    for (int i = 0; i < n; i++) {
+        if (IsIndexableRect(rs[i])) {
+            bounds = fz_union_rect(bounds, GrownRect(rs[i]));
+            nInside++;
+        }
+    }
+    if (nInside == 0) {
+        for (int i = 0; i < n; i++) {
+            outside.Append(i);
+        }
+        return;
+    }
+
+    float dx = bounds.x1 - bounds.x0;
+    float dy = bounds.y1 - bounds.y0;
+    double nCells = std::max(1, nInside / RECTS_PER_CELL);
+    double colsF = std::clamp(sqrt(nCells * dx / dy), 1.0, (double)RECT_INDEX_MAX_COLS);
+    cols = (int)colsF;
+    rows = std::clamp((int)(nCells / cols), 1, RECT_INDEX_MAX_COLS);
+    cellDx = dx / cols;
+    cellDy = dy / rows;
+    // items covering a large part of the page (e.g. background images)
+    // are cheaper to check for every query than to put into all cells
+    int maxCells = std::max(16, cols * rows / 8);
+
+    auto cellRange = [&](fz_rect r, int& cx0, int& cy0, int& cx1, int& cy1) {
+        fz_rect g = GrownRect(r);
+        cx0 = std::clamp((int)floorf((g.x0 - bounds.x0) / cellDx), 0, cols - 1);
+        cx1 = std::clamp((int)floorf((g.x1 - bounds.x0) / cellDx), 0, cols - 1);
+        cy0 = std::clamp((int)floorf((g.y0 - bounds.y0) / cellDy), 0, rows - 1);
+        cy1 = std::clamp((int)floorf((g.y1 - bounds.y0) / cellDy), 0, rows - 1);
+    };
+
+    // counting sort of the items into the cells they overlap (keeping them in order)
+    int* start = cellStart.AppendBlanks(cols * rows + 1);
+    for (int fill = 0; fill < 2; fill++) {
+        for (int i = 0; i < n; i++) {
+            int cx0 = 0, cy0 = 0, cx1 = -1, cy1 = -1;
+            if (IsIndexableRect(rs[i])) {
+                cellRange(rs[i], cx0, cy0, cx1, cy1);
+            }
+            if (cx1 < 0 || (cx1 - cx0 + 1) * (cy1 - cy0 + 1) > maxCells) {
+                if (fill == 0) {
+                    outside.Append(i);
+                }
+                continue;
+            }
+            for (int cy = cy0; cy <= cy1; cy++) {
+                for (int cx = cx0; cx <= cx1; cx++) {
+                    int cell = cy * cols + cx;
+                    if (fill == 0) {
+                        start[cell + 1]++;
+                    } else {
+                        cellItems.at(start[cell]++) = i;
+                    }
+                }
+            }
+        }
+        if (fill == 0) {
+            for (int cell = 0; cell < cols * rows; cell++) {
+                start[cell + 1] += start[cell];
+            }
+            cellItems.AppendBlanks(start[cols * rows]);
+        }
+    }
+    // the second fill has advanced each cell's start to the next cell's start
+    for (int cell = cols * rows; cell > 0; cell--) {
+        start[cell] = start[cell - 1];
+    }
+    start[0] = 0;
+}
+
+void FzRectIndex::FindAt(fz_point pt, Vec<int>& res) const {
+    res.Reset();
+    int i = 0, end = 0;
+    bool inBounds = pt.x >= bounds.x0 && pt.x <= bounds.x1 && pt.y >= bounds.y0 && pt.y <= bounds.y1;
+    if (cols > 0 && inBounds) {
+        int cx = std::clamp((int)floorf((pt.x - bounds.x0) / cellDx), 0, cols - 1);
+        int cy = std::clamp((int)floorf((pt.y - bounds.y0) / cellDy), 0, rows - 1);
+        int cell = cy * cols + cx;
+        i = cellStart.at(cell);
+        end = cellStart.at(cell + 1);
+    }
+    // merge the cell's items with those outside of any cell
+    size_t j = 0;
+    while (i < end || j < outside.size()) {
+        if (j == outside.size() || (i < end && cellItems.at(i) < outside.at(j))) {
+            res.Append(cellItems.at(i++));
+        } else {
+            res.Append(outside.at(j++));
+        }
+    }
+}
+
+// the rectangles of the elements in the order in which FzGetElementAtPos looks for them
+static void GetElementRects(FzPageInfo* pageInfo, Vec<fz_rect>& rects) {
+    for (fz_link* link = pageInfo->links; link; link = link->next) {
+        rects.Append(link->rect);
+    }
+    for (auto* pel : pageInfo->autoLinks) {
+        rects.Append(To_fz_rect(pel->GetRect()));
+    }
+    for (auto* pel : pageInfo->comments) {
+        rects.Append(To_fz_rect(pel->GetRect()));
+    }
+    for (auto& img : pageInfo->images) {
+        rects.Append(img.rect);
+    }
+}
+
+static FzRectIndex* NewElementIndex(FzPageInfo* pageInfo) {
+    Vec<fz_rect> rects;
+    GetElementRects(pageInfo, rects);
+    return new FzRectIndex(rects.LendData(), rects.isize());
+}
+
+// interprets the page once to find its text, auto-detected links and images
+// (instead of once for the links and images and again for ExtractPageText)
+// and indexes them together with the links and comments for hit-testing
+// caller must hold ctxAccess
+void FzAnalyzePage(fz_context* ctx, FzPageInfo* pageInfo, Vec<FzPageInfo*>& textCache) {
+    fz_stext_page* stext = nullptr;
+    fz_var(stext);
+    fz_stext_options opts{};
+    opts.flags = FZ_STEXT_PRESERVE_IMAGES;
+    fz_try(ctx) {
+        stext = fz_new_stext_page_from_page(ctx, pageInfo->page, &opts);
+    }
+    fz_catch(ctx) {
+    }
+
+    if (stext) {
+        PageText text;
+        text.text = fz_text_page_to_str(stext, &text.coords);
+        text.len = (int)str::Len(text.text);
+        fz_find_image_positions(ctx, pageInfo->images, stext);
+        fz_drop_stext_page(ctx, stext);
+
+        FzLinkifyPageText(pageInfo, text.text, text.coords);
+        FzPageTextCacheAdd(textCache, pageInfo, text);
+    }
+
+    delete pageInfo->elementIndex;
+    pageInfo->elementIndex = NewElementIndex(pageInfo);
+}
+
 static inline int wchars_per_rune(int rune) {
     if (rune & 0x1F0000) {
         return 2;
@@ -1045,40 +1838,69 @@ TocItem* newTocItemWithDestination(TocItem* parent, WCHAR* title, PageDestinatio
     return res;
 }
 
+// returns the element with the given position in the order of GetElementRects
+static IPageElement* NewElementAt(FzPageInfo* pageInfo, int nLinks, int idx) {
+    int nAutoLinks = pageInfo->autoLinks.isize();
+    int nComments = pageInfo->comments.isize();
+    if (idx < nLinks) {
+        fz_link* link = pageInfo->links;
+        for (int i = 0; i < idx; i++) {
+            link = link->next;
+        }
+        return newFzLink(pageInfo->pageNo, link, nullptr);
+    }
+    idx -= nLinks;
+    if (idx < nAutoLinks) {
+        return clonePageElement(pageInfo->autoLinks.at(idx));
+    }
+    idx -= nAutoLinks;
+    if (idx < nComments) {
+        return clonePageElement(pageInfo->comments.at(idx));
+    }
+    idx -= nComments;
+    return newFzImage(pageInfo->pageNo, pageInfo->images.at(idx).rect, idx);
+}
+
 IPageElement* FzGetElementAtPos(FzPageInfo* pageInfo, PointF pt) {
     if (!pageInfo) {
         return nullptr;
     }
-    int pageNo = pageInfo->pageNo;
-    fz_link* link = pageInfo->links;
     fz_point p = {(float)pt.x, (float)pt.y};
-    while (link) {
-        if (fz_is_pt_in_rect(link->rect, p)) {
-            return newFzLink(pageNo, link, nullptr);
+    Vec<int> candidates;
+    Vec<fz_rect> tmpRects;
+    const Vec<fz_rect>* rects = &tmpRects;
+    if (pageInfo->elementIndex) {
+        rects = &pageInfo->elementIndex->rects;
+        pageInfo->elementIndex->FindAt(p, candidates);
+    } else {
+        // pages are only indexed once they've been fully loaded
+        // (indexing them for a single lookup wouldn't pay off)
+        GetElementRects(pageInfo, tmpRects);
+        for (int i = 0; i < tmpRects.isize(); i++) {
+            candidates.Append(i);
         }
-        link = link->next;
     }
 
-    for (auto* pel : pageInfo->autoLinks) {
-        if (pel->GetRect().Contains(pt)) {
-            return clonePageElement(pel);
+    int nAutoLinks = pageInfo->autoLinks.isize();
+    int nComments = pageInfo->comments.isize();
+    int nLinks = rects->isize() - nAutoLinks - nComments - pageInfo->images.isize();
+
+    // the candidates come in order of precedence, so the first hit wins
+    for (int idx : candidates) {
+        int i = idx - nLinks;
+        bool isHit;
+        if (i >= 0 && i < nAutoLinks) {
+            isHit = pageInfo->autoLinks.at(i)->GetRect().Contains(pt);
+        } else if (i >= nAutoLinks && i < nAutoLinks + nComments) {
+            isHit = pageInfo->comments.at(i - nAutoLinks)->GetRect().Contains(pt);
+        } else {
+            // links and images
+            isHit = fz_is_pt_in_rect(rects->at(idx), p);
         }
-    }
-
-    for (auto* pel : pageInfo->comments) {
-        if (pel->GetRect().Contains(pt)) {
-            return clonePageElement(pel);
+        if (isHit) {
+            return NewElementAt(pageInfo, nLinks, idx);
         }
     }
-
-    size_t imageIdx = 0;
-    for (auto& img : pageInfo->images) {
-        fz_rect ir = img.rect;
-        if (fz_is_pt_in_rect(ir, p)) {
-            return newFzImage(pageNo, ir, imageIdx);
-        }
-        imageIdx++;
-    }
     return nullptr;
 }
 
@@ -1121,20 +1943,12 @@ void FzGetElements(Vec<IPageElement*>* els, FzPageInfo* pageInfo) {
     els->Reverse();
 }
 
-void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
-    if (!pageInfo || !stext) {
-        return;
-    }
-
-    Rect* coords;
-    WCHAR* pageText = fz_text_page_to_str(stext, &coords);
-    if (!pageText) {
+void FzLinkifyPageText(FzPageInfo* pageInfo, const WCHAR* pageText, Rect* coords) {
+    if (!pageInfo || !pageText) {
         return;
     }
 
     LinkRectList* list = LinkifyText(pageText, coords);
-    free(pageText);
-    // fz_page* page = pageInfo->page;
 
     for (size_t i = 0; i < list->links.size(); i++) {
         fz_rect bbox = list->coords.at(i);
@@ -1165,7 +1979,6 @@ void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext) {
         pageInfo->autoLinks.Append(pel);
     }
     delete list;
-    free(coords);
 }
 
 void fz_find_image_positions(fz_context* ctx, Vec<FitzImagePos>& images, fz_stext_page* stext) {
@@ -3,12 +3,19 @@
 
 // Common for EnginePdf.cpp and EngineXps.cpp
 
-// maximum amount of memory that MuPDF should use per fz_context store
+// maximum amount of memory that MuPDF should use for caching fonts,
+// images, glyphs etc. (shared by all documents, see fz_clone_shared_context)
 #define MAX_CONTEXT_MEMORY (256 * 1024 * 1024)
+// maximum amount of memory used for caching rendered glyphs (also shared by all
+// documents); text-dense CJK pages at high zoom levels need far more than 1 MB
+#define MAX_GLYPH_CACHE_SIZE (32 * 1024 * 1024)
 // number of page content trees to cache for quicker rendering
 #define MAX_PAGE_RUN_CACHE 8
 // maximum estimated memory requirement allowed for the run cache of one document
 #define MAX_PAGE_RUN_MEMORY (40 * 1024 * 1024)
+// number of pages whose text (extracted together with their links and images)
+// is kept until it's handed out by ExtractPageText
+#define MAX_PAGE_TEXT_CACHE 16
 
 class FitzAbortCookie : public AbortCookie {
   public:
@@ -21,6 +28,29 @@ class FitzAbortCookie : public AbortCookie {
     }
 };
 
+// uniform grid over the rectangles of a page's links, images, annotations etc.
+// so that hit-testing only has to look at those close to the point
+struct FzRectIndex {
+    // the rectangles as passed in (index i is item i)
+    Vec<fz_rect> rects;
+    // covers all items that aren't in outside
+    fz_rect bounds = fz_empty_rect;
+    float cellDx = 1;
+    float cellDy = 1;
+    int cols = 0;
+    int rows = 0;
+    // for each cell, the items overlapping it (by increasing index)
+    // are cellItems[cellStart[cell]] to cellItems[cellStart[cell + 1] - 1]
+    Vec<int> cellStart;
+    Vec<int> cellItems;
+    // items that are degenerate or too large to be put into cells (by increasing index)
+    Vec<int> outside;
+
+    FzRectIndex(const fz_rect* rects, int n);
+    // candidates that might contain pt (by increasing index, to be checked by the caller)
+    void FindAt(fz_point pt, Vec<int>& res) const;
+};
+
 struct FitzImagePos {
     fz_rect rect = fz_unit_rect;
     fz_matrix transform;
@@ -43,6 +73,26 @@ struct FzPageInfo {
     // if false, only loaded page (fast)
     // if true, loaded expensive info (extracted text etc.)
     bool fullyLoaded = false;
+    // links, autoLinks, comments and images (in that order), indexed
+    // once the page has been fully loaded (see FzAnalyzePage)
+    FzRectIndex* elementIndex = nullptr;
+    // rects of the annotations of a pdf page (in drawing order), built on demand
+    // and rebuilt whenever the page's annot_generation has changed
+    FzRectIndex* annotIndex = nullptr;
+    // the indexed annotations (item i of annotIndex is annotIndexAnnots[i])
+    Vec<pdf_annot*> annotIndexAnnots;
+    int annotIndexGeneration = 0;
+
+    // text extracted while fully loading the page, owned until handed out
+    // by ExtractPageText (only kept for the MAX_PAGE_TEXT_CACHE most recently
+    // loaded pages, see FzAnalyzePage)
+    PageText text{};
+
+    // recorded page content, replayed for rendering without holding ctxAccess
+    // (only kept for the MAX_PAGE_RUN_CACHE most recently rendered pages)
+    fz_display_list* list = nullptr;
+    // number of annotations at the time list was recorded
+    int listAnnotsCount = 0;
 };
 
 struct LinkRectList {
@@ -60,12 +110,27 @@ float fz_calc_overlap(fz_rect r1, fz_rect r2);
 WCHAR* pdf_to_wstr(fz_context* ctx, pdf_obj* obj);
 WCHAR* pdf_clean_string(WCHAR* string);
 
+fz_context* fz_clone_shared_context();
+void fz_set_shared_glyph_cache_size(size_t maxSize);
+fz_glyph_cache_stats fz_get_shared_glyph_cache_stats();
+
 fz_stream* fz_open_istream(fz_context* ctx, IStream* stream);
 fz_stream* fz_open_file2(fz_context* ctx, const WCHAR* filePath);
+fz_stream* fz_open_file_progressive(fz_context* ctx, const WCHAR* filePath, int bytesPerSec = 0);
+bool fz_wait_for_stream_data(fz_stream* stm, DWORD timeoutMs);
+void fz_wait_for_stream_data_until(fz_stream* stm, i64 offset);
+void fz_set_stream_try_later(fz_stream* stm, bool tryLater);
 void fz_stream_fingerprint(fz_context* ctx, fz_stream* stm, u8 digest[16]);
 std::span<u8> fz_extract_stream_data(fz_context* ctx, fz_stream* stream);
 
 RenderedBitmap* new_rendered_fz_pixmap(fz_context* ctx, fz_pixmap* pixmap);
+RenderedBitmap* FzRenderDisplayList(fz_context* ctx, CRITICAL_SECTION* ctxAccess, fz_display_list* list, fz_matrix ctm,
+                                    fz_rect pageRect, fz_cookie* cookie);
+void FzPageRunCacheAdd(fz_context* ctx, Vec<FzPageInfo*>& runCache, FzPageInfo* pageInfo, fz_display_list* list);
+void FzPageRunCacheRemove(fz_context* ctx, Vec<FzPageInfo*>& runCache, FzPageInfo* pageInfo);
+void FzAnalyzePage(fz_context* ctx, FzPageInfo* pageInfo, Vec<FzPageInfo*>& textCache);
+PageText FzPageTextCacheTake(Vec<FzPageInfo*>& textCache, FzPageInfo* pageInfo);
+void FzPageTextCacheRemove(Vec<FzPageInfo*>& textCache, FzPageInfo* pageInfo);
 
 WCHAR* fz_text_page_to_str(fz_stext_page* text, Rect** coordsOut);
 
@@ -78,7 +143,7 @@ PageElement* newFzLink(int pageNo, fz_link* link, fz_outline* outline);
 PageDestination* newFzDestination(fz_outline*);
 IPageElement* FzGetElementAtPos(FzPageInfo* pageInfo, PointF pt);
 void FzGetElements(Vec<IPageElement*>* els, FzPageInfo* pageInfo);
-void FzLinkifyPageText(FzPageInfo* pageInfo, fz_stext_page* stext);
+void FzLinkifyPageText(FzPageInfo* pageInfo, const WCHAR* pageText, Rect* coords);
 fz_pixmap* fz_convert_pixmap2(fz_context* ctx, fz_pixmap* pix, fz_colorspace* ds, fz_colorspace* prf,
                               fz_default_colorspaces* default_cs, fz_color_params color_params, int keep_alpha);
 fz_image* fz_find_image_at_idx(fz_context* ctx, FzPageInfo* pageInfo, int idx);
@@ -70,6 +70,11 @@ Kind kindEngineComicBooks = "engineComicBooks";
 
 // number of decoded bitmaps to cache for quicker rendering
 #define MAX_IMAGE_PAGE_CACHE 10
+// maximum amount of memory used by the decoded bitmaps of a single document
+#define MAX_IMAGE_PAGE_CACHE_SIZE (256 * 1024 * 1024)
+// number of pages decoded ahead (in reading order) after a page has been rendered
+// (also the maximum number of threads decoding them in parallel)
+#define IMAGE_DECODE_AHEAD_PAGES 3
 
 ///// EngineImages methods apply to all types of engines handling full-page images /////
 
@@ -78,6 +83,8 @@ struct ImagePage {
     Bitmap* bmp = nullptr;
     bool ownBmp = true;
     int refs = 1;
+    // estimated memory used by bmp (in bytes)
+    size_t size = 0;
 
     ImagePage(int pageNo, Bitmap* bmp) {
         this->pageNo = pageNo;
@@ -123,8 +130,21 @@ class EngineImages : public EngineBase {
 
     CRITICAL_SECTION cacheAccess;
     Vec<ImagePage*> pageCache;
+    // memory used by all bitmaps in pageCache (in bytes)
+    size_t pageCacheSize = 0;
     Vec<RectF> mediaboxes;
 
+    // only set for engines whose LoadBitmapForPage can be called from several threads at once
+    bool decodeAhead = false;
+    // pages waiting to be decoded ahead resp. being decoded (protected by cacheAccess)
+    Vec<int> decodeAheadQueue;
+    Vec<int> decodingAhead;
+    bool stopDecodingAhead = false;
+    // a semaphore counting queued pages
+    HANDLE decodeAheadSema = nullptr;
+    HANDLE decodeAheadThreads[IMAGE_DECODE_AHEAD_PAGES]{};
+    int nDecodeAheadThreads = 0;
+
     void GetTransform(Matrix& m, int pageNo, float zoom, int rotation);
 
     virtual Bitmap* LoadBitmapForPage(int pageNo, bool& deleteAfterUse) = 0;
@@ -132,6 +152,13 @@ class EngineImages : public EngineBase {
 
     ImagePage* GetPage(int pageNo, bool tryOnly = false);
     void DropPage(ImagePage* page, bool forceRemove);
+    void AddToCache(ImagePage* page);
+
+    void RequestDecodeAhead(int pageNo);
+    // must be called by derived engines before freeing what LoadBitmapForPage uses
+    void StopDecodingAhead();
+    void DecodeAhead();
+    static DWORD WINAPI DecodeAheadThread(LPVOID data);
 };
 
 EngineImages::EngineImages() {
@@ -144,6 +171,7 @@ EngineImages::EngineImages() {
 }
 
 EngineImages::~EngineImages() {
+    StopDecodingAhead();
     EnterCriticalSection(&cacheAccess);
     while (pageCache.size() > 0) {
         ImagePage* lastPage = pageCache.Last();
@@ -220,6 +248,8 @@ RenderedBitmap* EngineImages::RenderPage(RenderPageArgs& args) {
         return nullptr;
     }
 
+    RequestDecodeAhead(pageNo);
+
     return new RenderedBitmap(hbmp, screen.Size(), hMap);
 }
 
@@ -323,6 +353,17 @@ bool EngineImages::SaveFileAs(const char* copyFileName, [[maybe_unused]] bool in
 }
 
 ImagePage* EngineImages::GetPage(int pageNo, bool tryOnly) {
+    // wait for a page that is being decoded ahead instead of decoding it twice
+    for (;;) {
+        EnterCriticalSection(&cacheAccess);
+        bool isDecoding = !tryOnly && decodingAhead.Contains(pageNo);
+        LeaveCriticalSection(&cacheAccess);
+        if (!isDecoding) {
+            break;
+        }
+        Sleep(1);
+    }
+
     ScopedCritSec scope(&cacheAccess);
 
     ImagePage* result = nullptr;
@@ -338,15 +379,9 @@ ImagePage* EngineImages::GetPage(int pageNo, bool tryOnly) {
     }
 
     if (!result) {
-        // TODO: drop most memory intensive pages first
-        // (i.e. formats which aren't IsGdiPlusNativeFormat)?
-        if (pageCache.size() >= MAX_IMAGE_PAGE_CACHE) {
-            CrashIf(pageCache.size() != MAX_IMAGE_PAGE_CACHE);
-            DropPage(pageCache.Last(), true);
-        }
         result = new ImagePage(pageNo, nullptr);
         result->bmp = LoadBitmapForPage(pageNo, result->ownBmp);
-        pageCache.InsertAt(0, result);
+        AddToCache(result);
     } else if (result != pageCache.at(0)) {
         // keep the list Most Recently Used first
         pageCache.Remove(result);
@@ -370,7 +405,9 @@ void EngineImages::DropPage(ImagePage* page, bool forceRemove) {
     CrashIf(page->refs < 0);
 
     if (0 == page->refs || forceRemove) {
-        pageCache.Remove(page);
+        if (pageCache.Remove(page) != -1) {
+            pageCacheSize -= page->size;
+        }
     }
 
     if (0 == page->refs) {
@@ -381,6 +418,141 @@ void EngineImages::DropPage(ImagePage* page, bool forceRemove) {
     }
 }
 
+// inserts a newly loaded page as the most recently used one
+// (the caller must hold cacheAccess)
+void EngineImages::AddToCache(ImagePage* page) {
+    if (page->bmp) {
+        page->size = (size_t)page->bmp->GetWidth() * (size_t)page->bmp->GetHeight() * 4;
+    }
+    // TODO: drop most memory intensive pages first
+    // (i.e. formats which aren't IsGdiPlusNativeFormat)?
+    while (pageCache.size() >= MAX_IMAGE_PAGE_CACHE ||
+           (pageCache.size() > 0 && pageCacheSize + page->size > MAX_IMAGE_PAGE_CACHE_SIZE)) {
+        DropPage(pageCache.Last(), true);
+    }
+    pageCache.InsertAt(0, page);
+    pageCacheSize += page->size;
+}
+
+// decodes the pages following pageNo on background threads
+// so that they're ready by the time they're needed
+void EngineImages::RequestDecodeAhead(int pageNo) {
+    if (!decodeAhead) {
+        return;
+    }
+    ScopedCritSec scope(&cacheAccess);
+    if (stopDecodingAhead) {
+        return;
+    }
+    // pages queued for a previous request are no longer needed
+    decodeAheadQueue.Reset();
+    int last = std::min(pageNo + IMAGE_DECODE_AHEAD_PAGES, pageCount);
+    for (int i = pageNo + 1; i <= last; i++) {
+        bool isCached = false;
+        for (ImagePage* page : pageCache) {
+            isCached = isCached || page->pageNo == i;
+        }
+        if (!isCached && !decodingAhead.Contains(i)) {
+            decodeAheadQueue.Append(i);
+        }
+    }
+    int n = (int)decodeAheadQueue.size();
+    if (0 == n) {
+        return;
+    }
+
+    if (!decodeAheadSema) {
+        decodeAheadSema = CreateSemaphore(nullptr, 0, LONG_MAX, nullptr);
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        int nThreads = std::min((int)si.dwNumberOfProcessors, IMAGE_DECODE_AHEAD_PAGES);
+        for (int i = 0; i < nThreads; i++) {
+            decodeAheadThreads[i] = CreateThread(nullptr, 0, DecodeAheadThread, this, 0, nullptr);
+            if (decodeAheadThreads[i]) {
+                nDecodeAheadThreads++;
+            }
+        }
+    }
+    ReleaseSemaphore(decodeAheadSema, n, nullptr);
+}
+
+void EngineImages::StopDecodingAhead() {
+    EnterCriticalSection(&cacheAccess);
+    stopDecodingAhead = true;
+    LeaveCriticalSection(&cacheAccess);
+    if (!decodeAheadSema) {
+        return;
+    }
+    ReleaseSemaphore(decodeAheadSema, nDecodeAheadThreads, nullptr);
+    if (nDecodeAheadThreads > 0) {
+        WaitForMultipleObjects(nDecodeAheadThreads, decodeAheadThreads, TRUE, INFINITE);
+    }
+    for (int i = 0; i < nDecodeAheadThreads; i++) {
+        CloseHandle(decodeAheadThreads[i]);
+    }
+    nDecodeAheadThreads = 0;
+    CloseHandle(decodeAheadSema);
+    decodeAheadSema = nullptr;
+}
+
+DWORD WINAPI EngineImages::DecodeAheadThread(LPVOID data) {
+    EngineImages* engine = (EngineImages*)data;
+    engine->DecodeAhead();
+    return 0;
+}
+
+void EngineImages::DecodeAhead() {
+    for (;;) {
+        WaitForSingleObject(decodeAheadSema, INFINITE);
+        int pageNo = 0;
+        EnterCriticalSection(&cacheAccess);
+        if (!stopDecodingAhead && decodeAheadQueue.size() > 0) {
+            pageNo = decodeAheadQueue.at(0);
+            decodeAheadQueue.RemoveAt(0);
+            decodingAhead.Append(pageNo);
+        }
+        bool stop = stopDecodingAhead;
+        LeaveCriticalSection(&cacheAccess);
+        if (stop) {
+            return;
+        }
+        if (!pageNo) {
+            // the page was dropped from the queue by a more recent request
+            continue;
+        }
+
+        bool ownBmp = true;
+        Bitmap* bmp = LoadBitmapForPage(pageNo, ownBmp);
+        // GDI+ only decodes images when they're first drawn,
+        // so force decoding them here instead of in RenderPage
+        if (bmp && ownBmp) {
+            Bitmap* decoded = bmp->Clone(0, 0, bmp->GetWidth(), bmp->GetHeight(), PixelFormat32bppPARGB);
+            if (decoded && decoded->GetLastStatus() == Ok) {
+                delete bmp;
+                bmp = decoded;
+            } else {
+                delete decoded;
+            }
+        }
+
+        ScopedCritSec scope(&cacheAccess);
+        decodingAhead.Remove(pageNo);
+        bool isCached = false;
+        for (ImagePage* page : pageCache) {
+            isCached = isCached || page->pageNo == pageNo;
+        }
+        if (!bmp || isCached) {
+            if (ownBmp) {
+                delete bmp;
+            }
+            continue;
+        }
+        ImagePage* page = new ImagePage(pageNo, bmp);
+        page->ownBmp = ownBmp;
+        AddToCache(page);
+    }
+}
+
 ///// ImageEngine handles a single image file /////
 
 class EngineImage : public EngineImages {
@@ -668,9 +840,11 @@ class EngineImageDir : public EngineImages {
         // TODO: is there a better place to expose pageFileNames
         // than through page labels?
         hasPageLabels = true;
+        decodeAhead = true;
     }
 
     virtual ~EngineImageDir() {
+        StopDecodingAhead();
         delete tocTree;
     }
 
@@ -909,9 +1083,11 @@ class EngineCbx : public EngineImages, public json::ValueVisitor {
 EngineCbx::EngineCbx(MultiFormatArchive* arch) {
     cbxFile = arch;
     kind = kindEngineComicBooks;
+    decodeAhead = true;
 }
 
 EngineCbx::~EngineCbx() {
+    StopDecodingAhead();
     delete tocTree;
 
     // can be set in error conditions but generally is
@@ -1062,13 +1238,22 @@ bool EngineCbx::FinishLoading() {
     }
     tocTree = new TocTree(root);
 
+    // extract the images in the order in which they're stored so that solid
+    // RAR and 7z archives are decompressed in a single pass (instead of
+    // restarting decompression whenever the sorted order goes backwards)
+    Vec<int> extractOrder;
     for (int i = 0; i < pageCount; i++) {
+        extractOrder.Append(i);
+    }
+    std::sort(extractOrder.begin(), extractOrder.end(),
+              [this](int i1, int i2) { return files[i1]->fileId < files[i2]->fileId; });
+    images.AppendBlanks(pageCount);
+    for (int i : extractOrder) {
         size_t fileId = files[i]->fileId;
         std::span<u8> sv = cbxFile->GetFileDataById(fileId);
-        ImageData img;
+        ImageData& img = images[i];
         img.data = (char*)sv.data();
         img.len = sv.size();
-        images.Append(img);
     }
 
     delete cbxFile;
@@ -29,7 +29,6 @@ extern "C" {
 
 // in mupdf_load_system_font.c
 extern "C" void drop_cached_fonts_for_ctx(fz_context*);
-extern "C" void pdf_install_load_system_font_funcs(fz_context* ctx);
 
 AnnotationType AnnotationTypeFromPdfAnnot(enum pdf_annot_type tp);
 
@@ -307,6 +306,14 @@ class EnginePdf : public EngineBase {
     RectF PageMediabox(int pageNo) override;
     RectF PageContentBox(int pageNo, RenderTarget target = RenderTarget::View) override;
 
+    bool IsLoadingProgressively() override;
+    void SetProgressiveLoadingCallback(const std::function<void()>& onDataLoaded) override;
+    bool FinishProgressiveLoading() override;
+
+    u64 PageContentHash(int pageNo) override;
+    void ComputePageContentHashes(const std::function<void()>& onHashed) override;
+    void StopComputingPageContentHashes() override;
+
     RenderedBitmap* RenderPage(RenderPageArgs& args) override;
 
     RectF Transform(const RectF& rect, int pageNo, float zoom, int rotation, bool inverse = false) override;
@@ -341,15 +348,19 @@ class EnginePdf : public EngineBase {
     CRITICAL_SECTION* ctxAccess;
     CRITICAL_SECTION pagesAccess;
 
-    CRITICAL_SECTION mutexes[FZ_LOCK_MAX];
+    // guards ctx (i.e. everything but rasterizing display lists on cloned contexts)
+    CRITICAL_SECTION ctxAccessCs;
 
     RenderedBitmap* GetPageImage(int pageNo, RectF rect, int imageIdx);
 
     fz_context* ctx = nullptr;
-    fz_locks_context fz_locks_ctx;
     fz_document* _doc = nullptr;
     fz_stream* _docStream = nullptr;
     Vec<FzPageInfo> _pages;
+    // pages with a cached display list, most recently rendered first
+    Vec<FzPageInfo*> runCache;
+    // pages with cached extracted text, most recently loaded first
+    Vec<FzPageInfo*> textCache;
     fz_outline* outline = nullptr;
     fz_outline* attachments = nullptr;
     pdf_obj* _info = nullptr;
@@ -357,15 +368,38 @@ class EnginePdf : public EngineBase {
 
     TocTree* tocTree = nullptr;
 
+    // false for clones (which always load the whole document at once)
+    bool allowProgressiveLoading = true;
+    // set while a linearized document is still being read (see FinishProgressiveLoading)
+    bool loadingProgressively = false;
+    HANDLE progressiveThread = nullptr;
+    LONG stopProgressiveThread = 0;
+    // guarded by pagesAccess
+    bool progressiveDataLoaded = false;
+    std::function<void()> onProgressiveDataLoaded;
+
+    // see ComputePageContentHashes (the results are guarded by pagesAccess)
+    HANDLE hashingThread = nullptr;
+    LONG stopHashingThread = 0;
+    bool pageHashesComputed = false;
+    Vec<u64> pageHashes;
+    std::function<void()> onPagesHashed;
+
     bool Load(const WCHAR* filePath, PasswordUI* pwdUI = nullptr);
     bool Load(IStream* stream, PasswordUI* pwdUI = nullptr);
     // TODO(port): fz_stream can no-longer be re-opened (fz_clone_stream)
     // bool Load(fz_stream* stm, PasswordUI* pwdUI = nullptr);
-    bool LoadFromStream(fz_stream* stm, PasswordUI* pwdUI = nullptr);
+    bool LoadFromStream(fz_stream* stm, PasswordUI* pwdUI = nullptr, fz_buffer* repairedXref = nullptr);
     bool FinishLoading();
+    bool LoadPageMediaboxes(Vec<RectF>& mediaboxes);
+    void LoadDocumentProperties();
+    void StopReadingLinearly();
+    static DWORD WINAPI ProgressiveLoadingThread(LPVOID data);
+    static DWORD WINAPI PageHashingThread(LPVOID data);
 
     FzPageInfo* GetFzPageInfoFast(int pageNo);
     FzPageInfo* GetFzPageInfo(int pageNo, bool loadQuick);
+    fz_display_list* GetPageDisplayList(FzPageInfo* pageInfo, RenderTarget target, fz_cookie* cookie);
     fz_matrix viewctm(int pageNo, float zoom, int rotation);
     fz_matrix viewctm(fz_page* page, float zoom, int rotation);
     TocItem* BuildTocTree(TocItem* parent, fz_outline* outline, int& idCounter, bool isAttachment);
@@ -385,16 +419,6 @@ bool PdfLink::SaveEmbedded(LinkSaverUI& saveUI) {
 }
 #endif
 
-static void fz_lock_context_cs(void* user, int lock) {
-    EnginePdf* e = (EnginePdf*)user;
-    EnterCriticalSection(&e->mutexes[lock]);
-}
-
-static void fz_unlock_context_cs(void* user, int lock) {
-    EnginePdf* e = (EnginePdf*)user;
-    LeaveCriticalSection(&e->mutexes[lock]);
-}
-
 static void fz_print_cb(void* user, const char* msg) {
     log(msg);
     if (!str::EndsWith(msg, "\n")) {
@@ -411,23 +435,34 @@ EnginePdf::EnginePdf() {
     kind = kindEnginePdf;
     defaultFileExt = L".pdf";
     fileDPI = 72.0f;
+    // access to fz_context is guarded by ctxAccess
+    supportsConcurrentRendering = true;
 
-    for (size_t i = 0; i < dimof(mutexes); i++) {
-        InitializeCriticalSection(&mutexes[i]);
-    }
     InitializeCriticalSection(&pagesAccess);
-    ctxAccess = &mutexes[FZ_LOCK_ALLOC];
+    // ctxAccess used to alias FZ_LOCK_ALLOC, which serialized rendering with
+    // every allocation. a separate lock allows rasterizing on cloned contexts
+    // while ctx is busy interpreting another page
+    InitializeCriticalSection(&ctxAccessCs);
+    ctxAccess = &ctxAccessCs;
 
-    fz_locks_ctx.user = this;
-    fz_locks_ctx.lock = fz_lock_context_cs;
-    fz_locks_ctx.unlock = fz_unlock_context_cs;
-    ctx = fz_new_context(nullptr, &fz_locks_ctx, FZ_STORE_DEFAULT);
+    ctx = fz_clone_shared_context();
     installFitzErrorCallbacks(ctx);
-
-    pdf_install_load_system_font_funcs(ctx);
 }
 
 EnginePdf::~EnginePdf() {
+    if (progressiveThread) {
+        // the thread might be waiting for pagesAccess
+        InterlockedExchange(&stopProgressiveThread, 1);
+        WaitForSingleObject(progressiveThread, INFINITE);
+        CloseHandle(progressiveThread);
+    }
+    if (hashingThread) {
+        // the thread might be waiting for ctxAccess or pagesAccess
+        InterlockedExchange(&stopHashingThread, 1);
+        WaitForSingleObject(hashingThread, INFINITE);
+        CloseHandle(hashingThread);
+    }
+
     EnterCriticalSection(&pagesAccess);
 
     // TODO: remove this lock and see what happens
@@ -435,6 +470,7 @@ EnginePdf::~EnginePdf() {
 
     for (auto& piRef : _pages) {
         FzPageInfo* pi = &piRef;
+        fz_drop_display_list(ctx, pi->list);
         if (pi->links) {
             fz_drop_link(ctx, pi->links);
         }
@@ -443,6 +479,9 @@ EnginePdf::~EnginePdf() {
         }
         DeleteVecMembers(pi->autoLinks);
         DeleteVecMembers(pi->comments);
+        FreePageText(&pi->text);
+        delete pi->elementIndex;
+        delete pi->annotIndex;
     }
 
     fz_drop_outline(ctx, outline);
@@ -456,10 +495,8 @@ EnginePdf::~EnginePdf() {
     delete _pageLabels;
     delete tocTree;
 
-    for (size_t i = 0; i < dimof(mutexes); i++) {
-        LeaveCriticalSection(&mutexes[i]);
-        DeleteCriticalSection(&mutexes[i]);
-    }
+    LeaveCriticalSection(ctxAccess);
+    DeleteCriticalSection(ctxAccess);
     LeaveCriticalSection(&pagesAccess);
     DeleteCriticalSection(&pagesAccess);
 }
@@ -495,6 +532,7 @@ EngineBase* EnginePdf::Clone() {
     }
 
     EnginePdf* clone = new EnginePdf();
+    clone->allowProgressiveLoading = false;
     bool ok = clone->Load(FileName(), pwdUI);
     if (!ok) {
         delete clone;
@@ -585,6 +623,159 @@ std::span<u8> EnginePdf::LoadStreamFromPDFFile(const WCHAR* filePath) {
     return {data, dataSize};
 }
 
+static RepairedXrefPathFunc gRepairedXrefPath = nullptr;
+
+void SetPdfRepairedXrefPathFunc(RepairedXrefPathFunc func) {
+    gRepairedXrefPath = func;
+}
+
+#define REPAIRED_XREF_MAGIC 0x46455258 // "XREF"
+#define REPAIRED_XREF_VERSION 1
+// number of bytes at the start and at the end of a file which are
+// hashed for checking that a cached xref still belongs to it
+#define REPAIRED_XREF_HASHED_SIZE (64 * 1024)
+
+// followed by the data from pdf_save_repaired_xref
+struct RepairedXrefHeader {
+    u32 magic;
+    u32 version;
+    // the xref is only valid for the exact same file
+    i64 fileSize;
+    FILETIME fileTime;
+    u8 fingerprint[16];
+};
+
+static bool InitRepairedXrefHeader(RepairedXrefHeader* hdr, fz_context* ctx, fz_stream* stm, const WCHAR* filePath) {
+    WIN32_FILE_ATTRIBUTE_DATA fileAttr;
+    if (!stm || !GetFileAttributesExW(filePath, GetFileExInfoStandard, &fileAttr)) {
+        return false;
+    }
+    ZeroMemory(hdr, sizeof(*hdr));
+    hdr->magic = REPAIRED_XREF_MAGIC;
+    hdr->version = REPAIRED_XREF_VERSION;
+    hdr->fileSize = ((i64)fileAttr.nFileSizeHigh << 32) | fileAttr.nFileSizeLow;
+    hdr->fileTime = fileAttr.ftLastWriteTime;
+
+    // hashing the entire file would take too long for large documents
+    AutoFree buf = AllocArray<char>(REPAIRED_XREF_HASHED_SIZE);
+    if (!buf) {
+        return false;
+    }
+    i64 endOffset = std::max(hdr->fileSize - REPAIRED_XREF_HASHED_SIZE, (i64)0);
+    fz_md5 md5;
+    fz_md5_init(&md5);
+    fz_try(ctx) {
+        fz_seek(ctx, stm, 0, SEEK_SET);
+        size_t n = fz_read(ctx, stm, (u8*)buf.Get(), REPAIRED_XREF_HASHED_SIZE);
+        fz_md5_update(&md5, (u8*)buf.Get(), n);
+        fz_seek(ctx, stm, endOffset, SEEK_SET);
+        n = fz_read(ctx, stm, (u8*)buf.Get(), REPAIRED_XREF_HASHED_SIZE);
+        fz_md5_update(&md5, (u8*)buf.Get(), n);
+    }
+    fz_catch(ctx) {
+        return false;
+    }
+    fz_md5_final(&md5, hdr->fingerprint);
+    return true;
+}
+
+// damaged documents don't have to be rescanned if the
+// xref table reconstructed when last opening them is cached
+static fz_buffer* LoadRepairedXref(fz_context* ctx, fz_stream* stm, const WCHAR* filePath) {
+    if (!gRepairedXrefPath || !stm) {
+        return nullptr;
+    }
+    AutoFreeWstr path(gRepairedXrefPath(filePath));
+    if (!path || !file::Exists(path)) {
+        return nullptr;
+    }
+    AutoFree data = file::ReadFile(path);
+    RepairedXrefHeader hdr;
+    if (data.size() <= sizeof(hdr) || !InitRepairedXrefHeader(&hdr, ctx, stm, filePath)) {
+        return nullptr;
+    }
+    if (memcmp(data.Get(), &hdr, sizeof(hdr)) != 0) {
+        logf("LoadRepairedXref: cached xref is out of date\n");
+        return nullptr;
+    }
+    fz_buffer* xref = nullptr;
+    fz_try(ctx) {
+        xref = fz_new_buffer_from_copied_data(ctx, (u8*)data.Get() + sizeof(hdr), data.size() - sizeof(hdr));
+    }
+    fz_catch(ctx) {
+        xref = nullptr;
+    }
+    return xref;
+}
+
+static void SaveRepairedXref(fz_context* ctx, pdf_document* doc, const WCHAR* filePath) {
+    if (!gRepairedXrefPath || !pdf_was_repaired(ctx, doc)) {
+        return;
+    }
+    fz_buffer* xref = nullptr;
+    fz_try(ctx) {
+        xref = pdf_save_repaired_xref(ctx, doc);
+    }
+    fz_catch(ctx) {
+        xref = nullptr;
+    }
+    if (!xref) {
+        return;
+    }
+
+    AutoFreeWstr path(gRepairedXrefPath(filePath));
+    RepairedXrefHeader hdr;
+    if (path && InitRepairedXrefHeader(&hdr, ctx, doc->file, filePath)) {
+        str::Str data;
+        data.Append((const char*)&hdr, sizeof(hdr));
+        data.Append((const char*)xref->data, xref->len);
+        AutoFreeWstr dir(path::GetDir(path));
+        if (dir::Create(dir)) {
+            file::WriteFile(path, data.AsSpan());
+        }
+    }
+    fz_drop_buffer(ctx, xref);
+}
+
+static bool gPdfLoadProgressively = false;
+static int gPdfProgressiveBytesPerSec = 0;
+
+void SetPdfProgressiveLoading(bool enable, int bytesPerSec) {
+    gPdfLoadProgressively = enable;
+    gPdfProgressiveBytesPerSec = bytesPerSec;
+}
+
+// smaller files are read quickly enough even from a network share
+#define MIN_PROGRESSIVE_FILE_SIZE (1024 * 1024)
+
+// the first page of a linearized document can be shown as soon as the start
+// of the file has been read (up to the end of the first page's objects),
+// which is worth the trouble for files on slow (e.g. network) drives
+static bool ShouldLoadProgressively(const WCHAR* filePath) {
+    if (!gPdfLoadProgressively) {
+        return false;
+    }
+    if (gPdfProgressiveBytesPerSec > 0) {
+        // simulating a slow drive
+        return true;
+    }
+    if (path::IsOnFixedDrive(filePath)) {
+        return false;
+    }
+    AutoFreeStr path = strconv::WstrToUtf8(filePath);
+    if (file::GetSize(path.AsView()) < MIN_PROGRESSIVE_FILE_SIZE) {
+        return false;
+    }
+    // the linearization dictionary must be the first object in the file
+    char header[1024];
+    int n = file::ReadN(filePath, header, sizeof(header));
+    if (n <= 0) {
+        return false;
+    }
+    std::string_view sv(header, (size_t)n);
+    return sv.find("/Linearized") != std::string_view::npos;
+}
+
 bool EnginePdf::Load(const WCHAR* filePath, PasswordUI* pwdUI) {
     CrashIf(FileName() || _doc || !ctx);
     SetFileName(filePath);
@@ -595,20 +786,42 @@ bool EnginePdf::Load(const WCHAR* filePath, PasswordUI* pwdUI) {
     int streamNo = -1;
     AutoFreeWstr fnCopy = ParseEmbeddedStreamNumber(filePath, &streamNo);
 
+    bool progressive = streamNo < 0 && allowProgressiveLoading && ShouldLoadProgressively(fnCopy);
     fz_stream* file = nullptr;
     fz_try(ctx) {
-        file = fz_open_file2(ctx, fnCopy);
+        if (progressive) {
+            file = fz_open_file_progressive(ctx, fnCopy, gPdfProgressiveBytesPerSec);
+        }
+        if (!file) {
+            file = fz_open_file2(ctx, fnCopy);
+        }
     }
     fz_catch(ctx) {
         file = nullptr;
     }
 
-    if (!LoadFromStream(file, pwdUI)) {
+    fz_buffer* repairedXref = nullptr;
+    // (checking it would wait for the end of a progressively read file)
+    if (streamNo < 0 && !progressive) {
+        repairedXref = LoadRepairedXref(ctx, file, fnCopy);
+    }
+    bool ok = LoadFromStream(file, pwdUI, repairedXref);
+    fz_drop_buffer(ctx, repairedXref);
+    if (!ok) {
         return false;
     }
 
     if (streamNo < 0) {
-        return FinishLoading();
+        if (!FinishLoading()) {
+            return false;
+        }
+        // FinishLoading has loaded the page tree, which is saved along with the xref
+        // (also replacing a cached xref which no longer matched the file)
+        pdf_document* doc = (pdf_document*)_doc;
+        if (!pdf_repaired_xref_was_restored(ctx, doc)) {
+            SaveRepairedXref(ctx, doc, fnCopy);
+        }
+        return true;
     }
 
     pdf_document* doc = (pdf_document*)_doc;
@@ -658,13 +871,13 @@ bool EnginePdf::Load(IStream* stream, PasswordUI* pwdUI) {
     return FinishLoading();
 }
 
-bool EnginePdf::LoadFromStream(fz_stream* stm, PasswordUI* pwdUI) {
+bool EnginePdf::LoadFromStream(fz_stream* stm, PasswordUI* pwdUI, fz_buffer* repairedXref) {
     if (!stm) {
         return false;
     }
 
     fz_try(ctx) {
-        pdf_document* doc = pdf_open_document_with_stream(ctx, stm);
+        pdf_document* doc = pdf_open_document_with_repaired_xref(ctx, stm, repairedXref);
         _doc = (fz_document*)doc;
     }
     fz_always(ctx) {
@@ -778,6 +991,26 @@ static bool IsLinearizedFile(EnginePdf* e) {
     return isLinear;
 }
 
+// this does the job of pdf_bound_page but without doing pdf_load_page()
+static RectF GetPageObjMediabox(fz_context* ctx, pdf_obj* pageref, int pageIdx) {
+    fz_rect mbox{};
+    fz_matrix page_ctm{};
+    fz_try(ctx) {
+        pdf_page_obj_transform(ctx, pageref, &mbox, &page_ctm);
+        mbox = fz_transform_rect(mbox, page_ctm);
+    }
+    fz_catch(ctx) {
+    }
+    if (fz_is_empty_rect(mbox)) {
+        fz_warn(ctx, "cannot find page size for page %d", pageIdx);
+        mbox.x0 = 0;
+        mbox.y0 = 0;
+        mbox.x1 = 612;
+        mbox.y1 = 792;
+    }
+    return ToRectFl(mbox);
+}
+
 bool EnginePdf::FinishLoading() {
     pageCount = 0;
     fz_try(ctx) {
@@ -800,46 +1033,107 @@ bool EnginePdf::FinishLoading() {
 
     ScopedCritSec scope(ctxAccess);
 
+    _pages.AppendBlanks(pageCount);
+    for (int i = 0; i < pageCount; i++) {
+        _pages[i].pageNo = i + 1;
+    }
+
+    if (doc->file_reading_linearly) {
+        // only the first page's objects are available before the whole file has
+        // been read, so assume that all other pages have the same size for now.
+        // wait for the first page's section (which ends at the /E offset) and
+        // then only read as many objects as have arrived so far
+        fz_wait_for_stream_data_until(_docStream, pdf_dict_get_int(ctx, doc->linear_obj, PDF_NAME(E)));
+        RectF mediabox;
+        pdf_obj* pageref = nullptr;
+        fz_var(pageref);
+        fz_set_stream_try_later(_docStream, true);
+        fz_try(ctx) {
+            pageref = pdf_progressive_advance(ctx, doc, 0);
+        }
+        fz_always(ctx) {
+            fz_set_stream_try_later(_docStream, false);
+        }
+        fz_catch(ctx) {
+            pageref = nullptr;
+        }
+        fz_try(ctx) {
+            if (pageref) {
+                mediabox = GetPageObjMediabox(ctx, pageref, 0);
+            }
+        }
+        fz_catch(ctx) {
+            mediabox = RectF();
+        }
+        if (!mediabox.IsEmpty()) {
+            for (auto& pageInfo : _pages) {
+                pageInfo.mediabox = mediabox;
+            }
+            loadingProgressively = true;
+            progressiveThread = CreateThread(nullptr, 0, ProgressiveLoadingThread, this, 0, nullptr);
+            if (!progressiveThread) {
+                progressiveDataLoaded = true;
+            }
+            return true;
+        }
+        // load the document as if it weren't linearized
+        StopReadingLinearly();
+    }
+
+    Vec<RectF> mediaboxes;
+    if (!LoadPageMediaboxes(mediaboxes)) {
+        return false;
+    }
+    for (int i = 0; i < pageCount; i++) {
+        _pages[i].mediabox = mediaboxes[i];
+    }
+
+    LoadDocumentProperties();
+
+    // TODO: support javascript
+    CrashIf(pdf_js_supported(ctx, doc));
+    return true;
+}
+
+// returns the mediaboxes of all pages (by page index), caller must hold ctxAccess
+bool EnginePdf::LoadPageMediaboxes(Vec<RectF>& mediaboxes) {
+    pdf_document* doc = (pdf_document*)_doc;
+
     int nPages = 0;
+    bool treeLoaded = false;
     fz_try(ctx) {
         pdf_load_page_tree(ctx, doc);
         nPages = doc->rev_page_count;
-        if (nPages != pageCount) {
-            fz_warn(ctx, "mismatch between fz_count_pages() and doc->rev_page_count");
-            return false;
-        }
+        treeLoaded = true;
     }
     fz_catch(ctx) {
     }
+    if (treeLoaded && nPages != pageCount) {
+        fz_warn(ctx, "mismatch between fz_count_pages() and doc->rev_page_count");
+        return false;
+    }
 
-    _pages.AppendBlanks(pageCount);
-
-    // this does the job of pdf_bound_page but without doing pdf_load_page()
+    mediaboxes.Reset();
+    mediaboxes.AppendBlanks(pageCount);
     pdf_rev_page_map* map = doc->rev_page_map;
     for (int i = 0; i < nPages; i++) {
         int pageNo = map[i].page;
         int objNo = map[i].object;
-        fz_rect mbox{};
-        fz_matrix page_ctm{};
+        pdf_obj* pageref = nullptr;
         fz_try(ctx) {
-            pdf_obj* pageref = pdf_load_object(ctx, doc, objNo);
-            pdf_page_obj_transform(ctx, pageref, &mbox, &page_ctm);
-            mbox = fz_transform_rect(mbox, page_ctm);
-            pdf_drop_obj(ctx, pageref);
+            pageref = pdf_load_object(ctx, doc, objNo);
         }
         fz_catch(ctx) {
         }
-        if (fz_is_empty_rect(mbox)) {
-            fz_warn(ctx, "cannot find page size for page %d", i);
-            mbox.x0 = 0;
-            mbox.y0 = 0;
-            mbox.x1 = 612;
-            mbox.y1 = 792;
-        }
-        FzPageInfo* pageInfo = &_pages[pageNo];
-        pageInfo->mediabox = ToRectFl(mbox);
-        pageInfo->pageNo = pageNo + 1;
+        mediaboxes[pageNo] = GetPageObjMediabox(ctx, pageref, i);
+        pdf_drop_obj(ctx, pageref);
     }
+    return true;
+}
+
+// loads the outline, attachments, properties and page labels (caller must hold ctxAccess)
+void EnginePdf::LoadDocumentProperties() {
+    pdf_document* doc = (pdf_document*)_doc;
 
     fz_try(ctx) {
         outline = fz_load_outline(ctx, _doc);
@@ -921,9 +1215,94 @@ bool EnginePdf::FinishLoading() {
         hasPageLabels = true;
     }
 
-    // TODO: support javascript
-    CrashIf(pdf_js_supported(ctx, doc));
-    return true;
+}
+
+// linearized documents are first read page by page from the start of the file;
+// afterwards objects are looked up through the main xref table at its end
+// (which requires the whole file to have been read). caller must hold ctxAccess
+void EnginePdf::StopReadingLinearly() {
+    pdf_document* doc = (pdf_document*)_doc;
+    if (!doc->file_reading_linearly) {
+        return;
+    }
+    // reads all remaining objects and then the main xref table (the first
+    // attempt might fail because of broken hints which are then ignored)
+    for (int i = 0; i < 2 && doc->linear_pos < doc->file_length; i++) {
+        fz_try(ctx) {
+            pdf_progressive_advance(ctx, doc, doc->linear_page_count - 1);
+        }
+        fz_catch(ctx) {
+            fz_warn(ctx, "couldn't read the rest of the linearized document");
+        }
+    }
+    doc->file_reading_linearly = 0;
+}
+
+// waits for all of a progressively loaded document's data to have been read
+DWORD WINAPI EnginePdf::ProgressiveLoadingThread(LPVOID data) {
+    EnginePdf* engine = (EnginePdf*)data;
+    while (!InterlockedAdd(&engine->stopProgressiveThread, 0)) {
+        if (!fz_wait_for_stream_data(engine->_docStream, 100)) {
+            continue;
+        }
+        std::function<void()> onDataLoaded;
+        {
+            ScopedCritSec scope(&engine->pagesAccess);
+            engine->progressiveDataLoaded = true;
+            onDataLoaded = engine->onProgressiveDataLoaded;
+        }
+        if (onDataLoaded) {
+            onDataLoaded();
+        }
+        break;
+    }
+    return 0;
+}
+
+bool EnginePdf::IsLoadingProgressively() {
+    return loadingProgressively;
+}
+
+void EnginePdf::SetProgressiveLoadingCallback(const std::function<void()>& onDataLoaded) {
+    bool dataLoaded = false;
+    {
+        ScopedCritSec scope(&pagesAccess);
+        onProgressiveDataLoaded = onDataLoaded;
+        dataLoaded = progressiveDataLoaded;
+    }
+    if (dataLoaded && onDataLoaded) {
+        onDataLoaded();
+    }
+}
+
+// loads everything that FinishLoading had to skip for a linearized document
+bool EnginePdf::FinishProgressiveLoading() {
+    if (!loadingProgressively) {
+        return false;
+    }
+    loadingProgressively = false;
+
+    Vec<RectF> mediaboxes;
+    {
+        ScopedCritSec scope(ctxAccess);
+        // (this only waits for the rest of the file if called too early)
+        StopReadingLinearly();
+        if (!LoadPageMediaboxes(mediaboxes)) {
+            // keep the estimated page sizes
+            mediaboxes.Reset();
+        }
+        LoadDocumentProperties();
+    }
+
+    bool sizesChanged = false;
+    ScopedCritSec scope(&pagesAccess);
+    for (size_t i = 0; i < mediaboxes.size(); i++) {
+        if (!mediaboxes[i].IsEmpty() && _pages[i].mediabox != mediaboxes[i]) {
+            _pages[i].mediabox = mediaboxes[i];
+            sizesChanged = true;
+        }
+    }
+    return sizesChanged;
 }
 
 PageDestination* destFromAttachment(EnginePdf* engine, fz_outline* outline) {
@@ -1179,8 +1558,8 @@ static void MakePageElementCommentsFromAnnotations(fz_context* ctx, FzPageInfo*
 
 // Maybe: handle FZ_ERROR_TRYLATER, which can happen when parsing from network.
 // (I don't think we read from network now).
-// Maybe: when loading fully, cache extracted text in FzPageInfo
-// so that we don't have to re-do fz_new_stext_page_from_page() when doing search
+// When loading fully, the page's text is extracted in the same pass as
+// auto-detected links and images and kept for ExtractPageText
 FzPageInfo* EnginePdf::GetFzPageInfo(int pageNo, bool loadQuick) {
     // TODO: minimize time spent under pagesAccess when fully loading
     ScopedCritSec scope(&pagesAccess);
@@ -1191,9 +1570,29 @@ FzPageInfo* EnginePdf::GetFzPageInfo(int pageNo, bool loadQuick) {
 
     ScopedCritSec ctxScope(ctxAccess);
     if (!pageInfo->page) {
+        pdf_document* doc = (pdf_document*)_doc;
+        bool firstPageOnly = false;
+        if (doc->file_reading_linearly) {
+            // only the first page of a linearized document is reliably available
+            // before the whole file has been read. other pages are loaded once
+            // it has (and mustn't wait for it while blocking access to ctx)
+            if (pageIdx > 0 && !fz_wait_for_stream_data(_docStream, 0)) {
+                return nullptr;
+            }
+            if (pageIdx > 0) {
+                StopReadingLinearly();
+            } else {
+                firstPageOnly = true;
+            }
+        }
+        // (fz_load_page would otherwise wait for the rest of the file)
+        fz_set_stream_try_later(_docStream, firstPageOnly);
         fz_try(ctx) {
             pageInfo->page = fz_load_page(ctx, _doc, pageIdx);
         }
+        fz_always(ctx) {
+            fz_set_stream_try_later(_docStream, false);
+        }
         fz_catch(ctx) {
         }
     }
@@ -1211,27 +1610,12 @@ FzPageInfo* EnginePdf::GetFzPageInfo(int pageNo, bool loadQuick) {
 
     pageInfo->fullyLoaded = true;
 
-    fz_stext_page* stext = nullptr;
-    fz_var(stext);
-    fz_stext_options opts{};
-    opts.flags = FZ_STEXT_PRESERVE_IMAGES;
-    fz_try(ctx) {
-        stext = fz_new_stext_page_from_page(ctx, page, &opts);
-    }
-    fz_catch(ctx) {
-    }
-
     auto links = fz_load_links(ctx, page);
 
     pageInfo->links = FixupPageLinks(links);
     MakePageElementCommentsFromAnnotations(ctx, pageInfo);
-    if (!stext) {
-        return pageInfo;
-    }
-
-    FzLinkifyPageText(pageInfo, stext);
-    fz_find_image_positions(ctx, pageInfo->images, stext);
-    fz_drop_stext_page(ctx, stext);
+    // must come after the links so that auto-detected links don't duplicate them
+    FzAnalyzePage(ctx, pageInfo, textCache);
     return pageInfo;
 }
 
@@ -1258,7 +1642,7 @@ RectF EnginePdf::PageContentBox(int pageNo, RenderTarget target) {
     RectF mediabox = pageInfo->mediabox;
 
     fz_try(ctx) {
-        list = fz_new_display_list_from_page(ctx, pageInfo->page);
+        list = GetPageDisplayList(pageInfo, target, &fzcookie);
         if (list) {
             dev = fz_new_bbox_device(ctx, &rect);
             fz_run_display_list(ctx, list, dev, fz_identity, pagerect, &fzcookie);
@@ -1287,6 +1671,246 @@ RectF EnginePdf::PageContentBox(int pageNo, RenderTarget target) {
     return rect2.Intersect(mediabox);
 }
 
+#define FNV64_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV64_PRIME 0x100000001b3ULL
+
+static u64 HashBytes(u64 hash, const void* data, size_t len) {
+    const u8* bytes = (const u8*)data;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * FNV64_PRIME;
+    }
+    return hash;
+}
+
+// hashes PDF objects by value (following references) so that the hash
+// doesn't depend on object numbers, which usually all change when
+// a document is regenerated (e.g. by pdfTeX)
+struct PdfObjHasher {
+    fz_context* ctx = nullptr;
+    pdf_document* doc = nullptr;
+    // hashes of indirect objects (including their stream data) by object number,
+    // 0 if not hashed yet (fonts and images are usually shared between pages)
+    Vec<u64> objHashes;
+
+    PdfObjHasher(fz_context* ctx, pdf_document* doc);
+    u64 Hash(u64 hash, pdf_obj* obj);
+    u64 HashIndirect(pdf_obj* ref);
+    u64 HashPage(int pageIdx);
+};
+
+PdfObjHasher::PdfObjHasher(fz_context* ctx, pdf_document* doc) : ctx(ctx), doc(doc) {
+    objHashes.AppendBlanks(pdf_xref_len(ctx, doc));
+}
+
+u64 PdfObjHasher::Hash(u64 hash, pdf_obj* obj) {
+    if (pdf_is_indirect(ctx, obj)) {
+        u64 objHash = HashIndirect(obj);
+        return HashBytes(hash, &objHash, sizeof(objHash));
+    }
+    if (pdf_is_bool(ctx, obj)) {
+        return HashBytes(hash, pdf_to_bool(ctx, obj) ? "t" : "f", 1);
+    }
+    if (pdf_is_int(ctx, obj)) {
+        i64 value = pdf_to_int64(ctx, obj);
+        hash = HashBytes(hash, "i", 1);
+        return HashBytes(hash, &value, sizeof(value));
+    }
+    if (pdf_is_real(ctx, obj)) {
+        float value = pdf_to_real(ctx, obj);
+        hash = HashBytes(hash, "r", 1);
+        return HashBytes(hash, &value, sizeof(value));
+    }
+    if (pdf_is_name(ctx, obj)) {
+        const char* name = pdf_to_name(ctx, obj);
+        hash = HashBytes(hash, "/", 1);
+        return HashBytes(hash, name, str::Len(name) + 1);
+    }
+    if (pdf_is_string(ctx, obj)) {
+        size_t len = pdf_to_str_len(ctx, obj);
+        hash = HashBytes(hash, "(", 1);
+        hash = HashBytes(hash, &len, sizeof(len));
+        return HashBytes(hash, pdf_to_str_buf(ctx, obj), len);
+    }
+    if (pdf_is_array(ctx, obj)) {
+        int n = pdf_array_len(ctx, obj);
+        hash = HashBytes(hash, "[", 1);
+        for (int i = 0; i < n; i++) {
+            hash = Hash(hash, pdf_array_get(ctx, obj, i));
+        }
+        return HashBytes(hash, "]", 1);
+    }
+    if (pdf_is_dict(ctx, obj)) {
+        int n = pdf_dict_len(ctx, obj);
+        hash = HashBytes(hash, "<<", 2);
+        for (int i = 0; i < n; i++) {
+            pdf_obj* key = pdf_dict_get_key(ctx, obj, i);
+            // skip back references to the page tree resp. to an annotation's page
+            if (pdf_name_eq(ctx, key, PDF_NAME(Parent)) || pdf_name_eq(ctx, key, PDF_NAME(P))) {
+                continue;
+            }
+            hash = Hash(hash, key);
+            hash = Hash(hash, pdf_dict_get_val(ctx, obj, i));
+        }
+        return HashBytes(hash, ">>", 2);
+    }
+    return HashBytes(hash, "n", 1);
+}
+
+u64 PdfObjHasher::HashIndirect(pdf_obj* ref) {
+    int num = pdf_to_num(ctx, ref);
+    if (num <= 0 || num >= objHashes.isize()) {
+        return FNV64_OFFSET_BASIS;
+    }
+    if (objHashes[num] != 0) {
+        return objHashes[num];
+    }
+
+    pdf_obj* obj = pdf_resolve_indirect(ctx, ref);
+    u64 hash = FNV64_OFFSET_BASIS;
+    if (pdf_name_eq(ctx, pdf_dict_get(ctx, obj, PDF_NAME(Type)), PDF_NAME(Page))) {
+        // links to other pages mustn't depend on the content of those pages
+        int pageIdx = pdf_lookup_page_number(ctx, doc, obj);
+        hash = HashBytes(hash, "page", 4);
+        hash = HashBytes(hash, &pageIdx, sizeof(pageIdx));
+    } else if (pdf_mark_obj(ctx, obj)) {
+        // a reference cycle (don't remember the hash, as it depends on where the cycle was entered)
+        return HashBytes(hash, "cycle", 5);
+    } else {
+        fz_buffer* data = nullptr;
+        fz_var(data);
+        fz_try(ctx) {
+            hash = Hash(hash, obj);
+            if (pdf_obj_num_is_stream(ctx, doc, num)) {
+                // undecoded data suffices for telling whether it has changed
+                data = pdf_load_raw_stream_number(ctx, doc, num);
+                hash = HashBytes(hash, data->data, data->len);
+            }
+        }
+        fz_always(ctx) {
+            fz_drop_buffer(ctx, data);
+            pdf_unmark_obj(ctx, obj);
+        }
+        fz_catch(ctx) {
+            fz_rethrow(ctx);
+        }
+    }
+    objHashes[num] = hash != 0 ? hash : 1;
+    return objHashes[num];
+}
+
+u64 PdfObjHasher::HashPage(int pageIdx) {
+    pdf_obj* page = pdf_resolve_indirect(ctx, pdf_lookup_page_obj(ctx, doc, pageIdx));
+    u64 hash = Hash(FNV64_OFFSET_BASIS, page);
+    // attributes inherited from the page tree
+    pdf_obj* inheritable[] = {PDF_NAME(Resources), PDF_NAME(MediaBox), PDF_NAME(CropBox), PDF_NAME(Rotate)};
+    for (pdf_obj* key : inheritable) {
+        hash = Hash(hash, pdf_dict_get_inheritable(ctx, page, key));
+    }
+    return hash != 0 ? hash : 1;
+}
+
+u64 EnginePdf::PageContentHash(int pageNo) {
+    CrashIf(pageNo < 1 || pageNo > pageCount);
+    ScopedCritSec scope(&pagesAccess);
+    if (pageNo > pageHashes.isize()) {
+        return 0;
+    }
+    return pageHashes.at(pageNo - 1);
+}
+
+void EnginePdf::ComputePageContentHashes(const std::function<void()>& onHashed) {
+    {
+        ScopedCritSec scope(&pagesAccess);
+        if (!pageHashesComputed) {
+            onPagesHashed = onHashed;
+            if (!hashingThread) {
+                hashingThread = CreateThread(nullptr, 0, PageHashingThread, this, 0, nullptr);
+            }
+            if (hashingThread) {
+                return;
+            }
+            pageHashesComputed = true;
+        }
+    }
+    if (onHashed) {
+        onHashed();
+    }
+}
+
+void EnginePdf::StopComputingPageContentHashes() {
+    HANDLE thread = nullptr;
+    {
+        ScopedCritSec scope(&pagesAccess);
+        if (pageHashesComputed) {
+            return;
+        }
+        thread = hashingThread;
+        // PageContentHash keeps returning 0
+        pageHashesComputed = true;
+        onPagesHashed = nullptr;
+    }
+    if (thread) {
+        // the thread discards the hashes computed so far
+        InterlockedExchange(&stopHashingThread, 1);
+        WaitForSingleObject(thread, INFINITE);
+    }
+}
+
+// hashes one page at a time, so that rendering doesn't have to wait for ctxAccess
+// for long (for a progressively loaded document, waits for all of its data first)
+DWORD WINAPI EnginePdf::PageHashingThread(LPVOID data) {
+    EnginePdf* engine = (EnginePdf*)data;
+    fz_context* ctx = engine->ctx;
+    while (!fz_wait_for_stream_data(engine->_docStream, 100)) {
+        if (InterlockedAdd(&engine->stopHashingThread, 0)) {
+            return 0;
+        }
+    }
+
+    PdfObjHasher* hasher = nullptr;
+    {
+        ScopedCritSec scope(engine->ctxAccess);
+        // (no longer has to wait for any data)
+        engine->StopReadingLinearly();
+        hasher = new PdfObjHasher(ctx, (pdf_document*)engine->_doc);
+    }
+    Vec<u64> hashes;
+    for (int i = 0; i < engine->pageCount; i++) {
+        if (InterlockedAdd(&engine->stopHashingThread, 0)) {
+            delete hasher;
+            return 0;
+        }
+        ScopedCritSec scope(engine->ctxAccess);
+        u64 hash = 0;
+        fz_try(ctx) {
+            hash = hasher->HashPage(i);
+        }
+        fz_catch(ctx) {
+            fz_warn(ctx, "Couldn't hash page %d", i + 1);
+        }
+        hashes.Append(hash);
+    }
+    delete hasher;
+
+    std::function<void()> onHashed;
+    {
+        ScopedCritSec scope(&engine->pagesAccess);
+        if (engine->pageHashesComputed) {
+            // StopComputingPageContentHashes was called in the meantime
+            return 0;
+        }
+        for (u64 hash : hashes) {
+            engine->pageHashes.Append(hash);
+        }
+        engine->pageHashesComputed = true;
+        onHashed = engine->onPagesHashed;
+    }
+    if (onHashed) {
+        onHashed();
+    }
+    return 0;
+}
+
 RectF EnginePdf::Transform(const RectF& rect, int pageNo, float zoom, int rotation, bool inverse) {
     if (zoom <= 0) {
         char* name = str::Dup("");
@@ -1307,6 +1931,90 @@ RectF EnginePdf::Transform(const RectF& rect, int pageNo, float zoom, int rotati
     return ToRectFl(rect2);
 }
 
+// updates appearance streams of the page's annotations and returns their number.
+// changed is set if any of them got a new appearance since the last call
+static int UpdatePageAnnots(fz_context* ctx, pdf_page* page, bool* changed) {
+    int n = 0;
+    for (pdf_annot* annot = pdf_first_annot(ctx, page); annot; annot = pdf_next_annot(ctx, annot)) {
+        if (pdf_update_annot(ctx, annot)) {
+            *changed = true;
+        }
+        n++;
+    }
+    for (pdf_widget* widget = pdf_first_widget(ctx, page); widget; widget = pdf_next_widget(ctx, widget)) {
+        if (pdf_update_annot(ctx, widget)) {
+            *changed = true;
+        }
+        n++;
+    }
+    return n;
+}
+
+// returns a new reference to the display list of the page, recorded with usage
+// matching the target. only display lists for RenderTarget::View are cached
+// (and re-recorded when annotations have been modified, added or removed).
+// caller must hold ctxAccess
+fz_display_list* EnginePdf::GetPageDisplayList(FzPageInfo* pageInfo, RenderTarget target, fz_cookie* cookie) {
+    pdf_page* pdfpage = pdf_page_from_fz_page(ctx, pageInfo->page);
+    bool isCached = (target != RenderTarget::Print);
+
+    bool annotsChanged = false;
+    int nAnnots = 0;
+    fz_try(ctx) {
+        nAnnots = UpdatePageAnnots(ctx, pdfpage, &annotsChanged);
+    }
+    fz_catch(ctx) {
+        annotsChanged = true;
+    }
+    if (annotsChanged) {
+        // the cached text might include that of changed annotations
+        FzPageTextCacheRemove(textCache, pageInfo);
+        // the changes have been consumed by now, so the cached display list must go
+        // even if it isn't re-recorded here (i.e. when rendering for printing)
+        FzPageRunCacheRemove(ctx, runCache, pageInfo);
+    }
+    if (isCached && pageInfo->list) {
+        if (nAnnots == pageInfo->listAnnotsCount) {
+            FzPageRunCacheAdd(ctx, runCache, pageInfo, pageInfo->list);
+            return fz_keep_display_list(ctx, pageInfo->list);
+        }
+        FzPageRunCacheRemove(ctx, runCache, pageInfo);
+    }
+
+    const char* usage = "View";
+    if (target == RenderTarget::Print) {
+        usage = "Print";
+    }
+
+    fz_display_list* list = nullptr;
+    fz_device* dev = nullptr;
+    fz_var(list);
+    fz_var(dev);
+
+    fz_try(ctx) {
+        list = fz_new_display_list(ctx, fz_bound_page(ctx, pageInfo->page));
+        dev = fz_new_list_device(ctx, list);
+        pdf_document* doc = pdf_document_from_fz_document(ctx, _doc);
+        pdf_run_page_with_usage(ctx, doc, pdfpage, dev, fz_identity, usage, cookie);
+        fz_close_device(ctx, dev);
+    }
+    fz_always(ctx) {
+        fz_drop_device(ctx, dev);
+    }
+    fz_catch(ctx) {
+        fz_drop_display_list(ctx, list);
+        return nullptr;
+    }
+
+    // don't cache incompletely recorded pages
+    bool isAborted = cookie && cookie->abort;
+    if (isCached && !isAborted) {
+        pageInfo->listAnnotsCount = nAnnots;
+        FzPageRunCacheAdd(ctx, runCache, pageInfo, fz_keep_display_list(ctx, list));
+    }
+    return list;
+}
+
 RenderedBitmap* EnginePdf::RenderPage(RenderPageArgs& args) {
     auto pageNo = args.pageNo;
 
@@ -1315,7 +2023,6 @@ RenderedBitmap* EnginePdf::RenderPage(RenderPageArgs& args) {
         return nullptr;
     }
     fz_page* page = pageInfo->page;
-    pdf_page* pdfpage = pdf_page_from_fz_page(ctx, page);
 
     fz_cookie* fzcookie = nullptr;
     FitzAbortCookie* cookie = nullptr;
@@ -1325,63 +2032,31 @@ RenderedBitmap* EnginePdf::RenderPage(RenderPageArgs& args) {
         fzcookie = &cookie->cookie;
     }
 
-    // TODO(port): I don't see why this lock is needed
-    ScopedCritSec cs(ctxAccess);
-
-    auto pageRect = args.pageRect;
-    auto zoom = args.zoom;
-    auto rotation = args.rotation;
     fz_rect pRect;
-    if (pageRect) {
-        pRect = To_fz_rect(*pageRect);
-    } else {
-        // TODO(port): use pageInfo->mediabox?
-        pRect = fz_bound_page(ctx, page);
-    }
-    fz_matrix ctm = viewctm(page, zoom, rotation);
-    fz_irect bbox = fz_round_rect(fz_transform_rect(pRect, ctm));
-
-    fz_colorspace* colorspace = fz_device_rgb(ctx);
-    fz_irect ibounds = bbox;
-    fz_rect cliprect = fz_rect_from_irect(bbox);
-
-    fz_pixmap* pix = nullptr;
-    fz_device* dev = nullptr;
-    RenderedBitmap* bitmap = nullptr;
-
-    fz_var(dev);
-    fz_var(pix);
-    fz_var(bitmap);
-
-    const char* usage = "View";
-    switch (args.target) {
-        case RenderTarget::Print:
-            usage = "Print";
-            break;
-    }
+    fz_matrix ctm;
+    fz_display_list* list = nullptr;
+    {
+        // only interpreting the page content needs exclusive access to ctx,
+        // rasterizing happens on a cloned context in FzRenderDisplayList
+        ScopedCritSec cs(ctxAccess);
 
-    fz_try(ctx) {
-        pix = fz_new_pixmap_with_bbox(ctx, colorspace, ibounds, nullptr, 1);
-        // initialize with white background
-        fz_clear_pixmap_with_value(ctx, pix, 0xff);
-        // TODO: in printing different style. old code use pdf_run_page_with_usage(), with usage ="View"
-        // or "Print". "Export" is not used
-        dev = fz_new_draw_device(ctx, fz_identity, pix);
-        pdf_document* doc = pdf_document_from_fz_document(ctx, _doc);
-        pdf_run_page_with_usage(ctx, doc, pdfpage, dev, ctm, usage, fzcookie);
-        bitmap = new_rendered_fz_pixmap(ctx, pix);
-        fz_close_device(ctx, dev);
-    }
-    fz_always(ctx) {
-        if (dev) {
-            fz_drop_device(ctx, dev);
+        if (args.pageRect) {
+            pRect = To_fz_rect(*args.pageRect);
+        } else {
+            // TODO(port): use pageInfo->mediabox?
+            pRect = fz_bound_page(ctx, page);
         }
-        fz_drop_pixmap(ctx, pix);
+        ctm = viewctm(page, args.zoom, args.rotation);
+        list = GetPageDisplayList(pageInfo, args.target, fzcookie);
     }
-    fz_catch(ctx) {
-        delete bitmap;
+    if (!list) {
         return nullptr;
     }
+
+    RenderedBitmap* bitmap = FzRenderDisplayList(ctx, ctxAccess, list, ctm, pRect, fzcookie);
+
+    ScopedCritSec cs(ctxAccess);
+    fz_drop_display_list(ctx, list);
     return bitmap;
 }
 
@@ -1470,13 +2145,22 @@ RenderedBitmap* EnginePdf::GetPageImage(int pageNo, RectF rect, int imageIdx) {
 }
 
 PageText EnginePdf::ExtractPageText(int pageNo) {
+    // note: GetFzPageInfo doesn't wait for the data of a linearized document's other
+    // pages, so their text isn't available until all of the data has been read
+    // the text is only cached for pages which have been fully loaded already
+    // (a text search doesn't need a page's links, annotations and images)
     FzPageInfo* pageInfo = GetFzPageInfo(pageNo, true);
     if (!pageInfo) {
         return {};
     }
 
     ScopedCritSec scope(ctxAccess);
+    PageText cached = FzPageTextCacheTake(textCache, pageInfo);
+    if (cached.text) {
+        return cached;
+    }
 
+    // the text has been handed out or evicted since the page was loaded
     fz_stext_page* stext = nullptr;
     fz_var(stext);
     fz_stext_options opts{};
@@ -2047,6 +2731,23 @@ static bool IsAllowedAnnot(AnnotationType tp, AnnotationType* allowed) {
     return false;
 }
 
+// an annotation index is out of date once annotations have been added, removed
+// or modified or have got a new appearance (pdf_page's annot_generation)
+static void UpdateAnnotIndex(fz_context* ctx, pdf_page* page, FzPageInfo* pi) {
+    if (pi->annotIndex && pi->annotIndexGeneration == page->annot_generation) {
+        return;
+    }
+    delete pi->annotIndex;
+    pi->annotIndexAnnots.Reset();
+    Vec<fz_rect> rects;
+    for (pdf_annot* annot = pdf_first_annot(ctx, page); annot; annot = pdf_next_annot(ctx, annot)) {
+        rects.Append(pdf_annot_rect(ctx, annot));
+        pi->annotIndexAnnots.Append(annot);
+    }
+    pi->annotIndex = new FzRectIndex(rects.LendData(), rects.isize());
+    pi->annotIndexGeneration = page->annot_generation;
+}
+
 Annotation* EnginePdfGetAnnotationAtPos(EngineBase* engine, int pageNo, PointF pos, AnnotationType* allowedAnnots) {
     if (!engine || engine->kind != kindEnginePdf) {
         return nullptr;
@@ -2057,23 +2758,25 @@ Annotation* EnginePdfGetAnnotationAtPos(EngineBase* engine, int pageNo, PointF p
     ScopedCritSec cs(epdf->ctxAccess);
 
     pdf_page* pdfpage = pdf_page_from_fz_page(epdf->ctx, pi->page);
-    pdf_annot* annot = pdf_first_annot(epdf->ctx, pdfpage);
+    UpdateAnnotIndex(epdf->ctx, pdfpage, pi);
     fz_point p{pos.x, pos.y};
+    Vec<int> candidates;
+    pi->annotIndex->FindAt(p, candidates);
 
     // find last annotation that contains this point
     // they are drawn in order so later annotations
     // are drawn on top of earlier
     pdf_annot* matched = nullptr;
-    while (annot) {
+    for (int candidate : candidates) {
+        pdf_annot* annot = pi->annotIndexAnnots.at(candidate);
         enum pdf_annot_type tp = pdf_annot_type(epdf->ctx, annot);
         AnnotationType atp = AnnotationTypeFromPdfAnnot(tp);
         if (IsAllowedAnnot(atp, allowedAnnots)) {
-            fz_rect rc = pdf_annot_rect(epdf->ctx, annot);
+            fz_rect rc = pi->annotIndex->rects.at(candidate);
             if (fz_is_point_inside_rect(p, rc)) {
                 matched = annot;
             }
         }
-        annot = pdf_next_annot(epdf->ctx, annot);
     }
     if (matched) {
         return MakeAnnotationPdf(epdf->ctxAccess, epdf->ctx, pdfpage, matched, pageNo);
@@ -2,6 +2,15 @@
    License: GPLv3 */
 
 bool IsPdfEngineSupportedFileType(Kind);
+
+// returns the path at which the repaired xref table of a damaged
+// document should be cached (or nullptr if it shouldn't be cached)
+typedef WCHAR* (*RepairedXrefPathFunc)(const WCHAR* filePath);
+void SetPdfRepairedXrefPathFunc(RepairedXrefPathFunc);
+// if enabled, linearized documents on slow (e.g. network) drives are loaded progressively
+// (see EngineBase::IsLoadingProgressively). bytesPerSec > 0 loads all documents through
+// a stream throttled to that many bytes per second (for simulating a slow network share)
+void SetPdfProgressiveLoading(bool enable, int bytesPerSec = 0);
 EngineBase* CreateEnginePdfFromFile(const WCHAR* path, PasswordUI* pwdUI = nullptr);
 EngineBase* CreateEnginePdfFromStream(IStream* stream, PasswordUI* pwdUI = nullptr);
 
@@ -231,13 +231,17 @@ class EngineXps : public EngineBase {
     // protected critical section in order to avoid deadlocks
     CRITICAL_SECTION* ctxAccess;
     CRITICAL_SECTION pagesAccess;
-    CRITICAL_SECTION mutexes[FZ_LOCK_MAX];
+    // guards ctx (i.e. everything but rasterizing display lists on cloned contexts)
+    CRITICAL_SECTION ctxAccessCs;
 
     fz_context* ctx = nullptr;
-    fz_locks_context fz_locks_ctx;
     fz_document* _doc = nullptr;
     fz_stream* _docStream = nullptr;
     Vec<FzPageInfo*> _pages;
+    // pages with a cached display list, most recently rendered first
+    Vec<FzPageInfo*> runCache;
+    // pages with cached extracted text, most recently loaded first
+    Vec<FzPageInfo*> textCache;
     fz_outline* _outline = nullptr;
     xps_doc_props* _info = nullptr;
     fz_rect** imageRects = nullptr;
@@ -251,6 +255,7 @@ class EngineXps : public EngineBase {
     bool LoadFromStream(fz_stream* stm);
 
     FzPageInfo* GetFzPageInfo(int pageNo, bool failIfBusy);
+    fz_display_list* GetPageDisplayList(FzPageInfo* pageInfo, fz_cookie* cookie);
     int GetPageNo(fz_page* page);
     fz_matrix viewctm(int pageNo, float zoom, int rotation) {
         const fz_rect tmpRect = To_fz_rect(PageMediabox(pageNo));
@@ -266,16 +271,6 @@ class EngineXps : public EngineBase {
     WCHAR* ExtractFontList();
 };
 
-static void fz_lock_context_cs(void* user, int lock) {
-    EngineXps* e = (EngineXps*)user;
-    EnterCriticalSection(&e->mutexes[lock]);
-}
-
-static void fz_unlock_context_cs(void* user, int lock) {
-    EngineXps* e = (EngineXps*)user;
-    LeaveCriticalSection(&e->mutexes[lock]);
-}
-
 static void fz_print_cb(void* user, const char* msg) {
     log(msg);
 }
@@ -289,17 +284,16 @@ EngineXps::EngineXps() {
     kind = kindEngineXps;
     defaultFileExt = L".xps";
     fileDPI = 72.0f;
+    // access to fz_context is guarded by ctxAccess
+    supportsConcurrentRendering = true;
 
-    for (size_t i = 0; i < dimof(mutexes); i++) {
-        InitializeCriticalSection(&mutexes[i]);
-    }
     InitializeCriticalSection(&pagesAccess);
-    ctxAccess = &mutexes[FZ_LOCK_ALLOC];
+    // separate from FZ_LOCK_ALLOC so that cloned contexts can rasterize
+    // while ctx is busy (see EnginePdf)
+    InitializeCriticalSection(&ctxAccessCs);
+    ctxAccess = &ctxAccessCs;
 
-    fz_locks_ctx.user = this;
-    fz_locks_ctx.lock = fz_lock_context_cs;
-    fz_locks_ctx.unlock = fz_unlock_context_cs;
-    ctx = fz_new_context(nullptr, &fz_locks_ctx, FZ_STORE_DEFAULT);
+    ctx = fz_clone_shared_context();
     installFitzErrorCallbacks(ctx);
 }
 
@@ -308,12 +302,15 @@ EngineXps::~EngineXps() {
     EnterCriticalSection(ctxAccess);
 
     for (auto* pi : _pages) {
+        fz_drop_display_list(ctx, pi->list);
         if (pi->links) {
             fz_drop_link(ctx, pi->links);
         }
         if (pi->page) {
             fz_drop_page(ctx, pi->page);
         }
+        FreePageText(&pi->text);
+        delete pi->elementIndex;
     }
 
     DeleteVecMembers(_pages);
@@ -331,10 +328,8 @@ EngineXps::~EngineXps() {
     fz_drop_document(ctx, _doc);
     fz_drop_context(ctx);
 
-    for (size_t i = 0; i < dimof(mutexes); i++) {
-        LeaveCriticalSection(&mutexes[i]);
-        DeleteCriticalSection(&mutexes[i]);
-    }
+    LeaveCriticalSection(ctxAccess);
+    DeleteCriticalSection(ctxAccess);
     LeaveCriticalSection(&pagesAccess);
     DeleteCriticalSection(&pagesAccess);
 }
@@ -488,61 +483,56 @@ FzPageInfo* EngineXps::GetFzPageInfo(int pageNo, bool failIfBusy) {
 #endif
 
     fz_page* page = pageInfo->page;
-    fz_rect bounds;
-    fz_display_list* list = NULL;
-    fz_device* dev = NULL;
-    fz_cookie cookie = {0};
-    fz_var(list);
-    fz_var(dev);
-
     /* TODO: handle try later?
         if (fz_caught(ctx) != FZ_ERROR_TRYLATER) {
             return nullptr;
         }
     */
+    fz_display_list* list = GetPageDisplayList(pageInfo, nullptr);
+    if (!list) {
+        return pageInfo;
+    }
+    fz_drop_display_list(ctx, list);
+    pageInfo->links = fz_load_links(ctx, page);
+    FzAnalyzePage(ctx, pageInfo, textCache);
+
+    return pageInfo;
+}
+
+// returns a new reference to the display list of the page, which is cached
+// for the MAX_PAGE_RUN_CACHE most recently rendered pages.
+// caller must hold ctxAccess
+fz_display_list* EngineXps::GetPageDisplayList(FzPageInfo* pageInfo, fz_cookie* cookie) {
+    if (pageInfo->list) {
+        FzPageRunCacheAdd(ctx, runCache, pageInfo, pageInfo->list);
+        return fz_keep_display_list(ctx, pageInfo->list);
+    }
+
+    fz_display_list* list = nullptr;
+    fz_device* dev = nullptr;
+    fz_var(list);
+    fz_var(dev);
 
-    // TODO: use fz_new_display_list_from_page
     fz_try(ctx) {
-        bounds = fz_bound_page(ctx, page);
-        list = fz_new_display_list(ctx, bounds);
+        list = fz_new_display_list(ctx, fz_bound_page(ctx, pageInfo->page));
         dev = fz_new_list_device(ctx, list);
         // TODO(port): should this be just fz_run_page_contents?
-        fz_run_page(ctx, page, dev, fz_identity, &cookie);
+        fz_run_page(ctx, pageInfo->page, dev, fz_identity, cookie);
         fz_close_device(ctx, dev);
     }
     fz_always(ctx) {
         fz_drop_device(ctx, dev);
-        if (list) {
-            fz_drop_display_list(ctx, list);
-        }
-        dev = NULL;
     }
     fz_catch(ctx) {
         fz_drop_display_list(ctx, list);
-        // fz_drop_separations(ctx, seps);
-    }
-    if (!list) {
-        return pageInfo;
-    }
-    pageInfo->links = fz_load_links(ctx, page);
-
-    fz_stext_page* stext = nullptr;
-    fz_var(stext);
-
-    fz_try(ctx) {
-        stext = fz_new_stext_page_from_page(ctx, page, nullptr);
-    }
-    fz_catch(ctx) {
+        return nullptr;
     }
 
-    if (!stext) {
-        return pageInfo;
+    // don't cache incompletely recorded pages
+    if (!cookie || !cookie->abort) {
+        FzPageRunCacheAdd(ctx, runCache, pageInfo, fz_keep_display_list(ctx, list));
     }
-    FzLinkifyPageText(pageInfo, stext);
-    fz_find_image_positions(ctx, pageInfo->images, stext);
-    fz_drop_stext_page(ctx, stext);
-
-    return pageInfo;
+    return list;
 }
 
 int EngineXps::GetPageNo(fz_page* page) {
@@ -578,8 +568,10 @@ RectF EngineXps::PageContentBox(int pageNo, [[maybe_unused]] RenderTarget target
 
     fz_try(ctx) {
         dev = fz_new_bbox_device(ctx, &rect);
-        list = fz_new_display_list_from_page(ctx, pageInfo->page);
-        fz_run_display_list(ctx, list, dev, fz_identity, pagerect, &fzcookie);
+        list = GetPageDisplayList(pageInfo, &fzcookie);
+        if (list) {
+            fz_run_display_list(ctx, list, dev, fz_identity, pagerect, &fzcookie);
+        }
         fz_close_device(ctx, dev);
     }
     fz_always(ctx) {
@@ -625,54 +617,31 @@ RenderedBitmap* EngineXps::RenderPage(RenderPageArgs& args) {
         fzcookie = &cookie->cookie;
     }
 
-    // TODO(port): I don't see why this lock is needed
-    ScopedCritSec cs(ctxAccess);
-
     fz_rect pRect;
-    if (args.pageRect) {
-        pRect = To_fz_rect(*args.pageRect);
-    } else {
-        // TODO(port): use pageInfo->mediabox?
-        pRect = fz_bound_page(ctx, page);
-    }
-    fz_matrix ctm = viewctm(page, args.zoom, args.rotation);
-    fz_irect bbox = fz_round_rect(fz_transform_rect(pRect, ctm));
-
-    fz_colorspace* colorspace = fz_device_rgb(ctx);
-    fz_irect ibounds = bbox;
-    fz_rect cliprect = fz_rect_from_irect(bbox);
-
-    fz_pixmap* pix = nullptr;
-    fz_device* dev = nullptr;
-    RenderedBitmap* bitmap = nullptr;
-
-    fz_var(dev);
-    fz_var(pix);
-    fz_var(bitmap);
+    fz_matrix ctm;
+    fz_display_list* list = nullptr;
+    {
+        // only interpreting the page content needs exclusive access to ctx,
+        // rasterizing happens on a cloned context in FzRenderDisplayList
+        ScopedCritSec cs(ctxAccess);
 
-    fz_try(ctx) {
-        pix = fz_new_pixmap_with_bbox(ctx, colorspace, ibounds, nullptr, 1);
-        // initialize with white background
-        fz_clear_pixmap_with_value(ctx, pix, 0xff);
-
-        // TODO: in printing different style. old code use pdf_run_page_with_usage(), with usage ="View"
-        // or "Print". "Export" is not used
-        dev = fz_new_draw_device(ctx, fz_identity, pix);
-        // TODO: use fz_infinite_rect instead of cliprect?
-        fz_run_page(ctx, page, dev, ctm, fzcookie);
-        bitmap = new_rendered_fz_pixmap(ctx, pix);
-        fz_close_device(ctx, dev);
-    }
-    fz_always(ctx) {
-        if (dev) {
-            fz_drop_device(ctx, dev);
+        if (args.pageRect) {
+            pRect = To_fz_rect(*args.pageRect);
+        } else {
+            // TODO(port): use pageInfo->mediabox?
+            pRect = fz_bound_page(ctx, page);
         }
-        fz_drop_pixmap(ctx, pix);
+        ctm = viewctm(page, args.zoom, args.rotation);
+        list = GetPageDisplayList(pageInfo, fzcookie);
     }
-    fz_catch(ctx) {
-        delete bitmap;
+    if (!list) {
         return nullptr;
     }
+
+    RenderedBitmap* bitmap = FzRenderDisplayList(ctx, ctxAccess, list, ctm, pRect, fzcookie);
+
+    ScopedCritSec cs(ctxAccess);
+    fz_drop_display_list(ctx, list);
     return bitmap;
 }
 
@@ -827,6 +796,12 @@ PageText EngineXps::ExtractPageText(int pageNo) {
     }
 
     ScopedCritSec scope(ctxAccess);
+    PageText cached = FzPageTextCacheTake(textCache, pageInfo);
+    if (cached.text) {
+        return cached;
+    }
+
+    // the text has been handed out or evicted since the page was loaded
     fz_stext_page* stext = nullptr;
     fz_var(stext);
 
@@ -15,14 +15,19 @@
 #include "DisplayMode.h"
 #include "SettingsStructs.h"
 #include "FileHistory.h"
+#include "TextSelection.h"
 
 #include "AppTools.h"
 #include "FileThumbnails.h"
 
 #define THUMBNAILS_DIR_NAME L"sumatrapdfcache"
+#define THUMBNAIL_EXT L".png"
+#define TEXT_INDEX_EXT L".txtidx"
+#define REPAIRED_XREF_EXT L".xref"
+#define SYNCTEX_INDEX_EXT L".syncidx"
 
 // TODO: create in TEMP directory instead?
-static WCHAR* GetThumbnailPath(const WCHAR* filePath) {
+static WCHAR* GetCacheFilePath(const WCHAR* filePath, const WCHAR* ext) {
     // create a fingerprint of a (normalized) path for the file name
     // I'd have liked to also include the file's last modification time
     // in the fingerprint (much quicker than hashing the entire file's
@@ -48,16 +53,21 @@ static WCHAR* GetThumbnailPath(const WCHAR* filePath) {
     }
     AutoFreeWstr fname(strconv::FromAnsi(fingerPrint));
 
-    return str::Format(L"%s\\%s.png", thumbsPath.Get(), fname.Get());
+    return str::Format(L"%s\\%s%s", thumbsPath.Get(), fname.Get(), ext);
+}
+
+static WCHAR* GetThumbnailPath(const WCHAR* filePath) {
+    return GetCacheFilePath(filePath, THUMBNAIL_EXT);
 }
 
-// removes thumbnails that don't belong to any frequently used item in file history
+// removes thumbnails and text indexes that don't belong to
+// any frequently used item in file history
 void CleanUpThumbnailCache(const FileHistory& fileHistory) {
     AutoFreeWstr thumbsPath(AppGenDataFilename(THUMBNAILS_DIR_NAME));
     if (!thumbsPath) {
         return;
     }
-    AutoFreeWstr pattern(path::Join(thumbsPath, L"*.png"));
+    AutoFreeWstr pattern(path::Join(thumbsPath, L"*.*"));
 
     WStrVec files;
     WIN32_FIND_DATA fdata;
@@ -67,23 +77,30 @@ void CleanUpThumbnailCache(const FileHistory& fileHistory) {
         return;
     }
     do {
-        if (!(fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        if (fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            continue;
+        }
+        if (str::EndsWithI(fdata.cFileName, THUMBNAIL_EXT) || str::EndsWithI(fdata.cFileName, TEXT_INDEX_EXT) ||
+            str::EndsWithI(fdata.cFileName, REPAIRED_XREF_EXT) || str::EndsWithI(fdata.cFileName, SYNCTEX_INDEX_EXT)) {
             files.Append(str::Dup(fdata.cFileName));
         }
     } while (FindNextFile(hfind, &fdata));
     FindClose(hfind);
 
+    const WCHAR* cacheFileExts[] = {THUMBNAIL_EXT, TEXT_INDEX_EXT, REPAIRED_XREF_EXT, SYNCTEX_INDEX_EXT};
     Vec<DisplayState*> list;
     fileHistory.GetFrequencyOrder(list);
     for (size_t i = 0; i < list.size() && i < FILE_HISTORY_MAX_FREQUENT * 2; i++) {
-        AutoFreeWstr bmpPath(GetThumbnailPath(list.at(i)->filePath));
-        if (!bmpPath) {
-            continue;
-        }
-        int idx = files.Find(path::GetBaseNameNoFree(bmpPath));
-        if (idx != -1) {
-            CrashIf(idx < 0 || files.size() <= (size_t)idx);
-            free(files.PopAt(idx));
+        for (const WCHAR* ext : cacheFileExts) {
+            AutoFreeWstr cachePath(GetCacheFilePath(list.at(i)->filePath, ext));
+            if (!cachePath) {
+                continue;
+            }
+            int idx = files.Find(path::GetBaseNameNoFree(cachePath));
+            if (idx != -1) {
+                CrashIf(idx < 0 || files.size() <= (size_t)idx);
+                free(files.PopAt(idx));
+            }
         }
     }
 
@@ -224,3 +241,38 @@ void RemoveThumbnail(DisplayState& ds) {
     delete ds.thumbnail;
     ds.thumbnail = nullptr;
 }
+
+// the text of a document's pages is cached next to its thumbnail so that
+// it doesn't have to be extracted again when the document is reopened
+bool LoadTextIndex(DocumentTextCache* textCache, const WCHAR* filePath) {
+    AutoFreeWstr indexPath(GetCacheFilePath(filePath, TEXT_INDEX_EXT));
+    if (!indexPath || !file::Exists(indexPath)) {
+        return false;
+    }
+    return textCache->LoadIndex(indexPath);
+}
+
+// the xref tables of damaged PDF documents are cached the same way so that
+// they don't have to be repaired again (see SetPdfRepairedXrefPathFunc)
+WCHAR* GetRepairedXrefPath(const WCHAR* filePath) {
+    return GetCacheFilePath(filePath, REPAIRED_XREF_EXT);
+}
+
+WCHAR* GetSyncTexIndexPath(const WCHAR* filePath) {
+    return GetCacheFilePath(filePath, SYNCTEX_INDEX_EXT);
+}
+
+bool SaveTextIndex(DocumentTextCache* textCache, const WCHAR* filePath) {
+    if (!textCache->isDirty) {
+        return true;
+    }
+    AutoFreeWstr indexPath(GetCacheFilePath(filePath, TEXT_INDEX_EXT));
+    if (!indexPath) {
+        return false;
+    }
+    AutoFreeWstr cachePath(path::GetDir(indexPath));
+    if (!dir::Create(cachePath)) {
+        return false;
+    }
+    return textCache->SaveIndex(indexPath);
+}
@@ -13,3 +13,11 @@ bool HasThumbnail(DisplayState& ds);
 void SetThumbnail(DisplayState* ds, RenderedBitmap* bmp);
 void SaveThumbnail(DisplayState& ds);
 void RemoveThumbnail(DisplayState& ds);
+
+struct DocumentTextCache;
+
+bool LoadTextIndex(DocumentTextCache* textCache, const WCHAR* filePath);
+bool SaveTextIndex(DocumentTextCache* textCache, const WCHAR* filePath);
+
+WCHAR* GetRepairedXrefPath(const WCHAR* filePath);
+WCHAR* GetSyncTexIndexPath(const WCHAR* filePath);
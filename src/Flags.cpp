@@ -50,6 +50,7 @@ static const char* argNames =
     "n\0"
     "render\0"
     "bench\0"
+    "bench-layout\0"
     "lang\0"
     "bgcolor\0"
     "bg-color\0"
@@ -115,6 +116,7 @@ enum {
     ArgN,
     Render,
     Bench,
+    BenchLayout,
     Lang,
     BgColor,
     BgColor2,
@@ -476,6 +478,9 @@ void ParseCommandLine(const WCHAR* cmdLine, Flags& i) {
             }
             i.pathsToBenchmark.Append(s);
             i.exitImmediately = true;
+        } else if (BenchLayout == arg) {
+            i.benchLayout = true;
+            i.exitImmediately = true;
         } else if (CrashOnOpen == arg) {
             // to make testing of crash reporting system in pre-release/release
             // builds possible
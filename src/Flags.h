@@ -15,6 +15,8 @@ struct Flags {
     //   to benchmark. It can also be a string "loadonly" which means we'll
     //   only benchmark loading of the catalog
     WStrVec pathsToBenchmark;
+    // time DisplayModel's layout and page lookups for a synthetic huge document
+    bool benchLayout = false;
     bool exitWhenDone = false;
     bool printDialog = false;
     WCHAR* printerName = nullptr;
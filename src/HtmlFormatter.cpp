@@ -7,6 +7,7 @@
 #include "utils/CssParser.h"
 #include "utils/HtmlPullParser.h"
 #include "utils/Log.h"
+#include "utils/ScopedWin.h"
 #include "mui/Mui.h"
 #include "utils/Timer.h"
 
@@ -1358,6 +1359,7 @@ HtmlPage* HtmlFormatter::Next(bool skipEmptyPages) {
         if (finishedParsing) {
             return nullptr;
         }
+        EnsureHtmlLoaded();
         HtmlToken* t = htmlParser->Next();
         if (!t || t->IsError()) {
             break;
@@ -1392,6 +1394,171 @@ Vec<HtmlPage*>* HtmlFormatter::FormatAllPages(bool skipEmptyPages) {
     return pages;
 }
 
+// maximum amount of memory used by the decoded images of all documents
+#define DECODED_IMAGES_CACHE_SIZE (64 * 1024 * 1024)
+// number of hash buckets for looking up decoded images (must be a power of 2)
+#define DECODED_IMAGES_BUCKETS 256
+
+// an image decoded from the (compressed) data of a DrawInstr. the data is owned
+// by a document and its address might be reused for different data after the
+// document has been closed, so the data's hash is part of the key
+struct DecodedImage {
+    const char* data = nullptr;
+    size_t len = 0;
+    u32 hash = 0;
+
+    Bitmap* bmp = nullptr;
+    // memory used by bmp (in bytes)
+    size_t size = 0;
+
+    // links within DecodedImageCache's hash buckets and its LRU list
+    DecodedImage* hashNext = nullptr;
+    DecodedImage* lruPrev = nullptr;
+    DecodedImage* lruNext = nullptr;
+};
+
+// decoding images is much slower than drawing them, so decoded images are kept
+// around for repainting (and are evicted least recently used first)
+struct DecodedImageCache {
+    DecodedImage* buckets[DECODED_IMAGES_BUCKETS]{};
+    // most recently used image first
+    DecodedImage* lruFirst = nullptr;
+    DecodedImage* lruLast = nullptr;
+    size_t size = 0;
+    // GDI+ bitmaps mustn't be used by several threads at once,
+    // so this is also held while a cached image is drawn
+    CRITICAL_SECTION access;
+
+    DecodedImageCache() {
+        InitializeCriticalSection(&access);
+    }
+};
+
+static DecodedImageCache* GetDecodedImageCache() {
+    // never deleted, as it might be used until the very end
+    static DecodedImageCache* cache = new DecodedImageCache();
+    return cache;
+}
+
+static DecodedImage* FindDecodedImage(DecodedImageCache* cache, const ImageData& img, u32 hash) {
+    DecodedImage* e = cache->buckets[hash & (DECODED_IMAGES_BUCKETS - 1)];
+    for (; e; e = e->hashNext) {
+        if (e->data == img.data && e->len == img.len && e->hash == hash) {
+            return e;
+        }
+    }
+    return nullptr;
+}
+
+static void UnlinkDecodedImage(DecodedImageCache* cache, DecodedImage* e) {
+    if (e->lruPrev) {
+        e->lruPrev->lruNext = e->lruNext;
+    } else {
+        cache->lruFirst = e->lruNext;
+    }
+    if (e->lruNext) {
+        e->lruNext->lruPrev = e->lruPrev;
+    } else {
+        cache->lruLast = e->lruPrev;
+    }
+    e->lruPrev = e->lruNext = nullptr;
+}
+
+static void LinkDecodedImage(DecodedImageCache* cache, DecodedImage* e) {
+    e->lruNext = cache->lruFirst;
+    if (cache->lruFirst) {
+        cache->lruFirst->lruPrev = e;
+    } else {
+        cache->lruLast = e;
+    }
+    cache->lruFirst = e;
+}
+
+static void RemoveDecodedImage(DecodedImageCache* cache, DecodedImage* e) {
+    DecodedImage** prev = &cache->buckets[e->hash & (DECODED_IMAGES_BUCKETS - 1)];
+    while (*prev != e) {
+        prev = &(*prev)->hashNext;
+    }
+    *prev = e->hashNext;
+    UnlinkDecodedImage(cache, e);
+    cache->size -= e->size;
+    delete e->bmp;
+    delete e;
+}
+
+static Bitmap* DecodeImage(const ImageData& img) {
+    Bitmap* bmp = BitmapFromData(img.AsSpan());
+    if (!bmp) {
+        return nullptr;
+    }
+    // GDI+ only decodes images when they're first drawn,
+    // so force decoding them here (once) instead
+    Bitmap* decoded = bmp->Clone(0, 0, bmp->GetWidth(), bmp->GetHeight(), PixelFormat32bppPARGB);
+    if (decoded && decoded->GetLastStatus() == Ok) {
+        delete bmp;
+        return decoded;
+    }
+    delete decoded;
+    return bmp;
+}
+
+static void DrawCachedImage(Graphics* g, const ImageData& img, Gdiplus::RectF bbox) {
+    DecodedImageCache* cache = GetDecodedImageCache();
+    u32 hash = MurmurHash2(img.data, img.len);
+
+    ScopedCritSec scope(&cache->access);
+    DecodedImage* e = FindDecodedImage(cache, img, hash);
+    if (e) {
+        UnlinkDecodedImage(cache, e);
+        LinkDecodedImage(cache, e);
+    } else {
+        // don't block other threads from drawing cached images while decoding
+        LeaveCriticalSection(&cache->access);
+        Bitmap* bmp = DecodeImage(img);
+        EnterCriticalSection(&cache->access);
+        if (!bmp) {
+            return;
+        }
+        e = FindDecodedImage(cache, img, hash);
+        if (e) {
+            // another thread has decoded the same image in the meantime
+            delete bmp;
+            UnlinkDecodedImage(cache, e);
+            LinkDecodedImage(cache, e);
+        } else {
+            e = new DecodedImage();
+            e->data = img.data;
+            e->len = img.len;
+            e->hash = hash;
+            e->bmp = bmp;
+            e->size = (size_t)bmp->GetWidth() * bmp->GetHeight() * 4;
+            DecodedImage** bucket = &cache->buckets[hash & (DECODED_IMAGES_BUCKETS - 1)];
+            e->hashNext = *bucket;
+            *bucket = e;
+            LinkDecodedImage(cache, e);
+            cache->size += e->size;
+            // the most recently used image is kept even if it alone exceeds the budget
+            while (cache->size > DECODED_IMAGES_CACHE_SIZE && cache->lruLast != e) {
+                RemoveDecodedImage(cache, cache->lruLast);
+            }
+        }
+    }
+
+    Bitmap* bmp = e->bmp;
+    Status status = g->DrawImage(bmp, bbox, 0, 0, (float)bmp->GetWidth(), (float)bmp->GetHeight(), UnitPixel);
+    // GDI+ sometimes seems to succeed in loading an image because it lazily decodes it
+    CrashIf(status != Ok && status != Win32Error);
+}
+
+void FreeDecodedImages() {
+    DecodedImageCache* cache = GetDecodedImageCache();
+    ScopedCritSec scope(&cache->access);
+    while (cache->lruLast) {
+        RemoveDecodedImage(cache, cache->lruLast);
+    }
+    CrashIf(cache->size != 0);
+}
+
 // TODO: draw link in the appropriate format (blue text, underlined, should show hand cursor when
 // mouse is over a link. There's a slight complication here: we only get explicit information about
 // strings, not about the whitespace and we should underline the whitespace as well. Also the text
@@ -1450,15 +1617,7 @@ void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawI
             status = g->DrawLine(&linePen, p1, p2);
             CrashIf(status != Ok);
         } else if (DrawInstrType::Image == i.type) {
-            // TODO: cache the bitmap somewhere (?)
-            Bitmap* bmp = BitmapFromData(i.img.AsSpan());
-            if (bmp) {
-                status = g->DrawImage(bmp, ToGdipRectF(bbox), 0, 0, (float)bmp->GetWidth(), (float)bmp->GetHeight(),
-                                      UnitPixel);
-                // GDI+ sometimes seems to succeed in loading an image because it lazily decodes it
-                CrashIf(status != Ok && status != Win32Error);
-            }
-            delete bmp;
+            DrawCachedImage(g, i.img, ToGdipRectF(bbox));
         } else if (DrawInstrType::LinkStart == i.type) {
             // TODO: set text color to blue
             float y = floorf(bbox.y + bbox.dy + 0.5f);
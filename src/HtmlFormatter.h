@@ -244,6 +244,9 @@ class HtmlFormatter {
     void AppendInstr(DrawInstr di);
     bool IsCurrLineEmpty();
     virtual bool IgnoreText();
+    // for formatters whose html is loaded while it's being laid out
+    virtual void EnsureHtmlLoaded() {
+    }
 
     void DumpLineDebugInfo();
 
@@ -316,6 +319,8 @@ class HtmlFormatter {
 
 void DrawHtmlPage(Graphics* g, mui::ITextRender* textDraw, Vec<DrawInstr>* drawInstructions, float offX, float offY,
                   bool showBbox, Color textColor, bool* abortCookie = nullptr);
+// frees the images cached by DrawHtmlPage (must be called before GDI+ is shut down)
+void FreeDecodedImages();
 
 mui::TextRenderMethod GetTextRenderMethod();
 void SetTextRenderMethod(mui::TextRenderMethod method);
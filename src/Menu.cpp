@@ -163,6 +163,7 @@ static MenuDef menuDefGoTo[] = {
     { _TRN("F&orward\tAlt+Right Arrow"),    CmdGoToNavForward,       0 },
     { SEP_ITEM,                             0,                       MF_NOT_FOR_EBOOK_UI },
     { _TRN("Fin&d...\tCtrl+F"),             CmdFindFirst,            MF_NOT_FOR_EBOOK_UI },
+    { _TRN("Find &All\tAlt+F3"),            CmdFindAll,              MF_NOT_FOR_EBOOK_UI },
     { 0, 0, 0 },
 };
 //] ACCESSKEY_GROUP GoTo Menu
@@ -551,7 +552,7 @@ static void MenuUpdateStateForWindow(WindowInfo* win) {
         CmdGoToLastPage,   CmdGoToNavBack,          CmdGoToNavForward,   CmdGoToPage,      CmdFindFirst,
         CmdSaveAs,         CmdSaveAsBookmark,       CmdSendByEmail,      CmdSelectAll,     CmdCopySelection,
         CmdProperties,     CmdViewPresentationMode, CmdOpenWithAcrobat,  CmdOpenWithFoxIt, CmdOpenWithPdfXchange,
-        CmdRenameFile,     CmdShowInFolder,         CmdDebugAnnotations,
+        CmdRenameFile,     CmdShowInFolder,         CmdDebugAnnotations, CmdFindAll,
         // IDM_VIEW_WITH_XPS_VIEWER and IDM_VIEW_WITH_HTML_HELP
         // are removed instead of disabled (and can remain enabled
         // for broken XPS/CHM documents)
@@ -612,6 +613,7 @@ static void MenuUpdateStateForWindow(WindowInfo* win) {
     EngineBase* engine = dm ? dm->GetEngine() : nullptr;
     if (engine) {
         win::menu::SetEnabled(win->menu, CmdFindFirst, !engine->IsImageCollection());
+        win::menu::SetEnabled(win->menu, CmdFindAll, !engine->IsImageCollection());
     }
 
     if (win->IsDocLoaded() && !fileExists) {
@@ -190,9 +190,43 @@ static_assert(kCdicHeaderLen == sizeof(CdicHeader), "wrong size of CdicHeader st
 
 #define kCdicsMax 32
 
+// codes of up to that many bits are decoded with a single table lookup
+#define kHuffLookupBits 12
+#define kHuffLookupSize (1 << kHuffLookupBits)
+// dictionary entries can themselves be compressed (but shouldn't be nested that deeply)
+#define kHuffMaxRecursion 64
+// maximum number of dictionary entries and size of their decompressed symbols
+// kept per HuffDicCache
+#define kHuffCacheMaxEntries (1 << 20)
+#define kHuffCacheMaxDataSize (16 * 1024 * 1024)
+// marks a dictionary entry which is being decompressed (for detecting infinite recursion)
+#define kHuffCacheDecoding ((u32)-1)
+
+// a code and its length (if codeLen > kHuffLookupBits, the code has to be
+// determined from more bits, starting at codeLen bits)
+struct HuffLookupEntry {
+    u32 code;
+    u32 codeLen; // 0 for invalid codes
+    bool isTerminal;
+};
+
+// decompressed symbols of dictionary entries which are themselves compressed
+// (large dictionaries refer to the same entries over and over). not thread-safe,
+// so every thread decompressing records needs its own
+struct HuffDicCache {
+    // offset of the symbols in data + 1 (0 if the entry hasn't been decompressed yet)
+    Vec<u32> starts;
+    Vec<u32> lengths;
+    str::Str data;
+    int depth = 0;
+};
+
+// all state is set up before decompressing, so that several threads can use
+// the same HuffDicDecompressor (as long as each uses its own HuffDicCache)
 class HuffDicDecompressor {
     u32 cacheTable[kCacheItemCount] = {};
     u32 baseTable[kBaseTableItemCount] = {};
+    HuffLookupEntry lookupTable[kHuffLookupSize] = {};
 
     size_t dictsCount = 0;
     // owned by the creator (in our case: by the PdbReader)
@@ -201,21 +235,51 @@ class HuffDicDecompressor {
 
     u32 codeLength = 0;
 
-    Vec<u32> recursionGuard;
+    void BuildLookupTable();
 
   public:
     HuffDicDecompressor();
 
     bool SetHuffData(u8* huffData, size_t huffDataLen);
     bool AddCdicData(u8* cdicData, u32 cdicDataLen);
-    bool Decompress(u8* src, size_t srcSize, str::Str& dst);
-    bool DecodeOne(u32 code, str::Str& dst);
+    bool Decompress(u8* src, size_t srcSize, str::Str& dst, HuffDicCache& cache);
+    bool DecodeOne(u32 code, str::Str& dst, HuffDicCache& cache);
 };
 
 HuffDicDecompressor::HuffDicDecompressor() {
 }
 
-bool HuffDicDecompressor::DecodeOne(u32 code, str::Str& dst) {
+// for every kHuffLookupBits bit prefix, determines the code the way Decompress
+// used to do bit by bit from cacheTable and baseTable
+void HuffDicDecompressor::BuildLookupTable() {
+    for (u32 prefix = 0; prefix < kHuffLookupSize; prefix++) {
+        HuffLookupEntry& e = lookupTable[prefix];
+        u32 v = cacheTable[prefix >> (kHuffLookupBits - 8)];
+        u32 codeLen = v & 0x1f;
+        e.code = 0;
+        e.codeLen = codeLen;
+        e.isTerminal = (v & 0x80) != 0;
+        if (!codeLen || codeLen > kHuffLookupBits) {
+            continue;
+        }
+        if (e.isTerminal) {
+            e.code = (v >> 8) - (prefix >> (kHuffLookupBits - codeLen));
+            continue;
+        }
+        for (; codeLen <= kHuffLookupBits; codeLen++) {
+            u32 code = prefix >> (kHuffLookupBits - codeLen);
+            if (baseTable[codeLen * 2 - 2] <= code) {
+                e.code = baseTable[codeLen * 2 - 1] - code;
+                break;
+            }
+        }
+        // longer codes are determined in Decompress, starting at codeLen bits
+        e.codeLen = codeLen;
+    }
+}
+
+bool HuffDicDecompressor::DecodeOne(u32 code, str::Str& dst, HuffDicCache& cache) {
+    u32 entry = code;
     u16 dict = (u16)(code >> codeLength);
     if (dict >= dictsCount) {
         logf("invalid dict value\n");
@@ -236,15 +300,46 @@ bool HuffDicDecompressor::DecodeOne(u32 code, str::Str& dst) {
     }
 
     if (!(symLen & 0x8000)) {
-        if (recursionGuard.Contains(code)) {
+        if (cache.starts.size() == 0) {
+            size_t nEntries = dictsCount << codeLength;
+            if (nEntries <= kHuffCacheMaxEntries) {
+                cache.starts.AppendBlanks(nEntries);
+                cache.lengths.AppendBlanks(nEntries);
+            }
+        }
+        bool canCache = entry < cache.starts.size();
+        if (canCache) {
+            u32 start = cache.starts.at(entry);
+            if (kHuffCacheDecoding == start) {
+                logf("infinite recursion\n");
+                return false;
+            }
+            if (start != 0) {
+                dst.Append(cache.data.Get() + start - 1, cache.lengths.at(entry));
+                return true;
+            }
+            cache.starts.at(entry) = kHuffCacheDecoding;
+        }
+        if (cache.depth >= kHuffMaxRecursion) {
             logf("infinite recursion\n");
             return false;
         }
-        recursionGuard.Append(code);
-        if (!Decompress(p, symLen, dst)) {
+        size_t dstStart = dst.size();
+        cache.depth++;
+        bool ok = Decompress(p, symLen, dst, cache);
+        cache.depth--;
+        if (canCache) {
+            cache.starts.at(entry) = 0;
+        }
+        if (!ok) {
             return false;
         }
-        recursionGuard.Pop();
+        size_t len = dst.size() - dstStart;
+        if (canCache && cache.data.size() + len <= kHuffCacheMaxDataSize) {
+            cache.starts.at(entry) = (u32)cache.data.size() + 1;
+            cache.lengths.at(entry) = (u32)len;
+            cache.data.Append(dst.Get() + dstStart, len);
+        }
     } else {
         symLen &= 0x7fff;
         if (symLen > 127) {
@@ -256,7 +351,7 @@ bool HuffDicDecompressor::DecodeOne(u32 code, str::Str& dst) {
     return true;
 }
 
-bool HuffDicDecompressor::Decompress(u8* src, size_t srcSize, str::Str& dst) {
+bool HuffDicDecompressor::Decompress(u8* src, size_t srcSize, str::Str& dst, HuffDicCache& cache) {
     u32 bitsConsumed = 0;
     u32 bits = 0;
 
@@ -276,18 +371,17 @@ bool HuffDicDecompressor::Decompress(u8* src, size_t srcSize, str::Str& dst) {
         if (br.BitsLeft() < 8 && 0 == bits) {
             break;
         }
-        u32 v = cacheTable[bits >> 24];
-        u32 codeLen = v & 0x1f;
+        const HuffLookupEntry& e = lookupTable[bits >> (32 - kHuffLookupBits)];
+        u32 codeLen = e.codeLen;
         if (!codeLen) {
             logf("corrupted table, zero code len\n");
             return false;
         }
-        bool isTerminal = (v & 0x80) != 0;
 
-        u32 code;
-        if (isTerminal) {
-            code = (v >> 8) - (bits >> (32 - codeLen));
-        } else {
+        u32 code = e.code;
+        if (codeLen > kHuffLookupBits && e.isTerminal) {
+            code = (cacheTable[bits >> 24] >> 8) - (bits >> (32 - codeLen));
+        } else if (codeLen > kHuffLookupBits) {
             u32 baseVal;
             codeLen -= 1;
             do {
@@ -302,7 +396,7 @@ bool HuffDicDecompressor::Decompress(u8* src, size_t srcSize, str::Str& dst) {
             code = baseTable[codeLen * 2 - 1] - (bits >> (32 - codeLen));
         }
 
-        if (!DecodeOne(code, dst)) {
+        if (!DecodeOne(code, dst, cache)) {
             return false;
         }
         bitsConsumed = codeLen;
@@ -359,6 +453,7 @@ bool HuffDicDecompressor::SetHuffData(u8* huffData, size_t huffDataLen) {
         baseTable[i] = d.UInt32();
     }
     CrashIf(d.Offset() != kHuffRecordMinLen);
+    BuildLookupTable();
     return true;
 }
 
@@ -815,7 +910,7 @@ static size_t GetRealRecordSize(const u8* recData, size_t recLen, size_t trailer
 
 // Load a given record of a document into strOut, uncompressing if necessary.
 // Returns false if error.
-bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut) {
+bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut, HuffDicCache& huffCache) {
     std::span<u8> rec = pdbReader->GetRecord(recNo);
     u8* recData = rec.data();
     if (nullptr == recData) {
@@ -838,7 +933,7 @@ bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut) {
         return ok;
     }
     if (COMPRESSION_HUFF == compressionType && huffDic) {
-        bool ok = huffDic->Decompress((u8*)recData, recSize, strOut);
+        bool ok = huffDic->Decompress((u8*)recData, recSize, strOut, huffCache);
         if (!ok) {
             logf("HuffDic decompression failed\n");
         }
@@ -856,6 +951,78 @@ bool MobiDoc::LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut) {
     return false;
 }
 
+// shared by the threads decompressing a document's records
+struct MobiDecompressData {
+    MobiDoc* mb = nullptr;
+    // decompressed records (the first text record is at index 0)
+    str::Str* records = nullptr;
+    LONG nextRec = -1;
+    LONG nFailed = 0;
+};
+
+DWORD WINAPI MobiDoc::DecompressRecordsThread(LPVOID data) {
+    MobiDecompressData* d = (MobiDecompressData*)data;
+    HuffDicCache huffCache;
+    for (;;) {
+        LONG idx = InterlockedIncrement(&d->nextRec);
+        if (idx >= (LONG)d->mb->docRecCount) {
+            return 0;
+        }
+        if (!d->mb->LoadDocRecordIntoBuffer(idx + 1, d->records[idx], huffCache)) {
+            InterlockedIncrement(&d->nFailed);
+        }
+    }
+}
+
+// maximum number of threads decompressing the records of a document
+// (a record contains at most 4 KB of text, so small documents aren't worth it)
+int gMobiDecompressThreads = 8;
+#define MOBI_RECORDS_PER_THREAD 64
+
+// decompresses all text records into doc, returns the number of records which failed
+size_t MobiDoc::DecompressRecords() {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int nThreads = std::min((int)si.dwNumberOfProcessors, gMobiDecompressThreads);
+    nThreads = std::min(nThreads, (int)(docRecCount / MOBI_RECORDS_PER_THREAD));
+    bool isCompressed = COMPRESSION_PALM == compressionType || (COMPRESSION_HUFF == compressionType && huffDic);
+    if (!isCompressed || nThreads < 2 || docRecCount > LONG_MAX) {
+        HuffDicCache huffCache;
+        size_t nFailed = 0;
+        for (size_t i = 1; i <= docRecCount; i++) {
+            if (!LoadDocRecordIntoBuffer(i, *doc, huffCache)) {
+                nFailed++;
+            }
+        }
+        return nFailed;
+    }
+
+    // records are compressed independently of each other, so they can
+    // be decompressed in parallel (this thread being one of the workers)
+    MobiDecompressData data;
+    data.mb = this;
+    data.records = new str::Str[docRecCount];
+    Vec<HANDLE> threads;
+    for (int i = 1; i < nThreads; i++) {
+        HANDLE h = CreateThread(nullptr, 0, DecompressRecordsThread, &data, 0, nullptr);
+        if (h) {
+            threads.Append(h);
+        }
+    }
+    DecompressRecordsThread(&data);
+    if (threads.size() > 0) {
+        WaitForMultipleObjects((DWORD)threads.size(), threads.LendData(), TRUE, INFINITE);
+    }
+    for (HANDLE h : threads) {
+        CloseHandle(h);
+    }
+    for (size_t i = 0; i < docRecCount; i++) {
+        doc->Append(data.records[i].Get(), data.records[i].size());
+    }
+    delete[] data.records;
+    return (size_t)data.nFailed;
+}
+
 bool MobiDoc::LoadDocument(PdbReader* pdbReader) {
     logToDebugger = true;
     this->pdbReader = pdbReader;
@@ -865,12 +1032,7 @@ bool MobiDoc::LoadDocument(PdbReader* pdbReader) {
 
     CrashIf(doc != nullptr);
     doc = new str::Str(docUncompressedSize);
-    size_t nFailed = 0;
-    for (size_t i = 1; i <= docRecCount; i++) {
-        if (!LoadDocRecordIntoBuffer(i, *doc)) {
-            nFailed++;
-        }
-    }
+    size_t nFailed = DecompressRecords();
 
     // TODO: this is a heuristic for https://github.com/sumatrapdfreader/sumatrapdf/issues/1314
     // It has 29 records that fail to decompress because infinite recursion
@@ -2,6 +2,7 @@
    License: Simplified BSD (see COPYING.BSD) */
 
 class HuffDicDecompressor;
+struct HuffDicCache;
 class PdbReader;
 
 class MobiDoc {
@@ -34,7 +35,9 @@ class MobiDoc {
     explicit MobiDoc(const WCHAR* filePath);
 
     bool ParseHeader();
-    bool LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut);
+    bool LoadDocRecordIntoBuffer(size_t recNo, str::Str& strOut, HuffDicCache& huffCache);
+    size_t DecompressRecords();
+    static DWORD WINAPI DecompressRecordsThread(LPVOID data);
     void LoadImages();
     bool LoadImage(size_t imageNo);
     bool LoadDocument(PdbReader* pdbReader);
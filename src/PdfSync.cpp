@@ -63,25 +63,34 @@ class Pdfsync : public Synchronizer {
     Vec<size_t> sheetIndex;          // start of entries for a sheet in <points>
 };
 
+struct SyncTexIndex;
+struct SyncTexIndexBuild;
+
 // Synchronizer based on .synctex file generated with SyncTex
+// (the .synctex file is parsed into a SyncTexIndex on a background thread)
 class SyncTex : public Synchronizer {
   public:
-    SyncTex(const WCHAR* syncfilename, EngineBase* engine)
-        : Synchronizer(syncfilename), engine(engine), scanner(nullptr) {
-        CrashIf(!str::EndsWithI(syncfilename, SYNCTEX_EXTENSION));
-    }
-    virtual ~SyncTex() {
-        synctex_scanner_free(scanner);
-    }
+    SyncTex(const WCHAR* syncfilename, const WCHAR* pdffilename, EngineBase* engine);
+    ~SyncTex() override;
 
     int DocToSource(UINT pageNo, Point pt, AutoFreeWstr& filename, UINT* line, UINT* col) override;
     int SourceToDoc(const WCHAR* srcfilename, UINT line, UINT col, UINT* page, Vec<Rect>& rects) override;
 
   private:
     int RebuildIndex();
-
-    EngineBase* engine; // needed for converting between coordinate systems
-    synctex_scanner_t scanner;
+    int EnsureIndex();
+    void StartIndexBuild();
+    void FinishIndexBuild();
+    void ResolveInputPaths();
+
+    EngineBase* engine;   // needed for converting between coordinate systems
+    AutoFreeWstr pdfpath; // the index is cached by the path of the PDF document
+    SyncTexIndex* index = nullptr;
+    // absolute paths of the source files by input (resolved when first needed)
+    WStrVec inputPaths;
+    // set while an index is being built
+    SyncTexIndexBuild* build = nullptr;
+    HANDLE buildThread = nullptr;
 };
 
 Synchronizer::Synchronizer(const WCHAR* syncfilepath) : indexDiscarded(true), syncfilepath(str::Dup(syncfilepath)) {
@@ -146,7 +155,7 @@ int Synchronizer::Create(const WCHAR* pdffilename, EngineBase* engine, Synchroni
     if (file::Exists(texGzFile) || file::Exists(texFile)) {
         // due to a bug with synctex_parser.c, this must always be
         // the path to the .synctex file (even if a .synctex.gz file is used instead)
-        *sync = new SyncTex(texFile, engine);
+        *sync = new SyncTex(texFile, pdffilename, engine);
         return *sync ? PDFSYNCERR_SUCCESS : PDFSYNCERR_OUTOFMEMORY;
     }
 
@@ -509,83 +518,586 @@ int Pdfsync::SourceToDoc(const WCHAR* srcfilename, UINT line, UINT col, UINT* pa
     return PDFSYNCERR_NOSYNCPOINT_FOR_LINERECORD;
 }
 
+
 // SYNCTEX synchronizer
 
-int SyncTex::RebuildIndex() {
-    synctex_scanner_free(scanner);
-    scanner = nullptr;
+#define SYNCTEX_INDEX_MAGIC 0x58445453 // "STDX"
+#define SYNCTEX_INDEX_VERSION 1
+
+// a SyncTexIndex contains everything synctex_edit_query and synctex_display_query
+// look at. it consists of a SyncTexIndexHeader followed by (in this order)
+// SyncTexInput[nInputs], SyncTexNode[nNodes], SyncTexPage[nPages], u32 pageBoxes[nPageBoxes],
+// u32 sourceNodes[nSourceNodes] and the input names (namesSize bytes)
+struct SyncTexIndexHeader {
+    u32 magic;
+    u32 version;
+    // the index is only valid for the exact same .synctex(.gz) file
+    i64 syncFileSize;
+    FILETIME syncFileTime;
+    int nInputs;
+    int nNodes;
+    int nPages;
+    int nPageBoxes;
+    int nSourceNodes;
+    u32 namesSize;
+};
+
+struct SyncTexInput {
+    int tag;
+    u32 nameOffset; // zero-terminated name as found in the .synctex file
+};
+
+// the nodes of all sheets in document order
+struct SyncTexNode {
+    int type; // synctex_node_type_t
+    int tag, line, column;
+    int page;
+    int parent; // index of the enclosing box (-1 for a sheet's top-level nodes)
+    int end;    // one past the index of the node's last descendant
+    float h;    // horizontal position (for nodes which aren't boxes)
+    // the visible box (for nodes which aren't boxes, the enclosing box's)
+    float x, y, dx, dy;
+};
+
+// a page's hboxes are sorted by their top edge (in pageBoxes)
+struct SyncTexPage {
+    int boxStart, boxEnd;
+    // the height of the tallest box (bounds the search for boxes containing a point)
+    float maxDy;
+};
+
+static bool IsSyncTexBox(int type) {
+    return type == synctex_node_type_vbox || type == synctex_node_type_void_vbox || type == synctex_node_type_hbox ||
+           type == synctex_node_type_void_hbox;
+}
+
+static RectF SyncTexNodeRect(const SyncTexNode& node) {
+    RectF rc(node.x, node.y, node.dx, node.dy);
+    // boxes can have a negative width, height or depth
+    if (rc.dx < 0) {
+        rc.x += rc.dx;
+        rc.dx = -rc.dx;
+    }
+    if (rc.dy < 0) {
+        rc.y += rc.dy;
+        rc.dy = -rc.dy;
+    }
+    return rc;
+}
+
+// synctex_parser.c uses whichever of the .synctex and .synctex.gz files is newer
+static bool GetSyncFileStamp(const WCHAR* syncfilepath, SyncTexIndexHeader* hdr) {
+    AutoFreeWstr gzfilepath(str::Join(syncfilepath, L".gz"));
+    const WCHAR* paths[] = {syncfilepath, gzfilepath};
+    bool found = false;
+    for (const WCHAR* path : paths) {
+        WIN32_FILE_ATTRIBUTE_DATA fileAttr;
+        if (!GetFileAttributesExW(path, GetFileExInfoStandard, &fileAttr)) {
+            continue;
+        }
+        if (found && CompareFileTime(&fileAttr.ftLastWriteTime, &hdr->syncFileTime) <= 0) {
+            continue;
+        }
+        hdr->syncFileSize = ((i64)fileAttr.nFileSizeHigh << 32) | fileAttr.nFileSizeLow;
+        hdr->syncFileTime = fileAttr.ftLastWriteTime;
+        found = true;
+    }
+    return found;
+}
 
+// appends node, its siblings and all their descendants to nodes
+static void AddSyncTexNodes(synctex_node_t node, int page, int parent, Vec<SyncTexNode>& nodes) {
+    for (; node; node = synctex_node_sibling(node)) {
+        SyncTexNode n;
+        n.type = synctex_node_type(node);
+        n.tag = synctex_node_tag(node);
+        n.line = synctex_node_line(node);
+        n.column = synctex_node_column(node);
+        n.page = page;
+        n.parent = parent;
+        n.end = 0;
+        n.h = synctex_node_visible_h(node);
+        n.x = synctex_node_box_visible_h(node);
+        n.y = (float)((double)synctex_node_box_visible_v(node) - (double)synctex_node_box_visible_height(node));
+        n.dx = synctex_node_box_visible_width(node);
+        n.dy = (float)((double)synctex_node_box_visible_height(node) + (double)synctex_node_box_visible_depth(node));
+        int idx = nodes.isize();
+        nodes.Append(n);
+        AddSyncTexNodes(synctex_node_child(node), page, idx, nodes);
+        nodes.at(idx).end = nodes.isize();
+    }
+}
+
+// parses the .synctex file (which can take seconds for large documents)
+// and serializes the parsed node tree into a SyncTexIndex
+static bool BuildSyncTexIndex(const WCHAR* syncfilepath, int pageCount, str::Str& data) {
+    SyncTexIndexHeader hdr{};
+    hdr.magic = SYNCTEX_INDEX_MAGIC;
+    hdr.version = SYNCTEX_INDEX_VERSION;
+    // (stamp the file before parsing it, so that changes while parsing aren't missed)
+    if (!GetSyncFileStamp(syncfilepath, &hdr)) {
+        return false;
+    }
     AutoFree syncfname(strconv::WstrToAnsi(syncfilepath));
     if (!syncfname.Get()) {
-        return PDFSYNCERR_OUTOFMEMORY;
+        return false;
     }
-
-    scanner = synctex_scanner_new_with_output_file(syncfname.Get(), nullptr, 1);
+    synctex_scanner_t scanner = synctex_scanner_new_with_output_file(syncfname.Get(), nullptr, 1);
     if (!scanner) {
-        return PDFSYNCERR_SYNCFILE_NOTFOUND; // cannot rebuild the index
+        return false;
     }
 
-    return Synchronizer::RebuildIndex();
+    Vec<SyncTexInput> inputs;
+    str::Str names;
+    for (synctex_node_t input = synctex_scanner_input(scanner); input; input = synctex_node_sibling(input)) {
+        int tag = synctex_node_tag(input);
+        const char* name = synctex_scanner_get_name(scanner, tag);
+        if (name) {
+            inputs.Append({tag, (u32)names.size()});
+            names.Append(name, str::Len(name) + 1);
+        }
+    }
+
+    Vec<SyncTexNode> nodes;
+    Vec<SyncTexPage> pages;
+    Vec<u32> pageBoxes;
+    for (int pageNo = 1; pageNo <= pageCount; pageNo++) {
+        int nodeStart = nodes.isize();
+        AddSyncTexNodes(synctex_sheet_content(scanner, pageNo), pageNo, -1, nodes);
+
+        SyncTexPage page = {pageBoxes.isize(), 0, 0.f};
+        for (int i = nodeStart; i < nodes.isize(); i++) {
+            if (nodes.at(i).type == synctex_node_type_hbox) {
+                pageBoxes.Append((u32)i);
+                page.maxDy = std::max(page.maxDy, SyncTexNodeRect(nodes.at(i)).dy);
+            }
+        }
+        page.boxEnd = pageBoxes.isize();
+        std::sort(pageBoxes.begin() + page.boxStart, pageBoxes.begin() + page.boxEnd, [&nodes](u32 a, u32 b) {
+            return SyncTexNodeRect(nodes.at(a)).y < SyncTexNodeRect(nodes.at(b)).y;
+        });
+        pages.Append(page);
+    }
+    synctex_scanner_free(scanner);
+
+    // all nodes for a line of a source file, in document order
+    Vec<u32> sourceNodes;
+    for (int i = 0; i < nodes.isize(); i++) {
+        if (nodes.at(i).tag > 0) {
+            sourceNodes.Append((u32)i);
+        }
+    }
+    std::sort(sourceNodes.begin(), sourceNodes.end(), [&nodes](u32 a, u32 b) {
+        const SyncTexNode& na = nodes.at(a);
+        const SyncTexNode& nb = nodes.at(b);
+        if (na.tag != nb.tag) {
+            return na.tag < nb.tag;
+        }
+        if (na.line != nb.line) {
+            return na.line < nb.line;
+        }
+        return a < b;
+    });
+
+    hdr.nInputs = inputs.isize();
+    hdr.nNodes = nodes.isize();
+    hdr.nPages = pages.isize();
+    hdr.nPageBoxes = pageBoxes.isize();
+    hdr.nSourceNodes = sourceNodes.isize();
+    hdr.namesSize = (u32)names.size();
+
+    data.Reset();
+    data.Append((const char*)&hdr, sizeof(hdr));
+    data.Append((const char*)inputs.LendData(), inputs.size() * sizeof(SyncTexInput));
+    data.Append((const char*)nodes.LendData(), nodes.size() * sizeof(SyncTexNode));
+    data.Append((const char*)pages.LendData(), pages.size() * sizeof(SyncTexPage));
+    data.Append((const char*)pageBoxes.LendData(), pageBoxes.size() * sizeof(u32));
+    data.Append((const char*)sourceNodes.LendData(), sourceNodes.size() * sizeof(u32));
+    data.Append(names.LendData(), names.size());
+    return true;
 }
 
-int SyncTex::DocToSource(UINT pageNo, Point pt, AutoFreeWstr& filename, UINT* line, UINT* col) {
-    if (IsIndexDiscarded()) {
-        if (RebuildIndex() != PDFSYNCERR_SUCCESS) {
-            return PDFSYNCERR_SYNCFILE_CANNOT_BE_OPENED;
+// an index either mapped from the cache or built in memory
+struct SyncTexIndex {
+    u8* data = nullptr;
+    size_t size = 0;
+    bool isMapped = false;
+
+    const SyncTexIndexHeader* hdr = nullptr;
+    const SyncTexInput* inputs = nullptr;
+    const SyncTexNode* nodes = nullptr;
+    const SyncTexPage* pages = nullptr;
+    const u32* pageBoxes = nullptr;
+    const u32* sourceNodes = nullptr;
+    const char* names = nullptr;
+
+    SyncTexIndex(u8* data, size_t size, bool isMapped) : data(data), size(size), isMapped(isMapped) {
+    }
+    ~SyncTexIndex() {
+        if (isMapped) {
+            UnmapViewOfFile(data);
+        } else {
+            free(data);
         }
     }
-    CrashIf(!this->scanner);
 
-    // Coverity: at this point, this->scanner->flags.has_parsed == 1 and thus
-    // synctex_scanner_parse never gets the chance to freeing the scanner
-    if (synctex_edit_query(this->scanner, pageNo, (float)pt.x, (float)pt.y) <= 0) {
-        return PDFSYNCERR_NO_SYNC_AT_LOCATION;
+    bool Init();
+    bool IsUpToDate(const WCHAR* syncfilepath) const;
+};
+
+// validates the index, so that lookups don't have to (a cached index might be damaged)
+bool SyncTexIndex::Init() {
+    if (size < sizeof(SyncTexIndexHeader)) {
+        return false;
+    }
+    hdr = (const SyncTexIndexHeader*)data;
+    if (hdr->magic != SYNCTEX_INDEX_MAGIC || hdr->version != SYNCTEX_INDEX_VERSION || hdr->nInputs < 0 ||
+        hdr->nNodes < 0 || hdr->nPages < 0 || hdr->nPageBoxes < 0 || hdr->nSourceNodes < 0) {
+        return false;
+    }
+    u64 expectedSize = sizeof(SyncTexIndexHeader) + (u64)hdr->nInputs * sizeof(SyncTexInput) +
+                       (u64)hdr->nNodes * sizeof(SyncTexNode) + (u64)hdr->nPages * sizeof(SyncTexPage) +
+                       ((u64)hdr->nPageBoxes + (u64)hdr->nSourceNodes) * sizeof(u32) + hdr->namesSize;
+    if (expectedSize != size) {
+        return false;
+    }
+    inputs = (const SyncTexInput*)(data + sizeof(SyncTexIndexHeader));
+    nodes = (const SyncTexNode*)(inputs + hdr->nInputs);
+    pages = (const SyncTexPage*)(nodes + hdr->nNodes);
+    pageBoxes = (const u32*)(pages + hdr->nPages);
+    sourceNodes = pageBoxes + hdr->nPageBoxes;
+    names = (const char*)(sourceNodes + hdr->nSourceNodes);
+
+    if (hdr->namesSize > 0 && names[hdr->namesSize - 1] != '\0') {
+        return false;
+    }
+    for (int i = 0; i < hdr->nInputs; i++) {
+        if (inputs[i].nameOffset >= hdr->namesSize) {
+            return false;
+        }
+    }
+    for (int i = 0; i < hdr->nNodes; i++) {
+        const SyncTexNode& node = nodes[i];
+        if (node.parent < -1 || node.parent >= i || node.end <= i || node.end > hdr->nNodes) {
+            return false;
+        }
+    }
+    for (int i = 0; i < hdr->nPages; i++) {
+        const SyncTexPage& page = pages[i];
+        if (page.boxStart < 0 || page.boxStart > page.boxEnd || page.boxEnd > hdr->nPageBoxes) {
+            return false;
+        }
+    }
+    for (int i = 0; i < hdr->nPageBoxes; i++) {
+        if (pageBoxes[i] >= (u32)hdr->nNodes) {
+            return false;
+        }
+    }
+    for (int i = 0; i < hdr->nSourceNodes; i++) {
+        if (sourceNodes[i] >= (u32)hdr->nNodes) {
+            return false;
+        }
     }
+    return true;
+}
 
-    synctex_node_t node = synctex_next_result(this->scanner);
-    if (!node) {
-        return PDFSYNCERR_NO_SYNC_AT_LOCATION;
+bool SyncTexIndex::IsUpToDate(const WCHAR* syncfilepath) const {
+    SyncTexIndexHeader stamp{};
+    if (!GetSyncFileStamp(syncfilepath, &stamp)) {
+        return false;
     }
+    return stamp.syncFileSize == hdr->syncFileSize && CompareFileTime(&stamp.syncFileTime, &hdr->syncFileTime) == 0;
+}
 
-    const char* name = synctex_scanner_get_name(this->scanner, synctex_node_tag(node));
-    if (!name) {
-        return PDFSYNCERR_UNKNOWN_SOURCEFILE;
+// takes ownership of data
+static SyncTexIndex* NewSyncTexIndex(u8* data, size_t size) {
+    SyncTexIndex* index = new SyncTexIndex(data, size, false);
+    if (!index->Init()) {
+        delete index;
+        return nullptr;
     }
+    return index;
+}
 
-    bool isUtf8 = true;
-    filename.Set(strconv::Utf8ToWstr(name));
-TryAgainAnsi:
-    if (!filename) {
-        return PDFSYNCERR_OUTOFMEMORY;
+// mapping the cached index means only the parts needed for lookups are ever read
+static SyncTexIndex* MapSyncTexIndex(const WCHAR* indexPath) {
+    AutoCloseHandle h = CreateFileW(indexPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (!h.IsValid()) {
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(h, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(SyncTexIndexHeader) ||
+        (u64)fileSize.QuadPart > SIZE_MAX) {
+        return nullptr;
+    }
+    // the view keeps the mapping alive
+    AutoCloseHandle hMap = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!hMap.IsValid()) {
+        return nullptr;
     }
+    u8* data = (u8*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        return nullptr;
+    }
+    SyncTexIndex* index = new SyncTexIndex(data, (size_t)fileSize.QuadPart, true);
+    if (!index->Init()) {
+        delete index;
+        return nullptr;
+    }
+    return index;
+}
+
+static SyncTexIndexPathFunc gSyncTexIndexPath = nullptr;
+
+void SetSyncTexIndexPathFunc(SyncTexIndexPathFunc func) {
+    gSyncTexIndexPath = func;
+}
 
-    // undecorate the filepath: replace * by space and / by \ (backslash)
-    str::TransChars(filename, L"*/", L" \\");
-    // Convert the source filepath to an absolute path
-    if (PathIsRelative(filename)) {
-        filename.Set(PrependDir(filename));
+// shared between SyncTex and the thread building the index
+// (the thread outlives SyncTex if the document is closed in the meantime)
+struct SyncTexIndexBuild {
+    AutoFreeWstr syncfilepath;
+    AutoFreeWstr indexPath; // nullptr if the index isn't cached
+    int pageCount = 0;
+    str::Str data;
+    LONG refs = 2;
+};
+
+static void ReleaseSyncTexIndexBuild(SyncTexIndexBuild* build) {
+    if (InterlockedDecrement(&build->refs) == 0) {
+        delete build;
     }
+}
 
-    // recent SyncTeX versions encode in UTF-8 instead of ANSI
-    if (isUtf8 && !file::Exists(filename)) {
-        isUtf8 = false;
-        filename.Set(strconv::FromAnsi(name));
-        goto TryAgainAnsi;
+static DWORD WINAPI SyncTexIndexBuildThread(LPVOID data) {
+    SyncTexIndexBuild* build = (SyncTexIndexBuild*)data;
+    if (!BuildSyncTexIndex(build->syncfilepath, build->pageCount, build->data)) {
+        build->data.Reset();
+    } else if (build->indexPath) {
+        AutoFreeWstr dir(path::GetDir(build->indexPath));
+        if (dir::Create(dir)) {
+            file::WriteFile(build->indexPath, build->data.AsSpan());
+        }
     }
+    ReleaseSyncTexIndexBuild(build);
+    return 0;
+}
 
-    *line = synctex_node_line(node);
-    *col = synctex_node_column(node);
+SyncTex::SyncTex(const WCHAR* syncfilename, const WCHAR* pdffilename, EngineBase* engine)
+    : Synchronizer(syncfilename), engine(engine), pdfpath(str::Dup(pdffilename)) {
+    CrashIf(!str::EndsWithI(syncfilename, SYNCTEX_EXTENSION));
+    // the document is usually (re)loaded right after the .synctex file has been
+    // written, so the index is likely ready by the time it's first needed
+    StartIndexBuild();
+}
 
-    return PDFSYNCERR_SUCCESS;
+SyncTex::~SyncTex() {
+    if (build) {
+        if (buildThread) {
+            CloseHandle(buildThread);
+        }
+        ReleaseSyncTexIndexBuild(build);
+    }
+    delete index;
 }
 
-int SyncTex::SourceToDoc(const WCHAR* srcfilename, UINT line, UINT col, UINT* page, Vec<Rect>& rects) {
-    if (IsIndexDiscarded()) {
+// uses a cached index if it's up-to-date or starts building a new one
+void SyncTex::StartIndexBuild() {
+    CrashIf(build || index);
+    AutoFreeWstr indexPath(gSyncTexIndexPath ? gSyncTexIndexPath(pdfpath) : nullptr);
+    if (indexPath && file::Exists(indexPath)) {
+        index = MapSyncTexIndex(indexPath);
+        if (index && index->IsUpToDate(syncfilepath)) {
+            return;
+        }
+        // unmap the index so that it can be overwritten
+        delete index;
+        index = nullptr;
+    }
+
+    build = new SyncTexIndexBuild();
+    build->syncfilepath.SetCopy(syncfilepath);
+    build->indexPath.Set(indexPath.StealData());
+    build->pageCount = engine->PageCount();
+    buildThread = CreateThread(nullptr, 0, SyncTexIndexBuildThread, build, 0, nullptr);
+    if (!buildThread) {
+        SyncTexIndexBuildThread(build);
+    }
+}
+
+// waits for the index being built (if any)
+void SyncTex::FinishIndexBuild() {
+    if (!build) {
+        return;
+    }
+    if (buildThread) {
+        WaitForSingleObject(buildThread, INFINITE);
+        CloseHandle(buildThread);
+        buildThread = nullptr;
+    }
+    size_t size = build->data.size();
+    if (size > 0) {
+        index = NewSyncTexIndex((u8*)build->data.StealData(), size);
+    }
+    ReleaseSyncTexIndexBuild(build);
+    build = nullptr;
+}
+
+int SyncTex::RebuildIndex() {
+    FinishIndexBuild();
+    if (!index || !index->IsUpToDate(syncfilepath)) {
+        delete index;
+        index = nullptr;
+        inputPaths.Reset();
+        StartIndexBuild();
+        FinishIndexBuild();
+    }
+    if (!index) {
+        return PDFSYNCERR_SYNCFILE_NOTFOUND; // cannot rebuild the index
+    }
+    return Synchronizer::RebuildIndex();
+}
+
+int SyncTex::EnsureIndex() {
+    FinishIndexBuild();
+    if (IsIndexDiscarded() || !index || !index->IsUpToDate(syncfilepath)) {
         if (RebuildIndex() != PDFSYNCERR_SUCCESS) {
             return PDFSYNCERR_SYNCFILE_CANNOT_BE_OPENED;
         }
     }
-    CrashIf(!this->scanner);
+    CrashIf(!index);
+    return PDFSYNCERR_SUCCESS;
+}
+
+void SyncTex::ResolveInputPaths() {
+    if (inputPaths.isize() == index->hdr->nInputs) {
+        return;
+    }
+    inputPaths.Reset();
+    for (int i = 0; i < index->hdr->nInputs; i++) {
+        const char* name = index->names + index->inputs[i].nameOffset;
+        AutoFreeWstr filename;
+        // recent SyncTeX versions encode in UTF-8 instead of ANSI
+        for (int isUtf8 = 1; isUtf8 >= 0; isUtf8--) {
+            filename.Set(isUtf8 ? strconv::Utf8ToWstr(name) : strconv::FromAnsi(name));
+            if (!filename) {
+                continue;
+            }
+            // undecorate the filepath: replace * by space and / by \ (backslash)
+            str::TransChars(filename, L"*/", L" \\");
+            // Convert the source filepath to an absolute path
+            if (PathIsRelative(filename)) {
+                filename.Set(PrependDir(filename));
+            }
+            filename.Set(path::Normalize(filename));
+            if (file::Exists(filename)) {
+                break;
+            }
+        }
+        inputPaths.Append(filename ? filename.StealData() : str::Dup(L""));
+    }
+}
+
+int SyncTex::DocToSource(UINT pageNo, Point pt, AutoFreeWstr& filename, UINT* line, UINT* col) {
+    int res = EnsureIndex();
+    if (res != PDFSYNCERR_SUCCESS) {
+        return res;
+    }
+    if (pageNo < 1 || pageNo > (UINT)index->hdr->nPages) {
+        return PDFSYNCERR_NO_SYNC_AT_LOCATION;
+    }
+
+    // find the smallest hbox containing pt (boxes are sorted by their top edge,
+    // so only those starting at most maxDy above pt have to be looked at)
+    const SyncTexPage& page = index->pages[pageNo - 1];
+    const u32* boxes = index->pageBoxes;
+    float x = (float)pt.x;
+    float y = (float)pt.y;
+    auto isAbove = [this](u32 box, float top) { return SyncTexNodeRect(index->nodes[box]).y < top; };
+    const u32* first = std::lower_bound(boxes + page.boxStart, boxes + page.boxEnd, y - page.maxDy, isAbove);
+    int container = -1;
+    RectF containerRect;
+    for (const u32* box = first; box < boxes + page.boxEnd; box++) {
+        RectF rc = SyncTexNodeRect(index->nodes[*box]);
+        if (rc.y > y) {
+            break;
+        }
+        if (!rc.Contains(PointF(x, y))) {
+            continue;
+        }
+        // cf. _synctex_smallest_container
+        if (container == -1 || rc.dx < containerRect.dx || (rc.dx == containerRect.dx && rc.dy < containerRect.dy)) {
+            container = (int)*box;
+            containerRect = rc;
+        }
+    }
+    if (container == -1) {
+        // fall back to the closest box
+        float minDist = 0;
+        for (int i = page.boxStart; i < page.boxEnd; i++) {
+            RectF rc = SyncTexNodeRect(index->nodes[boxes[i]]);
+            float dx = std::max({rc.x - x, x - (rc.x + rc.dx), 0.f});
+            float dy = std::max({rc.y - y, y - (rc.y + rc.dy), 0.f});
+            if (container == -1 || dx + dy < minDist) {
+                container = (int)boxes[i];
+                minDist = dx + dy;
+            }
+        }
+    }
+    if (container == -1) {
+        return PDFSYNCERR_NO_SYNC_AT_LOCATION;
+    }
+
+    // the result is the container's child closest to pt (cf. _synctex_eq_get_closest_children_in_box)
+    int left = -1, right = -1;
+    float leftDist = 0, rightDist = 0;
+    const SyncTexNode* nodes = index->nodes;
+    for (int i = container + 1; i < nodes[container].end; i = IsSyncTexBox(nodes[i].type) ? nodes[i].end : i + 1) {
+        const SyncTexNode& node = nodes[i];
+        bool isLeft;
+        float dist;
+        if (IsSyncTexBox(node.type)) {
+            RectF rc = SyncTexNodeRect(node);
+            isLeft = x >= rc.x;
+            dist = isLeft ? std::max(x - (rc.x + rc.dx), 0.f) : rc.x - x;
+        } else {
+            isLeft = x >= node.h;
+            dist = fabsf(x - node.h);
+        }
+        if (isLeft && (left == -1 || dist < leftDist)) {
+            left = i;
+            leftDist = dist;
+        } else if (!isLeft && (right == -1 || dist < rightDist)) {
+            right = i;
+            rightDist = dist;
+        }
+    }
+    int result = container;
+    if (left != -1 && right != -1) {
+        result = leftDist > rightDist ? right : left;
+    } else if (left != -1 || right != -1) {
+        result = left != -1 ? left : right;
+    }
+
+    const SyncTexNode& node = nodes[result];
+    ResolveInputPaths();
+    for (int i = 0; i < index->hdr->nInputs; i++) {
+        if (index->inputs[i].tag == node.tag) {
+            filename.SetCopy(inputPaths.at(i));
+            *line = node.line;
+            *col = node.column;
+            return PDFSYNCERR_SUCCESS;
+        }
+    }
+    return PDFSYNCERR_UNKNOWN_SOURCEFILE;
+}
+
+int SyncTex::SourceToDoc(const WCHAR* srcfilename, UINT line, UINT col, UINT* page, Vec<Rect>& rects) {
+    int res = EnsureIndex();
+    if (res != PDFSYNCERR_SUCCESS) {
+        return res;
+    }
 
     AutoFreeWstr srcfilepath;
     // convert the source file to an absolute path
@@ -594,58 +1106,83 @@ int SyncTex::SourceToDoc(const WCHAR* srcfilename, UINT line, UINT col, UINT* pa
     } else {
         srcfilepath.SetCopy(srcfilename);
     }
+    srcfilepath.Set(path::Normalize(srcfilepath));
     if (!srcfilepath) {
         return PDFSYNCERR_OUTOFMEMORY;
     }
 
-    bool isUtf8 = true;
-    const char* mb_srcfilepath = strconv::WstrToUtf8(srcfilepath).data();
-TryAgainAnsi:
-    if (!mb_srcfilepath) {
-        return PDFSYNCERR_OUTOFMEMORY;
+    ResolveInputPaths();
+    int tag = 0;
+    for (int i = 0; i < index->hdr->nInputs && !tag; i++) {
+        if (str::EqI(inputPaths.at(i), srcfilepath)) {
+            tag = index->inputs[i].tag;
+        }
     }
-    int ret = synctex_display_query(this->scanner, mb_srcfilepath, line, col);
-    str::Free(mb_srcfilepath);
-    // recent SyncTeX versions encode in UTF-8 instead of ANSI
-    if (isUtf8 && -1 == ret) {
-        isUtf8 = false;
-        mb_srcfilepath = (char*)strconv::WstrToAnsi(srcfilepath).data();
-        goto TryAgainAnsi;
+    // the source file might have been referred to through a different path
+    for (int i = 0; i < index->hdr->nInputs && !tag; i++) {
+        if (str::EqI(path::GetBaseNameNoFree(inputPaths.at(i)), path::GetBaseNameNoFree(srcfilepath))) {
+            tag = index->inputs[i].tag;
+        }
     }
-
-    if (-1 == ret) {
+    if (!tag) {
         return PDFSYNCERR_UNKNOWN_SOURCEFILE;
     }
-    if (0 == ret) {
+
+    // find the nodes for the first line at or after line (cf. synctex_display_query)
+    const SyncTexNode* nodes = index->nodes;
+    const u32* srcStart = index->sourceNodes;
+    const u32* srcEnd = srcStart + index->hdr->nSourceNodes;
+    const u32* first = std::lower_bound(srcStart, srcEnd, 0, [&](u32 idx, int) {
+        return nodes[idx].tag < tag || (nodes[idx].tag == tag && nodes[idx].line < (int)line);
+    });
+    if (first == srcEnd || nodes[*first].tag != tag) {
         return PDFSYNCERR_NOSYNCPOINT_FOR_LINERECORD;
     }
+    const u32* last = first;
+    while (last < srcEnd && nodes[*last].tag == tag && nodes[*last].line == nodes[*first].line) {
+        last++;
+    }
 
-    synctex_node_t node;
-    int firstpage = -1;
-    rects.Reset();
-
-    while ((node = synctex_next_result(this->scanner)) != nullptr) {
-        if (firstpage == -1) {
-            firstpage = synctex_node_page(node);
-            if (firstpage <= 0 || firstpage > engine->PageCount()) {
-                continue;
+    // prefer boundaries over kerns, glues and maths over boxes
+    Vec<int> found;
+    int minTypes[] = {synctex_node_type_boundary, synctex_node_type_kern, 0};
+    for (int minType : minTypes) {
+        for (const u32* idx = first; idx < last; idx++) {
+            if (nodes[*idx].type >= minType) {
+                found.Append((int)*idx);
             }
-            *page = (UINT)firstpage;
         }
-        if (synctex_node_page(node) != firstpage) {
-            continue;
+        if (found.size() > 0) {
+            break;
         }
-
-        RectF rc;
-        rc.x = synctex_node_box_visible_h(node);
-        rc.y = (double)synctex_node_box_visible_v(node) - (double)synctex_node_box_visible_height(node);
-        rc.dx = synctex_node_box_visible_width(node),
-        rc.dy = (double)synctex_node_box_visible_height(node) + (double)synctex_node_box_visible_depth(node);
-        rects.Append(rc.Round());
+    }
+    // only keep nodes which aren't descendants of their predecessor's parent
+    Vec<int> results;
+    for (int idx : found) {
+        if (results.size() > 0) {
+            int prevParent = nodes[results.Last()].parent;
+            bool isDescendant = false;
+            for (int parent = nodes[idx].parent; parent != -1 && !isDescendant; parent = nodes[parent].parent) {
+                isDescendant = parent == prevParent;
+            }
+            if (isDescendant) {
+                continue;
+            }
+        }
+        results.Append(idx);
     }
 
-    if (firstpage <= 0) {
+    int firstpage = nodes[results.at(0)].page;
+    if (firstpage <= 0 || firstpage > engine->PageCount()) {
         return PDFSYNCERR_NOSYNCPOINT_FOR_LINERECORD;
     }
+    *page = (UINT)firstpage;
+    rects.Reset();
+    for (int idx : results) {
+        const SyncTexNode& node = nodes[idx];
+        if (node.page == firstpage) {
+            rects.Append(RectF(node.x, node.y, node.dx, node.dy).Round());
+        }
+    }
     return PDFSYNCERR_SUCCESS;
 }
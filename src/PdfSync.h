@@ -57,3 +57,8 @@ class Synchronizer {
   public:
     static int Create(const WCHAR* pdffilename, EngineBase* engine, Synchronizer** sync);
 };
+
+// returns the path where the lookup index for a document's .synctex file
+// is cached (or nullptr if it shouldn't be cached); the caller must free() it
+typedef WCHAR* (*SyncTexIndexPathFunc)(const WCHAR* pdfPath);
+void SetSyncTexIndexPathFunc(SyncTexIndexPathFunc func);
@@ -44,18 +44,24 @@ RenderCache::RenderCache() : maxTileSize({GetSystemMetrics(SM_CXSCREEN), GetSyst
     InitializeCriticalSection(&cacheAccess);
     InitializeCriticalSection(&requestAccess);
 
-    startRendering = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-    renderThread = CreateThread(nullptr, 0, RenderCacheThread, this, 0, 0);
-    CrashIf(nullptr == renderThread);
+    // render threads are started on the first rendering request
+    // so that their count can still be configured after construction
+    startRendering = CreateSemaphoreW(nullptr, 0, LONG_MAX, nullptr);
 }
 
 RenderCache::~RenderCache() {
     EnterCriticalSection(&requestAccess);
     EnterCriticalSection(&cacheAccess);
 
-    CloseHandle(renderThread);
+    for (int i = 0; i < nRenderThreads; i++) {
+        CloseHandle(renderThreads[i]);
+    }
     CloseHandle(startRendering);
-    CrashIf(curReq || 0 != requestCount || 0 != cacheCount);
+    for (PageRenderRequest* req : curReqs) {
+        CrashIf(req);
+    }
+    CrashIf(0 != requestCount || 0 != cacheCount);
+    CrashIf(lruFirst || lruLast);
 
     LeaveCriticalSection(&cacheAccess);
     DeleteCriticalSection(&cacheAccess);
@@ -63,21 +69,79 @@ RenderCache::~RenderCache() {
     DeleteCriticalSection(&requestAccess);
 }
 
+void RenderCache::SetRenderThreadCount(int n) {
+    ScopedCritSec scope(&requestAccess);
+    CrashIf(nRenderThreads > 0);
+    nRenderThreadsWanted = n;
+}
+
+void RenderCache::StartRenderThreads() {
+    ScopedCritSec scope(&requestAccess);
+    if (nRenderThreads > 0) {
+        return;
+    }
+    int n = nRenderThreadsWanted;
+    if (n <= 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        n = (int)si.dwNumberOfProcessors;
+    }
+    n = std::clamp(n, 1, MAX_RENDER_THREADS);
+    for (int i = 0; i < n; i++) {
+        renderThreads[i] = CreateThread(nullptr, 0, RenderCacheThread, this, 0, nullptr);
+        CrashIf(nullptr == renderThreads[i]);
+        if (!renderThreads[i]) {
+            break;
+        }
+        nRenderThreads++;
+    }
+    logf("RenderCache: started %d render threads\n", nRenderThreads);
+}
+
+// zoom and tile aren't part of the hash because Find() can be asked
+// for any of them (and there are only a few entries per page anyway)
+static uint GetBucketIdx(DisplayModel* dm, int pageNo, int rotation) {
+    uintptr_t h = (uintptr_t)dm;
+    h ^= h >> 16;
+    h = h * 31 + (uint)pageNo;
+    h = h * 31 + (uint)rotation / 90;
+    h ^= h >> 8;
+    return (uint)h & (BITMAP_CACHE_BUCKETS - 1);
+}
+
+// memory used by a bitmap, in bytes
+static size_t GetBitmapSize(RenderedBitmap* bmp) {
+    if (!bmp) {
+        return 0;
+    }
+    BITMAP info{};
+    HBITMAP hbmp = bmp->GetBitmap();
+    if (hbmp && GetObjectW(hbmp, sizeof(info), &info) == sizeof(info)) {
+        return (size_t)info.bmWidthBytes * (size_t)info.bmHeight;
+    }
+    Size size = bmp->Size();
+    return (size_t)size.dx * (size_t)size.dy * 4;
+}
+
 /* Find a bitmap for a page defined by <dm> and <pageNo> and optionally also
    <rotation> and <zoom> in the cache - call DropCacheEntry when you
    no longer need a found entry. */
 BitmapCacheEntry* RenderCache::Find(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition* tile) {
     ScopedCritSec scope(&cacheAccess);
     rotation = NormalizeRotation(rotation);
-    for (int i = 0; i < cacheCount; i++) {
-        BitmapCacheEntry* e = cache[i];
+    uint idx = GetBucketIdx(dm, pageNo, rotation);
+    for (BitmapCacheEntry* e = buckets[idx]; e; e = e->hashNext) {
         if ((dm == e->dm) && (pageNo == e->pageNo) && (rotation == e->rotation) &&
             (INVALID_ZOOM == zoom || zoom == e->zoom) && (!tile || e->tile == *tile)) {
             e->refs++;
-            CrashIf(i != e->cacheIdx);
+            // move to the front of the LRU list
+            UnlinkEntry(e);
+            LinkEntry(e);
+            stats.hits++;
             return e;
         }
     }
+    stats.misses++;
     return nullptr;
 }
 
@@ -89,77 +153,157 @@ bool RenderCache::Exists(DisplayModel* dm, int pageNo, int rotation, float zoom,
     return entry != nullptr;
 }
 
+// adds entry to the hash and as most recently used entry to the LRU list.
+// the cache takes over the entry's initial reference
+void RenderCache::LinkEntry(BitmapCacheEntry* entry) {
+    ScopedCritSec scope(&cacheAccess);
+    CrashIf(entry->isCached);
+    uint idx = GetBucketIdx(entry->dm, entry->pageNo, entry->rotation);
+    entry->hashNext = buckets[idx];
+    buckets[idx] = entry;
+
+    entry->lruPrev = nullptr;
+    entry->lruNext = lruFirst;
+    if (lruFirst) {
+        lruFirst->lruPrev = entry;
+    } else {
+        lruLast = entry;
+    }
+    lruFirst = entry;
+
+    entry->isCached = true;
+    cacheCount++;
+    cacheSize += entry->size;
+}
+
+// removes entry from the hash and the LRU list without dropping the cache's reference
+void RenderCache::UnlinkEntry(BitmapCacheEntry* entry) {
+    ScopedCritSec scope(&cacheAccess);
+    CrashIf(!entry->isCached);
+    uint idx = GetBucketIdx(entry->dm, entry->pageNo, entry->rotation);
+    BitmapCacheEntry** next = &buckets[idx];
+    while (*next != entry) {
+        CrashIf(!*next);
+        next = &(*next)->hashNext;
+    }
+    *next = entry->hashNext;
+    entry->hashNext = nullptr;
+
+    if (entry->lruPrev) {
+        entry->lruPrev->lruNext = entry->lruNext;
+    } else {
+        lruFirst = entry->lruNext;
+    }
+    if (entry->lruNext) {
+        entry->lruNext->lruPrev = entry->lruPrev;
+    } else {
+        lruLast = entry->lruPrev;
+    }
+    entry->lruPrev = nullptr;
+    entry->lruNext = nullptr;
+
+    entry->isCached = false;
+    cacheCount--;
+    CrashIf(cacheCount < 0);
+    CrashIf(cacheSize < entry->size);
+    cacheSize -= entry->size;
+}
+
+// removes entry from the cache. it's deleted once nobody uses it anymore
+void RenderCache::RemoveEntry(BitmapCacheEntry* entry) {
+    ScopedCritSec scope(&cacheAccess);
+    UnlinkEntry(entry);
+    DropCacheEntry(entry);
+}
+
 bool RenderCache::DropCacheEntry(BitmapCacheEntry* entry) {
     ScopedCritSec scope(&cacheAccess);
     CrashIf(!entry);
     if (!entry) {
         return false;
     }
-    int idx = entry->cacheIdx;
-    CrashIf(idx < 0);
-    CrashIf(idx >= cacheCount);
-    if ((idx < 0) || (idx >= cacheCount)) {
-        return false;
-    }
     CrashIf(entry->refs <= 0);
     --entry->refs;
     if (entry->refs > 0) {
         return false;
     }
-    CrashIf(entry->refs != 0);
-    CrashIf(cache[idx] != entry);
+    // the cache's reference is only dropped by RemoveEntry
+    CrashIf(entry->isCached);
     dbglogf("RenderCache::DropCacheEntry: pageNo: %d, rotation: %d, zoom: %.2f\n", entry->pageNo, entry->rotation,
             entry->zoom);
 
     delete entry;
+    return true;
+}
+
+struct DocCacheSize {
+    DisplayModel* dm = nullptr;
+    size_t size = 0;
+};
 
-    // fast removal by replacing freed item with the item at the end
-    cache[idx] = nullptr;
-    int lastIdx = cacheCount - 1;
-    if ((lastIdx >= 0) && (idx != lastIdx)) {
-        cache[idx] = cache[lastIdx];
-        cache[idx]->cacheIdx = idx;
-        cache[lastIdx] = nullptr;
+static size_t* GetDocCacheSize(Vec<DocCacheSize>& sizes, DisplayModel* dm) {
+    for (auto& ds : sizes) {
+        if (ds.dm == dm) {
+            return &ds.size;
+        }
     }
-    cacheCount--;
-    CrashIf(cacheCount < 0);
-    return true;
+    DocCacheSize ds;
+    ds.dm = dm;
+    sizes.Append(ds);
+    return &sizes.Last().size;
 }
 
-static bool FreeIfFull(RenderCache* rc, const PageRenderRequest& req) {
-    int n = rc->cacheCount;
-    if (n < MAX_BITMAPS_CACHED) {
-        return true;
+static bool IsCacheFull(RenderCache* rc, size_t size) {
+    return rc->cacheCount >= MAX_BITMAPS_CACHED || rc->cacheSize + size > MAX_BITMAP_CACHE_SIZE;
+}
+
+// evicts the least recently used bitmaps until there's room for a new one
+// of the given size for dm: first invisible pages of documents exceeding their
+// quota, then invisible pages of all documents and finally visible pages of
+// other documents (which might be from a background tab or a window that's
+// currently hidden). visible pages of dm are never evicted as it leads to flicker
+void RenderCache::FreeForNewEntry(DisplayModel* dm, size_t size) {
+    ScopedCritSec scope(&cacheAccess);
+    if (!IsCacheFull(this, size)) {
+        return;
     }
 
-    DisplayModel* dm = req.dm;
-    // free an invisible page of the same DisplayModel ...
-    for (int i = 0; i < n; i++) {
-        auto entry = rc->cache[i];
-        if (entry->dm == dm && !dm->PageVisibleNearby(entry->pageNo)) {
-            bool didDrop = rc->DropCacheEntry(entry);
-            if (didDrop) {
-                return true;
+    Vec<DocCacheSize> docSizes;
+    for (BitmapCacheEntry* e = lruFirst; e; e = e->lruNext) {
+        *GetDocCacheSize(docSizes, e->dm) += e->size;
+    }
+    *GetDocCacheSize(docSizes, dm) += size;
+
+    for (int pass = 0; pass < 3 && IsCacheFull(this, size); pass++) {
+        BitmapCacheEntry* e = lruLast;
+        while (e && IsCacheFull(this, size)) {
+            BitmapCacheEntry* prev = e->lruPrev;
+            size_t* docSize = GetDocCacheSize(docSizes, e->dm);
+            bool isVisible = e->dm->PageVisibleNearby(e->pageNo);
+            bool shouldFree = false;
+            if (pass == 0) {
+                shouldFree = !isVisible && *docSize > MAX_BITMAP_CACHE_SIZE_PER_DOC;
+            } else if (pass == 1) {
+                shouldFree = !isVisible;
+            } else {
+                shouldFree = (e->dm != dm);
+            }
+            if (shouldFree) {
+                *docSize -= e->size;
+                stats.evictions++;
+                RemoveEntry(e);
             }
+            e = prev;
         }
     }
+}
 
-    // ... or just the oldest cached page
-    for (int i = 0; i < n; i++) {
-        auto entry = rc->cache[i];
-        if (entry->dm == dm) {
-            // don't free pages from the document we're currently displaying
-            // as it leads to flicker
-            // TODO: it can still flicker if the dm is from a visible tab
-            // in a different window, but it's harder to detect
-            continue;
-        }
-        bool didDrop = rc->DropCacheEntry(entry);
-        if (didDrop) {
-            return true;
-        }
-    }
-    return false;
+BitmapCacheStats RenderCache::GetStats() {
+    ScopedCritSec scope(&cacheAccess);
+    BitmapCacheStats res = stats;
+    res.count = cacheCount;
+    res.size = cacheSize;
+    return res;
 }
 
 void RenderCache::Add(PageRenderRequest& req, RenderedBitmap* bmp) {
@@ -167,20 +311,15 @@ void RenderCache::Add(PageRenderRequest& req, RenderedBitmap* bmp) {
     CrashIf(!req.dm);
 
     req.rotation = NormalizeRotation(req.rotation);
-    CrashIf(cacheCount > MAX_BITMAPS_CACHED);
 
     /* It's possible there still is a cached bitmap with different zoom/rotation */
     FreePage(req.dm, req.pageNo, &req.tile);
 
-    bool hasSpace = FreeIfFull(this, req);
-    CrashIf(!hasSpace); // TODO: FreeIfFull() might actually fail to free
-    CrashIf(cacheCount > MAX_BITMAPS_CACHED);
-
     // Copy the PageRenderRequest as it will be reused
     auto entry = new BitmapCacheEntry(req.dm, req.pageNo, req.rotation, req.zoom, req.tile, bmp);
-    entry->cacheIdx = cacheCount;
-    cache[cacheCount] = entry;
-    cacheCount++;
+    entry->size = GetBitmapSize(bmp);
+    FreeForNewEntry(req.dm, entry->size);
+    LinkEntry(entry);
 }
 
 static RectF GetTileRect(RectF pagerect, TilePosition tile) {
@@ -215,18 +354,19 @@ static Rect GetTileOnScreen(EngineBase* engine, int pageNo, int rotation, float
     return bbox;
 }
 
-static bool IsTileVisible(DisplayModel* dm, int pageNo, TilePosition tile, float fuzz = 0) {
+// returns the part of the tile that is currently visible on screen
+static Rect GetVisibleTileRect(DisplayModel* dm, int pageNo, TilePosition tile, float fuzz = 0) {
     if (!dm) {
-        return false;
+        return {};
     }
     PageInfo* pageInfo = dm->GetPageInfo(pageNo);
     EngineBase* engine = dm->GetEngine();
     if (!engine || !pageInfo) {
-        return false;
+        return {};
     }
     int rotation = dm->GetRotation();
     float zoom = dm->GetZoomReal(pageNo);
-    Rect r = pageInfo->pageOnScreen;
+    Rect r = dm->PageOnScreen(pageNo);
     Rect tileOnScreen = GetTileOnScreen(engine, pageNo, rotation, zoom, tile, r);
     // consider nearby tiles visible depending on the fuzz factor
     tileOnScreen.x -= (int)(tileOnScreen.dx * fuzz * 0.5);
@@ -234,7 +374,18 @@ static bool IsTileVisible(DisplayModel* dm, int pageNo, TilePosition tile, float
     tileOnScreen.y -= (int)(tileOnScreen.dy * fuzz * 0.5);
     tileOnScreen.dy = (int)(tileOnScreen.dy * (fuzz + 1));
     Rect screen(Point(), dm->GetViewPort().Size());
-    return !tileOnScreen.Intersect(screen).IsEmpty();
+    return tileOnScreen.Intersect(screen);
+}
+
+static bool IsTileVisible(DisplayModel* dm, int pageNo, TilePosition tile, float fuzz = 0) {
+    return !GetVisibleTileRect(dm, pageNo, tile, fuzz).IsEmpty();
+}
+
+static void AbortRequest(PageRenderRequest* req) {
+    if (req->abortCookie) {
+        req->abortCookie->Abort();
+    }
+    req->abort = true;
 }
 
 /* Free all bitmaps in the cache that are of a specific page (or all pages
@@ -243,9 +394,10 @@ void RenderCache::FreePage(DisplayModel* dm, int pageNo, TilePosition* tile) {
     dbglogf("RenderCache::FreePage: dm: 0x%p, pageNo: %d\n", dm, pageNo);
     ScopedCritSec scope(&cacheAccess);
 
-    // must go from end becaues freeing changes the cache
-    for (int i = cacheCount - 1; i >= 0; i--) {
-        BitmapCacheEntry* entry = cache[i];
+    BitmapCacheEntry* next = nullptr;
+    for (BitmapCacheEntry* entry = lruFirst; entry; entry = next) {
+        // get next entry first because freeing changes the cache
+        next = entry->lruNext;
         bool shouldFree;
         if (dm && pageNo != INVALID_PAGE_NO) {
             // a specific page
@@ -269,7 +421,7 @@ void RenderCache::FreePage(DisplayModel* dm, int pageNo, TilePosition* tile) {
             }
         }
         if (shouldFree) {
-            DropCacheEntry(entry);
+            RemoveEntry(entry);
         }
     }
 }
@@ -283,16 +435,48 @@ void RenderCache::FreeNotVisible() {
 }
 
 // keep the cached bitmaps for visible pages to avoid flickering during a reload.
-// mark invisible pages as out-of-date to prevent inconsistencies
-void RenderCache::KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm) {
+// mark invisible pages as out-of-date to prevent inconsistencies.
+// bitmaps of pages which haven't changed (origPageNos as set by
+// DisplayModel::CopyUnchangedPages) remain up-to-date
+void RenderCache::KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm, const Vec<int>* origPageNos) {
     ScopedCritSec scope(&cacheAccess);
-    for (int i = 0; i < cacheCount; i++) {
-        BitmapCacheEntry* entry = cache[i];
-        if (entry->dm != oldDm) {
+    // the inverse of origPageNos (0 for pages which have changed)
+    Vec<int> newPageNos;
+    if (origPageNos) {
+        newPageNos.AppendBlanks(oldDm->PageCount() + 1);
+        for (int i = 0; i < origPageNos->isize(); i++) {
+            int origPageNo = origPageNos->at(i);
+            if (origPageNo > 0 && origPageNo < newPageNos.isize() && newPageNos.at(origPageNo) == 0) {
+                newPageNos.at(origPageNo) = i + 1;
+            }
+        }
+    }
+
+    Vec<BitmapCacheEntry*> entries;
+    for (BitmapCacheEntry* entry = lruFirst; entry; entry = entry->lruNext) {
+        if (entry->dm == oldDm) {
+            entries.Append(entry);
+        }
+    }
+    // iterate from the end so that the LRU order is preserved
+    for (int i = entries.isize() - 1; i >= 0; i--) {
+        BitmapCacheEntry* entry = entries[i];
+        int newPageNo = entry->pageNo < newPageNos.isize() ? newPageNos.at(entry->pageNo) : 0;
+        if (newPageNo > 0) {
+            // the page might have moved, but its bitmaps are still up-to-date
+            UnlinkEntry(entry);
+            entry->dm = newDm;
+            entry->pageNo = newPageNo;
+            LinkEntry(entry);
             continue;
         }
-        if (oldDm->PageVisible(entry->pageNo)) {
+        // don't mix bitmaps of a changed page with those of an unchanged page that took its place
+        bool replaced = origPageNos && entry->pageNo <= origPageNos->isize() && origPageNos->at(entry->pageNo - 1) > 0;
+        if (oldDm->PageVisible(entry->pageNo) && !replaced) {
+            // dm is part of the hash key
+            UnlinkEntry(entry);
             entry->dm = newDm;
+            LinkEntry(entry);
         }
         // make sure that the page is rerendered eventually
         entry->zoom = INVALID_ZOOM;
@@ -305,15 +489,12 @@ void RenderCache::Invalidate(DisplayModel* dm, int pageNo, RectF rect) {
     ScopedCritSec scopeReq(&requestAccess);
 
     ClearQueueForDisplayModel(dm, pageNo);
-    if (curReq && curReq->dm == dm && curReq->pageNo == pageNo) {
-        AbortCurrentRequest();
-    }
+    AbortCurrentRequests(dm, pageNo);
 
     ScopedCritSec scopeCache(&cacheAccess);
 
     RectF mediabox = dm->GetEngine()->PageMediabox(pageNo);
-    for (int i = 0; i < cacheCount; i++) {
-        auto e = cache[i];
+    for (BitmapCacheEntry* e = lruFirst; e; e = e->lruNext) {
         if (e->dm == dm && e->pageNo == pageNo && !GetTileRect(mediabox, e->tile).Intersect(rect).IsEmpty()) {
             e->zoom = INVALID_ZOOM;
             e->outOfDate = true;
@@ -358,8 +539,7 @@ USHORT RenderCache::GetTileRes(DisplayModel* dm, int pageNo) {
 USHORT RenderCache::GetMaxTileRes(DisplayModel* dm, int pageNo, int rotation) {
     ScopedCritSec scope(&cacheAccess);
     USHORT maxRes = 0;
-    for (int i = 0; i < cacheCount; i++) {
-        auto e = cache[i];
+    for (BitmapCacheEntry* e = lruFirst; e; e = e->lruNext) {
         if (e->dm == dm && e->pageNo == pageNo && e->rotation == rotation) {
             maxRes = std::max(e->tile.res, maxRes);
         }
@@ -384,13 +564,13 @@ bool RenderCache::ReduceTileSize() {
     }
 
     // invalidate all rendered bitmaps and all requests
-    while (cacheCount > 0) {
-        FreeForDisplayModel(cache[0]->dm);
+    while (lruFirst) {
+        FreePage(lruFirst->dm);
     }
     while (requestCount > 0) {
         ClearQueueForDisplayModel(requests[0].dm);
     }
-    AbortCurrentRequest();
+    AbortCurrentRequests();
 
     return true;
 }
@@ -424,14 +604,17 @@ void RenderCache::RequestRendering(DisplayModel* dm, int pageNo, TilePosition ti
     int rotation = NormalizeRotation(dm->GetRotation());
     float zoom = dm->GetZoomReal(pageNo);
 
-    if (curReq && (curReq->pageNo == pageNo) && (curReq->dm == dm) && (curReq->tile == tile)) {
+    for (PageRenderRequest* curReq : curReqs) {
+        if (!curReq || (curReq->pageNo != pageNo) || (curReq->dm != dm) || !(curReq->tile == tile)) {
+            continue;
+        }
         if ((curReq->zoom == zoom) && (curReq->rotation == rotation)) {
             /* we're already rendering exactly the same page */
             return;
         }
         /* Currently rendered page is for the same page but with different zoom
         or rotation, so abort it */
-        AbortCurrentRequest();
+        AbortRequest(curReq);
     }
 
     // clear requests for tiles of different resolution and invisible tiles
@@ -491,6 +674,9 @@ bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
     }
 
     ScopedCritSec scope(&requestAccess);
+    if (nRenderThreads == 0) {
+        StartRenderThreads();
+    }
     PageRenderRequest* newRequest;
 
     /* add request to the queue */
@@ -526,7 +712,7 @@ bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
     newRequest->timestamp = GetTickCount();
     newRequest->renderCb = renderCb;
 
-    SetEvent(startRendering);
+    ReleaseSemaphore(startRendering, 1, nullptr);
 
     return true;
 }
@@ -534,8 +720,10 @@ bool RenderCache::Render(DisplayModel* dm, int pageNo, int rotation, float zoom,
 int RenderCache::GetRenderDelay(DisplayModel* dm, int pageNo, TilePosition tile) {
     ScopedCritSec scope(&requestAccess);
 
-    if (curReq && curReq->pageNo == pageNo && curReq->dm == dm && curReq->tile == tile) {
-        return GetTickCount() - curReq->timestamp;
+    for (PageRenderRequest* curReq : curReqs) {
+        if (curReq && curReq->pageNo == pageNo && curReq->dm == dm && curReq->tile == tile) {
+            return GetTickCount() - curReq->timestamp;
+        }
     }
 
     for (int i = 0; i < requestCount; i++) {
@@ -547,6 +735,36 @@ int RenderCache::GetRenderDelay(DisplayModel* dm, int pageNo, TilePosition tile)
     return RENDER_DELAY_UNDEFINED;
 }
 
+// visible tiles are rendered first (those with the largest visible area
+// before the others), then tiles of pages close to the visible ones
+static i64 GetRequestPriority(PageRenderRequest* req) {
+    if (req->renderCb) {
+        // somebody is explicitly waiting for this (e.g. a thumbnail)
+        return std::numeric_limits<i64>::max();
+    }
+    DisplayModel* dm = req->dm;
+    if (dm->PageVisible(req->pageNo)) {
+        Rect visible = GetVisibleTileRect(dm, req->pageNo, req->tile);
+        if (!visible.IsEmpty()) {
+            return (i64)visible.dx * (i64)visible.dy;
+        }
+    }
+    if (dm->PageVisibleNearby(req->pageNo)) {
+        return 0;
+    }
+    return -1;
+}
+
+// returns true if one of the render threads is currently busy with a page of <dm>
+bool RenderCache::IsBeingRendered(DisplayModel* dm) const {
+    for (PageRenderRequest* req : curReqs) {
+        if (req && req->dm == dm) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool RenderCache::GetNextRequest(PageRenderRequest* req) {
     ScopedCritSec scope(&requestAccess);
 
@@ -556,21 +774,58 @@ bool RenderCache::GetNextRequest(PageRenderRequest* req) {
 
     CrashIf(requestCount < 0);
     CrashIf(requestCount > MAX_PAGE_REQUESTS);
+
+    PageRenderRequest** slot = nullptr;
+    for (PageRenderRequest*& curReq : curReqs) {
+        if (!curReq) {
+            slot = &curReq;
+            break;
+        }
+    }
+    CrashIf(!slot);
+    if (!slot) {
+        return false;
+    }
+
+    // more recent requests are at the end of the queue and win on equal priority
+    int bestIdx = -1;
+    i64 bestPriority = 0;
+    for (int i = requestCount - 1; i >= 0; i--) {
+        PageRenderRequest* r = &requests[i];
+        // engines which can't render concurrently only get a single render thread at a time
+        if (IsBeingRendered(r->dm) && !r->dm->GetEngine()->supportsConcurrentRendering) {
+            continue;
+        }
+        i64 priority = GetRequestPriority(r);
+        if (bestIdx < 0 || priority > bestPriority) {
+            bestIdx = i;
+            bestPriority = priority;
+        }
+    }
+    if (bestIdx < 0) {
+        return false;
+    }
+
+    *req = requests[bestIdx];
+    int nAfter = requestCount - bestIdx - 1;
+    memmove(&requests[bestIdx], &requests[bestIdx + 1], sizeof(PageRenderRequest) * nAfter);
     requestCount--;
-    *req = requests[requestCount];
-    curReq = req;
+    *slot = req;
     CrashIf(requestCount < 0);
     CrashIf(req->abort);
 
     return true;
 }
 
-bool RenderCache::ClearCurrentRequest() {
+bool RenderCache::ClearCurrentRequest(PageRenderRequest* req) {
     ScopedCritSec scope(&requestAccess);
-    if (curReq) {
-        delete curReq->abortCookie;
+    for (PageRenderRequest*& curReq : curReqs) {
+        if (curReq == req) {
+            delete curReq->abortCookie;
+            curReq->abortCookie = nullptr;
+            curReq = nullptr;
+        }
     }
-    curReq = nullptr;
 
     bool isQueueEmpty = requestCount == 0;
     return isQueueEmpty;
@@ -584,14 +839,14 @@ void RenderCache::CancelRendering(DisplayModel* dm) {
 
     for (;;) {
         EnterCriticalSection(&requestAccess);
-        if (!curReq || (curReq->dm != dm)) {
+        if (!IsBeingRendered(dm)) {
             // to be on the safe side
             ClearQueueForDisplayModel(dm);
             LeaveCriticalSection(&requestAccess);
             return;
         }
 
-        AbortCurrentRequest();
+        AbortCurrentRequests(dm);
         LeaveCriticalSection(&requestAccess);
 
         /* TODO: busy loop is not good, but I don't have a better idea */
@@ -621,15 +876,16 @@ void RenderCache::ClearQueueForDisplayModel(DisplayModel* dm, int pageNo, TilePo
     }
 }
 
-void RenderCache::AbortCurrentRequest() {
+// aborts requests currently being rendered (either all of them
+// or only those for a given document resp. a given page)
+void RenderCache::AbortCurrentRequests(DisplayModel* dm, int pageNo) {
     ScopedCritSec scope(&requestAccess);
-    if (!curReq) {
-        return;
-    }
-    if (curReq->abortCookie) {
-        curReq->abortCookie->Abort();
+    for (PageRenderRequest* req : curReqs) {
+        if (!req || (dm && req->dm != dm) || (pageNo != INVALID_PAGE_NO && req->pageNo != pageNo)) {
+            continue;
+        }
+        AbortRequest(req);
     }
-    curReq->abort = true;
 }
 
 DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
@@ -638,15 +894,11 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
     RenderedBitmap* bmp;
 
     for (;;) {
-        if (cache->ClearCurrentRequest()) {
-            DWORD waitResult = WaitForSingleObject(cache->startRendering, INFINITE);
-            // Is it not a page render request?
-            if (WAIT_OBJECT_0 != waitResult) {
-                continue;
-            }
-        }
-
-        if (!cache->GetNextRequest(&req)) {
+        bool isQueueEmpty = cache->ClearCurrentRequest(&req);
+        // also wait if all queued requests are for documents
+        // that are already being rendered by other threads
+        if (isQueueEmpty || !cache->GetNextRequest(&req)) {
+            WaitForSingleObject(cache->startRendering, INFINITE);
             continue;
         }
 
@@ -664,7 +916,8 @@ DWORD WINAPI RenderCache::RenderCacheThread(LPVOID data) {
         // make sure that we have extracted page text for
         // all rendered pages to allow text selection and
         // searching without any further delays
-        if (!req.dm->textCache->HasTextForPage(req.pageNo)) {
+        // (unless that would have to wait for the rest of a progressively loaded document)
+        if (!req.dm->GetEngine()->IsLoadingProgressively() && !req.dm->textCache->HasTextForPage(req.pageNo)) {
             req.dm->textCache->GetTextForPage(req.pageNo);
         }
 
@@ -6,12 +6,19 @@ constexpr int RENDER_DELAY_UNDEFINED = std::numeric_limits<int>::max() - 2;
 
 #define INVALID_TILE_RES ((USHORT)-1)
 
-#define MAX_PAGE_REQUESTS 8
-// keep this value reasonably low, else we'll run out of
-// GDI resources/memory when caching many larger bitmaps
-// TODO: this should be based on amount of memory taken by rendered pages
-// i.e. one big page can use as much memory as lots of small pages
-#define MAX_BITMAPS_CACHED 64
+#define MAX_PAGE_REQUESTS 32
+// maximum number of threads rendering pages (resp. page tiles) in parallel
+#define MAX_RENDER_THREADS 8
+// maximum amount of memory used by the cached bitmaps of all documents
+#define MAX_BITMAP_CACHE_SIZE (256 * 1024 * 1024)
+// soft quota for a single document: it's only exceeded if no
+// other document's bitmaps can be evicted instead
+#define MAX_BITMAP_CACHE_SIZE_PER_DOC (MAX_BITMAP_CACHE_SIZE / 2)
+// cached bitmaps are GDI objects which are limited per process,
+// so also limit their number (in case there are many small ones)
+#define MAX_BITMAPS_CACHED 512
+// number of hash buckets for looking up cached bitmaps (must be a power of 2)
+#define BITMAP_CACHE_BUCKETS 256
 
 class RenderingCallback {
   public:
@@ -47,12 +54,20 @@ struct BitmapCacheEntry {
     int rotation = 0;
     float zoom = 0.f;
     TilePosition tile;
-    int cacheIdx = -1; // index within RenderCache.cache
 
     // owned by the BitmapCacheEntry
     RenderedBitmap* bitmap = nullptr;
+    // memory used by bitmap (in bytes)
+    size_t size = 0;
     bool outOfDate = false;
+    // the cache holds one reference for as long as isCached is set
     int refs = 1;
+    bool isCached = false;
+
+    // links within RenderCache's hash buckets and its LRU list
+    BitmapCacheEntry* hashNext = nullptr;
+    BitmapCacheEntry* lruPrev = nullptr;
+    BitmapCacheEntry* lruNext = nullptr;
 
     BitmapCacheEntry(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition tile,
                      RenderedBitmap* bitmap) {
@@ -68,6 +83,15 @@ struct BitmapCacheEntry {
     }
 };
 
+// counters for diagnosing the effectiveness of RenderCache
+struct BitmapCacheStats {
+    i64 hits = 0;
+    i64 misses = 0;
+    i64 evictions = 0;
+    int count = 0;
+    size_t size = 0;
+};
+
 /* Even though this looks a lot like a BitmapCacheEntry, we keep it
    separate for clarity in the code (PageRenderRequests are reused,
    while BitmapCacheEntries are ref-counted) */
@@ -89,17 +113,28 @@ struct PageRenderRequest {
 
 class RenderCache {
   public:
-    BitmapCacheEntry* cache[MAX_BITMAPS_CACHED]{};
+    // entries hashed by (dm, pageNo, rotation)
+    BitmapCacheEntry* buckets[BITMAP_CACHE_BUCKETS]{};
+    // most recently used entry first
+    BitmapCacheEntry* lruFirst = nullptr;
+    BitmapCacheEntry* lruLast = nullptr;
     int cacheCount = 0;
+    // memory used by all cached bitmaps (in bytes)
+    size_t cacheSize = 0;
+    BitmapCacheStats stats;
     // make sure to never ask for requestAccess in a cacheAccess
     // protected critical section in order to avoid deadlocks
     CRITICAL_SECTION cacheAccess;
 
     PageRenderRequest requests[MAX_PAGE_REQUESTS]{};
     int requestCount = 0;
-    PageRenderRequest* curReq = nullptr;
+    // requests currently being rendered (at most one per render thread)
+    PageRenderRequest* curReqs[MAX_RENDER_THREADS]{};
     CRITICAL_SECTION requestAccess;
-    HANDLE renderThread = nullptr;
+    HANDLE renderThreads[MAX_RENDER_THREADS]{};
+    int nRenderThreads = 0;
+    // number of render threads to start, 0 means one per processor core
+    int nRenderThreadsWanted = 0;
 
     Size maxTileSize{};
     bool isRemoteSession = false;
@@ -107,7 +142,7 @@ class RenderCache {
     COLORREF textColor = 0;
     COLORREF backgroundColor = 0;
 
-    /* Interface for page rendering thread */
+    /* Interface for page rendering threads (a semaphore counting queued requests) */
     HANDLE startRendering = nullptr;
 
     RenderCache();
@@ -115,20 +150,24 @@ class RenderCache {
     RenderCache& operator=(RenderCache const&) = delete;
     ~RenderCache();
 
+    // must be called before the first rendering request
+    void SetRenderThreadCount(int n);
+
     void RequestRendering(DisplayModel* dm, int pageNo);
     void Render(DisplayModel* dm, int pageNo, int rotation, float zoom, RectF pageRect, RenderingCallback& callback);
     void CancelRendering(DisplayModel* dm);
     bool Exists(DisplayModel* dm, int pageNo, int rotation, float zoom = INVALID_ZOOM, TilePosition* tile = nullptr);
     void FreeForDisplayModel(DisplayModel* dm);
-    void KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm);
+    void KeepForDisplayModel(DisplayModel* oldDm, DisplayModel* newDm, const Vec<int>* origPageNos = nullptr);
     void Invalidate(DisplayModel* dm, int pageNo, RectF rect);
     // returns how much time in ms has past since the most recent rendering
     // request for the visible part of the page if nothing at all could be
     // painted, 0 if something has been painted and RENDER_DELAY_FAILED on failure
     int Paint(HDC hdc, Rect bounds, DisplayModel* dm, int pageNo, PageInfo* pageInfo, bool* renderOutOfDateCue);
 
-    bool ClearCurrentRequest();
+    bool ClearCurrentRequest(PageRenderRequest* req);
     bool GetNextRequest(PageRenderRequest* req);
+    bool IsBeingRendered(DisplayModel* dm) const;
     void Add(PageRenderRequest& req, RenderedBitmap* bmp);
 
     USHORT GetTileRes(DisplayModel* dm, int pageNo);
@@ -143,13 +182,19 @@ class RenderCache {
     bool Render(DisplayModel* dm, int pageNo, int rotation, float zoom, TilePosition* tile = nullptr,
                 RectF* pageRect = nullptr, RenderingCallback* renderCb = nullptr);
     void ClearQueueForDisplayModel(DisplayModel* dm, int pageNo = INVALID_PAGE_NO, TilePosition* tile = nullptr);
-    void AbortCurrentRequest();
+    void AbortCurrentRequests(DisplayModel* dm = nullptr, int pageNo = INVALID_PAGE_NO);
 
+    void StartRenderThreads();
     static DWORD WINAPI RenderCacheThread(LPVOID data);
 
     BitmapCacheEntry* Find(DisplayModel* dm, int pageNo, int rotation, float zoom = INVALID_ZOOM,
                            TilePosition* tile = nullptr);
     bool DropCacheEntry(BitmapCacheEntry* entry);
+    void LinkEntry(BitmapCacheEntry* entry);
+    void UnlinkEntry(BitmapCacheEntry* entry);
+    void RemoveEntry(BitmapCacheEntry* entry);
+    void FreeForNewEntry(DisplayModel* dm, size_t size);
+    BitmapCacheStats GetStats();
     void FreePage(DisplayModel* dm = nullptr, int pageNo = -1, TilePosition* tile = nullptr);
     void FreeNotVisible();
 
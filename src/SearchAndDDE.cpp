@@ -250,12 +250,16 @@ struct FindThreadData : public ProgressUpdateUI {
         SendMessageW(win->hwndToolbar, TB_ENABLEBUTTON, CmdFindMatch, disable);
     }
 
-    void HideUI(bool success, bool loopedAround) {
+    void EnableButtons() {
         LPARAM enable = (LPARAM)MAKELONG(1, 0);
 
         SendMessageW(win->hwndToolbar, TB_ENABLEBUTTON, CmdFindPrev, enable);
         SendMessageW(win->hwndToolbar, TB_ENABLEBUTTON, CmdFindNext, enable);
         SendMessageW(win->hwndToolbar, TB_ENABLEBUTTON, CmdFindMatch, enable);
+    }
+
+    void HideUI(bool success, bool loopedAround) {
+        EnableButtons();
 
         if (!win->notifications->Contains(wnd)) {
             /* our notification has been replaced or closed (or never created) */;
@@ -384,6 +388,251 @@ void FindTextOnThread(WindowInfo* win, TextSearchDirection direction, bool showP
     ftd->thread = win->findThread; // safe because only accesssed on ui thread
 }
 
+// maximum number of threads searching different pages for "Find All" in parallel
+#define MAX_FIND_ALL_THREADS 8
+
+// "Find All" searches all pages on several threads, each using its own clone
+// of the engine for text extraction (the extracted text ends up in the shared
+// textCache, though); hits are posted to the UI in page order as they come in
+struct FindAllData : public FindThreadData {
+    DisplayModel* dm = nullptr;
+    bool caseSensitive = false;
+    int nPages = 0;
+    // last page claimed by a worker thread
+    LONG lastPageNo = 0;
+
+    CRITICAL_SECTION hitsAccess;
+    // for each page its hits, set once the page has been searched
+    Vec<Vec<TextSel>*> pageHits;
+    // hits on pages before this one have already been posted to the UI
+    int nextPageToPost = 1;
+    int pagesSearched = 0;
+
+    // only accessed on the ui thread
+    int hitCount = 0;
+    int hitPageCount = 0;
+
+    FindAllData(WindowInfo* win, HWND findBox) : FindThreadData(win, TextSearchDirection::Forward, findBox) {
+        dm = win->AsFixed();
+        nPages = dm->PageCount();
+        pageHits.AppendBlanks(nPages);
+        InitializeCriticalSection(&hitsAccess);
+    }
+    ~FindAllData() {
+        for (Vec<TextSel>* hits : pageHits) {
+            FreeHits(hits);
+        }
+        DeleteCriticalSection(&hitsAccess);
+    }
+
+    static void FreeHits(Vec<TextSel>* hits) {
+        if (!hits) {
+            return;
+        }
+        for (TextSel& hit : *hits) {
+            free(hit.pages);
+            free(hit.rects);
+        }
+        delete hits;
+    }
+
+    void AddPageHits(int pageNo, Vec<TextSel>* hits);
+};
+
+static void FindAllAddHitsTask(WindowInfo* win, FindAllData* fad, Vec<TextSel>* hits) {
+    if (!WindowInfoStillValid(win) || win->findThread != fad->thread || !win->IsDocLoaded()) {
+        FindAllData::FreeHits(hits);
+        return;
+    }
+
+    TabInfo* tab = win->currentTab;
+    if (!tab->selectionOnPage) {
+        tab->selectionOnPage = new Vec<SelectionOnPage>();
+    }
+    int lastPageNo = 0;
+    for (TextSel& hit : *hits) {
+        for (int i = 0; i < hit.len; i++) {
+            RectF rect = ToRectFl(hit.rects[i]);
+            tab->selectionOnPage->Append(SelectionOnPage(hit.pages[i], &rect));
+        }
+        if (hit.pages[0] != lastPageNo) {
+            lastPageNo = hit.pages[0];
+            fad->hitPageCount++;
+        }
+    }
+    if (0 == fad->hitCount && hits->size() > 0) {
+        // show the first hit as soon as it's been found
+        win->ctrl->GoToPage(hits->at(0).pages[0], true);
+    }
+    fad->hitCount += (int)hits->size();
+    win->showSelection = tab->selectionOnPage->size() > 0;
+    FindAllData::FreeHits(hits);
+    RepaintAsync(win, 0);
+}
+
+void FindAllData::AddPageHits(int pageNo, Vec<TextSel>* hits) {
+    ScopedCritSec scope(&hitsAccess);
+    pageHits[pageNo - 1] = hits;
+    UpdateProgress(++pagesSearched, nPages);
+
+    // post all hits which now are in page order
+    Vec<TextSel>* toPost = nullptr;
+    for (; nextPageToPost <= nPages && pageHits[nextPageToPost - 1]; nextPageToPost++) {
+        Vec<TextSel>* pageHitsToPost = pageHits[nextPageToPost - 1];
+        if (pageHitsToPost->size() > 0) {
+            if (!toPost) {
+                toPost = new Vec<TextSel>();
+            }
+            toPost->Append(pageHitsToPost->LendData(), pageHitsToPost->size());
+            // ownership of the hits' pages and rects has moved to toPost
+            pageHitsToPost->Reset();
+        }
+    }
+    if (toPost) {
+        // posting while still in hitsAccess keeps the hits in page order
+        FindAllData* fad = this;
+        WindowInfo* win = this->win;
+        uitask::Post([=] { FindAllAddHitsTask(win, fad, toPost); });
+    }
+}
+
+struct FindAllWorker {
+    FindAllData* fad = nullptr;
+    // nullptr if text is to be extracted through the DisplayModel's engine
+    EngineBase* engine = nullptr;
+    HANDLE thread = nullptr;
+};
+
+static DWORD WINAPI FindAllWorkerThread(LPVOID data) {
+    FindAllWorker* worker = (FindAllWorker*)data;
+    FindAllData* fad = worker->fad;
+    DocumentTextCache* textCache = fad->dm->textCache;
+
+    TextSearch search(fad->dm->GetEngine(), textCache);
+    search.SetSensitive(fad->caseSensitive);
+    while (!fad->WasCanceled()) {
+        int pageNo = (int)InterlockedIncrement(&fad->lastPageNo);
+        if (pageNo > fad->nPages) {
+            break;
+        }
+        if (worker->engine && !textCache->HasTextForPage(pageNo)) {
+            // (pages which haven't been loaded yet mustn't be cached as empty)
+            bool loading = worker->engine->IsLoadingProgressively();
+            PageText text = worker->engine->ExtractPageText(pageNo);
+            if (text.text || !loading) {
+                textCache->AddTextForPage(pageNo, text);
+            }
+        }
+        Vec<TextSel>* hits = new Vec<TextSel>();
+        search.FindAllInPage(pageNo, fad->text, *hits);
+        fad->AddPageHits(pageNo, hits);
+    }
+    return 0;
+}
+
+static void FindAllEndTask(WindowInfo* win, FindAllData* fad) {
+    if (!WindowInfoStillValid(win)) {
+        delete fad;
+        return;
+    }
+    if (win->findThread != fad->thread) {
+        // see FindEndTask
+        delete fad;
+        return;
+    }
+    if (!win->IsDocLoaded()) {
+        // the UI has already been disabled and hidden
+    } else if (win->findCanceled) {
+        // (the matches found until then remain highlighted)
+        fad->HideUI(false, false);
+    } else if (fad->hitCount > 0) {
+        fad->EnableButtons();
+        if (win->notifications->Contains(fad->wnd)) {
+            AutoFreeWstr buf(str::Format(_TR("Found %d matches on %d pages"), fad->hitCount, fad->hitPageCount));
+            fad->wnd->UpdateMessage(buf, 3000);
+        }
+    } else {
+        // nothing found
+        fad->HideUI(false, true);
+    }
+    win->findThread = nullptr;
+    delete fad;
+}
+
+static DWORD WINAPI FindAllThread(LPVOID data) {
+    FindAllData* fad = (FindAllData*)data;
+    WindowInfo* win = fad->win;
+    EngineBase* engine = fad->dm->GetEngine();
+
+    int nMissing = 0;
+    for (int pageNo = 1; pageNo <= fad->nPages; pageNo++) {
+        if (!fad->dm->textCache->HasTextForPage(pageNo)) {
+            nMissing++;
+        }
+    }
+    // only bother with additional threads if there's text to be extracted
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    int nWorkers = std::min((int)si.dwNumberOfProcessors, MAX_FIND_ALL_THREADS);
+    nWorkers = std::max(std::min(nWorkers, nMissing), 1);
+
+    FindAllWorker workers[MAX_FIND_ALL_THREADS];
+    HANDLE threads[MAX_FIND_ALL_THREADS];
+    int nThreads = 0;
+    for (int i = 0; i < nWorkers && !fad->WasCanceled(); i++) {
+        FindAllWorker* worker = &workers[nThreads];
+        worker->fad = fad;
+        // the first worker doesn't need a clone (and cloning might not be supported)
+        worker->engine = i > 0 ? engine->Clone() : nullptr;
+        if (i > 0 && !worker->engine) {
+            break;
+        }
+        worker->thread = CreateThread(nullptr, 0, FindAllWorkerThread, worker, 0, nullptr);
+        if (!worker->thread) {
+            delete worker->engine;
+            break;
+        }
+        threads[nThreads++] = worker->thread;
+    }
+    if (nThreads > 0) {
+        WaitForMultipleObjects(nThreads, threads, TRUE, INFINITE);
+    }
+    for (int i = 0; i < nThreads; i++) {
+        CloseHandle(workers[i].thread);
+        delete workers[i].engine;
+    }
+    logf("FindAllThread: searched %d pages using %d threads\n", fad->nPages, nThreads);
+
+    // wait for FindAllOnThread to return (see FindThread)
+    while (!win->findThread) {
+        Sleep(1);
+    }
+    uitask::Post([=] { FindAllEndTask(win, fad); });
+    return 0;
+}
+
+void OnMenuFindAll(WindowInfo* win) {
+    if (!win->IsDocLoaded() || !NeedsFindUI(win)) {
+        return;
+    }
+    AbortFinding(win, true);
+
+    FindAllData* fad = new FindAllData(win, win->hwndFindBox);
+    if (str::IsEmpty(fad->text.Get())) {
+        delete fad;
+        OnMenuFind(win);
+        return;
+    }
+    WORD state = (WORD)SendMessageW(win->hwndToolbar, TB_GETSTATE, CmdFindMatch, 0);
+    fad->caseSensitive = (state & TBSTATE_CHECKED) != 0;
+
+    ClearSearchResult(win);
+    fad->ShowUI(true);
+    win->findThread = nullptr;
+    win->findThread = CreateThread(nullptr, 0, FindAllThread, fad, 0, 0);
+    fad->thread = win->findThread; // safe because only accesssed on ui thread
+}
+
 void PaintForwardSearchMark(WindowInfo* win, HDC hdc) {
     CrashIf(!win->AsFixed());
     DisplayModel* dm = win->AsFixed();
@@ -24,6 +24,7 @@ void OnMenuFindPrev(WindowInfo* win);
 void OnMenuFindNext(WindowInfo* win);
 void OnMenuFind(WindowInfo* win);
 void OnMenuFindMatchCase(WindowInfo* win);
+void OnMenuFindAll(WindowInfo* win);
 void OnMenuFindSel(WindowInfo* win, TextSearchDirection direction);
 void AbortFinding(WindowInfo* win, bool hideMessage);
 void FindTextOnThread(WindowInfo* win, TextSearchDirection direction, bool showProgress);
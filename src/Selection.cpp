@@ -60,7 +60,7 @@ Vec<SelectionOnPage>* SelectionOnPage::FromRectangle(DisplayModel* dm, Rect rect
             continue;
         }
 
-        Rect intersect = rect.Intersect(pageInfo->pageOnScreen);
+        Rect intersect = rect.Intersect(dm->PageOnScreen(pageNo));
         if (intersect.IsEmpty()) {
             continue;
         }
@@ -229,6 +229,149 @@ static void BenchFile(const WCHAR* filePath, const WCHAR* pagesSpec) {
     logf(L"Finished (in %.2f ms): %s", TimeSinceInMs(total), filePath);
 }
 
+// a document with lots of pages of varying size which is never rendered
+class EngineBenchLayout : public EngineBase {
+  public:
+    explicit EngineBenchLayout(int nPages) {
+        kind = "benchLayout";
+        defaultFileExt = L".pdf";
+        pageCount = nPages;
+    }
+    EngineBase* Clone() override {
+        return nullptr;
+    }
+    RectF PageMediabox(int pageNo) override {
+        // mostly letter size with every 7th page in landscape and every 13th page smaller
+        RectF mediabox(0, 0, 612, 792);
+        if (pageNo % 7 == 0) {
+            std::swap(mediabox.dx, mediabox.dy);
+        }
+        if (pageNo % 13 == 0) {
+            mediabox.dx /= 2;
+            mediabox.dy /= 2;
+        }
+        return mediabox;
+    }
+    RenderedBitmap* RenderPage([[maybe_unused]] RenderPageArgs& args) override {
+        return nullptr;
+    }
+    RectF Transform(const RectF& rect, [[maybe_unused]] int pageNo, float zoom, int rotation,
+                    bool inverse = false) override {
+        float scale = inverse ? 1.0f / zoom : zoom;
+        RectF res(rect.x * scale, rect.y * scale, rect.dx * scale, rect.dy * scale);
+        if (rotation % 180 != 0) {
+            res = RectF(res.y, res.x, res.dy, res.dx);
+        }
+        return res;
+    }
+    std::span<u8> GetFileData() override {
+        return {};
+    }
+    bool SaveFileAs([[maybe_unused]] const char* copyFileName, [[maybe_unused]] bool includeUserAnnots) override {
+        return false;
+    }
+    PageText ExtractPageText([[maybe_unused]] int pageNo) override {
+        return {};
+    }
+    bool HasClipOptimizations([[maybe_unused]] int pageNo) override {
+        return false;
+    }
+    WCHAR* GetProperty([[maybe_unused]] DocumentProperty prop) override {
+        return nullptr;
+    }
+    Vec<IPageElement*>* GetElements([[maybe_unused]] int pageNo) override {
+        return nullptr;
+    }
+    IPageElement* GetElementAtPos([[maybe_unused]] int pageNo, [[maybe_unused]] PointF pt) override {
+        return nullptr;
+    }
+    bool BenchLoadPage([[maybe_unused]] int pageNo) override {
+        return true;
+    }
+};
+
+struct BenchLayoutCallback : ControllerCallback {
+    void PageNoChanged(Controller*, int) override {
+    }
+    void GotoLink(PageDestination*) override {
+    }
+    void Repaint() override {
+    }
+    void UpdateScrollbars(Size) override {
+    }
+    void RequestRendering(int) override {
+    }
+    void CleanUp(DisplayModel*) override {
+    }
+    void RenderThumbnail(DisplayModel*, Size, const onBitmapRenderedCb&) override {
+    }
+    void DocumentDataLoaded(DisplayModel*) override {
+    }
+    void FocusFrame(bool) override {
+    }
+    void SaveDownload(const WCHAR*, std::span<u8>) override {
+    }
+    void HandleLayoutedPages(EbookController*, EbookFormattingData*) override {
+    }
+    void RequestDelayedLayout(int) override {
+    }
+};
+
+// times the page layout and page lookups of DisplayModel for a huge document
+void BenchDisplayModelLayout() {
+    const int nPages = 200000;
+    logf(L"Starting: layout benchmark for %d pages", nPages);
+
+    BenchLayoutCallback cb;
+    auto t = TimeGet();
+    DisplayModel* dm = new DisplayModel(new EngineBenchLayout(nPages), &cb);
+    dm->SetInitialViewSettings(DisplayMode::Continuous, 1, Size(1280, 1024), 96);
+    logf(L"initial layout: %.2f ms", TimeSinceInMs(t));
+
+    float zooms[] = {ZOOM_FIT_WIDTH, ZOOM_FIT_PAGE, 100.f, 400.f, 25.f};
+    for (float zoom : zooms) {
+        t = TimeGet();
+        dm->SetZoomVirtual(zoom, nullptr);
+        logf(L"relayout at zoom %.0f: %.2f ms", zoom, TimeSinceInMs(t));
+    }
+
+    t = TimeGet();
+    dm->RotateBy(90);
+    logf(L"relayout after rotation: %.2f ms", TimeSinceInMs(t));
+    dm->RotateBy(-90);
+    dm->SetZoomVirtual(100.f, nullptr);
+
+    const int nScrolls = 10000;
+    t = TimeGet();
+    for (int i = 0; i < nScrolls; i++) {
+        dm->ScrollYBy(i % 2 ? -997 : 1024, true);
+    }
+    logf(L"%d scrolls: %.2f ms", nScrolls, TimeSinceInMs(t));
+
+    const int nGoTos = 10000;
+    t = TimeGet();
+    for (int i = 0; i < nGoTos; i++) {
+        dm->GoToPage((int)(((i64)i * 7919) % nPages) + 1, 0);
+    }
+    logf(L"%d page jumps: %.2f ms", nGoTos, TimeSinceInMs(t));
+
+    const int nLookups = 100000;
+    Size viewPort = dm->GetViewPort().Size();
+    int found = 0;
+    t = TimeGet();
+    for (int i = 0; i < nLookups; i++) {
+        Point pt((i * 37) % viewPort.dx, (i * 101) % viewPort.dy);
+        if (dm->GetPageNoByPoint(pt) > 0) {
+            found++;
+        }
+        dm->GetPageNextToPoint(pt);
+    }
+    logf(L"%d point lookups: %.2f ms (%d on a page)", nLookups, TimeSinceInMs(t), found);
+
+    delete dm;
+    logf(L"Finished layout benchmark");
+}
+
 static bool IsFileToBench(const WCHAR* path) {
     Kind kind = GuessFileType(path, true);
     if (IsSupportedFileType(kind, true)) {
@@ -6,6 +6,7 @@ bool IsBenchPagesInfo(const WCHAR* s);
 void BenchFileOrDir(WStrVec& pathsToBench);
 bool IsStressTesting();
 void BenchEbookLayout(WCHAR* filePath);
+void BenchDisplayModelLayout();
 
 struct Flags;
 struct WindowInfo;
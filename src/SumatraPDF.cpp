@@ -707,6 +707,7 @@ struct ControllerCallbackHandler : ControllerCallback {
     void RequestRendering(int pageNo) override;
     void CleanUp(DisplayModel* dm) override;
     void RenderThumbnail(DisplayModel* dm, Size size, const onBitmapRenderedCb&) override;
+    void DocumentDataLoaded(DisplayModel* dm) override;
     void GotoLink(PageDestination* dest) override {
         win->linkHandler->GotoLink(dest);
     }
@@ -1081,6 +1082,42 @@ static bool showTocByDefault(const WCHAR* path) {
     return showByDefault;
 }
 
+// for progressively loaded documents, page sizes are only estimated and the ToC
+// isn't available until all of the file has been read (resp. for ebooks, until
+// all pages have been laid out, which is reported several times as pages are added)
+void ControllerCallbackHandler::DocumentDataLoaded(DisplayModel* dm) {
+    uitask::Post([=] {
+        WindowInfo* win = FindWindowInfoByController(dm);
+        if (!win) {
+            return;
+        }
+        bool wasLoading = dm->GetEngine()->IsLoadingProgressively();
+        bool sizesChanged = dm->FinishProgressiveLoading();
+        if (sizesChanged || (wasLoading && !dm->GetEngine()->IsLoadingProgressively())) {
+            // bitmaps rendered at estimated page sizes are out of date and
+            // pages that weren't available yet have been cached as failed
+            gRenderCache.CancelRendering(dm);
+            gRenderCache.FreeForDisplayModel(dm);
+            // no rendering thread can still use the page info of fewer pages now
+            dm->FreeSupersededPagesInfo();
+        }
+        if (win->ctrl != dm) {
+            // the background tab's UI is updated when it's selected
+            return;
+        }
+        if (dm->GetEngine()->IsLoadingProgressively()) {
+            // only the page count has changed so far
+        } else if (win->tocVisible) {
+            ClearTocBox(win);
+            LoadTocTree(win);
+        } else if (dm->HacToc() && showTocByDefault(dm->FilePath())) {
+            SetSidebarVisibility(win, true, gGlobalPrefs->showFavorites);
+        }
+        UpdateUiForCurrentTab(win);
+        win->RedrawAll(true);
+    });
+}
+
 // meaning of the internal values of LoadArgs:
 // isNewWindow : if true then 'win' refers to a newly created window that needs
 //   to be resized and placed
@@ -1161,8 +1198,15 @@ static void LoadDocIntoCurrentTab(const LoadArgs& args, Controller* ctrl, Displa
             if (tab->GetEngineType() == kindEngineComicBooks || tab->GetEngineType() == kindEngineImageDir) {
                 dm->SetDisplayR2L(state ? state->displayR2L : gGlobalPrefs->comicBookUI.cbxMangaMode);
             }
+            if (gGlobalPrefs->reloadModifiedDocuments) {
+                // the hashes have to be known before the file changes (see ReloadDocument)
+                dm->GetEngine()->ComputePageContentHashes(nullptr);
+            }
             if (prevCtrl && prevCtrl->AsFixed() && str::Eq(win->ctrl->FilePath(), prevCtrl->FilePath())) {
-                gRenderCache.KeepForDisplayModel(prevCtrl->AsFixed(), dm);
+                // after a reload, only pages which have changed have to be rendered again
+                Vec<int> origPageNos;
+                dm->CopyUnchangedPages(*prevCtrl->AsFixed(), origPageNos);
+                gRenderCache.KeepForDisplayModel(prevCtrl->AsFixed(), dm, &origPageNos);
                 dm->CopyNavHistory(*prevCtrl->AsFixed());
             }
             // tell UI Automation about content change
@@ -1286,39 +1330,9 @@ static void LoadDocIntoCurrentTab(const LoadArgs& args, Controller* ctrl, Displa
     }
 }
 
-void ReloadDocument(WindowInfo* win, bool autoRefresh) {
-    // TODO: must disable reload for EngineMulti representing a directory
+// replaces the current tab's document with its reloaded version
+static void ReplaceDocument(WindowInfo* win, Controller* ctrl) {
     TabInfo* tab = win->currentTab;
-
-    // we can't reload while having annotations window open because
-    // that invalidates the mupdf objects that we hold in editAnnotsWindow
-    // TODO: a better approach would be to have a callback that editAnnotsWindow
-    // would register for and re-do its state
-    if (!tab || tab->editAnnotsWindow) {
-        return;
-    }
-    if (!win->IsDocLoaded()) {
-        if (!autoRefresh) {
-            LoadArgs args(tab->filePath, win);
-            args.forceReuse = true;
-            args.noSavePrefs = true;
-            LoadDocument(args);
-        }
-        return;
-    }
-
-    HwndPasswordUI pwdUI(win->hwndFrame);
-    Controller* ctrl = CreateControllerForFile(tab->filePath, &pwdUI, win);
-    // We don't allow PDF-repair if it is an autorefresh because
-    // a refresh event can occur before the file is finished being written,
-    // in which case the repair could fail. Instead, if the file is broken,
-    // we postpone the reload until the next autorefresh event
-    if (!ctrl && autoRefresh) {
-        SetFrameTitleForTab(tab, true);
-        win::SetText(win->hwndFrame, tab->frameTitle);
-        return;
-    }
-
     DisplayState* ds = NewDisplayState(tab->filePath);
     tab->ctrl->GetDisplayState(ds);
     UpdateDisplayStateWindowRect(win, *ds);
@@ -1373,6 +1387,87 @@ void ReloadDocument(WindowInfo* win, bool autoRefresh) {
     DeleteDisplayState(ds);
 }
 
+// called once the pages of the reloaded document of a pending reload have been hashed
+static void OnReloadPagesHashed(int reloadId) {
+    for (WindowInfo* win : gWindows) {
+        for (TabInfo* tab : win->tabs) {
+            if (!tab->reloadedCtrl || tab->reloadId != reloadId) {
+                continue;
+            }
+            Controller* ctrl = tab->reloadedCtrl;
+            tab->reloadedCtrl = nullptr;
+            if (tab != win->currentTab || !tab->AsFixed() || tab->editAnnotsWindow) {
+                // reload again once that's possible
+                delete ctrl;
+                tab->reloadOnFocus = true;
+                return;
+            }
+            // the data of a progressively loaded document has been read by now
+            // (and DocumentDataLoaded ignores documents which aren't displayed)
+            ctrl->AsFixed()->FinishProgressiveLoading();
+            ReplaceDocument(win, ctrl);
+            return;
+        }
+    }
+}
+
+void ReloadDocument(WindowInfo* win, bool autoRefresh) {
+    // TODO: must disable reload for EngineMulti representing a directory
+    TabInfo* tab = win->currentTab;
+
+    // we can't reload while having annotations window open because
+    // that invalidates the mupdf objects that we hold in editAnnotsWindow
+    // TODO: a better approach would be to have a callback that editAnnotsWindow
+    // would register for and re-do its state
+    if (!tab || tab->editAnnotsWindow) {
+        return;
+    }
+    if (!win->IsDocLoaded()) {
+        if (!autoRefresh) {
+            LoadArgs args(tab->filePath, win);
+            args.forceReuse = true;
+            args.noSavePrefs = true;
+            LoadDocument(args);
+        }
+        return;
+    }
+
+    HwndPasswordUI pwdUI(win->hwndFrame);
+    Controller* ctrl = CreateControllerForFile(tab->filePath, &pwdUI, win);
+    // We don't allow PDF-repair if it is an autorefresh because
+    // a refresh event can occur before the file is finished being written,
+    // in which case the repair could fail. Instead, if the file is broken,
+    // we postpone the reload until the next autorefresh event
+    if (!ctrl && autoRefresh) {
+        SetFrameTitleForTab(tab, true);
+        win::SetText(win->hwndFrame, tab->frameTitle);
+        return;
+    }
+
+    // supersede a reload that's still pending
+    delete tab->reloadedCtrl;
+    tab->reloadedCtrl = nullptr;
+    DisplayModel* prevDm = tab->AsFixed();
+    if (prevDm) {
+        // the displayed document's hashes (if computed since it was loaded)
+        // must not include anything read from the changed file
+        prevDm->GetEngine()->StopComputingPageContentHashes();
+    }
+    if (ctrl && ctrl->AsFixed() && prevDm) {
+        // finding out which pages haven't changed (see CopyUnchangedPages) requires
+        // hashing the reloaded document, which is done in the background. it
+        // replaces the displayed one once that's done
+        static int nextReloadId = 0;
+        tab->reloadedCtrl = ctrl;
+        tab->reloadId = ++nextReloadId;
+        int reloadId = tab->reloadId;
+        auto onHashed = [reloadId] { uitask::Post([reloadId] { OnReloadPagesHashed(reloadId); }); };
+        ctrl->AsFixed()->GetEngine()->ComputePageContentHashes(onHashed);
+        return;
+    }
+    ReplaceDocument(win, ctrl);
+}
+
 static void CreateSidebar(WindowInfo* win) {
     win->sidebarSplitter = new SplitterCtrl(win->hwndFrame);
     win->sidebarSplitter->type = SplitterType::Vert;
@@ -1611,6 +1706,10 @@ void scheduleReloadTab(TabInfo* tab) {
             return;
         }
         tab->reloadOnFocus = true;
+        if (tab->AsFixed()) {
+            // the file has changed, so don't finish hashing the displayed document
+            tab->GetEngine()->StopComputingPageContentHashes();
+        }
         if (tab == win->currentTab) {
             // delay the reload slightly, in case we get another request immediately after this one
             SetTimer(win->hwndCanvas, AUTO_RELOAD_TIMER_ID, AUTO_RELOAD_DELAY_IN_MS, nullptr);
@@ -4515,6 +4614,10 @@ static LRESULT FrameOnCommand(WindowInfo* win, HWND hwnd, UINT msg, WPARAM wp, L
             OnMenuFindSel(win, TextSearchDirection::Backward);
             break;
 
+        case CmdFindAll:
+            OnMenuFindAll(win);
+            break;
+
         case CmdHelpVisitWebsite:
             SumatraLaunchBrowser(WEBSITE_MAIN_URL);
             break;
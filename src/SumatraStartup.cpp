@@ -35,6 +35,7 @@
 #include "Annotation.h"
 #include "EngineBase.h"
 #include "EngineCreate.h"
+#include "EnginePdf.h"
 #include "DisplayMode.h"
 #include "SettingsStructs.h"
 #include "Controller.h"
@@ -912,6 +913,15 @@ int APIENTRY WinMain(HINSTANCE hInstance, [[maybe_unused]] HINSTANCE hPrevInstan
     UpdateGlobalPrefs(i);
     SetCurrentLang(i.lang ? i.lang : gGlobalPrefs->uiLanguage);
 
+    // damaged PDF documents don't have to be repaired every time they're opened
+    // and .synctex files don't have to be parsed again until they change
+    if (gGlobalPrefs->rememberOpenedFiles && HasPermission(Perm_SavePreferences | Perm_DiskAccess)) {
+        SetPdfRepairedXrefPathFunc(GetRepairedXrefPath);
+        SetSyncTexIndexPathFunc(GetSyncTexIndexPath);
+    }
+    // show the first page of linearized PDF documents before they've been read from slow drives
+    SetPdfProgressiveLoading(true);
+
     // This allows ad-hoc comparison of gdi, gdi+ and gdi+ quick when used
     // in layout
 #if 0
@@ -938,6 +948,13 @@ int APIENTRY WinMain(HINSTANCE hInstance, [[maybe_unused]] HINSTANCE hPrevInstan
         }
     }
 
+    if (i.benchLayout) {
+        BenchDisplayModelLayout();
+        if (i.showConsole) {
+            system("pause");
+        }
+    }
+
     if (i.exitImmediately) {
         goto Exit;
     }
@@ -945,6 +962,7 @@ int APIENTRY WinMain(HINSTANCE hInstance, [[maybe_unused]] HINSTANCE hPrevInstan
     gCrashOnOpen = i.crashOnOpen;
 
     GetFixedPageUiColors(gRenderCache.textColor, gRenderCache.backgroundColor);
+    gRenderCache.SetRenderThreadCount(gGlobalPrefs->renderThreads);
 
     gIsStartup = true;
     if (!RegisterWinClass()) {
@@ -1156,6 +1174,8 @@ Exit:
 
     extern void CleanupDjVuEngine(); // in EngineDjVu.cpp
     CleanupDjVuEngine();
+    extern void FreeDecodedImages(); // in HtmlFormatter.cpp
+    FreeDecodedImages();
     destroy_system_font_list();
 
     // wait for FileExistenceChecker to terminate
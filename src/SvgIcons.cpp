@@ -136,38 +136,17 @@ static const char* gAllIcons[] = {
 // clang-format on
 
 struct MupdfContext {
-    fz_locks_context fz_locks_ctx{};
-    CRITICAL_SECTION mutexes[FZ_LOCK_MAX];
     fz_context* ctx = nullptr;
     MupdfContext();
     ~MupdfContext();
 };
 
-static void fz_lock_context_cs(void* user, int lock) {
-    MupdfContext* ctx = (MupdfContext*)user;
-    EnterCriticalSection(&ctx->mutexes[lock]);
-}
-
-static void fz_unlock_context_cs(void* user, int lock) {
-    MupdfContext* ctx = (MupdfContext*)user;
-    LeaveCriticalSection(&ctx->mutexes[lock]);
-}
-
 MupdfContext::MupdfContext() {
-    for (int i = 0; i < FZ_LOCK_MAX; i++) {
-        InitializeCriticalSection(&mutexes[i]);
-    }
-    fz_locks_ctx.user = this;
-    fz_locks_ctx.lock = fz_lock_context_cs;
-    fz_locks_ctx.unlock = fz_unlock_context_cs;
-    ctx = fz_new_context(nullptr, &fz_locks_ctx, FZ_STORE_DEFAULT);
+    ctx = fz_clone_shared_context();
 }
 
 MupdfContext::~MupdfContext() {
     fz_drop_context(ctx);
-    for (int i = 0; i < FZ_LOCK_MAX; i++) {
-        DeleteCriticalSection(&mutexes[i]);
-    }
 }
 
 void BlitPixmap(fz_pixmap* dst, fz_pixmap* src, int dstX, int dstY) {
@@ -42,6 +42,7 @@ TabInfo::~TabInfo() {
     DeleteVecMembers(altBookmarks);
     delete selectionOnPage;
     delete ctrl;
+    delete reloadedCtrl;
     delete tocSorted;
     DeleteEditAnnotationsWindow(editAnnotsWindow);
 }
@@ -27,6 +27,10 @@ struct TabInfo {
     Rect canvasRc;
     // whether to auto-reload the document when the tab is selected
     bool reloadOnFocus = 0;
+    // a reloaded document which replaces ctrl once its pages
+    // have been hashed (see ReloadDocument)
+    Controller* reloadedCtrl = nullptr;
+    int reloadId = 0;
     // FileWatcher token for unsubscribing
     WatchedFile* watcher = nullptr;
     // list of rectangles of the last rectangular, text or image selection
@@ -32,6 +32,16 @@ TextSearch::~TextSearch() {
     Clear();
 }
 
+// the page count grows while an ebook is still being laid out
+void TextSearch::UpdatePageCount() {
+    int count = textCache->PageCount();
+    if (count != nPages) {
+        nPages = count;
+        pagesToSkip.SetSize(nPages);
+        markAllPagesNonSkip(pagesToSkip);
+    }
+}
+
 void TextSearch::Reset() {
     pageText = nullptr;
     TextSelection::Reset();
@@ -301,6 +311,13 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker) {
             pageNo += next;
             continue;
         }
+        // a match can only start on pages containing the anchor
+        // (which never spans pages), so consult the page's filter first
+        if (anchor && !textCache->MightContainWord(pageNo, anchor)) {
+            pagesToSkip[pageNo - 1] = true;
+            pageNo += next;
+            continue;
+        }
 
         Reset();
 
@@ -334,6 +351,7 @@ bool TextSearch::FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker) {
 
 TextSel* TextSearch::FindFirst(int page, const WCHAR* text, ProgressUpdateUI* tracker) {
     SetText(text);
+    UpdatePageCount();
 
     if (FindStartingAtPage(page, tracker)) {
         return &result;
@@ -341,11 +359,43 @@ TextSel* TextSearch::FindFirst(int page, const WCHAR* text, ProgressUpdateUI* tr
     return nullptr;
 }
 
+int TextSearch::FindAllInPage(int pageNo, const WCHAR* text, Vec<TextSel>& hits) {
+    SetText(text);
+    forward = true;
+    if (str::IsEmpty(findText)) {
+        return 0;
+    }
+    if (anchor && !textCache->MightContainWord(pageNo, anchor)) {
+        return 0;
+    }
+
+    Reset();
+    pageText = textCache->GetTextForPage(pageNo);
+    findIndex = 0;
+
+    int nFound = 0;
+    PageAndOffset r;
+    while (FindTextInPage(pageNo, &r)) {
+        TextSel hit;
+        hit.len = hit.cap = result.len;
+        hit.pages = (int*)memdup(result.pages, result.len * sizeof(int));
+        hit.rects = (Rect*)memdup(result.rects, result.len * sizeof(Rect));
+        hits.Append(hit);
+        nFound++;
+        if (r.page != pageNo) {
+            // the hit continues on the following page(s)
+            break;
+        }
+    }
+    return nFound;
+}
+
 TextSel* TextSearch::FindNext(ProgressUpdateUI* tracker) {
     CrashIf(!findText);
     if (!findText) {
         return nullptr;
     }
+    UpdatePageCount();
 
     if (tracker) {
         if (tracker->WasCanceled()) {
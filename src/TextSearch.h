@@ -13,6 +13,8 @@ class TextSearch : public TextSelection {
     void SetLastResult(TextSelection* sel);
     TextSel* FindFirst(int page, const WCHAR* text, ProgressUpdateUI* tracker = nullptr);
     TextSel* FindNext(ProgressUpdateUI* tracker = nullptr);
+    // appends all hits starting on pageNo to hits (caller must free their pages and rects)
+    int FindAllInPage(int pageNo, const WCHAR* text, Vec<TextSel>& hits);
 
     // note: the result might not be a valid page number!
     int GetCurrentPageNo() const {
@@ -47,6 +49,7 @@ class TextSearch : public TextSelection {
     bool FindTextInPage(int pageNo, PageAndOffset* finalGlyph);
     bool FindStartingAtPage(int pageNo, ProgressUpdateUI* tracker);
     PageAndOffset MatchEnd(const WCHAR* start) const;
+    void UpdatePageCount();
 
     void Clear() {
         str::ReplacePtr(&findText, nullptr);
@@ -3,6 +3,7 @@
 
 #include "utils/BaseUtil.h"
 #include "utils/ScopedWin.h"
+#include "utils/FileUtil.h"
 
 #include "wingui/TreeModel.h"
 
@@ -18,10 +19,259 @@ bool isWordChar(WCHAR c) {
     return IsCharAlphaNumeric(c) || c == '_';
 }
 
+// if false, hit-testing looks at all glyphs of a page (for EngineDump -bench-select)
+bool gTextSelectionUseIndex = true;
+
+// average number of glyphs (by center) per GlyphIndex cell
+#define GLYPHS_PER_CELL 4
+
+static bool IsGlyph(const Rect& r) {
+    // line breaks have empty coordinates
+    return r.x || r.dx;
+}
+
+static int FloorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+
+GlyphIndex::GlyphIndex(const Rect* coords, int len) {
+    int n = 0;
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+    for (int i = 0; i < len; i++) {
+        const Rect& r = coords[i];
+        if (!IsGlyph(r)) {
+            continue;
+        }
+        // the glyph's center lies between these
+        x0 = std::min(x0, std::min(r.x, r.x + r.dx));
+        x1 = std::max(x1, std::max(r.x, r.x + r.dx));
+        y0 = std::min(y0, std::min(r.y, r.y + r.dy));
+        y1 = std::max(y1, std::max(r.y, r.y + r.dy));
+        n++;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    bounds = Rect(x0, y0, x1 - x0, y1 - y0);
+    double area = (double)(bounds.dx + 1) * (bounds.dy + 1);
+    cellSize = std::max(1, (int)sqrt(area * GLYPHS_PER_CELL / n));
+    cols = bounds.dx / cellSize + 1;
+    rows = bounds.dy / cellSize + 1;
+    int nCells = cols * rows;
+
+    // counting sort of the glyphs into the cells they belong to (keeping
+    // them in glyph order), first by center and then by box
+    for (int pass = 0; pass < 2; pass++) {
+        Vec<int>& cells = pass == 0 ? centerCells : boxCells;
+        Vec<int>& glyphs = pass == 0 ? centerGlyphs : boxGlyphs;
+        int* start = cells.AppendBlanks(nCells + 1);
+        for (int fill = 0; fill < 2; fill++) {
+            for (int i = 0; i < len; i++) {
+                const Rect& r = coords[i];
+                if (!IsGlyph(r)) {
+                    continue;
+                }
+                int cx0, cy0, cx1, cy1;
+                if (pass == 0) {
+                    cx0 = cx1 = (r.x + r.dx / 2 - bounds.x) / cellSize;
+                    cy0 = cy1 = (r.y + r.dy / 2 - bounds.y) / cellSize;
+                } else {
+                    if (r.dx < 0 || r.dy < 0) {
+                        // such a box can't contain any point
+                        continue;
+                    }
+                    cx0 = (r.x - bounds.x) / cellSize;
+                    cx1 = (r.x + r.dx - bounds.x) / cellSize;
+                    cy0 = (r.y - bounds.y) / cellSize;
+                    cy1 = (r.y + r.dy - bounds.y) / cellSize;
+                }
+                for (int cy = cy0; cy <= cy1; cy++) {
+                    for (int cx = cx0; cx <= cx1; cx++) {
+                        int cell = cy * cols + cx;
+                        if (fill == 0) {
+                            start[cell + 1]++;
+                        } else {
+                            glyphs.at(start[cell]++) = i;
+                        }
+                    }
+                }
+            }
+            if (fill == 0) {
+                for (int cell = 0; cell < nCells; cell++) {
+                    start[cell + 1] += start[cell];
+                }
+                glyphs.AppendBlanks(start[nCells]);
+            } else {
+                // start[cell] has been advanced to the start of the next cell
+                for (int cell = nCells; cell > 0; cell--) {
+                    start[cell] = start[cell - 1];
+                }
+                start[0] = 0;
+            }
+        }
+    }
+}
+
+int GlyphIndex::FindClosest(const Rect* coords, int x, int y, Point pt) const {
+    if (cols == 0) {
+        return -1;
+    }
+
+    int result = -1;
+    uint maxDist = UINT_MAX;
+
+    // prefer glyphs the cursor is actually over
+    if (bounds.Contains(pt)) {
+        int cell = (pt.y - bounds.y) / cellSize * cols + (pt.x - bounds.x) / cellSize;
+        for (int i = boxCells.at(cell); i < boxCells.at(cell + 1); i++) {
+            int glyph = boxGlyphs.at(i);
+            const Rect& r = coords[glyph];
+            if (!r.Contains(pt)) {
+                continue;
+            }
+            uint dist = distSq(x - r.x - r.dx / 2, y - r.y - r.dy / 2);
+            if (dist < maxDist) {
+                result = glyph;
+                maxDist = dist;
+            }
+        }
+        if (result != -1) {
+            return result;
+        }
+    }
+
+    // look at the cells in rings of growing distance around the one containing (x, y)
+    // until no glyph center in the next ring can be closer than the closest one found
+    int px = FloorDiv(x - bounds.x, cellSize);
+    int py = FloorDiv(y - bounds.y, cellSize);
+    int minR = std::max(std::max(0, std::max(-px, px - (cols - 1))), std::max(-py, py - (rows - 1)));
+    int maxR = std::max(std::max(px, cols - 1 - px), std::max(py, rows - 1 - py));
+    auto visitCell = [&](int cx, int cy) {
+        if (cx < 0 || cx >= cols) {
+            return;
+        }
+        int cell = cy * cols + cx;
+        for (int i = centerCells.at(cell); i < centerCells.at(cell + 1); i++) {
+            int glyph = centerGlyphs.at(i);
+            const Rect& r = coords[glyph];
+            uint dist = distSq(x - r.x - r.dx / 2, y - r.y - r.dy / 2);
+            if (dist < maxDist || (dist == maxDist && glyph < result)) {
+                result = glyph;
+                maxDist = dist;
+            }
+        }
+    };
+    for (int r = minR; r <= maxR; r++) {
+        if (r > 0 && result != -1) {
+            i64 minDist = (i64)(r - 1) * cellSize;
+            if (minDist * minDist >= (i64)maxDist) {
+                break;
+            }
+        }
+        for (int cy = std::max(py - r, 0); cy <= std::min(py + r, rows - 1); cy++) {
+            if (cy == py - r || cy == py + r) {
+                for (int cx = std::max(px - r, 0); cx <= std::min(px + r, cols - 1); cx++) {
+                    visitCell(cx, cy);
+                }
+            } else {
+                visitCell(px - r, cy);
+                visitCell(px + r, cy);
+            }
+        }
+    }
+    return result;
+}
+
+void GlyphIndex::FindInRect(Rect rect, Vec<int>& glyphs) const {
+    Rect r = rect.Intersect(bounds);
+    if (cols == 0 || r.IsEmpty()) {
+        return;
+    }
+    int cx0 = (r.x - bounds.x) / cellSize;
+    int cx1 = std::min((r.x + r.dx - bounds.x) / cellSize, cols - 1);
+    int cy0 = (r.y - bounds.y) / cellSize;
+    int cy1 = std::min((r.y + r.dy - bounds.y) / cellSize, rows - 1);
+    // glyphs overlapping several cells are listed for each of them
+    Vec<int> found;
+    for (int cy = cy0; cy <= cy1; cy++) {
+        for (int cx = cx0; cx <= cx1; cx++) {
+            int cell = cy * cols + cx;
+            for (int i = boxCells.at(cell); i < boxCells.at(cell + 1); i++) {
+                found.Append(boxGlyphs.at(i));
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+    for (size_t i = 0; i < found.size(); i++) {
+        if (i == 0 || found.at(i) != found.at(i - 1)) {
+            glyphs.Append(found.at(i));
+        }
+    }
+}
+
+// text indexes larger than this are truncated (pages beyond
+// the limit will have to be extracted again after reloading)
+#define MAX_TEXT_INDEX_SIZE (64 * 1024 * 1024)
+#define TEXT_INDEX_MAGIC 0x58444954 // "TIDX"
+#define TEXT_INDEX_VERSION 1
+
+struct TextIndexHeader {
+    u32 magic;
+    u32 version;
+    // the index is only valid for the exact same file
+    i64 fileSize;
+    FILETIME fileTime;
+    int nPages;
+    int filterSize;
+};
+
+// followed by len + 1 characters of text, len glyph coordinates
+// (if hasCoords is set) and PAGE_TEXT_FILTER_SIZE u64 of filter
+struct TextIndexPage {
+    int len; // -1 if the page's text hasn't been extracted
+    int hasCoords;
+};
+
+// same as isnoncjkwordchar in TextSearch.cpp: only between such characters
+// does TextSearch never ignore any whitespace
+static bool IsFilterChar(WCHAR c) {
+    return isWordChar(c) && (unsigned short)c < 0x2E80;
+}
+
+static uint GetFilterBit(WCHAR c1, WCHAR c2) {
+    uint h = ((uint)c1 << 16 | (uint)c2) * 2654435761u;
+    return h % (PAGE_TEXT_FILTER_SIZE * 64);
+}
+
+static bool InitTextIndexHeader(TextIndexHeader* hdr, DocumentTextCache* cache) {
+    if (!cache->hasFileStats) {
+        return false;
+    }
+    ZeroMemory(hdr, sizeof(*hdr));
+    hdr->magic = TEXT_INDEX_MAGIC;
+    hdr->version = TEXT_INDEX_VERSION;
+    hdr->fileSize = cache->fileSize;
+    hdr->fileTime = cache->fileTime;
+    hdr->nPages = cache->nPages;
+    hdr->filterSize = PAGE_TEXT_FILTER_SIZE;
+    return true;
+}
+
 DocumentTextCache::DocumentTextCache(EngineBase* engine) : engine(engine) {
     nPages = engine->PageCount();
+    // the file might have been replaced by the time the index is saved
+    const WCHAR* filePath = engine->FileName();
+    WIN32_FILE_ATTRIBUTE_DATA fileAttr;
+    if (filePath && GetFileAttributesExW(filePath, GetFileExInfoStandard, &fileAttr)) {
+        hasFileStats = true;
+        fileSize = ((i64)fileAttr.nFileSizeHigh << 32) | fileAttr.nFileSizeLow;
+        fileTime = fileAttr.ftLastWriteTime;
+    }
     pagesText = AllocArray<PageText>(nPages);
-    debugSize = nPages * (sizeof(Rect*) + sizeof(WCHAR*) + sizeof(int));
+    pagesIndex = AllocArray<GlyphIndex*>(nPages);
+    pagesFilter = AllocArray<u64>((size_t)nPages * PAGE_TEXT_FILTER_SIZE);
+    debugSize = nPages * (sizeof(Rect*) + sizeof(WCHAR*) + sizeof(int) + PAGE_TEXT_FILTER_SIZE * sizeof(u64));
 
     InitializeCriticalSection(&access);
 }
@@ -29,19 +279,50 @@ DocumentTextCache::DocumentTextCache(EngineBase* engine) : engine(engine) {
 DocumentTextCache::~DocumentTextCache() {
     EnterCriticalSection(&access);
 
-    int nPages = engine->PageCount();
     for (int i = 0; i < nPages; i++) {
         PageText* pageText = &pagesText[i];
         free(pageText->coords);
         free(pageText->text);
+        delete pagesIndex[i];
     }
     free(pagesText);
+    free(pagesIndex);
+    free(pagesFilter);
     LeaveCriticalSection(&access);
     DeleteCriticalSection(&access);
 }
 
+int DocumentTextCache::PageCount() {
+    ScopedCritSec scope(&access);
+    return nPages;
+}
+
+template <typename T>
+static T* GrowArray(T* arr, size_t count, size_t newCount) {
+    T* res = AllocArray<T>(newCount);
+    memcpy(res, arr, count * sizeof(T));
+    free(arr);
+    return res;
+}
+
+void DocumentTextCache::UpdatePageCount() {
+    ScopedCritSec scope(&access);
+    int newCount = engine->PageCount();
+    if (newCount <= nPages) {
+        return;
+    }
+    pagesText = GrowArray(pagesText, nPages, newCount);
+    pagesIndex = GrowArray(pagesIndex, nPages, newCount);
+    pagesFilter = GrowArray(pagesFilter, (size_t)nPages * PAGE_TEXT_FILTER_SIZE,
+                            (size_t)newCount * PAGE_TEXT_FILTER_SIZE);
+    debugSize +=
+        (newCount - nPages) * (sizeof(Rect*) + sizeof(WCHAR*) + sizeof(int) + PAGE_TEXT_FILTER_SIZE * sizeof(u64));
+    nPages = newCount;
+}
+
 bool DocumentTextCache::HasTextForPage(int pageNo) {
     CrashIf(pageNo < 1 || pageNo > nPages);
+    ScopedCritSec scope(&access);
     PageText* pageText = &pagesText[pageNo - 1];
     return pageText->text != nullptr;
 }
@@ -53,12 +334,20 @@ const WCHAR* DocumentTextCache::GetTextForPage(int pageNo, int* lenOut, Rect** c
     PageText* pageText = &pagesText[pageNo - 1];
 
     if (!pageText->text) {
-        *pageText = engine->ExtractPageText(pageNo);
-        if (!pageText->text) {
-            pageText->text = str::Dup(L"");
-            pageText->len = 0;
+        // the text of pages which haven't been loaded yet will be extracted again
+        bool loading = engine->IsLoadingProgressively();
+        PageText text = engine->ExtractPageText(pageNo);
+        if (!text.text && loading) {
+            if (lenOut) {
+                *lenOut = 0;
+            }
+            if (coordsOut) {
+                *coordsOut = nullptr;
+            }
+            return L"";
         }
-        debugSize += (pageText->len + 1) * (int)(sizeof(WCHAR) + sizeof(Rect));
+        SetPageText(pageNo, text);
+        isDirty = true;
     }
 
     if (lenOut) {
@@ -70,6 +359,178 @@ const WCHAR* DocumentTextCache::GetTextForPage(int pageNo, int* lenOut, Rect** c
     return pageText->text;
 }
 
+// the index is built when first needed (the page's text never changes afterwards)
+const GlyphIndex* DocumentTextCache::GetGlyphIndex(int pageNo) {
+    int len;
+    Rect* coords;
+    GetTextForPage(pageNo, &len, &coords);
+    if (!coords) {
+        return nullptr;
+    }
+
+    ScopedCritSec scope(&access);
+    GlyphIndex*& index = pagesIndex[pageNo - 1];
+    if (!index) {
+        index = new GlyphIndex(coords, len);
+        debugSize += (index->centerCells.isize() + index->centerGlyphs.isize() + index->boxCells.isize() +
+                      index->boxGlyphs.isize()) *
+                     (int)sizeof(int);
+    }
+    return index;
+}
+
+void DocumentTextCache::AddTextForPage(int pageNo, PageText text) {
+    CrashIf(pageNo < 1 || pageNo > nPages);
+
+    ScopedCritSec scope(&access);
+    if (pagesText[pageNo - 1].text) {
+        FreePageText(&text);
+        return;
+    }
+    SetPageText(pageNo, text);
+    isDirty = true;
+}
+
+// takes ownership of text and coords (must be called in access)
+void DocumentTextCache::SetPageText(int pageNo, PageText text) {
+    PageText* pageText = &pagesText[pageNo - 1];
+    CrashIf(pageText->text);
+    *pageText = text;
+    if (!pageText->text) {
+        pageText->text = str::Dup(L"");
+        pageText->len = 0;
+    }
+    debugSize += (pageText->len + 1) * (int)(sizeof(WCHAR) + sizeof(Rect));
+
+    u64* filter = &pagesFilter[(size_t)(pageNo - 1) * PAGE_TEXT_FILTER_SIZE];
+    AutoFreeWstr lower(str::DupN(pageText->text, pageText->len));
+    CharLowerBuffW(lower, (DWORD)pageText->len);
+    for (int i = 1; i < pageText->len; i++) {
+        if (IsFilterChar(lower[i - 1]) && IsFilterChar(lower[i])) {
+            uint bit = GetFilterBit(lower[i - 1], lower[i]);
+            filter[bit / 64] |= (u64)1 << (bit % 64);
+        }
+    }
+}
+
+// note: word must not contain any characters which TextSearch
+// might match against several different ones (or whitespace)
+bool DocumentTextCache::MightContainWord(int pageNo, const WCHAR* word) {
+    CrashIf(pageNo < 1 || pageNo > nPages);
+
+    ScopedCritSec scope(&access);
+    if (!pagesText[pageNo - 1].text) {
+        // a page's filter is only known once its text has been extracted
+        return true;
+    }
+
+    u64* filter = &pagesFilter[(size_t)(pageNo - 1) * PAGE_TEXT_FILTER_SIZE];
+    AutoFreeWstr lower(str::Dup(word));
+    int len = (int)str::Len(lower);
+    CharLowerBuffW(lower, (DWORD)len);
+    for (int i = 1; i < len; i++) {
+        if (IsFilterChar(lower[i - 1]) && IsFilterChar(lower[i])) {
+            uint bit = GetFilterBit(lower[i - 1], lower[i]);
+            if (!(filter[bit / 64] & ((u64)1 << (bit % 64)))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool DocumentTextCache::LoadIndex(const WCHAR* indexPath) {
+    TextIndexHeader hdr;
+    if (!InitTextIndexHeader(&hdr, this)) {
+        return false;
+    }
+    AutoFree data(file::ReadFile(indexPath));
+    if (data.len < sizeof(hdr) || memcmp(data.data, &hdr, sizeof(hdr)) != 0) {
+        return false;
+    }
+
+    ScopedCritSec scope(&access);
+
+    size_t off = sizeof(hdr);
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        TextIndexPage page;
+        if (data.len - off < sizeof(page)) {
+            return false;
+        }
+        memcpy(&page, data.data + off, sizeof(page));
+        off += sizeof(page);
+        if (page.len < 0) {
+            continue;
+        }
+        if (page.len > MAX_TEXT_INDEX_SIZE / (int)sizeof(WCHAR)) {
+            return false;
+        }
+        size_t textSize = (page.len + 1) * sizeof(WCHAR);
+        size_t coordsSize = page.hasCoords ? page.len * sizeof(Rect) : 0;
+        size_t filterSize = PAGE_TEXT_FILTER_SIZE * sizeof(u64);
+        if (data.len - off < textSize + coordsSize + filterSize) {
+            return false;
+        }
+        if (pagesText[pageNo - 1].text) {
+            // already extracted in the meantime
+            off += textSize + coordsSize + filterSize;
+            continue;
+        }
+
+        PageText* pageText = &pagesText[pageNo - 1];
+        pageText->text = (WCHAR*)memdup(data.data + off, textSize);
+        pageText->text[page.len] = '\0';
+        off += textSize;
+        if (page.hasCoords) {
+            pageText->coords = (Rect*)memdup(data.data + off, coordsSize);
+            off += coordsSize;
+        }
+        pageText->len = page.len;
+        memcpy(&pagesFilter[(size_t)(pageNo - 1) * PAGE_TEXT_FILTER_SIZE], data.data + off, filterSize);
+        off += filterSize;
+        debugSize += (pageText->len + 1) * (int)(sizeof(WCHAR) + sizeof(Rect));
+    }
+    return true;
+}
+
+bool DocumentTextCache::SaveIndex(const WCHAR* indexPath) {
+    TextIndexHeader hdr;
+    if (!InitTextIndexHeader(&hdr, this)) {
+        return false;
+    }
+
+    ScopedCritSec scope(&access);
+
+    str::Str data;
+    data.Append((const u8*)&hdr, sizeof(hdr));
+    for (int pageNo = 1; pageNo <= nPages; pageNo++) {
+        PageText* pageText = &pagesText[pageNo - 1];
+        TextIndexPage page{-1, 0};
+        size_t textSize = (pageText->len + 1) * sizeof(WCHAR);
+        size_t coordsSize = pageText->coords ? pageText->len * sizeof(Rect) : 0;
+        size_t filterSize = PAGE_TEXT_FILTER_SIZE * sizeof(u64);
+        if (pageText->text && data.size() + textSize + coordsSize + filterSize <= MAX_TEXT_INDEX_SIZE) {
+            page.len = pageText->len;
+            page.hasCoords = pageText->coords != nullptr;
+        }
+        data.Append((const u8*)&page, sizeof(page));
+        if (page.len < 0) {
+            continue;
+        }
+        data.Append((const u8*)pageText->text, textSize);
+        if (page.hasCoords) {
+            data.Append((const u8*)pageText->coords, coordsSize);
+        }
+        data.Append((const u8*)&pagesFilter[(size_t)(pageNo - 1) * PAGE_TEXT_FILTER_SIZE], filterSize);
+    }
+
+    bool ok = file::WriteFile(indexPath, data.AsSpan());
+    if (ok) {
+        isDirty = false;
+    }
+    return ok;
+}
+
 TextSelection::TextSelection(EngineBase* engine, DocumentTextCache* textCache) : engine(engine), textCache(textCache) {
 }
 
@@ -94,31 +555,35 @@ static int FindClosestGlyph(TextSelection* ts, int pageNo, double x, double y) {
     Rect* coords;
     ts->textCache->GetTextForPage(pageNo, &textLen, &coords);
     PointF pt = PointF(x, y);
-
-    unsigned int maxDist = UINT_MAX;
     Point pti = ToPoint(pt);
-    bool overGlyph = false;
     int result = -1;
 
-    for (int i = 0; i < textLen; i++) {
-        Rect& coord = coords[i];
-        if (!coord.x && !coord.dx) {
-            continue;
-        }
-        if (overGlyph && !coord.Contains(pti)) {
-            continue;
-        }
+    const GlyphIndex* index = gTextSelectionUseIndex ? ts->textCache->GetGlyphIndex(pageNo) : nullptr;
+    if (index) {
+        result = index->FindClosest(coords, (int)x, (int)y, pti);
+    } else {
+        unsigned int maxDist = UINT_MAX;
+        bool overGlyph = false;
+        for (int i = 0; i < textLen; i++) {
+            Rect& coord = coords[i];
+            if (!IsGlyph(coord)) {
+                continue;
+            }
+            if (overGlyph && !coord.Contains(pti)) {
+                continue;
+            }
 
-        uint dist = distSq((int)x - coord.x - coord.dx / 2, (int)y - coord.y - coord.dy / 2);
-        if (dist < maxDist) {
-            result = i;
-            maxDist = dist;
-        }
-        // prefer glyphs the cursor is actually over
-        if (!overGlyph && coord.Contains(pti)) {
-            overGlyph = true;
-            result = i;
-            maxDist = dist;
+            uint dist = distSq((int)x - coord.x - coord.dx / 2, (int)y - coord.y - coord.dy / 2);
+            if (dist < maxDist) {
+                result = i;
+                maxDist = dist;
+            }
+            // prefer glyphs the cursor is actually over
+            if (!overGlyph && coord.Contains(pti)) {
+                overGlyph = true;
+                result = i;
+                maxDist = dist;
+            }
         }
     }
 
@@ -1,19 +1,77 @@
 /* Copyright 2020 the SumatraPDF project authors (see AUTHORS file).
    License: GPLv3 */
 
+// number of u64 in a page's filter of the word character pairs it contains
+#define PAGE_TEXT_FILTER_SIZE 32
+
+// uniform grid over the glyph boxes of a page so that hit-testing while
+// selecting text only has to look at the glyphs close to the cursor
+struct GlyphIndex {
+    // covers all glyph boxes
+    Rect bounds;
+    int cellSize{1};
+    int cols{0};
+    int rows{0};
+    // for each cell, the glyphs whose center lies within it (by increasing glyph
+    // index) are centerGlyphs[centerCells[cell]] to centerGlyphs[centerCells[cell + 1] - 1]
+    Vec<int> centerCells;
+    Vec<int> centerGlyphs;
+    // same for the glyphs whose box overlaps the cell
+    Vec<int> boxCells;
+    Vec<int> boxGlyphs;
+
+    GlyphIndex(const Rect* coords, int len);
+    // same result as looking at all glyphs in order: the glyph closest to (x, y)
+    // among those containing pt, if any, else among all of them (-1 if none)
+    int FindClosest(const Rect* coords, int x, int y, Point pt) const;
+    // appends the glyphs whose box overlaps rect (by increasing glyph index)
+    void FindInRect(Rect rect, Vec<int>& glyphs) const;
+};
+
 struct DocumentTextCache {
     EngineBase* engine{nullptr};
     int nPages{0};
     PageText* pagesText{nullptr};
+    // built on demand from the glyph coordinates in pagesText
+    GlyphIndex** pagesIndex{nullptr};
+    // for each page a bit set of the hashed (lower-cased) pairs of adjacent
+    // word characters in its text, so that searches can skip most pages
+    // without having to look at their text
+    u64* pagesFilter{nullptr};
     int debugSize{0};
+    // set once text has been extracted that isn't part of the on-disk index yet
+    bool isDirty{false};
+    // the document file's size and modification time when it was loaded
+    // (the on-disk index is only valid for a file which still matches these)
+    bool hasFileStats{false};
+    i64 fileSize{0};
+    FILETIME fileTime{};
 
     CRITICAL_SECTION access;
 
     explicit DocumentTextCache(EngineBase* engine);
     ~DocumentTextCache();
 
+    int PageCount();
+    // for documents which keep getting more pages (e.g. ebooks laid out in the background)
+    void UpdatePageCount();
+
     bool HasTextForPage(int pageNo);
     const WCHAR* GetTextForPage(int pageNo, int* lenOut = nullptr, Rect** coordsOut = nullptr);
+    // returns nullptr if there are no glyph coordinates for the page
+    const GlyphIndex* GetGlyphIndex(int pageNo);
+    // for text extracted through a different engine instance (e.g. on another thread),
+    // takes ownership of text
+    void AddTextForPage(int pageNo, PageText text);
+    // returns false if the page's text can't contain word (case-insensitively)
+    bool MightContainWord(int pageNo, const WCHAR* word);
+
+    // the on-disk index contains the text of all pages extracted so far and
+    // is only valid for as long as the document doesn't change
+    bool LoadIndex(const WCHAR* indexPath);
+    // (doesn't need the engine, which might be gone by then)
+    bool SaveIndex(const WCHAR* indexPath);
+    void SetPageText(int pageNo, PageText pageText);
 };
 
 // TODO: replace with Vec<TextSel>
@@ -40,34 +40,17 @@ size_t BitReader::BitsLeft() {
 u32 BitReader::Peek(size_t bitsCount) {
     CrashIf((bitsCount == 0) || (bitsCount > 32));
     size_t currBytePos = currBitPos / 8;
-    u8 currByte = GetByte(currBytePos);
-    u8 currBit = currBitPos % 8;
-    currByte = currByte << currBit;
-    u8 bitsLeft = 8 - currBit;
-    u32 ret = 0;
-    while (bitsCount > 0) {
-        if (0 == bitsLeft) {
-            ++currBytePos;
-            currByte = GetByte(currBytePos);
-            bitsLeft = 8;
-        }
-        // being conservative here, could probably handle
-        // bitsLeft other than 8
-        if ((8 == bitsLeft) && (bitsCount >= 8)) {
-            // fast path - 8 bits at a time
-            ret = (ret << 8) | currByte;
-            bitsLeft = 0;
-            bitsCount -= 8;
-        } else {
-            // slow path - 1 bit at a time
-            ret = ret << 1;
-            if ((0x80 & currByte) != 0) {
-                ret |= 1;
-            }
-            currByte = currByte << 1;
-            bitsLeft--;
-            bitsCount--;
+    // the requested bits are contained in the next 5 bytes
+    u64 v = 0;
+    if (currBytePos + 5 <= dataLen) {
+        const u8* d = data + currBytePos;
+        v = ((u64)d[0] << 32) | ((u64)d[1] << 24) | ((u64)d[2] << 16) | ((u64)d[3] << 8) | d[4];
+    } else {
+        for (size_t i = 0; i < 5; i++) {
+            v = (v << 8) | GetByte(currBytePos + i);
         }
     }
-    return ret;
+    // drop the bits before currBitPos and move the requested ones to the top
+    v <<= 24 + currBitPos % 8;
+    return (u32)(v >> (64 - bitsCount));
 }
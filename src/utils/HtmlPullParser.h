@@ -96,6 +96,12 @@ class HtmlPullParser {
     void SetCurrPosOff(ptrdiff_t off) {
         currPos = start + off;
     }
+    // for data which is still being appended to (in place)
+    void Extend(size_t newLen) {
+        CrashIf(newLen < len);
+        len = newLen;
+        end = start + newLen;
+    }
     size_t Len() const {
         return len;
     }